@@ -266,14 +266,14 @@ iterator_result_entry &iterator_result_entry::operator =(const iterator_result_e
 	return *this;
 }
 
-dnet_iterator_request *iterator_result_entry::reply() const
+dnet_iterator_response *iterator_result_entry::reply() const
 {
-	return data<dnet_iterator_request>();
+	return data<dnet_iterator_response>();
 }
 
 data_pointer iterator_result_entry::reply_data() const
 {
-	return data().skip<dnet_iterator_request>();
+	return data().skip<dnet_iterator_response>();
 }
 
 } } // namespace ioremap::elliptics
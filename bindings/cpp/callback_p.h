@@ -75,7 +75,7 @@ struct entry_converter
 
 	static void convert(iterator_result_entry &entry, callback_result_data *)
 	{
-		dnet_convert_iterator_request(entry.reply());
+		dnet_convert_iterator_response(entry.reply());
 	}
 
 	static void convert(lookup_result_entry &entry, callback_result_data *)
@@ -809,7 +809,7 @@ class iterator_callback
 			memset(&ctl, 0, sizeof(ctl));
 			memcpy(&ctl.id, &id, sizeof(id));
 			ctl.id.group_id = sess.get_groups().front();
-			ctl.cflags = sess.get_cflags() | DNET_FLAGS_NEED_ACK;
+			ctl.cflags = sess.get_cflags() | DNET_FLAGS_NEED_ACK | DNET_FLAGS_FLOW_CONTROL;
 			ctl.cmd = DNET_CMD_ITERATOR;
 			ctl.complete = func;
 			ctl.priv = priv;
@@ -844,6 +844,72 @@ class iterator_callback
 		default_callback<iterator_result_entry> cb;
 };
 
+/*
+ * Sends DNET_CMD_INDEXES request to the node owning index in every group of the session,
+ * or only in the first one when @all_groups is false.
+ * @request is already converted to network byte order.
+ */
+class indexes_callback
+{
+	public:
+		typedef std::shared_ptr<indexes_callback> ptr;
+
+		indexes_callback(const session &sess, const async_generic_result &result)
+			: sess(sess), all_groups(true), cb(result)
+		{
+		}
+
+		bool start(error_info *error, complete_func func, void *priv)
+		{
+			(void) error;
+			cb.set_count(unlimited);
+
+			std::vector<int> groups = sess.get_groups();
+			if (!all_groups && !groups.empty())
+				groups.resize(1);
+
+			dnet_trans_control ctl;
+			memset(&ctl, 0, sizeof(ctl));
+			memcpy(&ctl.id, &id, sizeof(id));
+			ctl.cflags = sess.get_cflags() | DNET_FLAGS_NEED_ACK;
+			ctl.cmd = DNET_CMD_INDEXES;
+			ctl.complete = func;
+			ctl.priv = priv;
+			ctl.data = request.data();
+			ctl.size = request.size();
+
+			if (!all_groups)
+				ctl.cflags |= DNET_FLAGS_FLOW_CONTROL;
+
+			cb.set_total(groups.size());
+
+			// every transaction is completed exactly once even if it was not sent
+			for (size_t i = 0; i < groups.size(); ++i) {
+				ctl.id.group_id = groups[i];
+				dnet_trans_alloc_send(sess.get_native(), &ctl);
+			}
+
+			return cb.set_count(groups.size());
+		}
+
+		bool handle(error_info *error, struct dnet_net_state *state, struct dnet_cmd *cmd, complete_func func, void *priv)
+		{
+			(void) error;
+			return cb.handle(state, cmd, func, priv);
+		}
+
+		void finish(const error_info &exc)
+		{
+			cb.complete(exc);
+		}
+
+		session sess;
+		struct dnet_id id;
+		data_pointer request;
+		bool all_groups;
+		default_callback<callback_result_entry> cb;
+};
+
 template <typename T>
 struct dnet_style_handler
 {
@@ -1,5 +1,7 @@
 #include <elliptics/cppdef.h>
 
+#include <msgpack.hpp>
+
 #include <cassert>
 #include <sstream>
 #include <algorithm>
@@ -298,6 +300,166 @@ void test_1(session &sess)
 	}
 }
 
+typedef std::map<dnet_raw_id, std::string, index_comparator<0> > index_content;
+
+// reads the whole \a index and compares it with \a expected
+void check_index(session &sess, const std::string &index, const index_content &expected)
+{
+	dnet_raw_id start;
+	memset(&start, 0, sizeof(start));
+
+	std::vector<index_entry> result = sess.read_index(index, start);
+	std::cerr << index << ": read " << result.size() << " of " << expected.size() << " entries" << std::endl;
+	assert(result.size() == expected.size());
+
+	// entries are sorted by id as well as map
+	auto it = expected.begin();
+	for (size_t i = 0; i < result.size(); ++i, ++it) {
+		assert(!memcmp(result[i].index.id, it->first.id, sizeof(it->first.id)));
+		assert(result[i].data.to_string() == it->second);
+	}
+}
+
+/*
+ * Indexes of many objects are updated by one call, and if any index rejects its batch,
+ * both indexes and lists of indexes of objects are rolled back.
+ */
+void test_batch(session &sess)
+{
+	const std::string tag_a = "batch_tag_a";
+	const std::string tag_b = "batch_tag_b";
+	std::vector<std::pair<key, std::vector<index_entry> > > update;
+	std::vector<std::vector<index_entry> > lists;
+	index_content expected_a, expected_b;
+
+	key a = tag_a;
+	a.transform(sess);
+	key b = tag_b;
+	b.transform(sess);
+
+	for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+		key object = "batch_object_" + to_string(i + 1);
+		object.transform(sess);
+
+		std::vector<index_entry> entries;
+		index_entry entry;
+		std::string data = create_data();
+
+		entry.index = a.raw_id();
+		entry.data = data_pointer::copy(data.c_str(), data.size());
+		entries.push_back(entry);
+		expected_a[object.raw_id()] = data;
+
+		if (i % 2) {
+			data = create_data();
+			entry.index = b.raw_id();
+			entry.data = data_pointer::copy(data.c_str(), data.size());
+			entries.push_back(entry);
+			expected_b[object.raw_id()] = data;
+		}
+
+		update.push_back(std::make_pair(object, entries));
+		lists.push_back(entries);
+	}
+
+	sess.update_indexes(update);
+
+	check_index(sess, tag_a, expected_a);
+	check_index(sess, tag_b, expected_b);
+
+	// entry larger than index page is rejected by node owning tag_b, while tag_a accepts its batch
+	std::vector<std::pair<key, std::vector<index_entry> > > failing;
+	for (size_t i = 0; i < 2; ++i) {
+		std::vector<index_entry> entries(2);
+		entries[0].index = a.raw_id();
+		entries[0].data = data_pointer::copy("changed", 7);
+		entries[1].index = b.raw_id();
+		entries[1].data = data_pointer::allocate(2 * 1024 * 1024);
+		memset(entries[1].data.data(), 0, entries[1].data.size());
+
+		failing.push_back(std::make_pair(update[i].first, entries));
+	}
+
+	int result = 0;
+	try {
+		sess.update_indexes(failing);
+	} catch (error &e) {
+		result = e.error_code();
+	}
+	std::cerr << "batch: failing update: " << result << std::endl;
+	assert(result != 0);
+
+	check_index(sess, tag_a, expected_a);
+	check_index(sess, tag_b, expected_b);
+
+	// lists of indexes of objects are restored too
+	for (size_t i = 0; i < failing.size(); ++i) {
+		std::vector<index_entry> list = sess.check_indexes(failing[i].first);
+		std::vector<index_entry> &valid = lists[i];
+
+		std::sort(valid.begin(), valid.end(), index_comparator<0>());
+		std::sort(list.begin(), list.end(), index_comparator<0>());
+
+		assert(list.size() == valid.size());
+		for (size_t j = 0; j < list.size(); ++j) {
+			assert(!memcmp(list[j].index.id, valid[j].index.id, sizeof(valid[j].index.id)));
+			assert(list[j].data.to_string() == valid[j].data.to_string());
+		}
+	}
+}
+
+/*
+ * Index written by clients before indexes were kept by the server is a msgpack blob
+ * at index id, the server has to convert it on first access without losing entries.
+ */
+void test_legacy(session &sess)
+{
+	const std::string index = "legacy_tag";
+	index_content entries;
+
+	for (size_t i = 0; i < OBJECT_COUNT; ++i) {
+		key object = "legacy_object_" + to_string(i + 1);
+		object.transform(sess);
+		entries[object.raw_id()] = create_data();
+	}
+
+	msgpack::sbuffer buffer;
+	msgpack::packer<msgpack::sbuffer> packer(&buffer);
+	packer.pack_array(3);
+	packer.pack(1);
+	packer.pack_array(entries.size());
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		packer.pack_array(2);
+		packer.pack_raw(sizeof(it->first.id));
+		packer.pack_raw_body(reinterpret_cast<const char *>(it->first.id), sizeof(it->first.id));
+		packer.pack_raw(it->second.size());
+		packer.pack_raw_body(it->second.data(), it->second.size());
+	}
+	packer.pack_array(0);
+
+	sess.write_data(index, data_pointer::copy(buffer.data(), buffer.size()), 0).wait();
+
+	check_index(sess, index, entries);
+
+	// converted index is updated in place
+	std::vector<std::string> object_tags(1, index);
+	std::vector<data_pointer> object_datas(1, data_pointer::copy("updated", 7));
+	sess.update_indexes(std::string("legacy_object_1"), object_tags, object_datas);
+
+	key updated = std::string("legacy_object_1");
+	updated.transform(sess);
+	entries[updated.raw_id()] = "updated";
+
+	std::vector<find_indexes_result_entry> found = sess.find_indexes(object_tags);
+	assert(found.size() == entries.size());
+	for (size_t i = 0; i < found.size(); ++i) {
+		auto it = entries.find(found[i].id);
+		assert(it != entries.end());
+		assert(found[i].indexes.size() == 1);
+		assert(it->second == found[i].indexes[0].second.to_string());
+	}
+}
+
 }
 
 int main(int argc, char *argv[])
@@ -341,5 +503,7 @@ int main(int argc, char *argv[])
 
 	clear(sess);
 
+	test_legacy(sess);
+	test_batch(sess);
 	test_1(sess);
 }
@@ -16,6 +16,7 @@
 
 #include "callback_p.h"
 
+#include <mutex>
 #include <sstream>
 
 #if __GNUC__ == 4 && __GNUC_MINOR__ < 5
@@ -26,6 +27,12 @@
 
 namespace ioremap { namespace elliptics {
 
+/* default number of nodes read_data_range() queries concurrently */
+#define DNET_RANGE_FANOUT_DEFAULT	16
+
+/* read_data_range() requests at most so many entries of a segment at once */
+#define DNET_RANGE_SEGMENT_PAGE		DNET_FLOW_WINDOW_RECORDS
+
 template <typename T>
 class cstyle_scoped_pointer
 {
@@ -299,6 +306,7 @@ class session_data
 			filter = filters::positive;
 			checker = checkers::at_least_one;
 			policy = session::default_exceptions;
+			range_fanout = DNET_RANGE_FANOUT_DEFAULT;
 		}
 
 		~session_data()
@@ -313,6 +321,7 @@ class session_data
 		result_filter		filter;
 		result_checker		checker;
 		uint32_t		policy;
+		unsigned int		range_fanout;
 };
 
 session::session(const node &n) : m_data(std::make_shared<session_data>(n))
@@ -412,6 +421,21 @@ void session::set_timeout(unsigned int timeout)
 	dnet_session_set_timeout(m_data->session_ptr, timeout);
 }
 
+unsigned int session::get_timeout() const
+{
+	return dnet_session_get_timeout(m_data->session_ptr)->tv_sec;
+}
+
+void session::set_range_fanout(unsigned int fanout)
+{
+	m_data->range_fanout = fanout ? fanout : 1;
+}
+
+unsigned int session::get_range_fanout() const
+{
+	return m_data->range_fanout;
+}
+
 void session::read_file(const key &id, const std::string &file, uint64_t offset, uint64_t size)
 {
 	int err;
@@ -573,6 +597,7 @@ class session_scope
 			m_filter = m_sess.get_filter();
 			m_checker = m_sess.get_checker();
 			m_policy = m_sess.get_exceptions_policy();
+			m_cflags = m_sess.get_cflags();
 		}
 
 		~session_scope()
@@ -580,6 +605,7 @@ class session_scope
 			m_sess.set_filter(m_filter);
 			m_sess.set_checker(m_checker);
 			m_sess.set_exceptions_policy(m_policy);
+			m_sess.set_cflags(m_cflags);
 		}
 
 	private:
@@ -587,6 +613,7 @@ class session_scope
 		result_filter m_filter;
 		result_checker m_checker;
 		uint32_t m_policy;
+		uint64_t m_cflags;
 };
 
 struct prepare_latest_functor
@@ -768,6 +795,39 @@ async_write_result session::write_data(const key &id, const data_pointer &file,
 	return write_data(ctl);
 }
 
+async_write_result session::write_data(const key &id, const data_pointer &file, uint64_t remote_offset,
+	const std::string &metadata)
+{
+	transform(id);
+	dnet_id raw = id.id();
+
+	// metadata is sent in network byte order
+	std::string meta = metadata;
+	dnet_convert_metadata(m_data->node_guard.get_native(), &meta[0], meta.size());
+
+	struct dnet_io_control ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+
+	ctl.cflags = get_cflags();
+	ctl.data = file.data();
+
+	ctl.io.flags = get_ioflags() | DNET_IO_FLAGS_INLINE_META;
+	ctl.io.offset = remote_offset;
+	ctl.io.size = file.size();
+	ctl.io.type = raw.type;
+	ctl.io.num = file.size() + remote_offset;
+
+	ctl.meta = meta.data();
+	ctl.meta_size = meta.size();
+
+	memcpy(&ctl.id, &raw, sizeof(struct dnet_id));
+
+	ctl.fd = -1;
+
+	return write_data(ctl);
+}
+
 struct cas_data
 {
 	typedef std::shared_ptr<cas_data> ptr;
@@ -1273,6 +1333,7 @@ class read_data_range_callback
 				d->sess.set_checker(checkers::no_check);
 				d->sess.set_filter(filters::all_with_ack);
 				d->sess.set_exceptions_policy(session::no_exceptions);
+				d->sess.set_cflags(d->sess.get_cflags() | DNET_FLAGS_FLOW_CONTROL);
 
 				d->sess.read_data(d->id, groups, d->io, d->cmd).connect(d->me_entry, d->me_final);
 			}
@@ -1380,14 +1441,402 @@ class remove_data_range_callback : public read_data_range_callback
 		}
 };
 
+/*
+ * Reads range by querying all nodes which own its parts concurrently.
+ *
+ * Range is split by route table into per-node segments, at most session's range fanout
+ * of them are started at once. Replies of the head segment are passed to handler
+ * directly, replies of other segments are buffered until all preceding segments
+ * are completed, so entries reach handler in key order of segments.
+ *
+ * Segment is read in pages of DNET_RANGE_SEGMENT_PAGE entries, every next page starts
+ * right after the last received key. Head segment requests pages one after another,
+ * other segments pause after the first page until they become head, thus client never
+ * buffers more than fanout pages.
+ *
+ * Since segment sizes are not known in advance, io.start/io.num are applied on the client,
+ * segment never asks for more entries than io.start + io.num minus entries already
+ * buffered by preceding segments.
+ */
+class parallel_read_data_range_callback
+{
+	public:
+		struct segment
+		{
+			struct dnet_id id;
+			struct dnet_raw_id next;
+			// key to read the next page from
+			struct dnet_raw_id from;
+			// entries asked and received by the current request
+			uint64_t requested;
+			uint64_t received;
+			bool completed;
+			bool paused;
+			std::vector<read_result_entry> entries;
+		};
+
+		struct scope
+		{
+			scope(const session &sess, const async_result_handler<read_result_entry> &handler)
+				: sess(sess), handler(handler) {}
+
+			session sess;
+			struct dnet_io_attr io;
+			int group_id;
+
+			async_result_handler<read_result_entry> handler;
+
+			std::mutex mutex;
+			std::vector<segment> segments;
+			size_t head;
+			size_t next_to_send;
+			size_t in_flight;
+			unsigned int fanout;
+
+			uint64_t skip;
+			uint64_t left;
+			bool limited;
+			bool paged;
+			bool has_any;
+			bool finished;
+			error_info last_exception;
+		};
+
+		struct segment_handler
+		{
+			std::shared_ptr<scope> data;
+			size_t index;
+
+			void operator() (const read_result_entry &entry)
+			{
+				parallel_read_data_range_callback(data).on_entry(index, entry);
+			}
+
+			void operator() (const error_info &error)
+			{
+				parallel_read_data_range_callback(data).on_final(index, error);
+			}
+		};
+
+		std::shared_ptr<scope> data;
+
+		parallel_read_data_range_callback(const session &orig,
+			const struct dnet_io_attr &io, int group_id,
+			const async_result_handler<read_result_entry> &handler)
+			: data(std::make_shared<scope>(session(orig.get_node()), handler))
+		{
+			scope *d = data.get();
+
+			/*
+			 * Segments are sent from completion threads, so they use private session
+			 * which settings are never changed after this point.
+			 */
+			d->sess.set_cflags(orig.get_cflags() | DNET_FLAGS_FLOW_CONTROL);
+			d->sess.set_ioflags(orig.get_ioflags());
+			d->sess.set_timeout(orig.get_timeout());
+			d->sess.set_checker(checkers::no_check);
+			d->sess.set_filter(filters::all_with_ack);
+			d->sess.set_exceptions_policy(session::no_exceptions);
+
+			d->io = io;
+			d->group_id = group_id;
+			d->head = 0;
+			d->next_to_send = 0;
+			d->in_flight = 0;
+			d->fanout = orig.get_range_fanout();
+			d->skip = io.start;
+			d->left = io.num;
+			d->limited = io.num != 0;
+			/* there are no entries to continue from, only counters are returned */
+			d->paged = !(io.flags & DNET_IO_FLAGS_NODATA);
+			d->has_any = false;
+			d->finished = false;
+		}
+
+		parallel_read_data_range_callback(const std::shared_ptr<scope> &data) : data(data)
+		{
+		}
+
+		void start(error_info *error)
+		{
+			scope *d = data.get();
+			struct dnet_node * const node = d->sess.get_node().get_native();
+			struct dnet_raw_id start, end;
+			segment seg;
+			int err;
+
+			memcpy(end.id, d->io.parent, DNET_ID_SIZE);
+
+			dnet_setup_id(&seg.id, d->group_id, d->io.id);
+			seg.id.type = d->io.type;
+			seg.requested = seg.received = 0;
+			seg.completed = false;
+			seg.paused = false;
+
+			while (true) {
+				err = dnet_search_range(node, &seg.id, &start, &seg.next);
+				if (err) {
+					*error = create_error(err, d->io.id, "Failed to read range data object: group: %d, size: %llu",
+						d->group_id, static_cast<unsigned long long>(d->io.size));
+					return;
+				}
+
+				bool last = (dnet_id_cmp_str(seg.id.id, seg.next.id) > 0) ||
+					!memcmp(start.id, seg.next.id, DNET_ID_SIZE) ||
+					(dnet_id_cmp_str(seg.next.id, end.id) > 0);
+				if (last)
+					memcpy(seg.next.id, end.id, DNET_ID_SIZE);
+
+				memcpy(seg.from.id, seg.id.id, DNET_ID_SIZE);
+				d->segments.push_back(seg);
+
+				if (last)
+					break;
+
+				memcpy(seg.id.id, seg.next.id, DNET_ID_SIZE);
+			}
+
+			dnet_log_raw(node, DNET_LOG_NOTICE, "%s: read range: segments: %zu, fanout: %u, start: %llu, num: %llu\n",
+					dnet_dump_id(&d->segments.front().id), d->segments.size(), d->fanout,
+					(unsigned long long)d->io.start, (unsigned long long)d->io.num);
+
+			send_next();
+		}
+
+	private:
+		// advances \a id to the next possible key, returns false if \a id was the last one
+		static bool next_key(struct dnet_raw_id &id)
+		{
+			for (int i = DNET_ID_SIZE - 1; i >= 0; --i) {
+				if (++id.id[i] != 0)
+					return true;
+			}
+			return false;
+		}
+
+		void send_next()
+		{
+			scope *d = data.get();
+			std::vector<size_t> batch;
+
+			{
+				std::lock_guard<std::mutex> lock(d->mutex);
+
+				while (!d->finished && d->in_flight < d->fanout && d->next_to_send < d->segments.size()) {
+					batch.push_back(d->next_to_send++);
+					d->in_flight++;
+				}
+			}
+
+			/* requests may complete synchronously, so they are sent without lock held */
+			for (size_t i = 0; i < batch.size(); ++i)
+				send_segment(batch[i]);
+		}
+
+		/*
+		 * Prepares request for the next page of segment @index, returns false
+		 * if preceding segments have already buffered all entries which are needed.
+		 * Must be called with scope mutex held.
+		 */
+		bool prepare_segment(size_t index, struct dnet_io_attr &io, struct dnet_id &id)
+		{
+			scope *d = data.get();
+			segment &seg = d->segments[index];
+			uint64_t num = 0;
+
+			seg.requested = seg.received = 0;
+			seg.paused = false;
+
+			if (d->limited) {
+				uint64_t buffered = 0;
+
+				for (size_t i = d->head; i < index; ++i)
+					buffered += d->segments[i].entries.size();
+
+				num = (d->skip > ~0ULL - d->left) ? ~0ULL : d->skip + d->left;
+				if (num <= buffered)
+					return false;
+				num -= buffered;
+			}
+
+			if (d->paged && (!num || num > DNET_RANGE_SEGMENT_PAGE))
+				num = DNET_RANGE_SEGMENT_PAGE;
+
+			io = d->io;
+			memcpy(io.id, seg.from.id, DNET_ID_SIZE);
+			memcpy(io.parent, seg.next.id, DNET_ID_SIZE);
+			io.start = 0;
+			io.num = num;
+
+			id = seg.id;
+			memcpy(id.id, seg.from.id, DNET_ID_SIZE);
+
+			seg.requested = num;
+			return true;
+		}
+
+		void send_segment(size_t index)
+		{
+			scope *d = data.get();
+			struct dnet_io_attr io;
+			struct dnet_id id;
+			bool send;
+
+			{
+				std::lock_guard<std::mutex> lock(d->mutex);
+
+				if (d->finished)
+					return;
+
+				send = prepare_segment(index, io, id);
+			}
+
+			if (!send) {
+				on_final(index, error_info());
+				return;
+			}
+
+			segment_handler handler = { data, index };
+			std::vector<int> groups(1, d->group_id);
+
+			d->sess.read_data(id, groups, io, DNET_CMD_READ_RANGE).connect(handler, handler);
+		}
+
+		/* must be called with scope mutex held */
+		void emit(const read_result_entry &entry)
+		{
+			scope *d = data.get();
+
+			if (entry.status() != 0 || entry.data().empty()) {
+				d->handler.process(entry);
+				return;
+			}
+
+			if (d->skip) {
+				d->skip--;
+				return;
+			}
+
+			d->handler.process(entry);
+			d->has_any = true;
+
+			if (d->limited && --d->left == 0)
+				d->finished = true;
+		}
+
+		void on_entry(size_t index, const read_result_entry &entry)
+		{
+			scope *d = data.get();
+
+			/* per-node counter, it is meaningless for the whole range */
+			if (entry.status() == 0 && entry.data().size() == sizeof(dnet_io_attr))
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(d->mutex);
+
+				if (d->finished)
+					return;
+
+				if (entry.status() == 0 && !entry.data().empty()) {
+					segment &seg = d->segments[index];
+
+					seg.received++;
+					memcpy(seg.from.id, entry.io_attribute()->id, DNET_ID_SIZE);
+				}
+
+				if (index != d->head) {
+					d->segments[index].entries.push_back(entry);
+					return;
+				}
+
+				emit(entry);
+				if (!d->finished)
+					return;
+			}
+
+			d->handler.complete(error_info());
+		}
+
+		void on_final(size_t index, const error_info &error)
+		{
+			scope *d = data.get();
+			std::vector<size_t> resume;
+			error_info result;
+			bool done = false;
+
+			{
+				std::lock_guard<std::mutex> lock(d->mutex);
+
+				if (d->finished)
+					return;
+
+				segment &seg = d->segments[index];
+				bool more = false;
+
+				if (error) {
+					d->last_exception = error;
+				} else if (d->paged && seg.requested && seg.received == seg.requested) {
+					/* full page was received, segment continues right after its last key */
+					more = next_key(seg.from) && dnet_id_cmp_str(seg.from.id, seg.next.id) <= 0;
+				}
+
+				if (!more) {
+					seg.completed = true;
+					d->in_flight--;
+				} else if (index == d->head) {
+					resume.push_back(index);
+				} else {
+					seg.paused = true;
+				}
+
+				while (!d->finished && d->head < d->segments.size() && d->segments[d->head].completed) {
+					if (++d->head == d->segments.size())
+						break;
+
+					std::vector<read_result_entry> entries;
+					entries.swap(d->segments[d->head].entries);
+
+					for (size_t i = 0; i < entries.size() && !d->finished; ++i)
+						emit(entries[i]);
+
+					if (d->segments[d->head].paused)
+						resume.push_back(d->head);
+				}
+
+				if (d->finished) {
+					done = true;
+				} else if (d->head == d->segments.size()) {
+					if (!d->has_any)
+						result = d->last_exception;
+					d->finished = true;
+					done = true;
+				}
+			}
+
+			if (done) {
+				d->handler.complete(result);
+				return;
+			}
+
+			for (size_t i = 0; i < resume.size(); ++i)
+				send_segment(resume[i]);
+
+			send_next();
+		}
+};
+
 async_read_result session::read_data_range(const struct dnet_io_attr &io, int group_id)
 {
 	async_read_result result(*this);
 	async_result_handler<read_result_entry> handler(result);
 	error_info error;
-	read_data_range_callback(*this, io, group_id, handler).do_next(&error);
-	if (get_exceptions_policy() & throw_at_start)
-		error.throw_error();
+	parallel_read_data_range_callback(*this, io, group_id, handler).start(&error);
+	if (error) {
+		if (get_exceptions_policy() & throw_at_start)
+			error.throw_error();
+		handler.complete(error);
+	}
 	return result;
 }
 
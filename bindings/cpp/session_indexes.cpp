@@ -262,284 +262,472 @@ static dnet_id indexes_generate_id(session &sess, const dnet_id &data_id)
 	return id;
 }
 
+// Builds DNET_CMD_INDEXES request for entry \a id in network byte order
+static data_pointer indexes_request(const dnet_raw_id &id, uint32_t op, const data_pointer &data, uint32_t limit = 0)
+{
+	data_pointer request = data_pointer::allocate(sizeof(dnet_indexes_request) + data.size());
+	dnet_indexes_request *req = request.data<dnet_indexes_request>();
+
+	memset(req, 0, sizeof(dnet_indexes_request));
+	req->id = id;
+	req->op = op;
+	req->limit = limit;
+	req->size = data.size();
+	if (!data.empty())
+		memcpy(req + 1, data.data(), data.size());
+
+	dnet_convert_indexes_request(req);
+	return request;
+}
+
+static async_generic_result indexes_send(session &sess, const dnet_raw_id &index, const data_pointer &request, bool all_groups)
+{
+	async_generic_result result(sess);
+	indexes_callback::ptr cb = std::make_shared<indexes_callback>(sess, result);
+	memset(&cb->id, 0, sizeof(cb->id));
+	memcpy(cb->id.id, index.id, sizeof(cb->id.id));
+	cb->request = request;
+	cb->all_groups = all_groups;
+
+	startCallback(cb);
+	return result;
+}
+
+// Appends entries of DNET_INDEXES_READ replies to \a entries, returns true if server has more entries
+static bool indexes_parse_reply(const sync_generic_result &result, std::vector<index_entry> &entries)
+{
+	bool more = false;
+
+	for (auto it = result.begin(); it != result.end(); ++it) {
+		data_pointer data = it->data();
+		if (data.size() < sizeof(dnet_indexes_reply))
+			continue;
+
+		dnet_indexes_reply *reply = data.data<dnet_indexes_reply>();
+		dnet_convert_indexes_reply(reply);
+		more |= !!(reply->flags & DNET_INDEXES_FLAGS_MORE);
+
+		data = data.skip<dnet_indexes_reply>();
+		for (uint32_t i = 0; i < reply->num; ++i) {
+			if (data.size() < sizeof(dnet_indexes_entry))
+				throw_error(-EILSEQ, "Corrupted index reply");
+
+			dnet_indexes_entry *e = data.data<dnet_indexes_entry>();
+			dnet_convert_indexes_entry(e);
+			data = data.skip<dnet_indexes_entry>();
+
+			if (data.size() < e->size)
+				throw_error(-EILSEQ, "Corrupted index reply");
+
+			index_entry entry;
+			entry.index = e->id;
+			entry.data = data_pointer::copy(data.data(), e->size);
+			entries.push_back(entry);
+
+			data = data.skip(e->size);
+		}
+	}
+
+	return more;
+}
+
+/*
+ * Updates indexes of several objects at once. Lists of indexes of objects are
+ * replaced by CAS in parallel, then changes are grouped by index and every index
+ * receives them in batches which the owner applies with one write per index page.
+ *
+ * If any list or any batch fails, the update is rolled back: applied batches are reverted
+ * and written lists are restored by CAS, unless list was changed by someone else meanwhile.
+ * Handler receives the first error, rollback errors are not reported separately,
+ * so indexes may be left partially updated only if rollback itself fails.
+ */
 struct update_indexes_data
 {
 	typedef std::shared_ptr<update_indexes_data> ptr;
 
+	// at most so many changes are sent to index in one request
+	enum { batch_size = 1024 };
+
 	update_indexes_data(session &sess) : sess(sess) {}
 
+	struct object
+	{
+		key request_id;
+		dnet_id id;
+		// indexes to set
+		dnet_indexes indexes;
+		msgpack::sbuffer buffer;
+		// currently set indexes and their packed form which is restored on rollback
+		dnet_indexes remote_indexes;
+		data_pointer remote_data;
+		bool written;
+	};
+
+	// change of one object's entry in index and the one which reverts it
+	struct change
+	{
+		dnet_raw_id id;
+		uint32_t op;
+		data_pointer data;
+		uint32_t revert_op;
+		data_pointer revert_data;
+	};
+
+	struct batch
+	{
+		dnet_raw_id index;
+		std::vector<change> changes;
+		bool success;
+	};
+
 	session sess;
 	std::function<void (const std::exception_ptr &)> handler;
-	key request_id;
-	data_pointer request_data;
-	// indexes to set
-	dnet_indexes indexes;
-	dnet_id id;
-
-	msgpack::sbuffer buffer;
-	// currently set indexes
-	dnet_indexes remote_indexes;
-	std::mutex previous_data_mutex;
-	std::map<dnet_raw_id, data_pointer, dnet_raw_id_less_than<>> previous_data;
-	std::vector<index_entry> inserted_ids;
-	std::vector<index_entry> removed_ids;
-	std::vector<dnet_raw_id> success_inserted_ids;
-	std::vector<dnet_raw_id> success_removed_ids;
-	std::mutex mutex;
+	std::vector<object> objects;
+	std::map<dnet_raw_id, std::vector<change>> changes;
+	std::vector<batch> batches;
+	// request may complete synchronously while previous one is being sent
+	std::recursive_mutex mutex;
 	size_t finished;
+	size_t reverting;
 	std::exception_ptr exception;
 
-	// basic functor which is able to update secondary index for object
-	struct update_functor
+	void on_fail(const error_info &err)
 	{
-		ptr scope;
-		bool insert;
-		dnet_raw_id id;
-		data_pointer index_data;
+		try {
+			err.throw_error();
+		} catch (...) {
+			if (!exception)
+				exception = std::current_exception();
+		}
+	}
 
-		data_pointer operator() (const data_pointer &data)
-		{
-			dnet_indexes indexes;
-			if (!data.empty())
-				indexes_unpack(data, &indexes);
-
-			// Construct index entry
-			index_entry request_id;
-			request_id.index = scope->request_id.raw_id();
-			request_id.data = index_data;
-
-			auto it = std::lower_bound(indexes.indexes.begin(), indexes.indexes.end(),
-				request_id, dnet_raw_id_less_than<skip_data>());
-			if (it != indexes.indexes.end() && it->index == request_id.index) {
-				// It's already there
-				if (insert) {
-					if (it->data == request_id.data) {
-						// All's ok, keep it untouched
-						return data;
-					} else {
-						// Data is not correct, remember current value due to possible rollback
-						std::lock_guard<std::mutex> lock(scope->previous_data_mutex);
-						scope->previous_data[it->index] = it->data;
-						it->data = request_id.data;
-					}
-				} else {
-					// Anyway, destroy it
-					indexes.indexes.erase(it);
-				}
+	// computes changes of indexes of object \a i
+	void diff(size_t i)
+	{
+		object &obj = objects[i];
+		std::vector<index_entry> inserted, removed;
+
+		// We "insert" items also to update their data
+		std::set_difference(obj.indexes.indexes.begin(), obj.indexes.indexes.end(),
+			obj.remote_indexes.indexes.begin(), obj.remote_indexes.indexes.end(),
+			std::back_inserter(inserted), dnet_raw_id_less_than<>());
+		// Remove only absolutly another items
+		std::set_difference(obj.remote_indexes.indexes.begin(), obj.remote_indexes.indexes.end(),
+			obj.indexes.indexes.begin(), obj.indexes.indexes.end(),
+			std::back_inserter(removed), dnet_raw_id_less_than<skip_data>());
+
+		for (size_t j = 0; j < inserted.size(); ++j) {
+			change c;
+			c.id = obj.request_id.raw_id();
+			c.op = DNET_INDEXES_ADD;
+			c.data = inserted[j].data;
+
+			// updated entry is reverted to its previous data
+			auto it = std::lower_bound(obj.remote_indexes.indexes.begin(), obj.remote_indexes.indexes.end(),
+				inserted[j].index, dnet_raw_id_less_than<skip_data>());
+			if (it != obj.remote_indexes.indexes.end() && it->index == inserted[j].index) {
+				c.revert_op = DNET_INDEXES_ADD;
+				c.revert_data = it->data;
 			} else {
-				// Index is not created yet
-				if (insert) {
-					// Just insert it
-					indexes.indexes.insert(it, 1, request_id);
-				} else {
-					// All's ok, keep it untouched
-					return data;
-				}
+				c.revert_op = DNET_INDEXES_REMOVE;
 			}
 
-			msgpack::sbuffer buffer;
-			msgpack::pack(&buffer, indexes);
-			return data_pointer::copy(buffer.data(), buffer.size());
+			changes[inserted[j].index].push_back(c);
 		}
-	};
 
-	struct revert_functor : public update_functor
-	{
-		void on_fail(const std::exception_ptr &exception)
-		{
-			scope->exception = exception;
-			check_finish();
+		for (size_t j = 0; j < removed.size(); ++j) {
+			change c;
+			c.id = obj.request_id.raw_id();
+			c.op = DNET_INDEXES_REMOVE;
+			c.revert_op = DNET_INDEXES_ADD;
+			c.revert_data = removed[j].data;
+
+			changes[removed[j].index].push_back(c);
 		}
+	}
 
-		void check_finish()
-		{
-			if (scope->finished != scope->success_inserted_ids.size() + scope->success_removed_ids.size())
-				return;
+	// builds DNET_INDEXES_UPDATE request for \a changes
+	static data_pointer request(const std::vector<change> &changes, bool revert)
+	{
+		size_t size = 0;
+		for (size_t i = 0; i < changes.size(); ++i)
+			size += sizeof(dnet_indexes_update_entry) + (revert ? changes[i].revert_data : changes[i].data).size();
+
+		data_pointer data = data_pointer::allocate(size);
+		data_pointer ptr = data;
+
+		for (size_t i = 0; i < changes.size(); ++i) {
+			const change &c = changes[i];
+			const data_pointer &entry_data = revert ? c.revert_data : c.data;
+			const uint32_t op = revert ? c.revert_op : c.op;
+
+			dnet_indexes_update_entry *e = ptr.data<dnet_indexes_update_entry>();
+			memset(e, 0, sizeof(dnet_indexes_update_entry));
+			e->id = c.id;
+			e->op = op;
+			e->size = op == DNET_INDEXES_ADD ? entry_data.size() : 0;
+			ptr = ptr.skip<dnet_indexes_update_entry>();
+
+			if (e->size) {
+				memcpy(ptr.data(), entry_data.data(), e->size);
+				ptr = ptr.skip(e->size);
+			}
 
-			scope->handler(scope->exception);
+			dnet_convert_indexes_update_entry(e);
 		}
 
-		using update_functor::operator();
+		dnet_raw_id id;
+		memset(&id, 0, sizeof(id));
+		return indexes_request(id, DNET_INDEXES_UPDATE, data);
+	}
 
-		void operator() (const sync_write_result &, const error_info &err)
-		{
-			std::lock_guard<std::mutex> lock(scope->mutex);
-			++scope->finished;
+	void on_reverted(const error_info &err)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex);
+		++finished;
 
-			if (err) {
-				try {
-					err.throw_error();
-				} catch (...) {
-					on_fail(std::current_exception());
-				}
-				return;
-			}
+		if (err)
+			on_fail(err);
 
-			check_finish();
-		}
-	};
+		if (finished == reverting)
+			handler(exception);
+	}
 
-	struct try_functor : public update_functor
+	struct revert_functor
 	{
-		void on_fail(const std::exception_ptr &exception)
+		ptr scope;
+
+		void operator() (const sync_generic_result &, const error_info &err)
 		{
-			scope->exception = exception;
-			check_finish();
+			scope->on_reverted(err);
 		}
+	};
 
-		void check_finish()
+	// restores list of indexes of object \a index if it still holds what was written
+	struct list_revert_functor
+	{
+		ptr scope;
+		size_t index;
+
+		data_pointer operator() (const data_pointer &data)
 		{
-			if (scope->finished != scope->inserted_ids.size() + scope->removed_ids.size())
-				return;
+			object &obj = scope->objects[index];
+			data_pointer written = data_pointer::from_raw(const_cast<char *>(obj.buffer.data()), obj.buffer.size());
 
-			scope->finished = 0;
+			if (!(data == written))
+				return data;
 
-			dnet_id id;
-			memset(&id, 0, sizeof(id));
+			return obj.remote_data;
+		}
 
-			if (scope->success_inserted_ids.size() != scope->inserted_ids.size()
-				|| scope->success_removed_ids.size() != scope->removed_ids.size()) {
+		void operator() (const sync_write_result &, const error_info &err)
+		{
+			scope->on_reverted(err);
+		}
+	};
 
-				if (scope->success_inserted_ids.empty() && scope->success_removed_ids.empty()) {
-					scope->handler(scope->exception);
-					return;
-				}
+	/*
+	 * Reverts batches listed in \a succeeded and all written lists of indexes.
+	 * Must be called with scope mutex held.
+	 */
+	static void revert(const ptr &scope, const std::vector<size_t> &succeeded)
+	{
+		std::vector<size_t> written;
+		for (size_t i = 0; i < scope->objects.size(); ++i) {
+			if (scope->objects[i].written)
+				written.push_back(i);
+		}
 
-				revert_functor functor;
-				functor.scope = scope;
-				functor.insert = false;
+		if (succeeded.empty() && written.empty()) {
+			scope->handler(scope->exception);
+			return;
+		}
 
-				for (size_t i = 0; i < scope->success_inserted_ids.size(); ++i) {
-					memcpy(id.id, scope->success_inserted_ids[i].id, sizeof(id.id));
-					functor.id = scope->success_inserted_ids[i];
-					scope->sess.write_cas(id, functor, 0).connect(functor);
-				}
+		scope->finished = 0;
+		scope->reverting = succeeded.size() + written.size();
 
-				functor.insert = true;
+		revert_functor functor = { scope };
+		for (size_t i = 0; i < succeeded.size(); ++i) {
+			const batch &b = scope->batches[succeeded[i]];
+			indexes_send(scope->sess, b.index, request(b.changes, true), true).connect(functor);
+		}
 
-				for (size_t i = 0; i < scope->success_removed_ids.size(); ++i) {
-					memcpy(id.id, scope->success_removed_ids[i].id, sizeof(id.id));
-					functor.id = scope->success_removed_ids[i];
-					functor.index_data = scope->previous_data[functor.id];
-					scope->sess.write_cas(id, functor, 0).connect(functor);
-				}
-			} else {
-				scope->handler(std::exception_ptr());
-				return;
-			}
+		for (size_t i = 0; i < written.size(); ++i) {
+			list_revert_functor list_functor = { scope, written[i] };
+			scope->sess.write_cas(scope->objects[written[i]].id, list_functor, 0).connect(list_functor);
 		}
+	}
 
-		using update_functor::operator();
+	struct batch_functor
+	{
+		ptr scope;
+		size_t index;
 
-		void operator() (const sync_write_result &, const error_info &err)
+		void operator() (const sync_generic_result &, const error_info &err)
 		{
-			std::lock_guard<std::mutex> lock(scope->mutex);
+			std::lock_guard<std::recursive_mutex> lock(scope->mutex);
 			++scope->finished;
 
-			if (err) {
-				try {
-					err.throw_error();
-				} catch (...) {
-					on_fail(std::current_exception());
-				}
+			if (err)
+				scope->on_fail(err);
+			else
+				scope->batches[index].success = true;
+
+			if (scope->finished != scope->batches.size())
 				return;
+
+			std::vector<size_t> succeeded;
+			for (size_t i = 0; i < scope->batches.size(); ++i) {
+				if (scope->batches[i].success)
+					succeeded.push_back(i);
 			}
 
-			(insert ? scope->success_inserted_ids : scope->success_removed_ids).push_back(id);
-			check_finish();
+			if (succeeded.size() == scope->batches.size()) {
+				scope->handler(scope->exception);
+				return;
+			}
+
+			revert(scope, succeeded);
 		}
 	};
 
-	struct main_functor
+	// sends all changes of indexes of \a scope grouped in batches
+	static void send_batches(const ptr &scope)
+	{
+		for (auto it = scope->changes.begin(); it != scope->changes.end(); ++it) {
+			for (size_t i = 0; i < it->second.size(); i += batch_size) {
+				batch b;
+				b.index = it->first;
+				b.success = false;
+				b.changes.assign(it->second.begin() + i,
+					it->second.begin() + std::min<size_t>(i + batch_size, it->second.size()));
+				scope->batches.push_back(b);
+			}
+		}
+		scope->changes.clear();
+
+		if (scope->batches.empty()) {
+			scope->handler(scope->exception);
+			return;
+		}
+
+		scope->finished = 0;
+		for (size_t i = 0; i < scope->batches.size(); ++i) {
+			batch_functor functor = { scope, i };
+			indexes_send(scope->sess, scope->batches[i].index,
+				request(scope->batches[i].changes, false), true).connect(functor);
+		}
+	}
+
+	struct write_functor
 	{
 		ptr scope;
+		size_t index;
 
 		void operator() (const sync_write_result &, const error_info &err)
 		{
+			std::lock_guard<std::recursive_mutex> lock(scope->mutex);
+			++scope->finished;
+
 			if (err) {
-				try {
-					err.throw_error();
-				} catch (...) {
-					scope->handler(std::current_exception());
-				}
-				return;
+				scope->on_fail(err);
+			} else {
+				scope->objects[index].written = true;
+				scope->diff(index);
 			}
 
-			try {
-				// We "insert" items also to update their data
-				std::set_difference(scope->indexes.indexes.begin(), scope->indexes.indexes.end(),
-					scope->remote_indexes.indexes.begin(), scope->remote_indexes.indexes.end(),
-					std::back_inserter(scope->inserted_ids), dnet_raw_id_less_than<>());
-				// Remove only absolutly another items
-				std::set_difference(scope->remote_indexes.indexes.begin(), scope->remote_indexes.indexes.end(),
-					scope->indexes.indexes.begin(), scope->indexes.indexes.end(),
-					std::back_inserter(scope->removed_ids), dnet_raw_id_less_than<skip_data>());
-
-				if (scope->inserted_ids.empty() && scope->removed_ids.empty()) {
-					scope->handler(std::exception_ptr());
-					return;
-				}
-
-				try_functor functor;
-				functor.scope = scope;
-				functor.insert = true;
-
-				dnet_id id;
-				id.group_id = 0;
-				id.type = 0;
-
-				for (size_t i = 0; i < scope->inserted_ids.size(); ++i) {
-					memcpy(id.id, scope->inserted_ids[i].index.id, sizeof(id.id));
-					functor.id = scope->inserted_ids[i].index;
-					functor.index_data = scope->inserted_ids[i].data;
-					scope->sess.write_cas(id, functor, 0).connect(functor);
-				}
+			if (scope->finished != scope->objects.size())
+				return;
 
-				functor.insert = false;
+			// indexes are not touched if any list failed, written ones are restored
+			if (scope->exception) {
+				revert(scope, std::vector<size_t>());
+				return;
+			}
 
-				for (size_t i = 0; i < scope->removed_ids.size(); ++i) {
-					memcpy(id.id, scope->removed_ids[i].index.id, sizeof(id.id));
-					functor.id = scope->removed_ids[i].index;
-					scope->sess.write_cas(id, functor, 0).connect(functor);
-				}
+			try {
+				send_batches(scope);
 			} catch (...) {
 				scope->handler(std::current_exception());
-				return;
 			}
 		}
 
 		data_pointer operator() (const data_pointer &data)
 		{
-			if (data.empty())
-				scope->remote_indexes.indexes.clear();
-			else
-				indexes_unpack(data, &scope->remote_indexes);
+			object &obj = scope->objects[index];
+
+			if (data.empty()) {
+				obj.remote_indexes.indexes.clear();
+				obj.remote_indexes.friends.clear();
+
+				msgpack::sbuffer buffer;
+				msgpack::pack(buffer, obj.remote_indexes);
+				obj.remote_data = data_pointer::copy(buffer.data(), buffer.size());
+			} else {
+				indexes_unpack(data, &obj.remote_indexes);
+				obj.remote_data = data_pointer::copy(data.data(), data.size());
+			}
 
-			return data_pointer::from_raw(const_cast<char *>(scope->buffer.data()),
-				scope->buffer.size());
+			return data_pointer::from_raw(const_cast<char *>(obj.buffer.data()), obj.buffer.size());
 		}
 	};
 };
 
-// Update \a indexes for \a request_id
+// Update indexes of several objects, \a indexes holds the new indexes of every object
 // Result is pushed to \a handler
 void session::update_indexes(const std::function<void (const update_indexes_result &)> &handler,
-	const key &request_id, const std::vector<index_entry> &indexes)
+	const std::vector<std::pair<key, std::vector<index_entry>>> &indexes)
 {
-	transform(request_id);
-
 	update_indexes_data::ptr scope = std::make_shared<update_indexes_data>(*this);
 	scope->handler = handler;
-	scope->request_id = request_id;
-	scope->indexes.indexes = indexes;
-	std::sort(scope->indexes.indexes.begin(), scope->indexes.indexes.end(), dnet_raw_id_less_than<>());
-	// Generate id for storing the entire indexes
-	scope->id = indexes_generate_id(*this, request_id.id());
 	scope->finished = 0;
+	scope->reverting = 0;
+	scope->objects.resize(indexes.size());
+
+	for (size_t i = 0; i < indexes.size(); ++i) {
+		update_indexes_data::object &obj = scope->objects[i];
+
+		obj.request_id = indexes[i].first;
+		obj.written = false;
+		transform(obj.request_id);
+
+		obj.indexes.indexes = indexes[i].second;
+		std::sort(obj.indexes.indexes.begin(), obj.indexes.indexes.end(), dnet_raw_id_less_than<>());
+		// Generate id for storing the entire indexes
+		obj.id = indexes_generate_id(*this, obj.request_id.id());
 
-	msgpack::pack(scope->buffer, scope->indexes);
-	update_indexes_data::main_functor functor = { scope };
-	write_cas(scope->id, functor, 0).connect(functor);
+		msgpack::pack(obj.buffer, obj.indexes);
+	}
+
+	if (indexes.empty()) {
+		handler(std::exception_ptr());
+		return;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(scope->mutex);
+
+	for (size_t i = 0; i < scope->objects.size(); ++i) {
+		update_indexes_data::write_functor functor = { scope, i };
+		write_cas(scope->objects[i].id, functor, 0).connect(functor);
+	}
+}
+
+void session::update_indexes(const std::vector<std::pair<key, std::vector<index_entry>>> &indexes)
+{
+	waiter<std::exception_ptr> w;
+	update_indexes(w.handler(), indexes);
+	w.result();
+}
+
+// Update \a indexes for \a request_id
+// Result is pushed to \a handler
+void session::update_indexes(const std::function<void (const update_indexes_result &)> &handler,
+	const key &request_id, const std::vector<index_entry> &indexes)
+{
+	std::vector<std::pair<key, std::vector<index_entry>>> objects;
+	objects.push_back(std::make_pair(request_id, indexes));
+
+	update_indexes(handler, objects);
 }
 
 void session::update_indexes(const key &request_id, const std::vector<index_entry> &indexes)
@@ -568,71 +756,221 @@ void session::update_indexes(const key &id, const std::vector<std::string> &inde
 	update_indexes(id, raw_indexes);
 }
 
-struct find_indexes_handler
+// Advances \a id to the next possible id, returns false if \a id was the last one
+static bool indexes_next_id(dnet_raw_id &id)
+{
+	for (int i = sizeof(id.id) - 1; i >= 0; --i) {
+		if (++id.id[i] != 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Intersection is pushed down to the nodes owning indexes: the smallest index is read
+ * in batches, every batch is probed against the rest of indexes in order of their size,
+ * and only ids present in all of them are transferred further. Client thus receives
+ * at most the size of the smallest index times the number of indexes.
+ */
+struct find_indexes_data
 {
+	typedef std::shared_ptr<find_indexes_data> ptr;
+
+	enum { batch_size = 4096 };
+
+	find_indexes_data(session &sess) : sess(sess) {}
+
+	session sess;
 	std::function<void (const find_indexes_result &)> handler;
-	size_t ios_size;
+	std::vector<dnet_raw_id> indexes;
+	// estimated number of entries of every index
+	std::vector<uint64_t> sizes;
+	// positions of indexes in order of their size
+	std::vector<size_t> order;
+	std::mutex mutex;
+	size_t finished;
+	std::exception_ptr exception;
+
+	// next id to read from the smallest index
+	dnet_raw_id start;
+	bool more;
+	// entries of current batch which were found in all probed indexes
+	std::vector<find_indexes_result_entry> candidates;
+	std::vector<find_indexes_result_entry> result;
 
-	void operator() (const sync_read_result &bulk_result, const error_info &err)
+	struct size_less_than
 	{
-		if (err) {
-			try {
-				err.throw_error();
-			} catch (...) {
-				handler(std::current_exception());
-			}
-			return;
+		const std::vector<uint64_t> &sizes;
+
+		bool operator() (size_t a, size_t b) const
+		{
+			return sizes[a] < sizes[b];
 		}
+	};
+
+	static void next_batch(const ptr &scope);
+	static void probe(const ptr &scope, size_t step);
+
+	struct stat_functor
+	{
+		ptr scope;
+		size_t index;
+
+		void operator() (const sync_generic_result &result, const error_info &err)
+		{
+			std::unique_lock<std::mutex> locker(scope->mutex);
 
-		if (bulk_result.size() != ios_size) {
 			try {
-				throw_error(-ENOENT, "Received not all results");
+				if (err)
+					err.throw_error();
+
+				for (auto it = result.begin(); it != result.end(); ++it) {
+					if (it->data().size() < sizeof(dnet_indexes_stat))
+						continue;
+
+					dnet_indexes_stat *stat = it->data<dnet_indexes_stat>();
+					dnet_convert_indexes_stat(stat);
+					scope->sizes[index] = stat->entries;
+				}
 			} catch (...) {
-				handler(std::current_exception());
+				scope->exception = std::current_exception();
+			}
+
+			if (++scope->finished != scope->indexes.size())
+				return;
+
+			locker.unlock();
+
+			if (scope->exception) {
+				scope->handler(scope->exception);
 				return;
 			}
+
+			size_less_than less = { scope->sizes };
+			std::stable_sort(scope->order.begin(), scope->order.end(), less);
+
+			next_batch(scope);
 		}
+	};
 
-		try {
-			std::vector<find_indexes_result_entry> result;
-			dnet_indexes tmp;
-			indexes_unpack(bulk_result[0].file(), &tmp);
-			result.resize(tmp.indexes.size());
-			for (size_t i = 0; i < tmp.indexes.size(); ++i) {
-				find_indexes_result_entry &entry = result[i];
-				entry.id = tmp.indexes[i].index;
-				entry.indexes.push_back(std::make_pair(
-					reinterpret_cast<dnet_raw_id&>(bulk_result[0].command()->id),
-					tmp.indexes[i].data));
-			}
+	struct read_functor
+	{
+		ptr scope;
+
+		void operator() (const sync_generic_result &result, const error_info &err)
+		{
+			try {
+				if (err)
+					err.throw_error();
 
-			for (size_t i = 1; i < bulk_result.size() && !result.empty(); ++i) {
-				auto raw = reinterpret_cast<dnet_raw_id&>(bulk_result[i].command()->id);
-				tmp.indexes.resize(0);
-				indexes_unpack(bulk_result[i].file(), &tmp);
-				auto it = std::set_intersection(result.begin(), result.end(),
-					tmp.indexes.begin(), tmp.indexes.end(),
-					result.begin(), dnet_raw_id_less_than<skip_data>());
-				result.resize(it - result.begin());
-				std::set_intersection(tmp.indexes.begin(), tmp.indexes.end(),
-					result.begin(), result.end(),
-					tmp.indexes.begin(), dnet_raw_id_less_than<skip_data>());
-				auto jt = tmp.indexes.begin();
-				for (auto kt = result.begin(); kt != result.end(); ++kt, ++jt) {
-					kt->indexes.push_back(std::make_pair(raw, jt->data));
+				std::vector<index_entry> entries;
+				scope->more = indexes_parse_reply(result, entries);
+
+				scope->candidates.clear();
+				scope->candidates.resize(entries.size());
+				for (size_t i = 0; i < entries.size(); ++i) {
+					find_indexes_result_entry &entry = scope->candidates[i];
+					entry.id = entries[i].index;
+					entry.indexes.reserve(scope->indexes.size());
+					for (size_t j = 0; j < scope->indexes.size(); ++j)
+						entry.indexes.push_back(std::make_pair(scope->indexes[j], data_pointer()));
+					entry.indexes[scope->order[0]].second = entries[i].data;
 				}
+
+				if (entries.empty()) {
+					scope->more = false;
+				} else {
+					scope->start = entries.back().index;
+					scope->more = scope->more && indexes_next_id(scope->start);
+				}
+			} catch (...) {
+				scope->handler(std::current_exception());
+				return;
 			}
 
+			probe(scope, 1);
+		}
+	};
+
+	struct probe_functor
+	{
+		ptr scope;
+		size_t step;
+
+		void operator() (const sync_generic_result &result, const error_info &err)
+		{
 			try {
-				handler(result);
+				if (err)
+					err.throw_error();
+
+				std::vector<index_entry> entries;
+				indexes_parse_reply(result, entries);
+
+				// both lists are sorted by id and found entries are subset of candidates
+				const size_t position = scope->order[step];
+				auto it = scope->candidates.begin();
+				auto out = scope->candidates.begin();
+				for (auto jt = entries.begin(); jt != entries.end(); ++jt) {
+					while (it != scope->candidates.end() && it->id < jt->index)
+						++it;
+					if (it == scope->candidates.end())
+						break;
+					if (it->id == jt->index) {
+						it->indexes[position].second = jt->data;
+						if (out != it)
+							std::swap(*out, *it);
+						++out;
+						++it;
+					}
+				}
+				scope->candidates.erase(out, scope->candidates.end());
 			} catch (...) {
+				scope->handler(std::current_exception());
+				return;
 			}
-		} catch (...) {
-			handler(std::current_exception());
+
+			probe(scope, step + 1);
+		}
+	};
+};
+
+void find_indexes_data::next_batch(const ptr &scope)
+{
+	data_pointer request = indexes_request(scope->start, DNET_INDEXES_READ, data_pointer(), batch_size);
+	read_functor functor = { scope };
+	indexes_send(scope->sess, scope->indexes[scope->order[0]], request, false).connect(functor);
+}
+
+void find_indexes_data::probe(const ptr &scope, size_t step)
+{
+	if (step == scope->order.size() || scope->candidates.empty()) {
+		scope->result.insert(scope->result.end(), scope->candidates.begin(), scope->candidates.end());
+		scope->candidates.clear();
+
+		if (scope->more) {
+			next_batch(scope);
 			return;
 		}
+
+		try {
+			scope->handler(scope->result);
+		} catch (...) {
+		}
+		return;
 	}
-};
+
+	data_pointer ids = data_pointer::allocate(scope->candidates.size() * sizeof(dnet_raw_id));
+	dnet_raw_id *raw = ids.data<dnet_raw_id>();
+	for (size_t i = 0; i < scope->candidates.size(); ++i)
+		raw[i] = scope->candidates[i].id;
+
+	dnet_raw_id unused;
+	memset(&unused, 0, sizeof(unused));
+
+	probe_functor functor = { scope, step };
+	indexes_send(scope->sess, scope->indexes[scope->order[step]],
+		indexes_request(unused, DNET_INDEXES_PROBE, ids), false).connect(functor);
+}
 
 void session::find_indexes(const std::function<void (const find_indexes_result &)> &handler, const std::vector<dnet_raw_id> &indexes)
 {
@@ -642,17 +980,30 @@ void session::find_indexes(const std::function<void (const find_indexes_result &
 		return;
 	}
 
-	std::vector<dnet_io_attr> ios;
-	struct dnet_io_attr io;
-	memset(&io, 0, sizeof(io));
+	find_indexes_data::ptr scope = std::make_shared<find_indexes_data>(*this);
+	scope->handler = handler;
+	scope->indexes = indexes;
+	scope->sizes.resize(indexes.size());
+	scope->finished = 0;
+	scope->more = false;
+	memset(&scope->start, 0, sizeof(scope->start));
 
-	for (size_t i = 0; i < indexes.size(); ++i) {
-		memcpy(io.id, indexes[i].id, sizeof(dnet_raw_id));
-		ios.push_back(io);
+	for (size_t i = 0; i < indexes.size(); ++i)
+		scope->order.push_back(i);
+
+	if (indexes.size() == 1) {
+		find_indexes_data::next_batch(scope);
+		return;
 	}
 
-	find_indexes_handler functor = { handler, ios.size() };
-	bulk_read(ios).connect(functor);
+	dnet_raw_id unused;
+	memset(&unused, 0, sizeof(unused));
+
+	// sizes of indexes define which one is streamed and the order of probes
+	for (size_t i = 0; i < indexes.size(); ++i) {
+		find_indexes_data::stat_functor functor = { scope, i };
+		indexes_send(*this, indexes[i], indexes_request(unused, DNET_INDEXES_STAT, data_pointer()), false).connect(functor);
+	}
 }
 
 find_indexes_result session::find_indexes(const std::vector<dnet_raw_id> &indexes)
@@ -676,6 +1027,52 @@ find_indexes_result session::find_indexes(const std::vector<std::string> &indexe
 	return find_indexes(raw_indexes);
 }
 
+struct read_index_handler
+{
+	std::function<void (const read_index_result &)> handler;
+
+	void operator() (const sync_generic_result &result, const error_info &err)
+	{
+		if (err) {
+			try {
+				err.throw_error();
+			} catch (...) {
+				handler(std::current_exception());
+			}
+			return;
+		}
+
+		try {
+			std::vector<index_entry> entries;
+			indexes_parse_reply(result, entries);
+
+			try {
+				handler(entries);
+			} catch (...) {
+			}
+		} catch (...) {
+			handler(std::current_exception());
+			return;
+		}
+	}
+};
+
+void session::read_index(const std::function<void (const read_index_result &)> &handler,
+	const key &index, const dnet_raw_id &start, unsigned int limit)
+{
+	transform(index);
+
+	read_index_handler functor = { handler };
+	indexes_send(*this, index.raw_id(), indexes_request(start, DNET_INDEXES_READ, data_pointer(), limit), false).connect(functor);
+}
+
+read_index_result session::read_index(const key &index, const dnet_raw_id &start, unsigned int limit)
+{
+	waiter<read_index_result> w;
+	read_index(w.handler(), index, start, limit);
+	return w.result();
+}
+
 struct check_indexes_handler
 {
 	std::function<void (const check_indexes_result &)> handler;
@@ -23,6 +23,7 @@
 
 #include <sstream>
 #include <fstream>
+#include <map>
 #include <set>
 
 #include "../../include/elliptics/cppdef.h"
@@ -191,6 +192,76 @@ static void test_range_request_2(session &s, int limit_start, int limit_num, int
 	}
 }
 
+static void test_range_request_pages_check(session &s, const std::map<std::string, std::string> &items,
+		int column, uint64_t limit_start, uint64_t limit_num, int group_id)
+{
+	struct dnet_io_attr io;
+	memset(&io, 0, sizeof(io));
+	memset(io.id, 0x00, sizeof(io.id));
+	memset(io.parent, 0xff, sizeof(io.parent));
+	io.type = column;
+	io.start = limit_start;
+	io.num = limit_num;
+
+	sync_read_result result = s.read_data_range(io, group_id);
+
+	std::vector<std::pair<std::string, std::string> > expected;
+	auto it = items.begin();
+	for (uint64_t i = 0; i < limit_start && it != items.end(); ++i)
+		++it;
+	for (; it != items.end() && (!limit_num || expected.size() < limit_num); ++it)
+		expected.push_back(*it);
+
+	std::cerr << "range pages [LIMIT(" << limit_start << ", " << limit_num << "): "
+		<< result.size() << " elements, expected: " << expected.size() << std::endl;
+
+	if (result.size() != expected.size())
+		throw_error(-ENOENT, "read_data_range_pages: Received size: %d, expected: %d",
+			int(result.size()), int(expected.size()));
+
+	for (size_t i = 0; i < expected.size(); ++i) {
+		std::string id(reinterpret_cast<const char *>(result[i].io_attribute()->id), DNET_ID_SIZE);
+		if (id != expected[i].first || result[i].file().to_string() != expected[i].second)
+			throw_error(-EIO, "read_data_range_pages: Invalid entry at %d of %d",
+				int(i), int(expected.size()));
+	}
+}
+
+/*
+ * Range spans every node and several pages of every segment, entries have to come
+ * in key order with io.start/io.num applied to the whole range.
+ */
+static void test_range_request_pages(session &s, int group_id)
+{
+	const int column = 5;
+	const size_t item_count = 3 * DNET_FLOW_WINDOW_RECORDS;
+	std::map<std::string, std::string> items;
+
+	for (size_t i = 0; i < item_count; ++i) {
+		std::ostringstream remote;
+		remote << "range-page-" << i;
+
+		key id(remote.str(), column);
+		id.transform(s);
+
+		s.write_data(id, remote.str(), 0).wait();
+		items[std::string(reinterpret_cast<const char *>(id.id().id), DNET_ID_SIZE)] = remote.str();
+	}
+
+	test_range_request_pages_check(s, items, column, 0, 0, group_id);
+	test_range_request_pages_check(s, items, column, 0, 10, group_id);
+	test_range_request_pages_check(s, items, column, DNET_FLOW_WINDOW_RECORDS - 5, DNET_FLOW_WINDOW_RECORDS + 10, group_id);
+	test_range_request_pages_check(s, items, column, item_count - 3, 100, group_id);
+
+	struct dnet_io_attr io;
+	memset(&io, 0, sizeof(io));
+	memset(io.id, 0x00, sizeof(io.id));
+	memset(io.parent, 0xff, sizeof(io.parent));
+	io.type = column;
+
+	s.remove_data_range(io, group_id).wait();
+}
+
 static void test_lookup_parse(const std::string &key,
 	struct dnet_cmd *cmd, struct dnet_addr *addr, const char *path)
 {
@@ -259,6 +330,50 @@ static void test_append(session &s)
 	}
 }
 
+/*
+ * CAS parent is SHA-512 of the data, run it against nodes with both 'checksum = sha512'
+ * and 'checksum = crc32c' in config, result must not depend on node's checksum engine
+ */
+static void test_cas(session &s)
+{
+	try {
+		std::string remote = "cas-test";
+		std::string data = "cas data";
+
+		s.write_data(remote, data, 0).wait();
+
+		struct dnet_id csum;
+		memset(&csum, 0, sizeof(csum));
+		s.transform(data, csum);
+
+		data = "cas data changed by digest";
+		s.write_cas(remote, data, csum, 0).wait();
+
+		int err = 0;
+		try {
+			s.write_cas(remote, std::string("cas data with stale digest"), csum, 0).wait();
+		} catch (const error &e) {
+			err = e.error_code();
+		}
+		if (err != -EBADFD)
+			throw std::runtime_error("CAS with stale digest did not fail with -EBADFD");
+
+		s.write_cas(remote, [] (const data_pointer &data) {
+			std::string changed = data.to_string() + " and converter";
+			return data_pointer::copy(changed.data(), changed.size());
+		}, 0).wait();
+
+		std::string ret = s.read_data(remote, 0, 0).get()[0].file().to_string();
+		std::cerr << remote << ": " << ret << std::endl;
+
+		if (ret != data + " and converter")
+			throw std::runtime_error("CAS data mismatch");
+	} catch (const std::exception &e) {
+		std::cerr << "CAS test failed: " << e.what() << std::endl;
+		throw std::runtime_error("CAS test failed");
+	}
+}
+
 static void read_column_raw(session &s, const std::string &remote, const std::string &data, int column)
 {
 	read_result_entry ret;
@@ -618,6 +733,7 @@ int main(int argc, char *argv[])
 		test_range_request_2(s, 0, 255, group_id);
 		test_range_request_2(s, 3, 14, group_id);
 		test_range_request_2(s, 7, 3, group_id);
+		test_range_request_pages(s, group_id);
 
 		test_lookup(s, groups);
 
@@ -639,6 +755,7 @@ int main(int argc, char *argv[])
 		s.set_cflags(cflags);
 
 		test_append(s);
+		test_cas(s);
 
 		test_bulk_write(s);
 		test_bulk_read(s);
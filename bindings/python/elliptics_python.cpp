@@ -52,6 +52,25 @@ enum elliptics_ioflags {
 	ioflags_cache_remove_from_disk = DNET_IO_FLAGS_CACHE_REMOVE_FROM_DISK,
 };
 
+enum elliptics_iterator_flags {
+	iterator_flags_default = 0,
+	iterator_flags_data = DNET_IFLAGS_DATA,
+	iterator_flags_key_range = DNET_IFLAGS_KEY_RANGE,
+	iterator_flags_ts_range = DNET_IFLAGS_TS_RANGE,
+};
+
+enum elliptics_iterator_types {
+	iterator_types_disk = DNET_ITYPE_DISK,
+	iterator_types_network = DNET_ITYPE_NETWORK,
+};
+
+enum elliptics_iterator_actions {
+	iterator_actions_start = DNET_ITERATOR_ACTION_START,
+	iterator_actions_pause = DNET_ITERATOR_ACTION_PAUSE,
+	iterator_actions_continue = DNET_ITERATOR_ACTION_CONTINUE,
+	iterator_actions_cancel = DNET_ITERATOR_ACTION_CANCEL,
+};
+
 enum elliptics_log_level {
 	log_level_data = DNET_LOG_DATA,
 	log_level_error = DNET_LOG_ERROR,
@@ -174,6 +193,36 @@ class elliptics_status : public dnet_node_status
 		}
 };
 
+/*
+ * Releases GIL for the lifetime of the object, so that other python threads
+ * run while this one waits for elliptics replies.
+ * Python objects must not be touched under it.
+ */
+class gil_release
+{
+	ELLIPTICS_DISABLE_COPY(gil_release)
+	public:
+		gil_release() : m_state(PyEval_SaveThread()) {}
+		~gil_release() { PyEval_RestoreThread(m_state); }
+
+	private:
+		PyThreadState *m_state;
+};
+
+/*
+ * Takes GIL in a thread python may know nothing about, i.e. elliptics io thread.
+ */
+class gil_acquire
+{
+	ELLIPTICS_DISABLE_COPY(gil_acquire)
+	public:
+		gil_acquire() : m_state(PyGILState_Ensure()) {}
+		~gil_acquire() { PyGILState_Release(m_state); }
+
+	private:
+		PyGILState_STATE m_state;
+};
+
 class elliptics_node_python : public node, public bp::wrapper<node> {
 	public:
 		elliptics_node_python(const logger &l)
@@ -183,6 +232,11 @@ class elliptics_node_python : public node, public bp::wrapper<node> {
 			: node(l, cfg.config) {}
 
 		elliptics_node_python(const node &n): node(n) {}
+
+		void add_remote(const char *addr, int port, int family) {
+			gil_release nogil;
+			node::add_remote(addr, port, family);
+		}
 };
 
 template <typename T>
@@ -192,33 +246,223 @@ static std::vector<T> convert_to_vector(const bp::api::object &list)
 	return std::vector<T>(begin, end);
 }
 
+/*
+ * Read data exported through buffer protocol, memoryview() of it
+ * references reply memory without copying it into python string.
+ */
+class python_data
+{
+	public:
+		python_data() {}
+		python_data(const data_pointer &data) : m_data(data) {}
+
+		size_t size() const
+		{
+			return m_data.size();
+		}
+
+		std::string to_string() const
+		{
+			return m_data.to_string();
+		}
+
+		static int get_buffer(PyObject *self, Py_buffer *view, int flags)
+		{
+			python_data *data = bp::extract<python_data *>(self);
+
+			return PyBuffer_FillInfo(view, self, data->m_data.data(), data->m_data.size(), 1, flags);
+		}
+
+		static void register_buffer(const bp::api::object &type_object)
+		{
+			static PyBufferProcs procs;
+			PyTypeObject *type = reinterpret_cast<PyTypeObject *>(type_object.ptr());
+
+			procs.bf_getbuffer = get_buffer;
+			type->tp_as_buffer = &procs;
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+			type->tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+		}
+
+	private:
+		data_pointer m_data;
+};
+
+/*
+ * Iterates over replies of async result as they arrive, GIL is released while waiting for them.
+ */
 template <typename T>
 struct python_result
 {
 	typedef typename T::iterator iterator;
+	typedef typename T::entry_type entry_type;
 
 	std::shared_ptr<T> scope;
+	std::shared_ptr<iterator> it;
 
-	iterator begin()
+	entry_type next()
 	{
-		return scope->begin();
-	}
+		{
+			gil_release nogil;
 
-	iterator end()
-	{
-		return scope->end();
+			if (!it)
+				it = std::make_shared<iterator>(scope->begin());
+			else
+				++*it;
+
+			if (*it != iterator())
+				return **it;
+		}
+
+		PyErr_SetNone(PyExc_StopIteration);
+		bp::throw_error_already_set();
+		return entry_type();
 	}
 };
 
 template <typename T>
 python_result<T> create_result(T &&result)
 {
-	python_result<T> pyresult = { std::make_shared<T>(std::move(result)) };
+	python_result<T> pyresult = { std::make_shared<T>(std::move(result)), std::shared_ptr<typename T::iterator>() };
 	return pyresult;
 }
 
 typedef python_result<async_iterator_result> python_iterator_result;
 
+/*
+ * Future of elliptics request.
+ * Callbacks connected to it are called with list of replies and error (None on success)
+ * once request completes. They are called with GIL taken from elliptics io thread,
+ * so they must not wait for other elliptics requests.
+ */
+template <typename T>
+class python_async_result
+{
+	public:
+		python_async_result(async_result<T> &&result) : m_data(std::make_shared<data>())
+		{
+			typename async_result<T>::result_array_function handler =
+				std::bind(complete, m_data, std::placeholders::_1, std::placeholders::_2);
+
+			m_data->finished = false;
+
+			gil_release nogil;
+			result.connect(handler);
+		}
+
+		bool ready() const
+		{
+			std::unique_lock<std::mutex> locker(m_data->lock);
+			return m_data->finished;
+		}
+
+		void wait()
+		{
+			error_info err;
+			{
+				gil_release nogil;
+
+				std::unique_lock<std::mutex> locker(m_data->lock);
+				while (!m_data->finished)
+					m_data->condition.wait(locker);
+				err = m_data->error;
+			}
+
+			if (err)
+				err.throw_error();
+		}
+
+		bp::list get()
+		{
+			wait();
+			return convert_results(m_data->results);
+		}
+
+		bp::api::object error() const
+		{
+			std::unique_lock<std::mutex> locker(m_data->lock);
+			return convert_error(m_data->error);
+		}
+
+		void connect(const bp::api::object &callback)
+		{
+			{
+				std::unique_lock<std::mutex> locker(m_data->lock);
+				if (!m_data->finished) {
+					m_data->callbacks.push_back(callback);
+					return;
+				}
+			}
+
+			call(callback, m_data);
+		}
+
+	private:
+		struct data
+		{
+			std::mutex lock;
+			std::condition_variable condition;
+			bool finished;
+			std::vector<T> results;
+			error_info error;
+			std::vector<bp::api::object> callbacks;
+		};
+
+		static bp::list convert_results(const std::vector<T> &results)
+		{
+			bp::list l;
+			for (size_t i = 0; i < results.size(); ++i)
+				l.append(results[i]);
+			return l;
+		}
+
+		static bp::api::object convert_error(const error_info &err)
+		{
+			if (!err)
+				return bp::api::object();
+			return bp::api::object(ioremap::elliptics::error(err.code(), err.message()));
+		}
+
+		static void call(const bp::api::object &callback, const std::shared_ptr<data> &d)
+		{
+			try {
+				callback(convert_results(d->results), convert_error(d->error));
+			} catch (const bp::error_already_set &) {
+				PyErr_Print();
+			}
+		}
+
+		static void complete(const std::shared_ptr<data> &d, const std::vector<T> &results, const error_info &error)
+		{
+			std::vector<bp::api::object> callbacks;
+
+			{
+				std::unique_lock<std::mutex> locker(d->lock);
+				d->results = results;
+				d->error = error;
+				d->finished = true;
+				/* vector swap does not touch python objects, so it is done without GIL */
+				callbacks.swap(d->callbacks);
+				d->condition.notify_all();
+			}
+
+			if (callbacks.empty())
+				return;
+
+			gil_acquire gil;
+			for (size_t i = 0; i < callbacks.size(); ++i)
+				call(callbacks[i], d);
+			callbacks.clear();
+		}
+
+		std::shared_ptr<data> m_data;
+};
+
+typedef python_async_result<read_result_entry> python_async_read_result;
+typedef python_async_result<write_result_entry> python_async_write_result;
+typedef python_async_result<callback_result_entry> python_async_remove_result;
+
 class elliptics_session: public session, public bp::wrapper<session> {
 	public:
 		elliptics_session(const node &n) : session(n) {}
@@ -242,8 +486,10 @@ class elliptics_session: public session, public bp::wrapper<session> {
 			memset(&ts, 0, sizeof(ts));
 
 			struct dnet_id raw = id.to_dnet();
+			std::vector<int> std_groups = convert_to_vector<int>(groups);
 
-			write_metadata((const dnet_id&)raw, remote, convert_to_vector<int>(groups), ts);
+			gil_release nogil;
+			write_metadata((const dnet_id&)raw, remote, std_groups, ts);
 		}
 
 		void write_metadata_by_data_transform(const std::string &remote) {
@@ -254,47 +500,70 @@ class elliptics_session: public session, public bp::wrapper<session> {
 
 			transform(remote, raw);
 
+			gil_release nogil;
 			write_metadata((const dnet_id&)raw, remote, session::get_groups(), ts);
 		}
 
 		void read_file_by_id(struct elliptics_id &id, const std::string &file, uint64_t offset, uint64_t size) {
 			struct dnet_id raw = id.to_dnet();
+
+			gil_release nogil;
 			read_file(raw, file, offset, size);
 		}
 
 		void read_file_by_data_transform(const std::string &remote, const std::string &file,
 							uint64_t offset, uint64_t size,	int type) {
+			gil_release nogil;
 			read_file(key(remote, type), file, offset, size);
 		}
 
 		void write_file_by_id(struct elliptics_id &id, const std::string &file,
 						    uint64_t local_offset, uint64_t offset, uint64_t size) {
 			struct dnet_id raw = id.to_dnet();
+
+			gil_release nogil;
 			write_file(raw, file, local_offset, offset, size);
 		}
 
 		void write_file_by_data_transform(const std::string &remote, const std::string &file,
 								uint64_t local_offset, uint64_t offset, uint64_t size,
 								int type) {
+			gil_release nogil;
 			write_file(key(remote, type), file, local_offset, offset, size);
 		}
 
 		std::string read_data_by_id(const struct elliptics_id &id, uint64_t offset, uint64_t size) {
 			struct dnet_id raw = id.to_dnet();
+
+			gil_release nogil;
 			return read_data(raw, offset, size).get()[0].file().to_string();
 		}
 
 		std::string read_data_by_data_transform(const std::string &remote, uint64_t offset, uint64_t size,
 							int type) {
+			gil_release nogil;
 			return read_data(key(remote, type), offset, size).get()[0].file().to_string();
 		}
 
+		python_async_read_result read_data_async_by_id(const struct elliptics_id &id, uint64_t offset, uint64_t size) {
+			struct dnet_id raw = id.to_dnet();
+			return python_async_read_result(read_data(raw, offset, size));
+		}
+
+		python_async_read_result read_data_async_by_data_transform(const std::string &remote, uint64_t offset, uint64_t size,
+									int type) {
+			return python_async_read_result(read_data(key(remote, type), offset, size));
+		}
+
 		bp::list prepare_latest_by_id(const struct elliptics_id &id, const bp::api::object &gl) {
 			struct dnet_id raw = id.to_dnet();
 
 			std::vector<int> groups = convert_to_vector<int>(gl);
 
-			prepare_latest(raw, groups);
+			{
+				gil_release nogil;
+				prepare_latest(raw, groups);
+			}
 
 			bp::list l;
 			for (unsigned i = 0; i < groups.size(); ++i)
@@ -308,7 +577,10 @@ class elliptics_session: public session, public bp::wrapper<session> {
 
 			std::vector<int> groups = convert_to_vector<int>(gl);
 
-			prepare_latest(raw, groups);
+			{
+				gil_release nogil;
+				prepare_latest(raw, groups);
+			}
 
 			std::string ret;
 			ret.assign((char *)groups.data(), groups.size() * 4);
@@ -318,11 +590,14 @@ class elliptics_session: public session, public bp::wrapper<session> {
 
 		std::string read_latest_by_id(const struct elliptics_id &id, uint64_t offset, uint64_t size) {
 			struct dnet_id raw = id.to_dnet();
+
+			gil_release nogil;
 			return read_latest(raw, offset, size).get()[0].file().to_string();
 		}
 
 		std::string read_latest_by_data_transform(const std::string &remote, uint64_t offset, uint64_t size,
 									int type) {
+			gil_release nogil;
 			return read_latest(key(remote, type), offset, size).get()[0].file().to_string();
 		}
 
@@ -340,33 +615,55 @@ class elliptics_session: public session, public bp::wrapper<session> {
 
 		std::string write_data_by_id(const struct elliptics_id &id, const std::string &data, uint64_t remote_offset) {
 			struct dnet_id raw = id.to_dnet();
+
+			gil_release nogil;
 			return convert_to_string(write_data(raw, data, remote_offset));
 		}
 
 		std::string write_data_by_data_transform(const std::string &remote, const std::string &data, uint64_t remote_offset,
 								int type) {
+			gil_release nogil;
 			return convert_to_string(write_data(key(remote, type), data, remote_offset));
 		}
 
+		/* @data is copied, python string may be destroyed before request completes */
+		python_async_write_result write_data_async_by_id(const struct elliptics_id &id, const std::string &data,
+									uint64_t remote_offset) {
+			struct dnet_id raw = id.to_dnet();
+			return python_async_write_result(write_data(raw,
+						data_pointer::copy(data.data(), data.size()), remote_offset));
+		}
+
+		python_async_write_result write_data_async_by_data_transform(const std::string &remote, const std::string &data,
+									uint64_t remote_offset, int type) {
+			return python_async_write_result(write_data(key(remote, type),
+						data_pointer::copy(data.data(), data.size()), remote_offset));
+		}
+
 		std::string write_cache_by_id(const struct elliptics_id &id, const std::string &data,
 							    long timeout) {
 			struct dnet_id raw = id.to_dnet();
 			raw.type = 0;
+
+			gil_release nogil;
 			return convert_to_string(write_cache(raw, data, timeout));
 		}
 
 		std::string write_cache_by_data_transform(const std::string &remote, const std::string &data,
 									long timeout) {
+			gil_release nogil;
 			return convert_to_string(write_cache(remote, data, timeout));
 		}
 
 		std::string lookup_addr_by_data_transform(const std::string &remote, const int group_id) {
+			gil_release nogil;
 			return lookup_address(remote, group_id);
 		}
 
 		std::string lookup_addr_by_id(const struct elliptics_id &id) {
 			struct dnet_id raw = id.to_dnet();
 
+			gil_release nogil;
 			return lookup_address(raw, raw.group_id);
 		}
 
@@ -380,25 +677,42 @@ class elliptics_session: public session, public bp::wrapper<session> {
 			return boost::python::make_tuple(address, port, info->size);
 		}
 
+		lookup_result_entry lookup_sync(const key &id) {
+			gil_release nogil;
+			return lookup(id).get()[0];
+		}
+
 		boost::python::tuple lookup_by_data_transform(const std::string &remote) {
-			return parse_lookup(lookup(remote).get()[0]);
+			return parse_lookup(lookup_sync(remote));
 		}
 
 		boost::python::tuple lookup_by_id(const struct elliptics_id &id) {
 			struct dnet_id raw = id.to_dnet();
 
-			return parse_lookup(lookup(raw).get()[0]);
+			return parse_lookup(lookup_sync(raw));
+		}
+
+		python_async_write_result lookup_async_by_data_transform(const std::string &remote) {
+			return python_async_write_result(lookup(remote));
+		}
+
+		python_async_write_result lookup_async_by_id(const struct elliptics_id &id) {
+			struct dnet_id raw = id.to_dnet();
+
+			return python_async_write_result(lookup(raw));
 		}
 
 		elliptics_status update_status_by_id(const struct elliptics_id &id, elliptics_status &status) {
 			struct dnet_id raw = id.to_dnet();
 
+			gil_release nogil;
 			update_status(raw, &status);
 			return status;
 		}
 		
 		elliptics_status update_status_by_string(const std::string &saddr, const int port, const int family,
 								elliptics_status &status) {
+			gil_release nogil;
 			update_status(saddr.c_str(), port, family, &status);
 			return status;
 		}
@@ -408,7 +722,10 @@ class elliptics_session: public session, public bp::wrapper<session> {
 			elliptics_extract_range(r, io);
 
 			std::vector<std::string> ret;
-			ret = session::read_data_range_raw(io, r.group_id);
+			{
+				gil_release nogil;
+				ret = session::read_data_range_raw(io, r.group_id);
+			}
 
 			boost::python::list l;
 
@@ -446,6 +763,7 @@ class elliptics_session: public session, public bp::wrapper<session> {
 						    const std::string &data, const std::string &binary) {
 			struct dnet_id raw = id.to_dnet();
 
+			gil_release nogil;
 			return exec_locked(&raw, event, data, binary);
 		}
 
@@ -456,23 +774,37 @@ class elliptics_session: public session, public bp::wrapper<session> {
 			raw.type = 0;
 			raw.group_id = 0;
 
+			gil_release nogil;
 			return exec_locked(&raw, event, data, binary);
 		}
 
 		std::string exec_name_all(const std::string &event, const std::string &data, const std::string &binary) {
+			gil_release nogil;
 			return exec_locked(NULL, event, data, binary);
 		}
 
 		void remove_by_id(const struct elliptics_id &id) {
 			struct dnet_id raw = id.to_dnet();
 
+			gil_release nogil;
 			remove(raw).wait();
 		}
 
 		void remove_by_name(const std::string &remote, int type) {
+			gil_release nogil;
 			remove(key(remote, type)).wait();
 		}
 
+		python_async_remove_result remove_async_by_id(const struct elliptics_id &id) {
+			struct dnet_id raw = id.to_dnet();
+
+			return python_async_remove_result(remove(raw));
+		}
+
+		python_async_remove_result remove_async_by_name(const std::string &remote, int type) {
+			return python_async_remove_result(remove(key(remote, type)));
+		}
+
 		struct dnet_id_comparator
 		{
 			bool operator() (const struct dnet_id &first, const struct dnet_id &second)
@@ -484,7 +816,11 @@ class elliptics_session: public session, public bp::wrapper<session> {
 		bp::api::object bulk_read_by_name(const bp::api::object &keys, bool raw) {
 			std::vector<std::string> std_keys = convert_to_vector<std::string>(keys);
 
-			const sync_read_result ret =  bulk_read(std_keys);
+			sync_read_result ret;
+			{
+				gil_release nogil;
+				ret = bulk_read(std_keys).get();
+			}
 
 			if (raw) {
 				bp::list result;
@@ -522,7 +858,11 @@ class elliptics_session: public session, public bp::wrapper<session> {
 		bp::list stat_log_count() {
 			bp::list statistics;
 
-			const sync_stat_count_result result = session::stat_log_count();
+			sync_stat_count_result result;
+			{
+				gil_release nogil;
+				result = session::stat_log_count().get();
+			}
 
 			for (size_t i = 0; i < result.size(); ++i) {
 				const stat_count_result_entry &data = result[i];
@@ -670,7 +1010,42 @@ void dnet_iterator_request_set_end(dnet_iterator_request *request, const bp::lis
 	convert_from_list(list, request->end.id, sizeof(request->end.id));
 }
 
-dnet_iterator_request iterator_result_reply(iterator_result_entry result)
+bp::list dnet_iterator_response_get_key(const dnet_iterator_response *response)
+{
+	return convert_to_list(response->key.id, sizeof(response->key.id));
+}
+
+bp::api::object pass_through(const bp::api::object &object)
+{
+	return object;
+}
+
+python_data read_result_data(const read_result_entry &result)
+{
+	return python_data(result.file());
+}
+
+uint64_t read_result_offset(const read_result_entry &result)
+{
+	return result.io_attribute()->offset;
+}
+
+std::string lookup_result_address(const lookup_result_entry &result)
+{
+	return dnet_server_convert_dnet_addr(result.storage_address());
+}
+
+uint64_t lookup_result_size(const lookup_result_entry &result)
+{
+	return result.file_info()->size;
+}
+
+std::string lookup_result_path(const lookup_result_entry &result)
+{
+	return result.file_path();
+}
+
+dnet_iterator_response iterator_result_reply(iterator_result_entry result)
 {
 	return *result.reply();
 }
@@ -681,6 +1056,11 @@ std::string iterator_result_reply_data(iterator_result_entry result)
 }
 
 BOOST_PYTHON_MODULE(elliptics) {
+#if PY_VERSION_HEX < 0x03070000
+	/* elliptics io threads take GIL to call python callbacks */
+	PyEval_InitThreads();
+#endif
+
 	bp::class_<error> error_class("ErrorInfo", bp::init<int, std::string>());
 	error_class.def("__str__", &error::error_message);
 	error_class.add_property("message", &error::error_message);
@@ -708,6 +1088,15 @@ BOOST_PYTHON_MODULE(elliptics) {
 		.def_readwrite("id", &dnet_iterator_request::id)
 		.def_readwrite("itype", &dnet_iterator_request::itype)
 		.def_readwrite("status", &dnet_iterator_request::status)
+		.def_readwrite("action", &dnet_iterator_request::action)
+	;
+
+	bp::class_<dnet_iterator_response>("IteratorResponse", bp::init<>())
+		.add_property("key", dnet_iterator_response_get_key)
+		.def_readonly("id", &dnet_iterator_response::id)
+		.def_readonly("status", &dnet_iterator_response::status)
+		.def_readonly("size", &dnet_iterator_response::size)
+		.def_readonly("flags", &dnet_iterator_response::flags)
 	;
 
 	bp::class_<iterator_result_entry>("IteratorResultEntry", bp::init<>())
@@ -753,7 +1142,55 @@ BOOST_PYTHON_MODULE(elliptics) {
 	;
 
 	bp::class_<python_iterator_result>("IteratorResult", bp::no_init)
-		.def("__iter__", bp::iterator<python_iterator_result>())
+		.def("__iter__", pass_through)
+		.def("next", &python_iterator_result::next)
+		.def("__next__", &python_iterator_result::next)
+	;
+
+	bp::class_<python_data> data_class("Data", bp::no_init);
+	data_class
+		.def("__len__", &python_data::size)
+		.def("__str__", &python_data::to_string)
+	;
+	python_data::register_buffer(data_class);
+
+	bp::class_<callback_result_entry>("CallbackResultEntry", bp::no_init)
+		.def("status", &callback_result_entry::status)
+	;
+
+	bp::class_<read_result_entry, bp::bases<callback_result_entry> >("ReadResultEntry", bp::no_init)
+		.def("data", read_result_data)
+		.def("offset", read_result_offset)
+	;
+
+	bp::class_<lookup_result_entry, bp::bases<callback_result_entry> >("LookupResultEntry", bp::no_init)
+		.def("address", lookup_result_address)
+		.def("size", lookup_result_size)
+		.def("path", lookup_result_path)
+	;
+
+	bp::class_<python_async_read_result>("AsyncReadResult", bp::no_init)
+		.def("ready", &python_async_read_result::ready)
+		.def("wait", &python_async_read_result::wait)
+		.def("get", &python_async_read_result::get)
+		.def("error", &python_async_read_result::error)
+		.def("connect", &python_async_read_result::connect)
+	;
+
+	bp::class_<python_async_write_result>("AsyncWriteResult", bp::no_init)
+		.def("ready", &python_async_write_result::ready)
+		.def("wait", &python_async_write_result::wait)
+		.def("get", &python_async_write_result::get)
+		.def("error", &python_async_write_result::error)
+		.def("connect", &python_async_write_result::connect)
+	;
+
+	bp::class_<python_async_remove_result>("AsyncRemoveResult", bp::no_init)
+		.def("ready", &python_async_remove_result::ready)
+		.def("wait", &python_async_remove_result::wait)
+		.def("get", &python_async_remove_result::get)
+		.def("error", &python_async_remove_result::error)
+		.def("connect", &python_async_remove_result::connect)
 	;
 	
 	bp::class_<elliptics_config>("Config", bp::init<>())
@@ -763,7 +1200,7 @@ BOOST_PYTHON_MODULE(elliptics) {
 
 	bp::class_<elliptics_node_python>("Node", bp::init<logger>())
 		.def(bp::init<logger, elliptics_config &>())
-		.def("add_remote", static_cast<void (node::*)(const char*, int, int)>(&node::add_remote),
+		.def("add_remote", &elliptics_node_python::add_remote,
 			(bp::arg("addr"), bp::arg("port"), bp::arg("family") = AF_INET))
 	;
 
@@ -798,6 +1235,11 @@ BOOST_PYTHON_MODULE(elliptics) {
 		.def("read_data", &elliptics_session::read_data_by_data_transform,
 			(bp::arg("key"), bp::arg("offset") = 0, bp::arg("size") = 0, bp::arg("column") = 0))
 
+		.def("read_data_async", &elliptics_session::read_data_async_by_id,
+			(bp::arg("key"), bp::arg("offset") = 0, bp::arg("size") = 0))
+		.def("read_data_async", &elliptics_session::read_data_async_by_data_transform,
+			(bp::arg("key"), bp::arg("offset") = 0, bp::arg("size") = 0, bp::arg("column") = 0))
+
 		.def("prepare_latest", &elliptics_session::prepare_latest_by_id)
 		.def("prepare_latest_str", &elliptics_session::prepare_latest_by_id_str)
 
@@ -811,6 +1253,11 @@ BOOST_PYTHON_MODULE(elliptics) {
 		.def("write_data", &elliptics_session::write_data_by_data_transform,
 			(bp::arg("key"), bp::arg("data"), bp::arg("offset") = 0, bp::arg("column") = 0))
 
+		.def("write_data_async", &elliptics_session::write_data_async_by_id,
+			(bp::arg("key"), bp::arg("data"), bp::arg("offset") = 0))
+		.def("write_data_async", &elliptics_session::write_data_async_by_data_transform,
+			(bp::arg("key"), bp::arg("data"), bp::arg("offset") = 0, bp::arg("column") = 0))
+
 		.def("write_metadata", &elliptics_session::write_metadata_by_id)
 		.def("write_metadata", &elliptics_session::write_metadata_by_data_transform)
 
@@ -823,6 +1270,9 @@ BOOST_PYTHON_MODULE(elliptics) {
 		.def("lookup", &elliptics_session::lookup_by_data_transform)
 		.def("lookup", &elliptics_session::lookup_by_id)
 
+		.def("lookup_async", &elliptics_session::lookup_async_by_data_transform)
+		.def("lookup_async", &elliptics_session::lookup_async_by_id)
+
 		.def("update_status", &elliptics_session::update_status_by_id)
 		.def("update_status", &elliptics_session::update_status_by_string)
 
@@ -840,6 +1290,9 @@ BOOST_PYTHON_MODULE(elliptics) {
 		.def("remove", &elliptics_session::remove_by_id)
 		.def("remove", &elliptics_session::remove_by_name)
 
+		.def("remove_async", &elliptics_session::remove_async_by_id)
+		.def("remove_async", &elliptics_session::remove_async_by_name)
+
 		.def("bulk_read", &elliptics_session::bulk_read_by_name,
 			(bp::arg("keys"), bp::arg("raw") = false))
 	;
@@ -866,6 +1319,25 @@ BOOST_PYTHON_MODULE(elliptics) {
 		.value("cache_remove_from_disk", ioflags_cache_remove_from_disk)
 	;
 
+	bp::enum_<elliptics_iterator_flags>("iterator_flags")
+		.value("default", iterator_flags_default)
+		.value("data", iterator_flags_data)
+		.value("key_range", iterator_flags_key_range)
+		.value("ts_range", iterator_flags_ts_range)
+	;
+
+	bp::enum_<elliptics_iterator_types>("iterator_types")
+		.value("disk", iterator_types_disk)
+		.value("network", iterator_types_network)
+	;
+
+	bp::enum_<elliptics_iterator_actions>("iterator_actions")
+		.value("start", iterator_actions_start)
+		.value("pause", iterator_actions_pause)
+		.value("continue_", iterator_actions_continue)
+		.value("cancel", iterator_actions_cancel)
+	;
+
 	bp::enum_<elliptics_log_level>("log_level")
 		.value("data", log_level_data)
 		.value("error", log_level_error)
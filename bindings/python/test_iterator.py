@@ -27,6 +27,8 @@ try:
 		request = elliptics.IteratorRequest()
 		request.key = [1, 2, 3, 4]
 		request.end = [4, 3, 2, 1]
+		request.itype = elliptics.iterator_types.network
+		request.flags = elliptics.iterator_flags.key_range
 
 		iterator = s.start_iterator(id, request)
 		for result in iterator:
@@ -34,7 +36,8 @@ try:
 				if result.status() != 0:
 					print "error: ", result.status()
 				else:
-					print result.reply_data()
+					reply = result.reply()
+					print reply.id, binascii.hexlify(bytearray(reply.key)), reply.size
 			except Exception as e:
 				print "Invalid element"
 	except Exception as e:
@@ -66,7 +66,7 @@ struct equal_to {
 
 class raw_data_t {
 	public:
-		raw_data_t(const char *data, size_t size) {
+		raw_data_t(const char *data, size_t size) : m_csum_valid(false) {
 			m_data.reserve(size);
 			m_data.insert(m_data.begin(), data, data + size);
 		}
@@ -79,8 +79,28 @@ class raw_data_t {
 			return m_data.size();
 		}
 
+		/*
+		 * Cached data is never modified in place (write replaces the whole entry),
+		 * so its checksum is calculated once and reused by subsequent CAS writes.
+		 * CAS parent is always SHA-512, so id transform is used whatever checksum engine node has.
+		 */
+		void checksum(struct dnet_node *n, unsigned char *csum, int csize) {
+			boost::mutex::scoped_lock guard(m_csum_lock);
+
+			if (!m_csum_valid) {
+				dnet_transform_node(n, m_data.data(), m_data.size(), m_csum, sizeof(m_csum));
+				m_csum_valid = true;
+			}
+
+			memcpy(csum, m_csum, std::min<int>(csize, sizeof(m_csum)));
+		}
+
 	private:
 		std::vector<char> m_data;
+
+		boost::mutex m_csum_lock;
+		bool m_csum_valid;
+		unsigned char m_csum[DNET_CSUM_SIZE];
 };
 
 struct data_lru_tag_t;
@@ -342,7 +362,7 @@ int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dn
 						d = cache->read(io->id);
 
 						struct dnet_raw_id csum;
-						dnet_transform_node(n, d->data().data(), d->data().size(), csum.id, sizeof(csum.id));
+						d->checksum(n, csum.id, sizeof(csum.id));
 
 						if (memcmp(csum.id, io->parent, DNET_ID_SIZE)) {
 							dnet_log(n, DNET_LOG_ERROR, "%s: cas: cache checksum mismatch\n", dnet_dump_id(&cmd->id));
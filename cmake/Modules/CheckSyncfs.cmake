@@ -0,0 +1,19 @@
+# Check whether syncfs() is supported
+
+include(CheckCSourceCompiles)
+
+if (UNIX OR MINGW)
+    SET(CMAKE_REQUIRED_DEFINITIONS -Werror-implicit-function-declaration -D_GNU_SOURCE)
+endif()
+
+check_c_source_compiles("#include <unistd.h>
+int main()
+{
+    return syncfs(0);
+}" HAVE_SYNCFS_SUPPORT)
+unset(CMAKE_REQUIRED_DEFINITIONS)
+
+if(HAVE_SYNCFS_SUPPORT)
+    add_definitions(-DHAVE_SYNCFS_SUPPORT=1)
+endif()
+message(STATUS "Syncfs support: ${HAVE_SYNCFS_SUPPORT}")
@@ -81,7 +81,8 @@ elliptics_storage_t::elliptics_storage_t(context_t& context,
     m_log(new log_t(context, name)),
     m_log_adapter(m_log, args.get("verbosity", DNET_LOG_ERROR).asUInt()),
     m_node(m_log_adapter),
-    m_session(m_node)
+    m_session(m_node),
+    m_inline_metadata(args.get("inline-metadata", false).asBool())
 {
     Json::Value nodes(args["nodes"]);
 
@@ -175,91 +176,172 @@ elliptics_storage_t::write(const std::string& collection,
             dnet_id
         );
 
-        // Write the blob.
-        m_session.write_data(dnet_id, blob, 0);
+        if(m_inline_metadata) {
+            // Write the blob and its metadata within a single request.
+            m_session.write_data(
+                dnet_id,
+                blob,
+                0,
+                m_session.create_metadata(dnet_id, id(collection, key), m_groups, ts)
+            ).wait();
+        } else {
+            // Write the blob.
+            m_session.write_data(dnet_id, blob, 0);
+
+            // Write the blob metadata.
+            m_session.write_metadata(
+                dnet_id,
+                id(collection, key),
+                m_groups,
+                ts
+            );
+        }
 
-        // Write the blob metadata.
-        m_session.write_metadata(
-            dnet_id,
+        // Add the key to the collection index. The index owner inserts it
+        // into the right page, so the cost doesn't depend on the collection size.
+        m_session.update_indexes(
             id(collection, key),
-            m_groups,
-            ts
+            std::vector<ioremap::elliptics::index_entry>(1, entry(collection, key))
         );
+    } catch(const ioremap::elliptics::error& e) {
+        throw storage_error_t(e.what());
+    }
+}
 
-        // Check if the key already exists in the collection.
-        std::vector<std::string> keylist(
-            list(collection)
-        );
+std::vector<std::string>
+elliptics_storage_t::list(const std::string& collection) {
+    // Keys are fetched page by page in the index order.
+    const unsigned int limit = 1024;
 
-        if(std::find(keylist.begin(), keylist.end(), key) == keylist.end()) {
-            msgpack::sbuffer buffer;
-            std::string object;
+    std::vector<std::string> result;
+    struct dnet_raw_id start;
 
-            keylist.push_back(key);
-            msgpack::pack(&buffer, keylist);
+    memset(&start, 0, sizeof(struct dnet_raw_id));
 
-            object.assign(
-                buffer.data(),
-                buffer.size()
-            );
+    migrate(collection);
 
-            // Generate the collection object key.
-            m_session.transform(
-                id("system", "list:" + collection),
-                dnet_id
+    try {
+        while(true) {
+            ioremap::elliptics::read_index_result page(
+                m_session.read_index(index(collection), start, limit)
             );
 
-            // Update the collection object.
-            m_session.write_data(dnet_id, object, 0);
+            const std::vector<ioremap::elliptics::index_entry>& entries(page);
 
-            // Update the collection object metadata.
-            m_session.write_metadata(
-                dnet_id,
-                id("system", "list:" + collection),
-                m_groups,
-                ts
-            );
+            for(std::vector<ioremap::elliptics::index_entry>::const_iterator it = entries.begin();
+                it != entries.end();
+                ++it)
+            {
+                result.push_back(it->data.to_string());
+            }
+
+            if(entries.size() < limit) {
+                break;
+            }
+
+            // Continue right after the last returned key.
+            start = entries.back().index;
+
+            int i = DNET_ID_SIZE - 1;
+
+            while(i >= 0 && ++start.id[i] == 0) {
+                --i;
+            }
+
+            if(i < 0) {
+                break;
+            }
         }
     } catch(const ioremap::elliptics::error& e) {
-        throw storage_error_t(e.what());
+        // There is no index for an empty collection.
+        if(e.error_code() != -ENOENT) {
+            throw storage_error_t(e.what());
+        }
     }
+
+    return result;
 }
 
-std::vector<std::string>
-elliptics_storage_t::list(const std::string& collection) {
-    std::vector<std::string> result;
+ioremap::elliptics::index_entry
+elliptics_storage_t::entry(const std::string& collection,
+                           const std::string& key)
+{
+    ioremap::elliptics::index_entry result;
+    struct dnet_id dnet_id;
+
+    memset(&dnet_id, 0, sizeof(struct dnet_id));
+
+    m_session.transform(index(collection), dnet_id);
+    memcpy(result.index.id, dnet_id.id, DNET_ID_SIZE);
+
+    result.data = ioremap::elliptics::data_pointer::copy(key.data(), key.size());
+
+    return result;
+}
+
+void
+elliptics_storage_t::migrate(const std::string& collection) {
+    std::vector<std::string> keylist;
     std::string blob;
 
+    // Collections written before the index was introduced keep their keys
+    // in a single msgpack list, move them into the index once.
     try {
         blob = m_session.read_data(id("system", "list:" + collection), 0, 0).get_one().file().to_string();
     } catch(const ioremap::elliptics::error& e) {
-        return result;
+        // Only a missing list means there is nothing to move, otherwise
+        // the collection would be listed without its old keys.
+        if(e.error_code() != -ENOENT) {
+            throw storage_error_t(e.what());
+        }
+
+        return;
     }
 
     msgpack::unpacked unpacked;
 
     try {
         msgpack::unpack(&unpacked, blob.data(), blob.size());
-        unpacked.get().convert(&result);
+        unpacked.get().convert(&keylist);
     } catch(const msgpack::unpack_error& e) {
         throw storage_error_t("the collection metadata is corrupted");
     } catch(const msgpack::type_error& e) {
         throw storage_error_t("the collection metadata is corrupted");
     }
 
-    return result;
+    COCAINE_LOG_INFO(
+        m_log,
+        "moving %d keys of the '%s' collection into the index",
+        keylist.size(),
+        collection
+    );
+
+    std::vector<
+        std::pair<ioremap::elliptics::key, std::vector<ioremap::elliptics::index_entry>>
+    > objects;
+
+    for(std::vector<std::string>::const_iterator it = keylist.begin();
+        it != keylist.end();
+        ++it)
+    {
+        objects.push_back(std::make_pair(
+            ioremap::elliptics::key(id(collection, *it)),
+            std::vector<ioremap::elliptics::index_entry>(1, entry(collection, *it))
+        ));
+    }
+
+    try {
+        m_session.update_indexes(objects);
+        m_session.remove(id("system", "list:" + collection));
+    } catch(const ioremap::elliptics::error& e) {
+        throw storage_error_t(e.what());
+    }
 }
 
 void
 elliptics_storage_t::remove(const std::string& collection,
                             const std::string& key)
 {
-    struct dnet_id dnet_id;
-    struct timespec ts = { 0, 0 };
-
-    // NOTE: Elliptcs does not initialize the contents of the keys.
-    memset(&dnet_id, 0, sizeof(struct dnet_id));
-
     COCAINE_LOG_DEBUG(
         m_log,
         "removing the '%s' object, collection: '%s'",
@@ -268,37 +350,12 @@ elliptics_storage_t::remove(const std::string& collection,
     );
 
     try {
-        std::vector<std::string> keylist(list(collection)),
-                                 updated;
-
-        std::remove_copy(
-            keylist.begin(),
-            keylist.end(),
-            std::back_inserter(updated),
-            key
-        );
-
-        msgpack::sbuffer buffer;
-        std::string object;
-
-        msgpack::pack(&buffer, updated);
-        object.assign(buffer.data(), buffer.size());
+        migrate(collection);
 
-        // Generate the collection object key.
-        m_session.transform(
-            id("system", "list:" + collection),
-            dnet_id
-        );
-
-        // Update the collection object.
-        m_session.write_data(dnet_id, object, 0);
-
-        // Update the collection object metadata.
-        m_session.write_metadata(
-            dnet_id,
-            id("system", "list:" + collection),
-            m_groups,
-            ts
+        // Drop the key from the collection index.
+        m_session.update_indexes(
+            id(collection, key),
+            std::vector<ioremap::elliptics::index_entry>()
         );
 
         // Remove the actual key.
@@ -85,6 +85,17 @@ class elliptics_storage_t:
             return collection + '\0' + key;
         };
 
+        // Name of the secondary index holding the collection keys.
+        std::string index(const std::string& collection)
+        {
+            return id("system", "index:" + collection);
+        };
+
+        ioremap::elliptics::index_entry entry(const std::string& collection,
+                                              const std::string& key);
+
+        void migrate(const std::string& collection);
+
     private:
         context_t& m_context;
         std::shared_ptr<logging::log_t> m_log;
@@ -94,6 +105,9 @@ class elliptics_storage_t:
         ioremap::elliptics::session m_session;
 
         std::vector<int> m_groups;
+
+        // Metadata is sent within the write request, requires servers which support it.
+        bool m_inline_metadata;
 };
 
 }}
@@ -0,0 +1,849 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+
+#include <elliptics/cppdef.h>
+
+using namespace ioremap::elliptics;
+
+/*
+ * Operations the benchmark knows about, their weights are set by -M option.
+ */
+enum bench_op {
+	BENCH_READ = 0,
+	BENCH_WRITE,
+	BENCH_LOOKUP,
+	BENCH_BULK_READ,
+	BENCH_RANGE,
+	BENCH_CACHE_WRITE,
+	BENCH_CACHE_READ,
+	BENCH_INDEX_UPDATE,
+	BENCH_INDEX_FIND,
+	BENCH_OP_MAX
+};
+
+static const char *bench_op_names[BENCH_OP_MAX] = {
+	"read",
+	"write",
+	"lookup",
+	"bulk_read",
+	"range",
+	"cache_write",
+	"cache_read",
+	"index_update",
+	"index_find",
+};
+
+static std::atomic<int> bench_stop;
+
+static void bench_signal(int signo __attribute__ ((unused)))
+{
+	bench_stop = 1;
+}
+
+static void dnet_usage(char *p)
+{
+	fprintf(stderr, "Usage: %s\n"
+			" -r addr:port:family  - adds a route to the given node\n"
+			" -g groups            - group IDs to connect\n"
+			" -S config            - start local dnet_ioserv with given config before benchmark,\n"
+			"                        can be repeated, backend (file, eblob, leveldb) is taken from config\n"
+			" -E path              - dnet_ioserv binary used by -S. Default: dnet_ioserv\n"
+			" -D seconds           - time to wait for started servers. Default: 2\n"
+			" -M mix               - operation weights, for example: read=80,write=15,lookup=5\n"
+			"                        operations: read, write, lookup, bulk_read, range, cache_write,\n"
+			"                        cache_read, index_update, index_find. Default: read=50,write=50\n"
+			" -s size              - object size in bytes, either fixed (4096) or uniform range (1024-65536)\n"
+			" -k keys              - number of distinct keys. Default: 10000\n"
+			" -z theta             - zipfian key distribution with given skew (0 < theta < 1).\n"
+			"                        Default: uniform distribution\n"
+			" -T threads           - number of concurrent clients. Default: 1\n"
+			" -t seconds           - benchmark duration. Default: 10\n"
+			" -n ops               - stop after given number of operations\n"
+			" -b keys              - number of keys per bulk read. Default: 16\n"
+			" -R num               - maximum number of keys returned by range request. Default: 16\n"
+			" -x indexes           - number of distinct indexes used by index operations. Default: 16\n"
+			" -P                   - write every key once before benchmark starts\n"
+			" -N namespace         - use this namespace for operations\n"
+			" -i flags             - IO flags (see DNET_IO_FLAGS_* in include/elliptics/packet.h\n"
+			" -C flags             - command flags\n"
+			" -w timeout           - wait timeout in seconds\n"
+			" -l log               - log file. Default: /dev/stderr\n"
+			" -m level             - log level\n"
+			"\n"
+			"Results are printed to stdout as JSON object, latencies are in microseconds.\n"
+			, p);
+}
+
+static std::vector<int> parse_groups(char *value)
+{
+	std::vector<int> result;
+	bool finished = false;
+	while (!finished && value && *value) {
+		char *delimiter = const_cast<char *>(strchrnul(value, DNET_CONF_ADDR_DELIM));
+		finished = !*delimiter;
+		*delimiter = '\0';
+		if (delimiter - value > 0)
+			result.push_back(atoi(value));
+		value = delimiter + 1;
+	}
+	return result;
+}
+
+static int parse_mix(char *value, unsigned int *weights)
+{
+	char *token, *saveptr;
+
+	memset(weights, 0, sizeof(unsigned int) * BENCH_OP_MAX);
+
+	for (token = strtok_r(value, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+		char *eq = strchr(token, '=');
+		unsigned int weight = 1;
+		int i;
+
+		if (eq) {
+			*eq = '\0';
+			weight = atoi(eq + 1);
+		}
+
+		for (i = 0; i < BENCH_OP_MAX; ++i) {
+			if (!strcmp(token, bench_op_names[i])) {
+				weights[i] = weight;
+				break;
+			}
+		}
+
+		if (i == BENCH_OP_MAX) {
+			fprintf(stderr, "Unknown operation '%s' in mix\n", token);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static inline uint64_t bench_now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Zipfian generator from Gray et al, "Quickly generating billion-record
+ * synthetic databases". Rank 0 is the hottest key, keys are hashed
+ * into ids anyway, so hot keys are spread over the whole ring.
+ */
+class zipf_generator
+{
+	public:
+		zipf_generator(uint64_t num, double theta) : m_num(num), m_theta(theta)
+		{
+			double zeta2 = zeta(2);
+
+			m_zetan = zeta(num);
+			m_alpha = 1.0 / (1.0 - theta);
+			m_eta = (1.0 - pow(2.0 / num, 1.0 - theta)) / (1.0 - zeta2 / m_zetan);
+			m_half_pow = 1.0 + pow(0.5, theta);
+		}
+
+		template <typename G>
+		uint64_t operator() (G &gen) const
+		{
+			double u = std::generate_canonical<double, 53>(gen);
+			double uz = u * m_zetan;
+			uint64_t ret;
+
+			if (uz < 1.0)
+				return 0;
+			if (uz < m_half_pow)
+				return 1;
+
+			ret = m_num * pow(m_eta * u - m_eta + 1.0, m_alpha);
+			return ret < m_num ? ret : m_num - 1;
+		}
+
+	private:
+		uint64_t	m_num;
+		double		m_theta;
+		double		m_zetan, m_alpha, m_eta, m_half_pow;
+
+		double zeta(uint64_t n) const
+		{
+			double sum = 0;
+
+			for (uint64_t i = 1; i <= n; ++i)
+				sum += 1.0 / pow(i, m_theta);
+			return sum;
+		}
+};
+
+/*
+ * Log-linear latency histogram: values below BENCH_HIST_SUB are stored
+ * exactly, every larger power of two is split into BENCH_HIST_SUB / 2
+ * buckets, which gives about 6% relative error. It has fixed size,
+ * so the benchmark may run for any time without storing every sample.
+ */
+#define BENCH_HIST_SUB_BITS	5
+#define BENCH_HIST_SUB		(1 << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_SIZE		(BENCH_HIST_SUB + (64 - BENCH_HIST_SUB_BITS + 1) * (BENCH_HIST_SUB / 2))
+
+struct bench_stat
+{
+	bench_stat() : ops(0), errors(0), bytes(0), total(0), min(~0ULL), max(0), hist(BENCH_HIST_SIZE, 0)
+	{
+	}
+
+	static int bucket(uint64_t value)
+	{
+		int shift;
+
+		if (value < BENCH_HIST_SUB)
+			return value;
+
+		shift = 63 - __builtin_clzll(value) - BENCH_HIST_SUB_BITS + 1;
+		return BENCH_HIST_SUB + (shift - 1) * (BENCH_HIST_SUB / 2) +
+			(value >> shift) - BENCH_HIST_SUB / 2;
+	}
+
+	/* upper bound of the values accounted in bucket @idx */
+	static uint64_t bucket_value(int idx)
+	{
+		int shift;
+		uint64_t top;
+
+		if (idx < BENCH_HIST_SUB)
+			return idx;
+
+		idx -= BENCH_HIST_SUB;
+		shift = idx / (BENCH_HIST_SUB / 2) + 1;
+		top = idx % (BENCH_HIST_SUB / 2) + BENCH_HIST_SUB / 2;
+
+		return ((top + 1) << shift) - 1;
+	}
+
+	void add(uint64_t usec, int err, uint64_t size)
+	{
+		ops++;
+		if (err) {
+			errors++;
+		} else {
+			bytes += size;
+		}
+
+		total += usec;
+		if (usec < min)
+			min = usec;
+		if (usec > max)
+			max = usec;
+		hist[bucket(usec)]++;
+	}
+
+	void merge(const bench_stat &other)
+	{
+		ops += other.ops;
+		errors += other.errors;
+		bytes += other.bytes;
+		total += other.total;
+		if (other.min < min)
+			min = other.min;
+		if (other.max > max)
+			max = other.max;
+		for (size_t i = 0; i < hist.size(); ++i)
+			hist[i] += other.hist[i];
+	}
+
+	uint64_t percentile(double p) const
+	{
+		uint64_t target = ceil(ops * p), seen = 0;
+
+		if (!target)
+			target = 1;
+
+		for (size_t i = 0; i < hist.size(); ++i) {
+			seen += hist[i];
+			if (seen >= target)
+				return std::min(bucket_value(i), max);
+		}
+
+		return max;
+	}
+
+	uint64_t		ops, errors, bytes;
+	uint64_t		total, min, max;
+	std::vector<uint64_t>	hist;
+};
+
+struct bench_config
+{
+	bench_config() : weights_total(0), size_min(4096), size_max(4096),
+		keys(10000), theta(0), zipf(NULL), threads(1), duration(10), max_ops(0),
+		bulk_num(16), range_num(16), indexes(16), ioflags(0), cflags(0),
+		ns(NULL), nsize(0)
+	{
+		memset(weights, 0, sizeof(weights));
+		weights[BENCH_READ] = 50;
+		weights[BENCH_WRITE] = 50;
+	}
+
+	unsigned int		weights[BENCH_OP_MAX];
+	unsigned int		weights_total;
+	uint64_t		size_min, size_max;
+	uint64_t		keys;
+	double			theta;
+	zipf_generator		*zipf;
+	int			threads;
+	int			duration;
+	uint64_t		max_ops;
+	int			bulk_num;
+	int			range_num;
+	int			indexes;
+	uint64_t		ioflags, cflags;
+	char			*ns;
+	int			nsize;
+	std::vector<int>	groups;
+	data_pointer		payload;
+	std::atomic<uint64_t>	issued;
+};
+
+class bench_worker
+{
+	public:
+		bench_worker(node &n, bench_config &cfg, int idx) :
+			m_sess(n), m_cfg(cfg), m_gen(time(NULL) ^ (idx * 0x9e3779b97f4a7c15ULL)),
+			m_stats(BENCH_OP_MAX)
+		{
+			m_sess.set_groups(cfg.groups);
+			m_sess.set_cflags(cfg.cflags);
+			m_sess.set_ioflags(cfg.ioflags);
+			m_sess.set_namespace(cfg.ns, cfg.nsize);
+			m_sess.set_exceptions_policy(session::no_exceptions);
+		}
+
+		void prefill(uint64_t start, uint64_t step)
+		{
+			for (uint64_t i = start; i < m_cfg.keys && !bench_stop; i += step)
+				do_write(key_name(i), 0);
+		}
+
+		void run()
+		{
+			while (!bench_stop) {
+				if (m_cfg.max_ops && m_cfg.issued.fetch_add(1) >= m_cfg.max_ops)
+					break;
+
+				int op = next_op();
+				uint64_t size = 0;
+				uint64_t start = bench_now_usec();
+				int err = process(op, size);
+
+				m_stats[op].add(bench_now_usec() - start, err, size);
+			}
+		}
+
+		const std::vector<bench_stat> &stats() const
+		{
+			return m_stats;
+		}
+
+	private:
+		session				m_sess;
+		bench_config			&m_cfg;
+		std::mt19937_64			m_gen;
+		std::vector<bench_stat>		m_stats;
+
+		int next_op()
+		{
+			unsigned int w = std::uniform_int_distribution<unsigned int>(0, m_cfg.weights_total - 1)(m_gen);
+
+			for (int i = 0; i < BENCH_OP_MAX; ++i) {
+				if (w < m_cfg.weights[i])
+					return i;
+				w -= m_cfg.weights[i];
+			}
+
+			return BENCH_READ;
+		}
+
+		uint64_t next_key()
+		{
+			if (m_cfg.zipf)
+				return (*m_cfg.zipf)(m_gen);
+
+			return std::uniform_int_distribution<uint64_t>(0, m_cfg.keys - 1)(m_gen);
+		}
+
+		uint64_t next_size()
+		{
+			if (m_cfg.size_min == m_cfg.size_max)
+				return m_cfg.size_min;
+
+			return std::uniform_int_distribution<uint64_t>(m_cfg.size_min, m_cfg.size_max)(m_gen);
+		}
+
+		std::string key_name(uint64_t k)
+		{
+			char name[64];
+
+			snprintf(name, sizeof(name), "bench-%llu", (unsigned long long)k);
+			return name;
+		}
+
+		std::string index_name(int i)
+		{
+			char name[64];
+
+			snprintf(name, sizeof(name), "bench-index-%d", i);
+			return name;
+		}
+
+		static uint64_t entry_size(const callback_result_entry &entry)
+		{
+			return entry.size();
+		}
+
+		static uint64_t entry_size(const read_result_entry &entry)
+		{
+			return entry.file().size();
+		}
+
+		template <typename T>
+		int wait_result(async_result<T> &result, uint64_t &size)
+		{
+			std::vector<T> entries = result.get();
+
+			if (result.error())
+				return result.error().code();
+
+			for (auto it = entries.begin(); it != entries.end(); ++it)
+				size += entry_size(*it);
+			return 0;
+		}
+
+		int do_write(const std::string &name, uint64_t *size)
+		{
+			uint64_t sz = next_size();
+			async_write_result result = m_sess.write_data(name, data_pointer::from_raw(m_cfg.payload.data(), sz), 0);
+			uint64_t tmp = 0;
+			int err = wait_result(result, tmp);
+
+			if (size)
+				*size = sz;
+			return err;
+		}
+
+		int process(int op, uint64_t &size)
+		{
+			switch (op) {
+			case BENCH_READ: {
+				async_read_result result = m_sess.read_data(key_name(next_key()), 0, 0);
+				return wait_result(result, size);
+			}
+			case BENCH_WRITE:
+				return do_write(key_name(next_key()), &size);
+			case BENCH_LOOKUP: {
+				async_lookup_result result = m_sess.lookup(key_name(next_key()));
+				return wait_result(result, size);
+			}
+			case BENCH_BULK_READ: {
+				std::vector<std::string> keys;
+
+				for (int i = 0; i < m_cfg.bulk_num; ++i)
+					keys.push_back(key_name(next_key()));
+
+				async_read_result result = m_sess.bulk_read(keys);
+				return wait_result(result, size);
+			}
+			case BENCH_RANGE: {
+				struct dnet_io_attr io;
+				struct dnet_id id;
+
+				memset(&io, 0, sizeof(io));
+				m_sess.transform(key_name(next_key()), id);
+				memcpy(io.id, id.id, DNET_ID_SIZE);
+				memset(io.parent, 0xff, DNET_ID_SIZE);
+				io.num = m_cfg.range_num;
+				io.flags = m_cfg.ioflags;
+
+				int group_id = m_cfg.groups[std::uniform_int_distribution<size_t>(0, m_cfg.groups.size() - 1)(m_gen)];
+				async_read_result result = m_sess.read_data_range(io, group_id);
+				return wait_result(result, size);
+			}
+			case BENCH_CACHE_WRITE: {
+				uint64_t sz = next_size();
+				async_write_result result = m_sess.write_cache(key_name(next_key()),
+						data_pointer::from_raw(m_cfg.payload.data(), sz), 0);
+				uint64_t tmp = 0;
+				int err = wait_result(result, tmp);
+
+				size = sz;
+				return err;
+			}
+			case BENCH_CACHE_READ: {
+				m_sess.set_ioflags(m_cfg.ioflags | DNET_IO_FLAGS_CACHE | DNET_IO_FLAGS_CACHE_ONLY);
+				async_read_result result = m_sess.read_data(key_name(next_key()), 0, 0);
+				int err = wait_result(result, size);
+
+				m_sess.set_ioflags(m_cfg.ioflags);
+				return err;
+			}
+			case BENCH_INDEX_UPDATE: {
+				std::uniform_int_distribution<int> dist(0, m_cfg.indexes - 1);
+				std::vector<std::string> indexes;
+				std::vector<data_pointer> datas;
+
+				indexes.push_back(index_name(dist(m_gen)));
+				datas.push_back(data_pointer());
+
+				try {
+					m_sess.update_indexes(key_name(next_key()), indexes, datas);
+				} catch (const error &e) {
+					return e.error_code();
+				} catch (const std::bad_alloc &) {
+					return -ENOMEM;
+				}
+				return 0;
+			}
+			case BENCH_INDEX_FIND: {
+				std::vector<std::string> indexes;
+
+				indexes.push_back(index_name(std::uniform_int_distribution<int>(0, m_cfg.indexes - 1)(m_gen)));
+
+				try {
+					std::vector<find_indexes_result_entry> results = m_sess.find_indexes(indexes);
+					size = results.size();
+				} catch (const error &e) {
+					return e.error_code();
+				} catch (const std::bad_alloc &) {
+					return -ENOMEM;
+				}
+				return 0;
+			}
+			}
+
+			return -EINVAL;
+		}
+};
+
+static pid_t bench_start_server(const char *binary, const char *config)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "Failed to fork server for '%s': %s\n", config, strerror(errno));
+		return -errno;
+	}
+
+	if (pid == 0) {
+		execlp(binary, binary, "-c", config, (char *)NULL);
+		fprintf(stderr, "Failed to start '%s -c %s': %s\n", binary, config, strerror(errno));
+		_exit(-1);
+	}
+
+	return pid;
+}
+
+static void bench_stop_servers(const std::vector<pid_t> &servers)
+{
+	for (auto it = servers.begin(); it != servers.end(); ++it)
+		kill(*it, SIGTERM);
+	for (auto it = servers.begin(); it != servers.end(); ++it)
+		waitpid(*it, NULL, 0);
+}
+
+static void bench_print_stat(const char *name, const bench_stat &st, double duration, bool last)
+{
+	printf("\t\t\"%s\": {\"ops\": %llu, \"errors\": %llu, \"ops_per_sec\": %.2f, \"bytes\": %llu, "
+			"\"latency_usec\": {\"min\": %llu, \"avg\": %.2f, \"p50\": %llu, \"p90\": %llu, "
+			"\"p99\": %llu, \"p999\": %llu, \"max\": %llu}}%s\n",
+			name, (unsigned long long)st.ops, (unsigned long long)st.errors,
+			st.ops / duration, (unsigned long long)st.bytes,
+			(unsigned long long)(st.ops ? st.min : 0), st.ops ? (double)st.total / st.ops : 0.0,
+			(unsigned long long)st.percentile(0.5), (unsigned long long)st.percentile(0.9),
+			(unsigned long long)st.percentile(0.99), (unsigned long long)st.percentile(0.999),
+			(unsigned long long)st.max, last ? "" : ",");
+}
+
+int main(int argc, char *argv[])
+{
+	int ch, err = 0;
+	struct dnet_config dcfg;
+	const char *logfile = "/dev/stderr";
+	const char *ioserv = "dnet_ioserv";
+	std::vector<const char *> remotes, configs;
+	std::vector<pid_t> servers;
+	int log_level = DNET_LOG_ERROR;
+	int delay = 2;
+	bool prefill = false;
+	bench_config cfg;
+	sigset_t mask;
+
+	memset(&dcfg, 0, sizeof(struct dnet_config));
+	dcfg.wait_timeout = 60;
+
+	while ((ch = getopt(argc, argv, "r:g:S:E:D:M:s:k:z:T:t:n:b:R:x:PN:i:C:w:l:m:h")) != -1) {
+		switch (ch) {
+			case 'r':
+				remotes.push_back(optarg);
+				break;
+			case 'g':
+				cfg.groups = parse_groups(optarg);
+				break;
+			case 'S':
+				configs.push_back(optarg);
+				break;
+			case 'E':
+				ioserv = optarg;
+				break;
+			case 'D':
+				delay = atoi(optarg);
+				break;
+			case 'M':
+				if (parse_mix(optarg, cfg.weights))
+					return -EINVAL;
+				break;
+			case 's': {
+				char *end;
+
+				cfg.size_min = cfg.size_max = strtoull(optarg, &end, 0);
+				if (*end == '-')
+					cfg.size_max = strtoull(end + 1, NULL, 0);
+				break;
+			}
+			case 'k':
+				cfg.keys = strtoull(optarg, NULL, 0);
+				break;
+			case 'z':
+				cfg.theta = atof(optarg);
+				break;
+			case 'T':
+				cfg.threads = atoi(optarg);
+				break;
+			case 't':
+				cfg.duration = atoi(optarg);
+				break;
+			case 'n':
+				cfg.max_ops = strtoull(optarg, NULL, 0);
+				break;
+			case 'b':
+				cfg.bulk_num = atoi(optarg);
+				break;
+			case 'R':
+				cfg.range_num = atoi(optarg);
+				break;
+			case 'x':
+				cfg.indexes = atoi(optarg);
+				break;
+			case 'P':
+				prefill = true;
+				break;
+			case 'N':
+				cfg.ns = optarg;
+				cfg.nsize = strlen(optarg);
+				break;
+			case 'i':
+				cfg.ioflags = strtoull(optarg, NULL, 0);
+				break;
+			case 'C':
+				cfg.cflags = strtoull(optarg, NULL, 0);
+				break;
+			case 'w':
+				dcfg.check_timeout = dcfg.wait_timeout = atoi(optarg);
+				break;
+			case 'l':
+				logfile = optarg;
+				break;
+			case 'm':
+				log_level = atoi(optarg);
+				break;
+			case 'h':
+			default:
+				dnet_usage(argv[0]);
+				return -1;
+		}
+	}
+
+	for (int i = 0; i < BENCH_OP_MAX; ++i)
+		cfg.weights_total += cfg.weights[i];
+
+	if (!cfg.weights_total || !cfg.keys || cfg.threads <= 0 || cfg.size_max < cfg.size_min ||
+			cfg.bulk_num <= 0 || cfg.indexes <= 0 || cfg.theta < 0 || cfg.theta >= 1) {
+		fprintf(stderr, "Invalid benchmark parameters\n");
+		dnet_usage(argv[0]);
+		return -EINVAL;
+	}
+
+	if (remotes.empty() || cfg.groups.empty()) {
+		fprintf(stderr, "Remote address and groups must be specified\n");
+		dnet_usage(argv[0]);
+		return -EINVAL;
+	}
+
+	if (!cfg.duration && !cfg.max_ops)
+		cfg.duration = 10;
+
+	for (auto it = configs.begin(); it != configs.end(); ++it) {
+		pid_t pid = bench_start_server(ioserv, *it);
+		if (pid < 0) {
+			bench_stop_servers(servers);
+			return pid;
+		}
+		servers.push_back(pid);
+	}
+
+	if (!servers.empty())
+		sleep(delay);
+
+	signal(SIGINT, bench_signal);
+	signal(SIGTERM, bench_signal);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGCHLD);
+	pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+	try {
+		file_logger log(logfile, log_level);
+		node n(log, dcfg);
+		std::vector<std::unique_ptr<bench_worker>> workers;
+		std::vector<std::thread> threads;
+		std::unique_ptr<zipf_generator> zipf;
+		uint64_t start, end;
+		double duration;
+		int connected = 0;
+
+		for (size_t i = 0; i < remotes.size(); ++i) {
+			try {
+				n.add_remote(remotes[i]);
+				connected++;
+			} catch (const error &e) {
+				std::cerr << "Could not connect to " << remotes[i] << ": " << e.what() << std::endl;
+			}
+		}
+
+		if (!connected)
+			throw std::runtime_error("could not connect to any remote node");
+
+		cfg.payload = data_pointer::allocate(cfg.size_max ? cfg.size_max : 1);
+		for (size_t i = 0; i < cfg.payload.size(); ++i)
+			((char *)cfg.payload.data())[i] = rand();
+
+		if (cfg.theta > 0) {
+			zipf.reset(new zipf_generator(cfg.keys, cfg.theta));
+			cfg.zipf = zipf.get();
+		}
+
+		for (int i = 0; i < cfg.threads; ++i)
+			workers.emplace_back(new bench_worker(n, cfg, i));
+
+		if (prefill) {
+			for (int i = 0; i < cfg.threads; ++i)
+				threads.emplace_back(std::bind(&bench_worker::prefill, workers[i].get(), i, cfg.threads));
+			for (auto it = threads.begin(); it != threads.end(); ++it)
+				it->join();
+			threads.clear();
+		}
+
+		cfg.issued = 0;
+		start = bench_now_usec();
+
+		for (int i = 0; i < cfg.threads; ++i)
+			threads.emplace_back(std::bind(&bench_worker::run, workers[i].get()));
+
+		if (cfg.duration) {
+			end = start + cfg.duration * 1000000ULL;
+			while (!bench_stop) {
+				uint64_t now = bench_now_usec();
+				if (now >= end)
+					break;
+				usleep(std::min<uint64_t>(end - now, 100000));
+			}
+			bench_stop = 1;
+		}
+
+		for (auto it = threads.begin(); it != threads.end(); ++it)
+			it->join();
+
+		duration = (bench_now_usec() - start) / 1000000.0;
+		if (duration <= 0)
+			duration = 1e-6;
+
+		std::vector<bench_stat> stats(BENCH_OP_MAX);
+		bench_stat total;
+
+		for (auto it = workers.begin(); it != workers.end(); ++it) {
+			for (int i = 0; i < BENCH_OP_MAX; ++i)
+				stats[i].merge((*it)->stats()[i]);
+		}
+
+		printf("{\n");
+		printf("\t\"duration\": %.3f,\n", duration);
+		printf("\t\"threads\": %d,\n", cfg.threads);
+		printf("\t\"keys\": %llu,\n", (unsigned long long)cfg.keys);
+		printf("\t\"zipf_theta\": %.3f,\n", cfg.theta);
+		printf("\t\"size_min\": %llu,\n", (unsigned long long)cfg.size_min);
+		printf("\t\"size_max\": %llu,\n", (unsigned long long)cfg.size_max);
+		printf("\t\"ops\": {\n");
+
+		int last = -1;
+		for (int i = 0; i < BENCH_OP_MAX; ++i) {
+			if (cfg.weights[i])
+				last = i;
+		}
+
+		for (int i = 0; i < BENCH_OP_MAX; ++i) {
+			if (!cfg.weights[i])
+				continue;
+
+			bench_print_stat(bench_op_names[i], stats[i], duration, i == last);
+			total.merge(stats[i]);
+		}
+		printf("\t},\n");
+
+		printf("\t\"total\": {\n");
+		bench_print_stat("all", total, duration, true);
+		printf("\t}\n");
+		printf("}\n");
+		fflush(stdout);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		err = -EINVAL;
+	}
+
+	bench_stop_servers(servers);
+	return err;
+}
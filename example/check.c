@@ -58,12 +58,14 @@ static void check_usage(char *p)
 			" -M                   - do not check copies in other groups, run only merge check\n"
 			" -R                   - only delete objects marked as REMOVED\n"
 			" -D                   - dry run - do not perform any action, just update counters\n"
+			" -H                   - compare hash trees with replicas and check only differing key ranges\n"
 			" -t timestamp         - only check those objects, which were previously checked BEFORE this time\n"
 			"                          format: year-month-day hours:minutes:seconds like \"2011-01-13 23:15:00\"\n"
 			" -u timestamp         - only check those objects, which were created after this time, format as above\n"
 			" -U timestamp         - only check those objects, which were created before this time, format as above\n"
 			" -g group:group...    - override groups with replicas\n"
 			" -n num               - number of checking threads to start by the server\n"
+			" -W num               - number of bulk check batches in flight to every peer\n"
 			" -f file              - file with list of objects to check\n"
 			" -b num               - start checking for data in blob number <num>\n"
 			" -B num               - number of blobs to check objects in\n"
@@ -205,7 +207,7 @@ int main(int argc, char *argv[])
 
 	r.thread_num = 1;
 
-	while ((ch = getopt(argc, argv, "b:B:DN:f:n:t:u:U:MRm:w:l:dr:g:h")) != -1) {
+	while ((ch = getopt(argc, argv, "b:B:DHN:f:n:W:t:u:U:MRm:w:l:dr:g:h")) != -1) {
 		switch (ch) {
 			case 'b':
 				r.blob_start = atoi(optarg);
@@ -226,6 +228,9 @@ int main(int argc, char *argv[])
 					fprintf(stderr, "You are going to run your recovery process with %d threads, "
 							"this can heavily screw up your system performance.\n", r.thread_num);
 				break;
+			case 'W':
+				r.bulk_window = atoi(optarg);
+				break;
 			case 't':
 				if (!strptime(optarg, "%F %T", &tm)) {
 					fprintf(stderr, "Invalid timestamp string in -t\n");
@@ -256,6 +261,9 @@ int main(int argc, char *argv[])
 			case 'M':
 				r.flags |= DNET_CHECK_MERGE;
 				break;
+			case 'H':
+				r.flags |= DNET_CHECK_MERKLE;
+				break;
 //			case 'F':
 //				r.flags |= DNET_CHECK_FULL;
 //				break;
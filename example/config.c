@@ -118,6 +118,10 @@ static int dnet_simple_set(struct dnet_config_backend *b __unused, char *key, ch
 		dnet_cfg_state.client_prio = value;
 	else if (!strcmp(key, "oplock_num"))
 		dnet_cfg_state.oplock_num = value;
+	else if (!strcmp(key, "merge_bandwidth"))
+		dnet_cfg_state.merge_bandwidth = value;
+	else if (!strcmp(key, "merge_iops"))
+		dnet_cfg_state.merge_iops = value;
 	else
 		return -1;
 
@@ -334,6 +338,19 @@ static int dnet_set_cache_size(struct dnet_config_backend *b __unused, char *key
 	return 0;
 }
 
+static int dnet_set_checksum(struct dnet_config_backend *b __unused, char *key __unused, char *value)
+{
+	int type = dnet_checksum_type_from_name(value);
+
+	if (type < 0) {
+		dnet_backend_log(DNET_LOG_ERROR, "Unsupported checksum type '%s'\n", value);
+		return type;
+	}
+
+	dnet_cfg_state.checksum_type = type;
+	return 0;
+}
+
 static struct dnet_config_entry dnet_cfg_entries[] = {
 	{"mallopt_mmap_threshold", dnet_set_malloc_options},
 	{"log_level", dnet_simple_set},
@@ -359,8 +376,11 @@ static struct dnet_config_entry dnet_cfg_entries[] = {
 	{"server_net_prio", dnet_simple_set},
 	{"client_net_prio", dnet_simple_set},
 	{"oplock_num", dnet_simple_set},
+	{"merge_bandwidth", dnet_simple_set},
+	{"merge_iops", dnet_simple_set},
 	{"srw_config", dnet_set_srw},
 	{"cache_size", dnet_set_cache_size},
+	{"checksum", dnet_set_checksum},
 };
 
 static struct dnet_config_entry *dnet_cur_cfg_entries = dnet_cfg_entries;
@@ -48,41 +48,147 @@
 #endif
 
 
-struct eblob_read_params {
-	int			fd;
-	int			pad;
-	uint64_t		offset;
-};
+/*
+ * Read access pattern detector.
+ *
+ * Reads are tracked per blob data file: every file (hashed by its descriptor) owns
+ * a small set of stream slots, each remembering offset where the next read of its stream
+ * is expected. A read which starts right after a tracked stream continues it, otherwise
+ * it takes over the oldest slot. Streams which continued several times get readahead hints,
+ * reads which do not belong to any stream are dropped from page cache after being sent,
+ * but only on files where random reads dominate.
+ *
+ * Detector is not protected by locks, concurrent updates may only make it less precise.
+ */
+#define EBLOB_RA_FILES			64
+#define EBLOB_RA_STREAMS		4
 
-static int eblob_read_params_compare(const void *p1, const void *p2)
-{
-	const struct eblob_read_params *r1 = p1;
-	const struct eblob_read_params *r2 = p2;
-	int ret;
+/* number of continuations after which stream is considered sequential */
+#define EBLOB_RA_SEQ_HITS		2
 
-	ret = r1->fd - r2->fd;
-	if (ret != 0)
-		return ret;
+/* maximum gap between reads in sequential stream, it covers record headers and alignment */
+#define EBLOB_RA_MAX_GAP		(64 * 1024)
 
-	if (r1->offset > r2->offset)
-		return 1;
-	if (r1->offset < r2->offset)
-		return -1;
+/* per-file read counters are halved when their sum reaches this limit */
+#define EBLOB_RA_DECAY			1024
 
-	return 0;
-}
+struct eblob_ra_stream {
+	uint64_t			next;
+	uint64_t			ra_end;
+	int				hits;
+};
+
+struct eblob_ra_file {
+	int				fd;
+	int				replace;
+	int				seq, random;
+	struct eblob_ra_stream		streams[EBLOB_RA_STREAMS];
+};
 
 struct eblob_backend_config {
 	struct eblob_config		data;
 	struct eblob_backend		*eblob;
 
-	pthread_mutex_t			last_read_lock;
-	int64_t				vm_total;		/* squared in bytes */
-	int				random_access;
-	int				last_read_index;
-	struct eblob_read_params	last_reads[100];
+	uint64_t			readahead_size;
+	struct eblob_ra_file		ra_files[EBLOB_RA_FILES];
+
+	uint64_t			reads_sequential;
+	uint64_t			reads_random;
+	uint64_t			readahead_hints;
+	uint64_t			cache_drops;
 };
 
+static inline void eblob_ra_counter_inc(uint64_t *counter)
+{
+#ifdef HAVE_SYNC_ATOMIC_SUPPORT
+	__sync_add_and_fetch(counter, 1);
+#else
+	(*counter)++;
+#endif
+}
+
+/*
+ * Accounts read of @size bytes at @offset in file @fd, issues readahead hint if read continues
+ * sequential stream and returns on-exit flags for the reply.
+ */
+static int blob_read_detect_pattern(struct eblob_backend_config *c, int fd, uint64_t offset, uint64_t size)
+{
+	struct eblob_ra_file *f = &c->ra_files[(unsigned int)fd % EBLOB_RA_FILES];
+	struct eblob_ra_stream *s, *match = NULL;
+	uint64_t next, end = offset + size;
+	int i, hits = 0;
+
+	if (f->fd != fd) {
+		memset(f->streams, 0, sizeof(f->streams));
+		f->seq = f->random = 0;
+		f->fd = fd;
+	}
+
+	for (i = 0; i < EBLOB_RA_STREAMS; ++i) {
+		s = &f->streams[i];
+
+		next = s->next;
+		if (next && offset >= next && offset - next <= EBLOB_RA_MAX_GAP) {
+			s->next = end;
+			if (s->hits < EBLOB_RA_SEQ_HITS)
+				s->hits++;
+
+			hits = s->hits;
+			match = s;
+			break;
+		}
+	}
+
+	if (f->seq + f->random >= EBLOB_RA_DECAY) {
+		f->seq /= 2;
+		f->random /= 2;
+	}
+
+	if (!match) {
+		s = &f->streams[(unsigned int)(f->replace++) % EBLOB_RA_STREAMS];
+		s->next = end;
+		s->ra_end = 0;
+		s->hits = 0;
+
+		f->random++;
+		eblob_ra_counter_inc(&c->reads_random);
+
+		/* at least 3/4 of recent reads on this file are random */
+		if (f->random * 4 >= (f->seq + f->random) * 3 && f->random >= EBLOB_RA_STREAMS * 4) {
+			eblob_ra_counter_inc(&c->cache_drops);
+			return DNET_IO_REQ_FLAGS_CACHE_FORGET;
+		}
+
+		return 0;
+	}
+
+	f->seq++;
+	if (hits < EBLOB_RA_SEQ_HITS)
+		return 0;
+
+	eblob_ra_counter_inc(&c->reads_sequential);
+
+	if (c->readahead_size && end + c->readahead_size / 2 > match->ra_end) {
+		uint64_t start = match->ra_end > end ? match->ra_end : end;
+
+		match->ra_end = end + c->readahead_size;
+		posix_fadvise(fd, start, match->ra_end - start, POSIX_FADV_WILLNEED);
+		eblob_ra_counter_inc(&c->readahead_hints);
+	}
+
+	return 0;
+}
+
+static void eblob_backend_storage_counters(void *priv, struct dnet_stat_count *counters)
+{
+	struct eblob_backend_config *c = priv;
+
+	counters[DNET_CNTR_READ_SEQUENTIAL].count = c->reads_sequential;
+	counters[DNET_CNTR_READ_RANDOM].count = c->reads_random;
+	counters[DNET_CNTR_READ_AHEAD].count = c->readahead_hints;
+	counters[DNET_CNTR_READ_CACHE_DROP].count = c->cache_drops;
+}
+
 static int blob_write(struct eblob_backend_config *c, void *state __unused, struct dnet_cmd *cmd __unused, void *data)
 {
 	int err;
@@ -259,78 +365,9 @@ static int blob_read(struct eblob_backend_config *c, void *state, struct dnet_cm
 	if (size && last)
 		cmd->flags &= ~DNET_FLAGS_NEED_ACK;
 
-	if (fd >= 0) {
-		struct eblob_read_params *p, *prev;
-		int i;
-
-		pthread_mutex_lock(&c->last_read_lock);
-		p = &c->last_reads[c->last_read_index];
-
-		if (++c->last_read_index >= (int)ARRAY_SIZE(c->last_reads)) {
-			int64_t tmp;
-			int64_t mult = 1;
-			int64_t mean = 0;
-			int old_ra;
-
-			qsort(c->last_reads, ARRAY_SIZE(c->last_reads), sizeof(struct eblob_read_params), eblob_read_params_compare);
-
-			prev = &c->last_reads[0];
-			tmp = prev->offset;
-
-			for (i = 1; i < (int)ARRAY_SIZE(c->last_reads); ++i) {
-				p = &c->last_reads[i];
-
-				if (p->fd != prev->fd)
-					mult++;
-
-				tmp += p->offset * mult;
-				prev = p;
-			}
-
-			/* found mean offset */
-			mean = tmp / ARRAY_SIZE(c->last_reads);
-
-			/* calculating mean squared error */
-			tmp = 0;
-			for (i = 0; i < (int)ARRAY_SIZE(c->last_reads); ++i) {
-				p = &c->last_reads[i];
-
-				tmp += ((int64_t)p->offset - mean) * ((int64_t)p->offset - mean);
-			}
-			tmp /= ARRAY_SIZE(c->last_reads);
-
-			/*
-			 * tmp and vm_total are squared, so if this check is true,
-			 * mean offset difference (error) is more than 25% of RAM
-			 */
-			old_ra = c->random_access;
-			if (tmp > c->vm_total / 16)
-				c->random_access = 1;
-			else
-				c->random_access = 0;
-
-			if (old_ra != c->random_access) {
-				dnet_backend_log(DNET_LOG_ERROR, "EBLOB: switch RA %d -> %d, offset MSE: %llu, squared VM total: %llu\n",
-						old_ra, c->random_access, (unsigned long long)tmp, (unsigned long long)c->vm_total);
-			}
-
-			if (c->random_access) {
-				for (i = 0; i < (int)ARRAY_SIZE(c->last_reads); ++i) {
-					p = &c->last_reads[i];
-					posix_fadvise(p->fd, 0, 0, POSIX_FADV_DONTNEED);
-				}
-			}
-
-			c->last_read_index = 0;
-		}
-
-		p->fd = fd;
-		p->offset = offset;
-		pthread_mutex_unlock(&c->last_read_lock);
-	}
+	if (fd >= 0)
+		on_close = blob_read_detect_pattern(c, fd, offset, size);
 
-	if (c->random_access)
-		on_close = DNET_IO_REQ_FLAGS_CACHE_FORGET;
 	err = dnet_send_read_data(state, cmd, io, read_data, fd, offset, on_close);
 
 	/* free compressed data */
@@ -634,6 +671,54 @@ err_out_exit:
 	return err;
 }
 
+static int eblob_backend_locate(void *priv, struct dnet_id *id,
+		int (* callback)(void *cb_priv, struct dnet_id *id, int fd, uint64_t offset, uint64_t size),
+		void *cb_priv)
+{
+	struct eblob_backend_config *c = priv;
+	struct eblob_backend *b = c->eblob;
+	struct dnet_id tmp;
+	uint64_t offset, size;
+	struct eblob_key key;
+	int *types, types_num, i;
+	int err, fd, ret;
+
+	memcpy(key.id, id->id, EBLOB_ID_SIZE);
+
+	if (id->type == -1) {
+		types_num = eblob_get_types(b, &types);
+		if (types_num < 0) {
+			err = types_num;
+			goto err_out_exit;
+		}
+	} else {
+		types_num = 1;
+		types = &id->type;
+	}
+
+	err = -ENOENT;
+	for (i = 0; i < types_num; ++i) {
+		if (types[i] == EBLOB_TYPE_META)
+			continue;
+
+		ret = eblob_read(b, &key, &fd, &offset, &size, types[i]);
+		if (ret < 0)
+			continue;
+
+		memcpy(&tmp, id, sizeof(struct dnet_id));
+		tmp.type = types[i];
+
+		err = callback(cb_priv, &tmp, fd, offset, size);
+		if (err)
+			break;
+	}
+
+	if (id->type == -1)
+		free(types);
+err_out_exit:
+	return err;
+}
+
 static int blob_file_info(struct eblob_backend_config *c, void *state, struct dnet_cmd *cmd)
 {
 	struct eblob_backend *b = c->eblob;
@@ -701,7 +786,7 @@ static int eblob_backend_checksum(struct dnet_node *n, void *priv, struct dnet_i
 	err = 0;
 	if (!size)
 		memset(csum, 0, *csize);
-	else
+	else if (dnet_meta_read_checksum(n, id->id, size, csum, *csize))
 		err = dnet_checksum_fd(n, fd, offset, size, csum, *csize);
 
 err_out_exit:
@@ -858,6 +943,20 @@ static int dnet_blob_set_blob_size(struct dnet_config_backend *b, char *key, cha
 	return 0;
 }
 
+static int dnet_blob_set_readahead_size(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct eblob_backend_config *c = b->data;
+	uint64_t val = strtoul(value, NULL, 0);
+
+	if (strchr(value, 'M'))
+		val *= 1024*1024;
+	else if (strchr(value, 'K'))
+		val *= 1024;
+
+	c->readahead_size = val;
+	return 0;
+}
+
 static int dnet_blob_set_index_block_size(struct dnet_config_backend *b, char *key __unused, char *value)
 {
 	struct eblob_backend_config *c = b->data;
@@ -954,7 +1053,6 @@ static void eblob_backend_cleanup(void *priv)
 
 	eblob_cleanup(c->eblob);
 
-	pthread_mutex_destroy(&c->last_read_lock);
 	free(c->data.file);
 }
 
@@ -988,10 +1086,34 @@ static int dnet_eblob_db_iterate(struct dnet_iterate_ctl *ctl)
 	return dnet_db_iterate(c->eblob, ctl);
 }
 
+static int eblob_backend_iterator_cb(struct eblob_disk_control *dc, struct eblob_ram_control *rc,
+		void *data, void *priv, void *thread_priv __unused)
+{
+	struct dnet_iterator_ctl *ctl = priv;
+
+	return ctl->callback(ctl->callback_private, (struct dnet_raw_id *)dc->key.id,
+			data, -1, 0, rc->size);
+}
+
+static int eblob_backend_iterator(struct dnet_iterator_ctl *ictl)
+{
+	struct eblob_backend_config *c = ictl->iterator_private;
+	struct eblob_iterate_control ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+
+	ctl.flags = EBLOB_ITERATE_FLAGS_ALL;
+	ctl.priv = ictl;
+	ctl.iterator_cb.iterator = eblob_backend_iterator_cb;
+	ctl.iterator_cb.thread_num = 1;
+	ctl.start_type = ctl.max_type = EBLOB_TYPE_DATA;
+
+	return eblob_iterate(c->eblob, &ctl);
+}
+
 static int dnet_blob_config_init(struct dnet_config_backend *b, struct dnet_config *cfg)
 {
 	struct eblob_backend_config *c = b->data;
-	struct dnet_stat st;
 	int err = 0;
 
 	if (!c->data.file) {
@@ -1002,30 +1124,17 @@ static int dnet_blob_config_init(struct dnet_config_backend *b, struct dnet_conf
 
 	c->data.log = (struct eblob_log *)b->log;
 
-	err = pthread_mutex_init(&c->last_read_lock, NULL);
-	if (err) {
-		err = -err;
-		dnet_backend_log(DNET_LOG_ERROR, "blob: could not create last-read lock: %d.\n", err);
-		goto err_out_exit;
-	}
-
-	memset(&st, 0, sizeof(struct dnet_stat));
-	err = eblob_backend_storage_stat(c, &st);
-	if (err)
-		goto err_out_last_read_lock_destroy;
-
-	c->vm_total = st.vm_total * st.vm_total * 1024 * 1024;
-
 	c->eblob = eblob_init(&c->data);
 	if (!c->eblob) {
 		err = -EINVAL;
-		goto err_out_last_read_lock_destroy;
+		goto err_out_exit;
 	}
 
 	cfg->cb = &b->cb;
 	cfg->storage_size = b->storage_size;
 	cfg->storage_free = b->storage_free;
 	b->cb.storage_stat = eblob_backend_storage_stat;
+	b->cb.storage_counters = eblob_backend_storage_counters;
 
 	b->cb.command_private = c;
 	b->cb.command_handler = eblob_backend_command_handler;
@@ -1038,11 +1147,11 @@ static int dnet_blob_config_init(struct dnet_config_backend *b, struct dnet_conf
 	b->cb.meta_remove = dnet_eblob_db_remove;
 	b->cb.meta_total_elements = dnet_eblob_db_total_elements;
 	b->cb.meta_iterate = dnet_eblob_db_iterate;
+	b->cb.iterator = eblob_backend_iterator;
+	b->cb.locate = eblob_backend_locate;
 
 	return 0;
 
-err_out_last_read_lock_destroy:
-	pthread_mutex_destroy(&c->last_read_lock);
 err_out_exit:
 	return err;
 }
@@ -1068,6 +1177,7 @@ static struct dnet_config_entry dnet_cfg_entries_blobsystem[] = {
 	{"blob_size_limit", dnet_blob_set_blob_size},
 	{"index_block_size", dnet_blob_set_index_block_size},
 	{"index_block_bloom_length", dnet_blob_set_index_block_bloom_length},
+	{"readahead_size", dnet_blob_set_readahead_size},
 };
 
 static struct dnet_config_backend dnet_eblob_backend = {
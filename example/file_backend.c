@@ -13,6 +13,10 @@
  * GNU General Public License for more details.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -22,6 +26,7 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,10 +37,68 @@
 #include "backends.h"
 #include "common.h"
 
+#include "../library/list.h"
+#include "../library/rbtree.h"
+
 #ifndef __unused
 #define __unused	__attribute__ ((unused))
 #endif
 
+/*
+ * Cached open file descriptor.
+ * Entry is referenced by every user and by the cache itself while it is linked into the tree,
+ * descriptor is closed when the last reference is dropped.
+ */
+struct file_backend_fd
+{
+	struct rb_node		fd_entry;
+	struct list_head	lru_entry;
+	struct dnet_raw_id	id;
+	int			fd;
+	int			refcnt;
+	int			cached;
+
+	/* descriptor is opened for writing, read-only ones are replaced when write needs them */
+	int			writable;
+
+	/* file stat taken at open time and refreshed after every write, protected by cache lock */
+	struct stat		st;
+};
+
+struct file_backend_fd_cache
+{
+	pthread_mutex_t		lock;
+	struct rb_root		root;
+	struct list_head	lru_list;
+	int			num, max;
+};
+
+/*
+ * Group commit state.
+ * Every synced write gets a sequence number after its data hit the page cache,
+ * the first writer which finds no flush in progress becomes a leader, waits @delay
+ * microseconds for other writers to join and flushes everything queued so far,
+ * all writers covered by that flush are woken up after it completes.
+ */
+struct file_backend_commit
+{
+	pthread_mutex_t		lock;
+	pthread_cond_t		wait;
+	int			enabled;
+	long			delay;
+	int			in_progress;
+	uint64_t		seq, synced;
+
+	/* writers waiting for their flush, every one gets result of the flush which covered it */
+	struct list_head	waiters;
+
+	/* descriptors to be flushed when syncfs() is not available */
+	int			fd_num, fd_size;
+	int			*fds;
+
+	uint64_t		batches, writes;
+};
+
 struct file_backend_root
 {
 	char			*root;
@@ -44,6 +107,9 @@ struct file_backend_root
 	int			sync;
 	int			bit_num;
 
+	struct file_backend_fd_cache	fd_cache;
+	struct file_backend_commit	commit;
+
 	uint64_t		records_in_blob;
 	uint64_t		blob_size;
 	int			defrag_percentage;
@@ -53,35 +119,59 @@ struct file_backend_root
 	struct eblob_backend	*meta;
 };
 
-static inline void file_backend_setup_file(struct file_backend_root *r, char *file,
-		unsigned int size, const unsigned char *id)
+/* returns first @bit_num bits of the id (big-endian) as integer, @bit_num must not exceed 64 */
+static inline uint64_t file_backend_get_dir_bits(const unsigned char *id, int bit_num)
 {
-	char dir[2*DNET_ID_SIZE+1];
-	char id_str[2*DNET_ID_SIZE+1];
+	uint64_t res = 0;
+	int i, bytes = (bit_num + 7) / 8;
+
+	for (i = 0; i < bytes; ++i)
+		res = (res << 8) | id[i];
 
-	file_backend_get_dir(id, r->bit_num, dir);
-	snprintf(file, size, "%s/%s", dir, dnet_dump_id_len_raw(id, DNET_ID_SIZE, id_str));
+	if (bit_num & 7)
+		res >>= 8 - (bit_num & 7);
+
+	return res;
 }
 
-static inline uint64_t file_backend_get_dir_bits(const unsigned char *id, int bit_num)
+static const char file_backend_hex[] = "0123456789abcdef";
+
+/*
+ * Builds "dir/id" path relative to root directory, where dir is hex representation
+ * of the first @bit_num bits of the id. Result is the same as dumping id and directory
+ * prefix through snprintf(), but without formatting on every request.
+ */
+static inline void file_backend_setup_file(struct file_backend_root *r, char *file,
+		unsigned int size, const unsigned char *id)
 {
-#if 0
-	uint64_t res = *(uint64_t *)id;
+	int dir_len = r->bit_num / 4;
+	uint64_t bits;
+	int i, pos;
 
-	bit_num = 64 - bit_num;
+	if (r->bit_num > 64 || dir_len + 1 + DNET_ID_SIZE * 2 + 1 > (int)size) {
+		char dir[2*DNET_ID_SIZE+1];
+		char id_str[2*DNET_ID_SIZE+1];
 
-	res <<= bit_num;
-	res >>= bit_num;
+		file_backend_get_dir(id, r->bit_num, dir);
+		snprintf(file, size, "%s/%s", dir, dnet_dump_id_len_raw(id, DNET_ID_SIZE, id_str));
+		return;
+	}
 
-	return res;
-#else
-	char sub[DNET_ID_SIZE*2+1];
-	char *res = file_backend_get_dir(id, bit_num, sub);
-	char hex[DNET_ID_SIZE*2 + 1 + 2];
+	bits = file_backend_get_dir_bits(id, r->bit_num);
+	for (i = dir_len - 1; i >= 0; --i) {
+		file[i] = file_backend_hex[bits & 0xf];
+		bits >>= 4;
+	}
 
-	snprintf(hex, sizeof(hex), "0x%s", res);
-	return strtoull(hex, NULL, 16);
-#endif
+	pos = dir_len;
+	file[pos++] = '/';
+
+	for (i = 0; i < DNET_ID_SIZE; ++i) {
+		file[pos++] = file_backend_hex[id[i] >> 4];
+		file[pos++] = file_backend_hex[id[i] & 0xf];
+	}
+
+	file[pos] = '\0';
 }
 
 static void dnet_remove_file_if_empty_raw(char *file)
@@ -102,57 +192,429 @@ static void dnet_remove_file_if_empty(struct file_backend_root *r, struct dnet_i
 	dnet_remove_file_if_empty_raw(file);
 }
 
-static int file_write_raw(struct file_backend_root *r, struct dnet_io_attr *io)
+static struct file_backend_fd *file_backend_fd_search(struct file_backend_fd_cache *c, const unsigned char *id)
 {
-	/* null byte + maximum directory length (32 bits in hex) + '/' directory prefix */
+	struct rb_node *n = c->root.rb_node;
+	struct file_backend_fd *f;
+	int cmp;
+
+	while (n) {
+		f = rb_entry(n, struct file_backend_fd, fd_entry);
+
+		cmp = dnet_id_cmp_str(f->id.id, id);
+		if (cmp < 0)
+			n = n->rb_left;
+		else if (cmp > 0)
+			n = n->rb_right;
+		else
+			return f;
+	}
+
+	return NULL;
+}
+
+static void file_backend_fd_insert(struct file_backend_fd_cache *c, struct file_backend_fd *a)
+{
+	struct rb_node **n = &c->root.rb_node, *parent = NULL;
+	struct file_backend_fd *f;
+	int cmp;
+
+	while (*n) {
+		parent = *n;
+
+		f = rb_entry(parent, struct file_backend_fd, fd_entry);
+
+		cmp = dnet_id_cmp_str(f->id.id, a->id.id);
+		if (cmp < 0)
+			n = &parent->rb_left;
+		else
+			n = &parent->rb_right;
+	}
+
+	rb_link_node(&a->fd_entry, parent, n);
+	rb_insert_color(&a->fd_entry, &c->root);
+
+	list_add(&a->lru_entry, &c->lru_list);
+	a->cached = 1;
+	a->refcnt++;
+	c->num++;
+}
+
+static void file_backend_fd_free(struct file_backend_fd *f)
+{
+	close(f->fd);
+	free(f);
+}
+
+/* must be called with cache lock held, returns entry if it has to be freed */
+static struct file_backend_fd *file_backend_fd_unlink_nolock(struct file_backend_fd_cache *c, struct file_backend_fd *f)
+{
+	if (!f->cached)
+		return NULL;
+
+	rb_erase(&f->fd_entry, &c->root);
+	list_del(&f->lru_entry);
+	f->cached = 0;
+	c->num--;
+
+	if (--f->refcnt == 0)
+		return f;
+	return NULL;
+}
+
+static void file_backend_fd_put(struct file_backend_root *r, struct file_backend_fd *f)
+{
+	struct file_backend_fd_cache *c = &r->fd_cache;
+	int last;
+
+	pthread_mutex_lock(&c->lock);
+	last = (--f->refcnt == 0);
+	pthread_mutex_unlock(&c->lock);
+
+	if (last)
+		file_backend_fd_free(f);
+}
+
+/*
+ * Drops cached descriptor for given id, it must be called when file is removed,
+ * otherwise subsequent writes would go into unlinked inode.
+ */
+static void file_backend_fd_forget(struct file_backend_root *r, const unsigned char *id)
+{
+	struct file_backend_fd_cache *c = &r->fd_cache;
+	struct file_backend_fd *f, *free_f = NULL;
+
+	pthread_mutex_lock(&c->lock);
+	f = file_backend_fd_search(c, id);
+	if (f)
+		free_f = file_backend_fd_unlink_nolock(c, f);
+	pthread_mutex_unlock(&c->lock);
+
+	if (free_f)
+		file_backend_fd_free(free_f);
+}
+
+/*
+ * Returns referenced descriptor for given id, opening (and creating if @oflags has O_CREAT) file if needed.
+ * Readers pass O_RDONLY, so objects on read-only files or mounts stay readable, writers pass O_RDWR,
+ * cached read-only descriptor is replaced with a writable one when write needs it.
+ * When cache is disabled (its size is zero) returned entry is private and file is closed on put.
+ */
+static struct file_backend_fd *file_backend_fd_get(struct file_backend_root *r, const unsigned char *id,
+		int oflags, int *errp)
+{
+	struct file_backend_fd_cache *c = &r->fd_cache;
 	char file[DNET_ID_SIZE * 2 + 8 + 8 + 2];
-	int oflags = O_RDWR | O_CREAT | O_LARGEFILE | O_CLOEXEC;
-	void *data = io + 1;
+	struct file_backend_fd *f, *old, *evicted;
+	struct list_head evict_list;
+	int writable = (oflags & O_ACCMODE) != O_RDONLY;
 	int fd;
-	ssize_t err;
 
-	file_backend_setup_file(r, file, sizeof(file), io->id);
+	if (c->max) {
+		pthread_mutex_lock(&c->lock);
+		f = file_backend_fd_search(c, id);
+		if (f && (f->writable || !writable)) {
+			f->refcnt++;
+			list_move(&f->lru_entry, &c->lru_list);
+			pthread_mutex_unlock(&c->lock);
+			return f;
+		}
+		pthread_mutex_unlock(&c->lock);
+	}
 
-	if (io->flags & DNET_IO_FLAGS_APPEND)
-		oflags |= O_APPEND;
-	else if (!io->offset)
-		oflags |= O_TRUNC;
-	
-	fd = open(file, oflags, 0644);
+	file_backend_setup_file(r, file, sizeof(file), id);
+
+	fd = open(file, oflags | O_LARGEFILE | O_CLOEXEC, 0644);
 	if (fd < 0) {
+		*errp = -errno;
+		return NULL;
+	}
+
+	f = malloc(sizeof(struct file_backend_fd));
+	if (!f) {
+		close(fd);
+		*errp = -ENOMEM;
+		return NULL;
+	}
+
+	memset(f, 0, sizeof(struct file_backend_fd));
+	memcpy(f->id.id, id, DNET_ID_SIZE);
+	f->fd = fd;
+	f->refcnt = 1;
+	f->writable = writable;
+
+	if (fstat(fd, &f->st)) {
+		*errp = -errno;
+		file_backend_fd_free(f);
+		return NULL;
+	}
+
+	if (!c->max)
+		return f;
+
+	INIT_LIST_HEAD(&evict_list);
+
+	pthread_mutex_lock(&c->lock);
+	old = file_backend_fd_search(c, id);
+	if (old && (old->writable || !writable)) {
+		old->refcnt++;
+		list_move(&old->lru_entry, &c->lru_list);
+		pthread_mutex_unlock(&c->lock);
+
+		file_backend_fd_free(f);
+		return old;
+	}
+
+	/* read-only descriptor is dropped from the cache, its current users keep their references */
+	if (old) {
+		old = file_backend_fd_unlink_nolock(c, old);
+		if (old)
+			list_add(&old->lru_entry, &evict_list);
+	}
+
+	file_backend_fd_insert(c, f);
+
+	while (c->num > c->max) {
+		evicted = list_entry(c->lru_list.prev, struct file_backend_fd, lru_entry);
+		evicted = file_backend_fd_unlink_nolock(c, evicted);
+		if (evicted)
+			list_add(&evicted->lru_entry, &evict_list);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	while (!list_empty(&evict_list)) {
+		evicted = list_first_entry(&evict_list, struct file_backend_fd, lru_entry);
+		list_del(&evicted->lru_entry);
+		file_backend_fd_free(evicted);
+	}
+
+	return f;
+}
+
+static void file_backend_fd_get_stat(struct file_backend_root *r, struct file_backend_fd *f, struct stat *st)
+{
+	pthread_mutex_lock(&r->fd_cache.lock);
+	*st = f->st;
+	pthread_mutex_unlock(&r->fd_cache.lock);
+}
+
+static int file_backend_fd_update_stat(struct file_backend_root *r, struct file_backend_fd *f)
+{
+	struct stat st;
+
+	if (fstat(f->fd, &st))
+		return -errno;
+
+	pthread_mutex_lock(&r->fd_cache.lock);
+	f->st = st;
+	pthread_mutex_unlock(&r->fd_cache.lock);
+	return 0;
+}
+
+static void file_backend_fd_cache_cleanup(struct file_backend_fd_cache *c)
+{
+	struct file_backend_fd *f, *tmp;
+
+	list_for_each_entry_safe(f, tmp, &c->lru_list, lru_entry) {
+		f = file_backend_fd_unlink_nolock(c, f);
+		if (f)
+			file_backend_fd_free(f);
+	}
+
+	pthread_mutex_destroy(&c->lock);
+}
+
+static int file_backend_flush(struct file_backend_root *r, int *fds, int fd_num)
+{
+	int err = 0;
+
+#ifdef HAVE_SYNCFS_SUPPORT
+	(void) fds;
+	(void) fd_num;
+
+	if (syncfs(r->rootfd))
 		err = -errno;
+#else
+	int i;
+
+	(void) r;
+
+	for (i = 0; i < fd_num; ++i) {
+		if (fdatasync(fds[i]))
+			err = -errno;
+	}
+#endif
+	return err;
+}
+
+struct file_backend_commit_waiter
+{
+	struct list_head	entry;
+	uint64_t		seq;
+	int			err;
+};
+
+/*
+ * Waits until data written into @fd is durably flushed together with writes from other threads.
+ * Returns error of the flush which covered given write.
+ */
+static int file_backend_commit(struct file_backend_root *r, int fd)
+{
+	struct file_backend_commit *c = &r->commit;
+	struct file_backend_commit_waiter self, *w, *tmp;
+	uint64_t target;
+	int *fds, fd_num;
+	int err;
+
+	pthread_mutex_lock(&c->lock);
+	self.seq = ++c->seq;
+	self.err = 0;
+	list_add_tail(&self.entry, &c->waiters);
+	c->writes++;
+
+#ifndef HAVE_SYNCFS_SUPPORT
+	if (c->fd_num == c->fd_size) {
+		int size = c->fd_size ? c->fd_size * 2 : 64;
+		int *tmp = realloc(c->fds, size * sizeof(int));
+
+		if (!tmp) {
+			list_del(&self.entry);
+			pthread_mutex_unlock(&c->lock);
+			return fsync(fd) ? -errno : 0;
+		}
+
+		c->fds = tmp;
+		c->fd_size = size;
+	}
+	c->fds[c->fd_num++] = fd;
+#else
+	(void) fd;
+#endif
+
+	while (c->synced < self.seq) {
+		if (c->in_progress) {
+			pthread_cond_wait(&c->wait, &c->lock);
+			continue;
+		}
+
+		c->in_progress = 1;
+		pthread_mutex_unlock(&c->lock);
+
+		if (c->delay)
+			usleep(c->delay);
+
+		pthread_mutex_lock(&c->lock);
+		target = c->seq;
+		fds = c->fds;
+		fd_num = c->fd_num;
+		c->fds = NULL;
+		c->fd_num = c->fd_size = 0;
+		pthread_mutex_unlock(&c->lock);
+
+		err = file_backend_flush(r, fds, fd_num);
+		free(fds);
+
+		pthread_mutex_lock(&c->lock);
+		list_for_each_entry_safe(w, tmp, &c->waiters, entry) {
+			if (w->seq > target)
+				continue;
+
+			w->err = err;
+			list_del_init(&w->entry);
+		}
+		c->synced = target;
+		c->in_progress = 0;
+		c->batches++;
+		pthread_cond_broadcast(&c->wait);
+	}
+
+	pthread_mutex_unlock(&c->lock);
+
+	return self.err;
+}
+
+static int file_write_raw(struct file_backend_root *r, struct dnet_io_attr *io, struct file_backend_fd **fp)
+{
+	/* null byte + maximum directory length (32 bits in hex) + '/' directory prefix */
+	char file[DNET_ID_SIZE * 2 + 8 + 8 + 2];
+	void *data = io + 1;
+	struct file_backend_fd *f;
+	uint64_t offset = io->offset;
+	struct stat st;
+	int fd;
+	ssize_t err;
+	int ierr;
+
+	f = file_backend_fd_get(r, io->id, O_RDWR | O_CREAT, &ierr);
+	if (!f) {
+		err = ierr;
+		file_backend_setup_file(r, file, sizeof(file), io->id);
 		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: OPEN: %zd: %s.\n",
 				dnet_dump_id_str(io->id), file, err, strerror(-err));
 		goto err_out_exit;
 	}
+	fd = f->fd;
 
-	err = pwrite(fd, data, io->size, io->offset);
+	if (io->flags & DNET_IO_FLAGS_APPEND) {
+		err = fstat(fd, &st);
+		if (err) {
+			err = -errno;
+			goto err_out_put;
+		}
+
+		offset = st.st_size;
+	}
+
+	err = pwrite(fd, data, io->size, offset);
 	if (err != (ssize_t)io->size) {
 		err = -errno;
+		file_backend_setup_file(r, file, sizeof(file), io->id);
 		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: WRITE: %zd: offset: %llu, size: %llu: %s.\n",
 			dnet_dump_id_str(io->id), file, err,
-			(unsigned long long)io->offset, (unsigned long long)io->size,
+			(unsigned long long)offset, (unsigned long long)io->size,
 			strerror(-err));
-		goto err_out_close;
+		goto err_out_put;
 	}
 
-	if (!r->sync)
-		fsync(fd);
+	/* plain write without offset replaces the whole object */
+	if (!io->offset && !(io->flags & DNET_IO_FLAGS_APPEND)) {
+		err = ftruncate(fd, io->size);
+		if (err) {
+			err = -errno;
+			goto err_out_put;
+		}
+	}
 
-	return fd;
+	err = file_backend_fd_update_stat(r, f);
+	if (err)
+		goto err_out_put;
+
+	if (!r->sync) {
+		if (r->commit.enabled) {
+			err = file_backend_commit(r, fd);
+			if (err)
+				goto err_out_put;
+		} else {
+			fsync(fd);
+		}
+	}
 
-err_out_close:
-	dnet_remove_file_if_empty_raw(file);
-	close(fd);
+	*fp = f;
+	return 0;
+
+err_out_put:
+	file_backend_fd_forget(r, io->id);
+	file_backend_fd_put(r, f);
 err_out_exit:
 	return err;
 }
 
 static int file_write(struct file_backend_root *r, void *state __unused, struct dnet_cmd *cmd, void *data)
 {
-	int err, fd;
+	int err;
 	char dir[2*DNET_ID_SIZE+1];
 	struct dnet_io_attr *io = data;
+	struct file_backend_fd *f;
 
 	dnet_convert_io_attr(io);
 	
@@ -170,24 +632,22 @@ static int file_write(struct file_backend_root *r, void *state __unused, struct
 		}
 	}
 
-	err = file_write_raw(r, io);
+	err = file_write_raw(r, io, &f);
 	if (err < 0)
 		goto err_out_check_remove;
 
-	fd = err;
-
 	dnet_backend_log(DNET_LOG_INFO, "%s: FILE: %s: WRITE: Ok: offset: %llu, size: %llu.\n",
 			dnet_dump_id(&cmd->id), dir, (unsigned long long)io->offset, (unsigned long long)io->size);
-	err = dnet_send_file_info(state, cmd, fd, 0, -1);
+	err = dnet_send_file_info(state, cmd, f->fd, 0, -1);
 	if (err)
-		goto err_out_close;
+		goto err_out_put;
 
-	close(fd);
+	file_backend_fd_put(r, f);
 
 	return 0;
 
-err_out_close:
-	close(fd);
+err_out_put:
+	file_backend_fd_put(r, f);
 err_out_check_remove:
 	dnet_remove_file_if_empty(r, io);
 err_out_exit:
@@ -197,6 +657,7 @@ err_out_exit:
 static int file_read(struct file_backend_root *r, void *state, struct dnet_cmd *cmd, void *data)
 {
 	struct dnet_io_attr *io = data;
+	struct file_backend_fd *f;
 	int fd, err;
 	ssize_t size;
 	char file[DNET_ID_SIZE * 2 + 8 + 8 + 2];
@@ -206,30 +667,40 @@ static int file_read(struct file_backend_root *r, void *state, struct dnet_cmd *
 
 	dnet_convert_io_attr(io);
 
-	file_backend_setup_file(r, file, sizeof(file), io->id);
-
-	fd = open(file, O_RDONLY | O_CLOEXEC, 0644);
-	if (fd < 0) {
-		err = -errno;
+	f = file_backend_fd_get(r, io->id, O_RDONLY, &err);
+	if (!f) {
+		file_backend_setup_file(r, file, sizeof(file), io->id);
 		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: READ: %d: %s.\n",
 				dnet_dump_id(&cmd->id), file, err, strerror(-err));
 		goto err_out_exit;
 	}
 
-	size = io->size;
-
-	err = fstat(fd, &st);
-	if (err) {
-		err = -errno;
-		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: read-stat: %d: %s.\n",
-				dnet_dump_id(&cmd->id), file, err, strerror(-err));
-		goto err_out_close_fd;
-	}
+	file_backend_fd_get_stat(r, f, &st);
 
 	size = dnet_backend_check_get_size(io, st.st_size);
 	if (size <= 0) {
 		err = size;
-		goto err_out_close_fd;
+		goto err_out_put;
+	}
+
+	/*
+	 * Reply is sent asynchronously and closes descriptor when completed,
+	 * so cached descriptor is duplicated, while private one is handed over as is.
+	 */
+	if (r->fd_cache.max) {
+		fd = dup(f->fd);
+		if (fd < 0) {
+			err = -errno;
+			file_backend_setup_file(r, file, sizeof(file), io->id);
+			dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: read-dup: %d: %s.\n",
+					dnet_dump_id(&cmd->id), file, err, strerror(-err));
+			goto err_out_put;
+		}
+
+		file_backend_fd_put(r, f);
+	} else {
+		fd = f->fd;
+		free(f);
 	}
 
 	io->size = size;
@@ -240,6 +711,10 @@ static int file_read(struct file_backend_root *r, void *state, struct dnet_cmd *
 
 err_out_close_fd:
 	close(fd);
+	return err;
+
+err_out_put:
+	file_backend_fd_put(r, f);
 err_out_exit:
 	return err;
 }
@@ -247,13 +722,10 @@ err_out_exit:
 static int file_del(struct file_backend_root *r, void *state __unused, struct dnet_cmd *cmd, void *data __unused)
 {
 	char file[DNET_ID_SIZE * 2 + 2*DNET_ID_SIZE + 2]; /* file + dir + suffix + slash + 0-byte */
-	char dir[2*DNET_ID_SIZE+1];
-	char id[2*DNET_ID_SIZE+1];
 
-	file_backend_get_dir(cmd->id.id, r->bit_num, dir);
+	file_backend_setup_file(r, file, sizeof(file), cmd->id.id);
 
-	snprintf(file, sizeof(file), "%s/%s",
-		dir, dnet_dump_id_len_raw(cmd->id.id, DNET_ID_SIZE, id));
+	file_backend_fd_forget(r, cmd->id.id);
 	remove(file);
 
 	return 0;
@@ -262,32 +734,20 @@ static int file_del(struct file_backend_root *r, void *state __unused, struct dn
 static int file_info(struct file_backend_root *r, void *state, struct dnet_cmd *cmd)
 {
 	char file[DNET_ID_SIZE * 2 + 2*DNET_ID_SIZE + 2]; /* file + dir + suffix + slash + 0-byte */
-	char dir[2*DNET_ID_SIZE+1];
-	char id[2*DNET_ID_SIZE+1];
-	int fd, err;
-
-	file_backend_get_dir(cmd->id.id, r->bit_num, dir);
-
-	snprintf(file, sizeof(file), "%s/%s",
-		dir, dnet_dump_id_len_raw(cmd->id.id, DNET_ID_SIZE, id));
+	struct file_backend_fd *f;
+	int err;
 
-	err = open(file, O_RDONLY | O_CLOEXEC);
-	if (err < 0) {
-		err = -errno;
+	f = file_backend_fd_get(r, cmd->id.id, O_RDONLY, &err);
+	if (!f) {
+		file_backend_setup_file(r, file, sizeof(file), cmd->id.id);
 		dnet_backend_log(DNET_LOG_ERROR, "%s: FILE: %s: info-stat-open-csum: %d: %s.\n",
 			dnet_dump_id(&cmd->id), file, err, strerror(-err));
 		goto err_out_exit;
 	}
-	fd = err;
 
-	err = dnet_send_file_info(state, cmd, fd, 0, -1);
-	if (err)
-		goto err_out_close;
-	
-	err = 0;
+	err = dnet_send_file_info(state, cmd, f->fd, 0, -1);
 
-err_out_close:
-	close(fd);
+	file_backend_fd_put(r, f);
 err_out_exit:
 	return err;
 }
@@ -406,6 +866,34 @@ static int dnet_file_set_sync(struct dnet_config_backend *b, char *key __unused,
 	return 0;
 }
 
+static int dnet_file_set_group_commit(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct file_backend_root *r = b->data;
+
+	r->commit.enabled = atoi(value);
+	return 0;
+}
+
+static int dnet_file_set_group_commit_delay(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct file_backend_root *r = b->data;
+
+	r->commit.delay = strtol(value, NULL, 0);
+	if (r->commit.delay < 0)
+		r->commit.delay = 0;
+	return 0;
+}
+
+static int dnet_file_set_fd_cache_size(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct file_backend_root *r = b->data;
+
+	r->fd_cache.max = atoi(value);
+	if (r->fd_cache.max < 0)
+		r->fd_cache.max = 0;
+	return 0;
+}
+
 static int dnet_file_set_root(struct dnet_config_backend *b, char *key __unused, char *root)
 {
 	struct file_backend_root *r = b->data;
@@ -521,7 +1009,16 @@ static void file_backend_cleanup(void *priv)
 {
 	struct file_backend_root *r = priv;
 
+	if (r->commit.enabled)
+		dnet_backend_log(DNET_LOG_INFO, "FILE: group commit: %llu writes flushed in %llu batches.\n",
+				(unsigned long long)r->commit.writes, (unsigned long long)r->commit.batches);
+
 	dnet_file_db_cleanup(r);
+	file_backend_fd_cache_cleanup(&r->fd_cache);
+	pthread_cond_destroy(&r->commit.wait);
+	pthread_mutex_destroy(&r->commit.lock);
+	free(r->commit.fds);
+	r->commit.fds = NULL;
 	close(r->rootfd);
 	free(r->root);
 }
@@ -559,11 +1056,122 @@ static int dnet_file_db_iterate(struct dnet_iterate_ctl *ctl)
 static int file_backend_checksum(struct dnet_node *n, void *priv, struct dnet_id *id, void *csum, int *csize)
 {
 	struct file_backend_root *r = priv;
-	char file[DNET_ID_SIZE * 2 + 2*DNET_ID_SIZE + 2];
-	/* file + dir + suffix + slash + 0-byte */
+	struct file_backend_fd *f;
+	struct stat st;
+	int err;
 
-	file_backend_setup_file(r, file, sizeof(file), id->id);
-	return dnet_checksum_file(n, file, 0, 0, csum, *csize);
+	f = file_backend_fd_get(r, id->id, O_RDONLY, &err);
+	if (!f)
+		return err;
+
+	file_backend_fd_get_stat(r, f, &st);
+
+	err = dnet_meta_read_checksum(n, id->id, st.st_size, csum, *csize);
+	if (err)
+		err = dnet_checksum_fd(n, f->fd, 0, st.st_size, csum, *csize);
+	file_backend_fd_put(r, f);
+
+	return err;
+}
+
+static int file_backend_iterator_dir(struct file_backend_root *r, struct dnet_iterator_ctl *ctl, const char *dname)
+{
+	struct dnet_raw_id key;
+	struct dirent *d;
+	struct stat st;
+	DIR *dir;
+	int dfd, fd, err = 0;
+
+	dfd = openat(r->rootfd, dname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dfd < 0)
+		return 0;
+
+	dir = fdopendir(dfd);
+	if (!dir) {
+		close(dfd);
+		return 0;
+	}
+
+	while ((d = readdir(dir)) != NULL) {
+		int i;
+
+		if (strlen(d->d_name) != DNET_ID_SIZE * 2)
+			continue;
+
+		for (i = 0; i < DNET_ID_SIZE * 2; ++i) {
+			if (!isxdigit((unsigned char)d->d_name[i]))
+				break;
+		}
+		if (i != DNET_ID_SIZE * 2)
+			continue;
+
+		dnet_parse_numeric_id(d->d_name, key.id);
+
+		if ((ctl->flags & DNET_IFLAGS_KEY_RANGE) &&
+				(memcmp(key.id, ctl->start.id, DNET_ID_SIZE) < 0 || memcmp(key.id, ctl->end.id, DNET_ID_SIZE) > 0))
+			continue;
+
+		fd = -1;
+		if (ctl->flags & DNET_IFLAGS_DATA) {
+			fd = openat(dfd, d->d_name, O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				continue;
+
+			err = fstat(fd, &st);
+		} else {
+			err = fstatat(dfd, d->d_name, &st, 0);
+		}
+
+		if (err) {
+			err = 0;
+			if (fd >= 0)
+				close(fd);
+			continue;
+		}
+
+		err = ctl->callback(ctl->callback_private, &key, NULL, fd, 0, st.st_size);
+		if (fd >= 0)
+			close(fd);
+		if (err)
+			break;
+	}
+
+	closedir(dir);
+	return err;
+}
+
+/*
+ * Walks every hashed subdirectory of the root, objects are plain files named by hex id.
+ */
+static int file_backend_iterator(struct dnet_iterator_ctl *ctl)
+{
+	struct file_backend_root *r = ctl->iterator_private;
+	struct dirent *d;
+	DIR *dir;
+	int fd, err = 0;
+
+	fd = openat(r->rootfd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	dir = fdopendir(fd);
+	if (!dir) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_name[0] == '.' || !strcmp(d->d_name, "history"))
+			continue;
+
+		err = file_backend_iterator_dir(r, ctl, d->d_name);
+		if (err)
+			break;
+	}
+
+	closedir(dir);
+	return err;
 }
 
 static int dnet_file_config_init(struct dnet_config_backend *b, struct dnet_config *c)
@@ -590,13 +1198,45 @@ static int dnet_file_config_init(struct dnet_config_backend *b, struct dnet_conf
 	b->cb.meta_remove = dnet_file_db_remove;
 	b->cb.meta_total_elements = dnet_file_db_total_elements;
 	b->cb.meta_iterate = dnet_file_db_iterate;
+	b->cb.iterator = file_backend_iterator;
+
+	r->fd_cache.root = RB_ROOT;
+	INIT_LIST_HEAD(&r->fd_cache.lru_list);
+	INIT_LIST_HEAD(&r->commit.waiters);
+
+	err = pthread_mutex_init(&r->fd_cache.lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_exit;
+	}
+
+	err = pthread_mutex_init(&r->commit.lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_destroy_cache_lock;
+	}
+
+	err = pthread_cond_init(&r->commit.wait, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_destroy_commit_lock;
+	}
 
 	mkdir("history", 0755);
 	err = dnet_file_db_init(r, c, "history");
 	if (err)
-		return err;
+		goto err_out_destroy_commit_wait;
 
 	return 0;
+
+err_out_destroy_commit_wait:
+	pthread_cond_destroy(&r->commit.wait);
+err_out_destroy_commit_lock:
+	pthread_mutex_destroy(&r->commit.lock);
+err_out_destroy_cache_lock:
+	pthread_mutex_destroy(&r->fd_cache.lock);
+err_out_exit:
+	return err;
 }
 
 static void dnet_file_config_cleanup(struct dnet_config_backend *b)
@@ -614,6 +1254,9 @@ static struct dnet_config_entry dnet_cfg_entries_filesystem[] = {
 	{"blob_size", dnet_file_set_blob_size},
 	{"defrag_timeout", dnet_file_set_defrag_timeout},
 	{"defrag_percentage", dnet_file_set_defrag_percentage},
+	{"group_commit", dnet_file_set_group_commit},
+	{"group_commit_delay", dnet_file_set_group_commit_delay},
+	{"fd_cache_size", dnet_file_set_fd_cache_size},
 };
 
 static struct dnet_config_backend dnet_file_backend = {
@@ -41,10 +41,39 @@
 #define __unused	__attribute__ ((unused))
 #endif
 
+/*
+ * Chunked value layout.
+ *
+ * When @chunk_size is set, object is split into fixed-size chunks, each one is stored
+ * under object id followed by big-endian chunk number (starting from 1). Key with
+ * chunk number 0 hosts small header with total object size and chunk size used to split it.
+ * Ranged reads only fetch chunks covering requested range, appends and offset writes
+ * only rewrite chunks they touch.
+ *
+ * Objects stored as a whole value under plain DNET_ID_SIZE key are still readable,
+ * they are converted into chunked layout on the first partial update.
+ */
+#define LEVELDB_CHUNK_KEY_SIZE		(DNET_ID_SIZE + sizeof(uint64_t))
+
+struct leveldb_chunk_header
+{
+	uint64_t		size;
+	uint64_t		chunk_size;
+	uint64_t		reserved[2];
+} __attribute__ ((packed));
+
+static inline void leveldb_convert_chunk_header(struct leveldb_chunk_header *h)
+{
+	h->size = dnet_bswap64(h->size);
+	h->chunk_size = dnet_bswap64(h->chunk_size);
+}
+
 struct leveldb_backend
 {
 	int			sync;
 
+	uint64_t		chunk_size;
+
 	size_t			cache_size;
 	size_t			write_buffer_size;
 	size_t			block_size;
@@ -64,20 +93,370 @@ struct leveldb_backend
 	leveldb_t		*db;
 };
 
+static void leveldb_chunk_key(char *key, const unsigned char *id, uint64_t chunk)
+{
+	int i;
+
+	memcpy(key, id, DNET_ID_SIZE);
+	for (i = sizeof(uint64_t) - 1; i >= 0; --i) {
+		key[DNET_ID_SIZE + i] = chunk & 0xff;
+		chunk >>= 8;
+	}
+}
+
+static uint64_t leveldb_chunk_key_number(const char *key)
+{
+	const unsigned char *p = (const unsigned char *)key + DNET_ID_SIZE;
+	uint64_t chunk = 0;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(uint64_t); ++i)
+		chunk = (chunk << 8) | p[i];
+
+	return chunk;
+}
+
+static inline uint64_t leveldb_chunk_num(uint64_t size, uint64_t chunk_size)
+{
+	return (size + chunk_size - 1) / chunk_size;
+}
+
+/*
+ * Returns 0 if object is stored in chunked layout and fills @hdr,
+ * -ENOENT if there is no chunked object with given id.
+ */
+static int leveldb_backend_get_header(struct leveldb_backend *s, const unsigned char *id,
+		struct leveldb_chunk_header *hdr, char **error_string)
+{
+	char key[LEVELDB_CHUNK_KEY_SIZE];
+	size_t size;
+	char *data;
+
+	leveldb_chunk_key(key, id, 0);
+
+	data = leveldb_get(s->db, s->roptions, key, sizeof(key), &size, error_string);
+	if (*error_string)
+		return -EIO;
+	if (!data)
+		return -ENOENT;
+
+	if (size != sizeof(struct leveldb_chunk_header)) {
+		free(data);
+		return -EINVAL;
+	}
+
+	memcpy(hdr, data, sizeof(struct leveldb_chunk_header));
+	leveldb_convert_chunk_header(hdr);
+	free(data);
+
+	if (!hdr->chunk_size)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Copies @size bytes starting at @offset of chunked object into @dst.
+ * Missing chunks (holes created by writes beyond object end) are read as zeroes.
+ */
+static int leveldb_backend_read_chunks(struct leveldb_backend *s, const unsigned char *id,
+		struct leveldb_chunk_header *hdr, uint64_t offset, uint64_t size, char *dst)
+{
+	char key[LEVELDB_CHUNK_KEY_SIZE];
+	uint64_t chunk, last;
+	leveldb_iterator_t *it;
+
+	if (!size)
+		return 0;
+
+	memset(dst, 0, size);
+
+	it = leveldb_create_iterator(s->db, s->roptions);
+	if (!it)
+		return -ENOMEM;
+
+	last = (offset + size - 1) / hdr->chunk_size;
+	leveldb_chunk_key(key, id, offset / hdr->chunk_size + 1);
+
+	for (leveldb_iter_seek(it, key, sizeof(key)); leveldb_iter_valid(it); leveldb_iter_next(it)) {
+		uint64_t chunk_start, start, end;
+		const char *val;
+		const char *k;
+		size_t ksize, vsize;
+
+		k = leveldb_iter_key(it, &ksize);
+		if (ksize != LEVELDB_CHUNK_KEY_SIZE || memcmp(k, id, DNET_ID_SIZE))
+			break;
+
+		chunk = leveldb_chunk_key_number(k) - 1;
+		if (chunk > last)
+			break;
+
+		val = leveldb_iter_value(it, &vsize);
+
+		chunk_start = chunk * hdr->chunk_size;
+		start = (offset > chunk_start) ? offset : chunk_start;
+		end = chunk_start + vsize;
+		if (end > offset + size)
+			end = offset + size;
+
+		if (end > start)
+			memcpy(dst + start - offset, val + start - chunk_start, end - start);
+	}
+
+	leveldb_iter_destroy(it);
+	return 0;
+}
+
+/*
+ * Reads the whole object into freshly allocated buffer regardless of the layout it is stored in.
+ */
+static int leveldb_backend_read_object(struct leveldb_backend *s, const unsigned char *id,
+		char **datap, size_t *sizep, char **error_string)
+{
+	struct leveldb_chunk_header hdr;
+	char *data;
+	int err;
+
+	err = leveldb_backend_get_header(s, id, &hdr, error_string);
+	if (err == -ENOENT) {
+		data = leveldb_get(s->db, s->roptions, (const char *)id, DNET_ID_SIZE, sizep, error_string);
+		if (*error_string)
+			return -EIO;
+		if (!data)
+			return -ENOENT;
+
+		*datap = data;
+		return 0;
+	}
+
+	if (err)
+		return err;
+
+	data = malloc(hdr.size ? hdr.size : 1);
+	if (!data)
+		return -ENOMEM;
+
+	err = leveldb_backend_read_chunks(s, id, &hdr, 0, hdr.size, data);
+	if (err) {
+		free(data);
+		return err;
+	}
+
+	*datap = data;
+	*sizep = hdr.size;
+	return 0;
+}
+
+static int leveldb_backend_remove_raw(struct leveldb_backend *s, const unsigned char *id, char **error_string)
+{
+	struct leveldb_chunk_header hdr;
+	leveldb_writebatch_t *batch;
+	char key[LEVELDB_CHUNK_KEY_SIZE];
+	uint64_t i, num;
+	int err;
+
+	err = leveldb_backend_get_header(s, id, &hdr, error_string);
+	if (err == -ENOENT) {
+		leveldb_delete(s->db, s->woptions, (const char *)id, DNET_ID_SIZE, error_string);
+		return *error_string ? -ENOENT : 0;
+	}
+
+	if (err && err != -EINVAL)
+		return err;
+
+	batch = leveldb_writebatch_create();
+	if (!batch)
+		return -ENOMEM;
+
+	num = err ? 0 : leveldb_chunk_num(hdr.size, hdr.chunk_size);
+	for (i = 0; i <= num; ++i) {
+		leveldb_chunk_key(key, id, i);
+		leveldb_writebatch_delete(batch, key, sizeof(key));
+	}
+	leveldb_writebatch_delete(batch, (const char *)id, DNET_ID_SIZE);
+
+	leveldb_write(s->db, s->woptions, batch, error_string);
+	leveldb_writebatch_destroy(batch);
+
+	return *error_string ? -ENOENT : 0;
+}
+
+/*
+ * Writes @io->size bytes at @io->offset (or at the end of the object if DNET_IO_FLAGS_APPEND is set)
+ * touching only chunks which cover given range. Everything is committed in a single write batch.
+ */
+static int leveldb_backend_write_chunked(struct leveldb_backend *s, struct dnet_io_attr *io, void *data,
+		char **error_string)
+{
+	struct leveldb_chunk_header hdr;
+	leveldb_writebatch_t *batch = NULL;
+	char key[LEVELDB_CHUNK_KEY_SIZE];
+	char *legacy = NULL, *buf = NULL, *old = NULL;
+	size_t legacy_size = 0;
+	uint64_t offset = io->offset, old_size, chunk, first, last, cs;
+	int err;
+
+	err = leveldb_backend_get_header(s, io->id, &hdr, error_string);
+	if (err == -ENOENT) {
+		legacy = leveldb_get(s->db, s->roptions, (const char *)io->id, DNET_ID_SIZE, &legacy_size, error_string);
+		if (*error_string) {
+			err = -EIO;
+			goto err_out_exit;
+		}
+
+		hdr.size = legacy ? legacy_size : 0;
+		hdr.chunk_size = s->chunk_size;
+	} else if (err) {
+		goto err_out_exit;
+	}
+
+	cs = hdr.chunk_size;
+	old_size = hdr.size;
+
+	if (io->flags & DNET_IO_FLAGS_APPEND)
+		offset = old_size;
+	else if (!offset)
+		hdr.size = 0;
+
+	if (offset + io->size > hdr.size)
+		hdr.size = offset + io->size;
+
+	batch = leveldb_writebatch_create();
+	buf = malloc(cs);
+	if (!batch || !buf) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+
+	first = offset / cs;
+	last = io->size ? (offset + io->size - 1) / cs : first;
+
+	for (chunk = first; io->size && chunk <= last; ++chunk) {
+		uint64_t chunk_start = chunk * cs;
+		uint64_t chunk_end = chunk_start + cs;
+		uint64_t start, end, old_end;
+		char *val = buf;
+
+		if (chunk_end > hdr.size)
+			chunk_end = hdr.size;
+
+		start = (offset > chunk_start) ? offset : chunk_start;
+		end = (offset + io->size < chunk_end) ? offset + io->size : chunk_end;
+
+		leveldb_chunk_key(key, io->id, chunk + 1);
+
+		if (start == chunk_start && end == chunk_end) {
+			val = (char *)data + start - offset;
+		} else {
+			memset(buf, 0, chunk_end - chunk_start);
+
+			/*
+			 * preserve old chunk content around written range,
+			 * truncating write never gets here, since it covers every chunk it touches
+			 */
+			old_end = old_size;
+			if (old_end > chunk_end)
+				old_end = chunk_end;
+
+			if (old_end > chunk_start) {
+				if (legacy) {
+					memcpy(buf, legacy + chunk_start, old_end - chunk_start);
+				} else {
+					size_t old_chunk_size;
+
+					old = leveldb_get(s->db, s->roptions, key, sizeof(key), &old_chunk_size, error_string);
+					if (*error_string) {
+						err = -EIO;
+						goto err_out_free;
+					}
+
+					if (old) {
+						if (old_chunk_size > old_end - chunk_start)
+							old_chunk_size = old_end - chunk_start;
+						memcpy(buf, old, old_chunk_size);
+						free(old);
+						old = NULL;
+					}
+				}
+			}
+
+			memcpy(buf + start - chunk_start, (char *)data + start - offset, end - start);
+		}
+
+		leveldb_writebatch_put(batch, key, sizeof(key), val, chunk_end - chunk_start);
+	}
+
+	/* whole-value object is converted into chunked layout, copy its content we have not overwritten yet */
+	if (legacy) {
+		uint64_t legacy_end = (offset || (io->flags & DNET_IO_FLAGS_APPEND)) ? legacy_size : 0;
+		uint64_t num = leveldb_chunk_num(legacy_end, cs);
+
+		for (chunk = 0; chunk < num; ++chunk) {
+			uint64_t chunk_start = chunk * cs;
+			uint64_t chunk_end = chunk_start + cs;
+
+			if (io->size && chunk >= first && chunk <= last)
+				continue;
+
+			if (chunk_end > legacy_end)
+				chunk_end = legacy_end;
+
+			leveldb_chunk_key(key, io->id, chunk + 1);
+			leveldb_writebatch_put(batch, key, sizeof(key), legacy + chunk_start, chunk_end - chunk_start);
+		}
+
+		leveldb_writebatch_delete(batch, (const char *)io->id, DNET_ID_SIZE);
+	}
+
+	/* drop chunks which are beyond truncated object */
+	for (chunk = leveldb_chunk_num(hdr.size, cs); chunk < leveldb_chunk_num(old_size, cs); ++chunk) {
+		leveldb_chunk_key(key, io->id, chunk + 1);
+		leveldb_writebatch_delete(batch, key, sizeof(key));
+	}
+
+	io->size = hdr.size;
+
+	leveldb_convert_chunk_header(&hdr);
+	leveldb_chunk_key(key, io->id, 0);
+	leveldb_writebatch_put(batch, key, sizeof(key), (const char *)&hdr, sizeof(struct leveldb_chunk_header));
+
+	leveldb_write(s->db, s->woptions, batch, error_string);
+	err = *error_string ? -EIO : 0;
+
+err_out_free:
+	free(old);
+	free(buf);
+	if (batch)
+		leveldb_writebatch_destroy(batch);
+	free(legacy);
+err_out_exit:
+	return err;
+}
+
 static int leveldb_backend_checksum(struct dnet_node *n, void *backend_priv, struct dnet_id *id, void *csum, int *csize)
 {
 	struct leveldb_backend *b = backend_priv;
+	struct leveldb_chunk_header hdr;
 	char *data = NULL;
 	size_t data_size;
 	int err = -EINVAL;
 	char *error_string = NULL;
 
-	data = leveldb_get(b->db, b->roptions, (const char *)id->id, DNET_ID_SIZE, &data_size, &error_string);
-	if (error_string || !data) {
-		if (!data)
-			err = -ENOENT;
+	/*
+	 * Chunked objects know their size without reading data,
+	 * so checksum maintained in metadata can be used directly
+	 */
+	err = leveldb_backend_get_header(b, id->id, &hdr, &error_string);
+	if (!err && !dnet_meta_read_checksum(n, id->id, hdr.size, csum, *csize))
+		goto err_out_exit;
+
+	free(error_string);
+	error_string = NULL;
+
+	err = leveldb_backend_read_object(b, id->id, &data, &data_size, &error_string);
+	if (err)
 		goto err_out_exit;
-	}
 
 	err = dnet_checksum_data(n, data, data_size, csum, *csize);
 	if (err)
@@ -92,15 +471,23 @@ err_out_exit:
 
 static int leveldb_backend_lookup(struct leveldb_backend *s, void *state, struct dnet_cmd *cmd)
 {
+	struct leveldb_chunk_header hdr;
 	char *data = NULL;
 	size_t data_size;
 	int err = -EINVAL;
 	char *error_string = NULL;
 
-	data = leveldb_get(s->db, s->roptions, (const char *)cmd->id.id, DNET_ID_SIZE, &data_size, &error_string);
-	if (error_string || !data) {
-		if (!data)
-			err = -ENOENT;
+	err = leveldb_backend_get_header(s, cmd->id.id, &hdr, &error_string);
+	if (!err) {
+		data_size = hdr.size;
+	} else if (err == -ENOENT) {
+		data = leveldb_get(s->db, s->roptions, (const char *)cmd->id.id, DNET_ID_SIZE, &data_size, &error_string);
+		if (error_string || !data) {
+			if (!data)
+				err = -ENOENT;
+			goto err_out_exit;
+		}
+	} else {
 		goto err_out_exit;
 	}
 
@@ -120,7 +507,9 @@ static int leveldb_backend_write(struct leveldb_backend *s, void *state, struct
 	int err = -EINVAL;
 	char *error_string = NULL;
 	struct dnet_io_attr *io = data;
+	struct leveldb_chunk_header hdr;
 	void *read_data = NULL;
+	int chunked = !!s->chunk_size;
 
 	dnet_convert_io_attr(io);
 	data += sizeof(struct dnet_io_attr);
@@ -130,6 +519,27 @@ static int leveldb_backend_write(struct leveldb_backend *s, void *state, struct
 	 * if one performs write without lock we do not really care that one write may overwrite another one
 	 */
 
+	/*
+	 * Object written in chunked layout before @chunk_size was turned off keeps that layout,
+	 * otherwise plain value would shadow its chunks only partially and append would lose old content
+	 */
+	if (!chunked) {
+		err = leveldb_backend_get_header(s, io->id, &hdr, &error_string);
+		if (err && err != -ENOENT)
+			goto err_out_exit;
+
+		chunked = !err;
+		err = -EINVAL;
+	}
+
+	if (chunked) {
+		err = leveldb_backend_write_chunked(s, io, data, &error_string);
+		if (err)
+			goto err_out_exit;
+
+		goto reply;
+	}
+
 	if (io->offset || (io->flags & DNET_IO_FLAGS_APPEND)) {
 		size_t data_size;
 		size_t offset = io->offset;
@@ -173,6 +583,7 @@ plain_write:
 	if (error_string)
 		goto err_out_exit;
 
+reply:
 	err = dnet_send_file_info_without_fd(state, cmd, 0, io->size);
 	if (err < 0)
 		goto err_out_exit;
@@ -192,33 +603,86 @@ err_out_exit:
 static int leveldb_backend_read(struct leveldb_backend *s, void *state, struct dnet_cmd *cmd, void *iodata, int last)
 {
 	struct dnet_io_attr *io = iodata;
-	char *data;
+	struct leveldb_chunk_header hdr;
+	char *data = NULL, *ptr;
 	size_t data_size;
+	int64_t size;
 	int err = -EINVAL;
 	char *error_string = NULL;
 
 	dnet_convert_io_attr(io);
-	if (io->size || io->offset) {
-		err = -ERANGE;
-		goto err_out_exit;
+
+	/*
+	 * Without chunking whole-value object is looked up first, so plain reads cost
+	 * a single get, header is only checked if there is no such value - object could
+	 * be written in chunked layout before @chunk_size was turned off.
+	 */
+	if (!s->chunk_size) {
+		data = leveldb_get(s->db, s->roptions, (const char *)io->id, DNET_ID_SIZE, &data_size, &error_string);
+		if (error_string) {
+			err = -EIO;
+			goto err_out_exit;
+		}
+
+		if (data)
+			goto plain_read;
 	}
 
-	data = leveldb_get(s->db, s->roptions, (const char *)io->id, DNET_ID_SIZE, &data_size, &error_string);
-	if (error_string || !data) {
-		if (!data)
-			err = -ENOENT;
+	err = leveldb_backend_get_header(s, io->id, &hdr, &error_string);
+	if (!err) {
+		size = dnet_backend_check_get_size(io, hdr.size);
+		if (size < 0 || (!size && hdr.size)) {
+			err = size;
+			goto err_out_exit;
+		}
+
+		data = malloc(size ? size : 1);
+		if (!data) {
+			err = -ENOMEM;
+			goto err_out_exit;
+		}
+
+		if (size) {
+			err = leveldb_backend_read_chunks(s, io->id, &hdr, io->offset, size, data);
+			if (err)
+				goto err_out_free;
+		}
+
+		data_size = size;
+		ptr = data;
+	} else if (err == -ENOENT) {
+		if (!s->chunk_size)
+			goto err_out_exit;
+
+		data = leveldb_get(s->db, s->roptions, (const char *)io->id, DNET_ID_SIZE, &data_size, &error_string);
+		if (error_string || !data) {
+			if (!data)
+				err = -ENOENT;
+			goto err_out_exit;
+		}
+
+plain_read:
+		size = dnet_backend_check_get_size(io, data_size);
+		if (size < 0 || (!size && data_size)) {
+			err = size;
+			goto err_out_free;
+		}
+
+		ptr = data + io->offset;
+	} else {
 		goto err_out_exit;
 	}
 
-	io->size = data_size;
+	/* zero-length object still gets (empty) read reply */
+	io->size = size;
 	if (data_size && data && last)
 		cmd->flags &= ~DNET_FLAGS_NEED_ACK;
-	err = dnet_send_read_data(state, cmd, io, data, -1, io->offset, 0);
+	err = dnet_send_read_data(state, cmd, io, ptr, -1, io->offset, 0);
 	if (err < 0)
 		goto err_out_free;
 
-	dnet_backend_log(DNET_LOG_NOTICE, "%s: leveldb: : READ: Ok: size: %llu.\n",
-			dnet_dump_id(&cmd->id), (unsigned long long)io->size);
+	dnet_backend_log(DNET_LOG_NOTICE, "%s: leveldb: : READ: Ok: offset: %llu, size: %llu.\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)io->offset, (unsigned long long)io->size);
 
 err_out_free:
 	free(data);
@@ -234,11 +698,12 @@ err_out_exit:
 static int leveldb_backend_remove(struct leveldb_backend *s, void *state __unused, struct dnet_cmd *cmd, void *data __unused)
 {
 	char *error_string = NULL;
+	int err;
 
-	leveldb_delete(s->db, s->woptions, (const char *)cmd->id.id, DNET_ID_SIZE, &error_string);
-	if (error_string) {
-		dnet_backend_log(DNET_LOG_ERROR, "%s: leveldb: REMOVE: error: %s\n",
-				dnet_dump_id(&cmd->id), error_string);
+	err = leveldb_backend_remove_raw(s, cmd->id.id, &error_string);
+	if (err) {
+		dnet_backend_log(DNET_LOG_ERROR, "%s: leveldb: REMOVE: error: %s: %d\n",
+				dnet_dump_id(&cmd->id), error_string, err);
 		free(error_string);
 		return -ENOENT;
 	}
@@ -283,15 +748,27 @@ static int leveldb_backend_range_read(struct leveldb_backend *s, void *state, st
 	}
 
 	for (leveldb_iter_seek(it, (const char*)io->id, DNET_ID_SIZE);
-	     leveldb_iter_valid(it) && j < io->num; leveldb_iter_next(it), i++)
+	     leveldb_iter_valid(it) && j < io->num; leveldb_iter_next(it))
 	{
-		size_t size;
-		const char * key = leveldb_iter_key(it, &size);
+		size_t size, key_size;
+		const char * key = leveldb_iter_key(it, &key_size);
 		const char * val = 0;
+		char * chunked = NULL;
+		struct leveldb_chunk_header hdr;
+
 		if (memcmp(io->parent, key, DNET_ID_SIZE) < 0) {
 			break;
 		}
-		if (i < io->start) {
+
+		/* chunked objects are represented by their header key, data chunks are skipped */
+		if (key_size == LEVELDB_CHUNK_KEY_SIZE) {
+			if (leveldb_chunk_key_number(key))
+				continue;
+		} else if (key_size != DNET_ID_SIZE) {
+			continue;
+		}
+
+		if (i++ < io->start) {
 			continue;
 		}
 		++j;
@@ -300,6 +777,30 @@ static int leveldb_backend_range_read(struct leveldb_backend *s, void *state, st
 		switch (cmd->cmd) {
 			case DNET_CMD_READ_RANGE: 
 				val = leveldb_iter_value(it, &size);
+				if (key_size == LEVELDB_CHUNK_KEY_SIZE) {
+					if (size != sizeof(struct leveldb_chunk_header)) {
+						err = -EINVAL;
+						break;
+					}
+
+					memcpy(&hdr, val, sizeof(struct leveldb_chunk_header));
+					leveldb_convert_chunk_header(&hdr);
+
+					size = hdr.size;
+					chunked = malloc(size ? size : 1);
+					if (!chunked) {
+						err = -ENOMEM;
+						break;
+					}
+
+					err = leveldb_backend_read_chunks(s, (const unsigned char *)key, &hdr, 0, size, chunked);
+					if (err) {
+						free(chunked);
+						break;
+					}
+					val = chunked;
+				}
+
 				memset(&dst_io, 0, sizeof(dst_io));
 				dst_io.flags  = 0;
 				dst_io.size   = size;
@@ -308,14 +809,16 @@ static int leveldb_backend_range_read(struct leveldb_backend *s, void *state, st
 				memcpy(dst_io.id, key, DNET_ID_SIZE);
 				memcpy(dst_io.parent, io->parent, DNET_ID_SIZE);
 				err = dnet_send_read_data(state, cmd, &dst_io, (char*)val, -1, 0, 0);
+				free(chunked);
 				break;
 			case DNET_CMD_DEL_RANGE:
-				leveldb_delete(s->db, s->woptions, key, size, &error_string);
-				if (error_string) {
+				err = leveldb_backend_remove_raw(s, (const unsigned char *)key, &error_string);
+				if (err) {
 					dnet_backend_log(DNET_LOG_ERROR, "%s: LEVELDB: REMOVE: error: %s",
 					                 dnet_dump_id_str((const unsigned char*)key), error_string);
 					err = -ENOENT;
 					free(error_string);
+					error_string = NULL;
 				}
 				break;
 		}
@@ -341,6 +844,83 @@ static int leveldb_backend_range_read(struct leveldb_backend *s, void *state, st
 	return err;
 }
 
+/*
+ * Walks database keys for server-side iterator, chunked objects are reported once (by their header key),
+ * their data is only assembled when iterator requested it.
+ */
+static int leveldb_backend_iterator(struct dnet_iterator_ctl *ctl)
+{
+	struct leveldb_backend *s = ctl->iterator_private;
+	leveldb_iterator_t *it;
+	int err = 0;
+
+	it = leveldb_create_iterator(s->db, s->roptions);
+	if (!it)
+		return -ENOMEM;
+
+	if (ctl->flags & DNET_IFLAGS_KEY_RANGE)
+		leveldb_iter_seek(it, (const char *)ctl->start.id, DNET_ID_SIZE);
+	else
+		leveldb_iter_seek_to_first(it);
+
+	for (; leveldb_iter_valid(it); leveldb_iter_next(it)) {
+		struct leveldb_chunk_header hdr;
+		struct dnet_raw_id key;
+		char *chunked = NULL;
+		const char *k, *val;
+		size_t ksize, size;
+
+		k = leveldb_iter_key(it, &ksize);
+
+		if ((ctl->flags & DNET_IFLAGS_KEY_RANGE) && memcmp(k, ctl->end.id, DNET_ID_SIZE) > 0)
+			break;
+
+		if (ksize == LEVELDB_CHUNK_KEY_SIZE) {
+			if (leveldb_chunk_key_number(k))
+				continue;
+		} else if (ksize != DNET_ID_SIZE) {
+			continue;
+		}
+
+		memcpy(key.id, k, DNET_ID_SIZE);
+		val = leveldb_iter_value(it, &size);
+
+		if (ksize == LEVELDB_CHUNK_KEY_SIZE) {
+			if (size != sizeof(struct leveldb_chunk_header))
+				continue;
+
+			memcpy(&hdr, val, sizeof(struct leveldb_chunk_header));
+			leveldb_convert_chunk_header(&hdr);
+
+			size = hdr.size;
+			val = NULL;
+
+			if ((ctl->flags & DNET_IFLAGS_DATA) && hdr.chunk_size) {
+				chunked = malloc(size ? size : 1);
+				if (!chunked) {
+					err = -ENOMEM;
+					break;
+				}
+
+				err = leveldb_backend_read_chunks(s, key.id, &hdr, 0, size, chunked);
+				if (err) {
+					free(chunked);
+					break;
+				}
+				val = chunked;
+			}
+		}
+
+		err = ctl->callback(ctl->callback_private, &key, (void *)val, -1, 0, size);
+		free(chunked);
+		if (err)
+			break;
+	}
+
+	leveldb_iter_destroy(it);
+	return err;
+}
+
 static int leveldb_backend_command_handler(void *state, void *priv, struct dnet_cmd *cmd, void *data)
 {
 	int err;
@@ -425,6 +1005,20 @@ static int dnet_leveldb_set_sync(struct dnet_config_backend *b, char *key __unus
 	return 0;
 }
 
+static int dnet_leveldb_set_chunk_size(struct dnet_config_backend *b, char *key __unused, char *value)
+{
+	struct leveldb_backend *s = b->data;
+	uint64_t val = strtoull(value, NULL, 0);
+
+	if (strchr(value, 'M'))
+		val *= 1024*1024;
+	else if (strchr(value, 'K'))
+		val *= 1024;
+
+	s->chunk_size = val;
+	return 0;
+}
+
 static int dnet_leveldb_set_compression(struct dnet_config_backend *b, char *key __unused, char *value)
 {
 	struct leveldb_backend *s = b->data;
@@ -645,6 +1239,7 @@ static int dnet_leveldb_config_init(struct dnet_config_backend *b, struct dnet_c
 	b->cb.meta_remove = dnet_leveldb_db_remove;
 	b->cb.meta_total_elements = dnet_leveldb_total_elements;
 	b->cb.meta_iterate = dnet_leveldb_db_iterate;
+	b->cb.iterator = leveldb_backend_iterator;
 
 	snprintf(hpath, hlen, "%s/history", s->path);
 	mkdir(hpath, 0755);
@@ -747,6 +1342,7 @@ static struct dnet_config_entry dnet_cfg_entries_leveldb[] = {
 	{"block_restart_interval", dnet_leveldb_set_block_restart_interval},
 	{"max_open_files", dnet_leveldb_set_max_open_files},
 	{"compression", dnet_leveldb_set_compression},
+	{"chunk_size", dnet_leveldb_set_chunk_size},
 //	{"", dnet_leveldb_set_},
 };
 
@@ -472,7 +472,7 @@ class iterator_result_entry : public callback_result_entry
 
 		iterator_result_entry &operator =(const iterator_result_entry &other);
 
-		dnet_iterator_request *reply() const;
+		dnet_iterator_response *reply() const;
 		data_pointer reply_data() const;
 };
 
@@ -535,6 +535,7 @@ struct find_indexes_result_entry
 typedef std::exception_ptr update_indexes_result;
 typedef array_result_holder<find_indexes_result_entry> find_indexes_result;
 typedef array_result_holder<index_entry> check_indexes_result;
+typedef array_result_holder<index_entry> read_index_result;
 
 class exec_context_data;
 
@@ -782,6 +783,20 @@ class session
 		uint32_t		get_ioflags() const;
 
 		void			set_timeout(unsigned int timeout);
+		/*!
+		 * Gets wait timeout of the session in seconds,
+		 * node's one is returned if session timeout is not set.
+		 */
+		unsigned int		get_timeout() const;
+
+		/*!
+		 * Sets maximum number of nodes queried concurrently by read_data_range().
+		 */
+		void			set_range_fanout(unsigned int fanout);
+		/*!
+		 * Gets maximum number of nodes queried concurrently by read_data_range().
+		 */
+		unsigned int		get_range_fanout() const;
 
 		/*!
 		 * Read file by key \a id to \a file by \a offset and \a size.
@@ -854,6 +869,15 @@ class session
 		 * of write_prepare(), write_plain() and write_commit().
 		 */
 		async_write_result write_data(const key &id, const data_pointer &file, uint64_t remote_offset);
+		/*!
+		 * Writes data \a file by the key \a id and remote offset \a remote_offset
+		 * together with \a metadata created by create_metadata().
+		 * Metadata is stored by the same request, so no separate write_metadata() is needed.
+		 *
+		 * Result is returned to \a handler.
+		 */
+		async_write_result write_data(const key &id, const data_pointer &file, uint64_t remote_offset,
+				const std::string &metadata);
 
 
 		async_write_result write_cas(const key &id, const std::function<data_pointer (const data_pointer &)> &converter, uint64_t remote_offset, int count = 3);
@@ -1069,6 +1093,21 @@ class session
 				const key &id, const std::vector<index_entry> &indexes);
 		void update_indexes(const key &id, const std::vector<index_entry> &indexes);
 		void update_indexes(const key &id, const std::vector<std::string> &indexes, const std::vector<data_pointer> &data);
+		/*!
+		 * Sets indexes of several objects, \a indexes holds pairs of object key
+		 * and all its indexes. Changes are grouped by index, so every index page
+		 * is rewritten once per batch instead of once per object.
+		 * If update of any index fails, already updated indexes are reverted.
+		 *
+		 * Result is returned to \a handler.
+		 */
+		void update_indexes(const std::function<void (const update_indexes_result &)> &handler,
+				const std::vector<std::pair<key, std::vector<index_entry>>> &indexes);
+		/*!
+		 * \overload update_indexes()
+		 * Synchronous overload.
+		 */
+		void update_indexes(const std::vector<std::pair<key, std::vector<index_entry>>> &indexes);
 
 		void find_indexes(const std::function<void (const find_indexes_result &)> &handler, const std::vector<dnet_raw_id> &indexes);
 		find_indexes_result find_indexes(const std::vector<dnet_raw_id> &indexes);
@@ -1077,6 +1116,21 @@ class session
 		void check_indexes(const std::function<void (const check_indexes_result &)> &handler, const key &id);
 		check_indexes_result check_indexes(const key &id);
 
+		/*!
+		 * Reads at most \a limit (0 means all) entries of index \a index
+		 * starting from object id \a start from the first group of the session.
+		 * Entries are sorted by object id, read continues after the last returned one.
+		 *
+		 * Result is returned to \a handler.
+		 */
+		void read_index(const std::function<void (const read_index_result &)> &handler,
+				const key &index, const dnet_raw_id &start, unsigned int limit = 0);
+		/*!
+		 * \overload read_index()
+		 * Synchronous overload.
+		 */
+		read_index_result read_index(const key &index, const dnet_raw_id &start, unsigned int limit = 0);
+
 		/*!
 		 * Returnes reference to parent node.
 		 */
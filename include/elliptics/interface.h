@@ -133,6 +133,14 @@ struct dnet_io_control {
 
 	/* Data transaction timestamp */
 	struct timespec			ts;
+
+	/*
+	 * Metadata container sent within the same write request
+	 * when DNET_IO_FLAGS_INLINE_META is set in @io.flags.
+	 * It must be already converted into network byte order.
+	 */
+	const void			*meta;
+	unsigned int			meta_size;
 };
 
 /*
@@ -226,6 +234,21 @@ enum dnet_log_level {
 #define DNET_CFG_NO_CSUM		(1<<3)		/* globally disable checksum verification and update */
 #define DNET_CFG_NO_META		(1<<4)		/* do not write metadata */
 #define DNET_CFG_RANDOMIZE_STATES	(1<<5)		/* randomize states for read requests */
+#define DNET_CFG_WRITE_CSUM		(1<<6)		/* maintain data checksum in metadata while writing */
+#define DNET_CFG_META_INDEX		(1<<7)		/* keep compact in-memory index of local metadata */
+#define DNET_CFG_ASYNC_LOG		(1<<8)		/* pass log messages to logger from background thread */
+
+/*
+ * Data checksum engines (dnet_config.checksum_type).
+ * Object ids are always SHA-512, checksum engine only affects content checksums
+ * calculated by the node: DNET_IO_FLAGS_CHECKSUM replies and backend checksums.
+ * CAS parent is SHA-512 calculated by client and is verified with SHA-512 whatever engine is used.
+ */
+enum dnet_checksum_types {
+	DNET_CHECKSUM_SHA512 = 0,		/* default, SHA-512 as used for ids */
+	DNET_CHECKSUM_CRC32C,			/* CRC32C, uses SSE4.2 crc32 instruction when available */
+	__DNET_CHECKSUM_MAX,
+};
 
 struct dnet_log {
 	/*
@@ -250,6 +273,26 @@ struct dnet_iterate_ctl {
 	void				*callback_private;
 };
 
+/*
+ * Backend key iterator control structure.
+ * Backend walks its keys (within [start, end] range if DNET_IFLAGS_KEY_RANGE is set in @flags,
+ * it is allowed to return keys outside of it though) and invokes @callback for every one.
+ * Object content is provided either as @data pointer or as @fd/@offset pair (@data is NULL then),
+ * @fd is only valid within callback. Nonzero return value from @callback stops iteration
+ * and is returned by backend.
+ */
+struct dnet_iterator_ctl {
+	void				*iterator_private;
+
+	uint64_t			flags;
+	struct dnet_raw_id		start;
+	struct dnet_raw_id		end;
+
+	void				*callback_private;
+	int				(* callback)(void *priv, struct dnet_raw_id *key,
+						void *data, int fd, uint64_t offset, uint64_t size);
+};
+
 struct dnet_backend_callbacks {
 	/* command handler processes DNET_CMD_* commands */
 	int			(* command_handler)(void *state, void *priv, struct dnet_cmd *cmd, void *data);
@@ -289,6 +332,22 @@ struct dnet_backend_callbacks {
 
 	/* returns number of metadata elements */
 	long long		(* meta_total_elements)(void *priv);
+
+	/* optional, walks backend keys for DNET_CMD_ITERATOR, @ctl->iterator_private is backend's @priv */
+	int			(* iterator)(struct dnet_iterator_ctl *ctl);
+
+	/* optional, fills backend-specific DNET_CNTR_* counters in @counters array of __DNET_CNTR_MAX elements */
+	void			(* storage_counters)(void *priv, struct dnet_stat_count *counters);
+
+	/*
+	 * optional, calls @callback for every data record (all types if @id->type is -1, metadata excluded)
+	 * of the given key with file descriptor, offset and size where it is stored,
+	 * merge uses it to stream objects directly from backend files,
+	 * @fd is only valid while record is not removed from storage
+	 */
+	int			(* locate)(void *priv, struct dnet_id *id,
+					int (* callback)(void *cb_priv, struct dnet_id *id, int fd, uint64_t offset, uint64_t size),
+					void *cb_priv);
 };
 
 /*
@@ -403,8 +462,15 @@ struct dnet_config
 
 	uint64_t		cache_size;
 
+	/* data checksum engine, one of DNET_CHECKSUM_* */
+	int			checksum_type;
+
+	/* merge transfer budget: megabytes and objects per second, 0 means unlimited */
+	int			merge_bandwidth;
+	int			merge_iops;
+
 	/* so that we do not change major version frequently */
-	int			reserved_for_future_use[12];
+	int			reserved_for_future_use[9];
 };
 
 struct dnet_node *dnet_get_node_from_state(void *state);
@@ -416,6 +482,7 @@ uint32_t dnet_session_get_ioflags(struct dnet_session *s);
 void dnet_session_set_cflags(struct dnet_session *s, uint64_t cflags);
 uint64_t dnet_session_get_cflags(struct dnet_session *s);
 void dnet_session_set_timeout(struct dnet_session *s, unsigned int wait_timeout);
+struct timespec *dnet_session_get_timeout(struct dnet_session *s);
 int dnet_session_set_ns(struct dnet_session *s, const char *ns, int nsize);
 
 struct dnet_node *dnet_session_get_node(struct dnet_session *s);
@@ -615,16 +682,10 @@ int dnet_stat_local(struct dnet_net_state *st, struct dnet_id *id);
  */
 static inline int dnet_id_cmp_str(const unsigned char *id1, const unsigned char *id2)
 {
-	unsigned int i = 0;
-
-	for (i*=sizeof(unsigned long); i<DNET_ID_SIZE; ++i) {
-		if (id1[i] < id2[i])
-			return -1;
-		if (id1[i] > id2[i])
-			return 1;
-	}
+	/* libc memcmp() compares whole words/vectors instead of byte-by-byte loop */
+	int cmp = memcmp(id1, id2, DNET_ID_SIZE);
 
-	return 0;
+	return (cmp > 0) - (cmp < 0);
 }
 static inline int dnet_id_cmp(const struct dnet_id *id1, const struct dnet_id *id2)
 {
@@ -794,17 +855,27 @@ int dnet_read_meta(struct dnet_session *s, struct dnet_meta_container *mc,
 struct dnet_meta *dnet_meta_search(struct dnet_node *n, struct dnet_meta_container *mc, uint32_t type);
 
 void dnet_create_meta_update(struct dnet_meta *m, struct timespec *ts, uint64_t flags_set, uint64_t flags_clear);
+void dnet_convert_metadata(struct dnet_node *n, void *data, int size);
 int dnet_write_metadata(struct dnet_session *s, struct dnet_meta_container *mc, int convert);
 int dnet_create_write_metadata(struct dnet_session *s, struct dnet_metadata_control *ctl);
 int dnet_create_write_metadata_strings(struct dnet_session *s, const void *remote, unsigned int remote_len,
 		struct dnet_id *id, struct timespec *ts);
 int dnet_create_metadata(struct dnet_session *s, struct dnet_metadata_control *ctl, struct dnet_meta_container *mc);
+int dnet_create_metadata_strings(struct dnet_session *s, const void *remote, unsigned int remote_len,
+		struct dnet_id *id, struct timespec *ts, struct dnet_meta_container *mc);
 void dnet_meta_print(struct dnet_session *s, struct dnet_meta_container *mc);
 
 int dnet_read_file_info(struct dnet_node *n, struct dnet_id *id, struct dnet_file_info *info);
 int dnet_meta_update_check_status_raw(struct dnet_node *n, struct dnet_meta_container *mc);
 int dnet_meta_update_check_status(struct dnet_node *n, struct dnet_meta_container *mc);
 
+/*
+ * Returns checksum of the first @size bytes of the object, which was calculated while data was written
+ * (only when DNET_CFG_WRITE_CSUM is set). Returns -ENOENT if there is no such checksum, in this case
+ * data has to be checksummed directly.
+ */
+int dnet_meta_read_checksum(struct dnet_node *n, const unsigned char *id, uint64_t size, void *csum, int csize);
+
 int dnet_lookup_addr(struct dnet_session *s, const void *remote, int len, struct dnet_id *id, int group_id, char *dst, int dlen);
 
 struct dnet_id_param {
@@ -825,7 +896,10 @@ struct dnet_check_reply {
 	int			total;
 	int			completed;
 	int			errors;
-	int			reserved[5];
+	/* objects moved to other nodes by merge and their size in megabytes */
+	int			merged;
+	int			merged_mb;
+	int			reserved[3];
 };
 
 static inline void dnet_convert_check_reply(struct dnet_check_reply *r)
@@ -833,6 +907,8 @@ static inline void dnet_convert_check_reply(struct dnet_check_reply *r)
 	r->total = dnet_bswap32(r->total);
 	r->completed = dnet_bswap32(r->completed);
 	r->errors = dnet_bswap32(r->errors);
+	r->merged = dnet_bswap32(r->merged);
+	r->merged_mb = dnet_bswap32(r->merged_mb);
 }
 
 /* Set by dnet_check when we only want to merge transaction
@@ -845,6 +921,11 @@ static inline void dnet_convert_check_reply(struct dnet_check_reply *r)
 #define DNET_CHECK_DRY_RUN			(1<<2)
 /* Physically delete files marked as REMOVED in history */
 #define DNET_CHECK_DELETE			(1<<3)
+/*
+ * Compare anti-entropy hash trees with other nodes first
+ * and check only keys from subranges which differ
+ */
+#define DNET_CHECK_MERKLE			(1<<4)
 
 struct dnet_check_request {
 	uint32_t		flags;
@@ -856,7 +937,8 @@ struct dnet_check_request {
 	uint32_t		group_num;
 	int			blob_start;
 	int			blob_num;
-	uint64_t		reserved;
+	uint32_t		bulk_window;	/* bulk check batches in flight per peer, 0 means default */
+	uint32_t		reserved;
 } __attribute__ ((packed));
 
 static inline void dnet_convert_check_request(struct dnet_check_request *r)
@@ -870,6 +952,7 @@ static inline void dnet_convert_check_request(struct dnet_check_request *r)
 	r->group_num = dnet_bswap32(r->group_num);
 	r->blob_start = dnet_bswap32(r->blob_start);
 	r->blob_num = dnet_bswap32(r->blob_num);
+	r->bulk_window = dnet_bswap32(r->bulk_window);
 }
 
 int dnet_request_check(struct dnet_session *s, struct dnet_check_request *r);
@@ -897,6 +980,18 @@ char *dnet_counter_string(int cntr, int cmd_num);
 int dnet_checksum_file(struct dnet_node *n, const char *file, uint64_t offset, uint64_t size, void *csum, int csize);
 int dnet_checksum_fd(struct dnet_node *n, int fd, uint64_t offset, uint64_t size, void *csum, int csize);
 int dnet_checksum_data(struct dnet_node *n, const void *data, uint64_t size, unsigned char *csum, int csize);
+int dnet_checksum_type_from_name(const char *name);
+const char *dnet_checksum_name(int type);
+
+/*
+ * Incremental checksum with node's data checksum engine.
+ * State is opaque buffer of dnet_checksum_state_size() bytes,
+ * dnet_checksum_state_final() does not modify it, so checksum can be continued.
+ */
+unsigned int dnet_checksum_state_size(struct dnet_node *n);
+void dnet_checksum_state_init(struct dnet_node *n, void *state);
+void dnet_checksum_state_update(struct dnet_node *n, void *state, const void *data, uint64_t size);
+void dnet_checksum_state_final(struct dnet_node *n, const void *state, void *csum, int csize);
 
 ssize_t dnet_db_read_raw(struct eblob_backend *b, struct dnet_raw_id *id, void **datap);
 int dnet_db_write_raw(struct eblob_backend *b, struct dnet_raw_id *id, void *data, unsigned int size);
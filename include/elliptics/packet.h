@@ -58,6 +58,9 @@ enum dnet_commands {
 	DNET_CMD_BULK_READ,			/* Read a number of ids at one time */
 	DNET_CMD_DEFRAG,			/* Start defragmentation process if backend supports it */
 	DNET_CMD_ITERATOR,			/* Start/stop/pause/status for server-side iterator */
+	DNET_CMD_CREDIT,			/* Grant flow control credit to transaction */
+	DNET_CMD_MERKLE,			/* Read nodes of the anti-entropy hash tree */
+	DNET_CMD_INDEXES,			/* Update or read secondary index stored at the server */
 	DNET_CMD_UNKNOWN,			/* This slot is allocated for statistics gathered for unknown commands */
 	__DNET_CMD_MAX,
 };
@@ -89,6 +92,10 @@ enum dnet_counters {
 	DNET_CNTR_DBR_ERROR,			/* Kyoto Cabinet DB read error */
 	DNET_CNTR_DBW_SYSTEM,			/* Kyoto Cabinet DB write error KCESYSTEM */
 	DNET_CNTR_DBW_ERROR,			/* Kyoto Cabinet DB write error */
+	DNET_CNTR_READ_SEQUENTIAL,		/* Backend reads which belong to sequential streams */
+	DNET_CNTR_READ_RANDOM,			/* Backend reads which do not belong to any stream */
+	DNET_CNTR_READ_AHEAD,			/* Readahead hints issued by backend */
+	DNET_CNTR_READ_CACHE_DROP,		/* Backend reads dropped from page cache after being sent */
 	DNET_CNTR_UNKNOWN,			/* This slot is allocated for statistics gathered for unknown counters */
 	__DNET_CNTR_MAX,
 };
@@ -122,6 +129,12 @@ enum dnet_counters {
 /* Do not locks operations - must be set for script callers or recursive operations */
 #define DNET_FLAGS_NOLOCK		(1<<4)
 
+/*
+ * Replies are flow controlled: server does not send more than granted window
+ * and waits for DNET_CMD_CREDIT from the client to proceed
+ */
+#define DNET_FLAGS_FLOW_CONTROL		(1<<5)
+
 struct dnet_id {
 	uint8_t			id[DNET_ID_SIZE];
 	uint32_t		group_id;
@@ -189,6 +202,15 @@ static inline void dnet_convert_cmd(struct dnet_cmd *cmd)
 /* Fill ctime/mtime from metadata when processing DNET_CMD_LOOKUP */
 #define DNET_ATTR_META_TIMES			(1ULL<<33)
 
+/*
+ * DNET_CMD_ROUTE_LIST request carries struct dnet_route_list_version,
+ * node only replies with states joined after given version of its route table
+ */
+#define DNET_ATTR_ROUTE_DELTA			(1ULL<<32)
+
+/* DNET_CMD_ROUTE_LIST reply carries struct dnet_route_list_version instead of address container */
+#define DNET_ATTR_ROUTE_VERSION			(1ULL<<33)
+
 /*
  * ascending sort data before returning range request to user
  */
@@ -236,6 +258,24 @@ static inline void dnet_convert_addr_cmd(struct dnet_addr_cmd *acmd)
 	dnet_convert_cmd(&acmd->cmd);
 }
 
+/*
+ * Route table version used in incremental route list exchange.
+ * @generation is random and changes when node restarts, @version grows on every route table change.
+ * If generation does not match or version is from the future, node sends full route list.
+ */
+struct dnet_route_list_version
+{
+	uint64_t		generation;
+	uint64_t		version;
+	uint64_t		reserved[2];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_route_list_version(struct dnet_route_list_version *v)
+{
+	v->generation = dnet_bswap64(v->generation);
+	v->version = dnet_bswap64(v->version);
+}
+
 static inline int dnet_addr_equal(struct dnet_addr *a1, struct dnet_addr *a2)
 {
 	if (a1->family != a2->family)
@@ -332,6 +372,15 @@ static inline void dnet_convert_list(struct dnet_list *l)
  */
 #define DNET_IO_FLAGS_CHECKSUM		(1<<14)
 
+/*
+ * DNET_IO_FLAGS_INLINE_META
+ *
+ * Write request carries metadata container between IO attribute and data,
+ * container size is command size minus IO attribute and @io->size.
+ * Data and metadata are stored within single command, no separate META write is needed.
+ */
+#define DNET_IO_FLAGS_INLINE_META	(1<<15)
+
 struct dnet_io_attr
 {
 	uint8_t			parent[DNET_ID_SIZE];
@@ -550,6 +599,15 @@ static inline void dnet_convert_time(struct dnet_time *tm)
 	tm->tnsec = dnet_bswap64(tm->tnsec);
 }
 
+static inline int dnet_time_cmp(const struct dnet_time *t1, const struct dnet_time *t2)
+{
+	if (t1->tsec != t2->tsec)
+		return (t1->tsec > t2->tsec) ? 1 : -1;
+	if (t1->tnsec != t2->tnsec)
+		return (t1->tnsec > t2->tnsec) ? 1 : -1;
+	return 0;
+}
+
 static inline void dnet_current_time(struct dnet_time *t)
 {
 	struct timeval tv;
@@ -631,6 +689,7 @@ enum dnet_meta_types {
 	DNET_META_NAMESPACE,		/* namespace where given object lives */
 	DNET_META_UPDATE,		/* last update information (timestamp, flags) */
 	DNET_META_CHECKSUM,		/* checksum (sha512) of the whole data object calculated on server */
+	DNET_META_CHECKSUM_STATE,	/* incremental data checksum maintained by server on write */
 	__DNET_META_MAX,
 };
 
@@ -687,11 +746,41 @@ static inline void dnet_convert_meta_checksum(struct dnet_meta_checksum *c)
 	dnet_convert_time(&c->tm);
 }
 
+/*
+ * Checksum of the first @size bytes of the object calculated with @type engine (DNET_CHECKSUM_*)
+ * while data was written. @state is engine-specific incremental state (host byte order),
+ * it is used to continue checksum when data is appended.
+ * @tm is DNET_META_UPDATE timestamp of the metadata stored together with checksum,
+ * zero means data was written and its metadata update is not yet stored.
+ */
+struct dnet_meta_checksum_state {
+	uint64_t		size;
+	uint32_t		type;
+	uint32_t		state_size;
+	uint8_t			checksum[DNET_CSUM_SIZE];
+	struct dnet_time	tm;
+	uint8_t			state[0];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_meta_checksum_state(struct dnet_meta_checksum_state *c)
+{
+	c->size = dnet_bswap64(c->size);
+	c->type = dnet_bswap32(c->type);
+	c->state_size = dnet_bswap32(c->state_size);
+	dnet_convert_time(&c->tm);
+}
+
 /* when set server-side iterator works with data as well as index/metadata,
  * otherwise only index/metadata is stored/sent to back client/disk
  */
 #define DNET_IFLAGS_DATA		(1<<0)
 
+/* only keys within [key, end] range are iterated */
+#define DNET_IFLAGS_KEY_RANGE		(1<<1)
+
+/* only keys updated within [time_begin, time_end] range are iterated */
+#define DNET_IFLAGS_TS_RANGE		(1<<2)
+
 enum dnet_iterator_types {
 	DNET_ITYPE_DISK		= 1,	/* iterator saves data chunks (index/metadata + (optionally) data) locally on
 					 * server to $root/iter/$id instead of sending chunks to client
@@ -700,6 +789,19 @@ enum dnet_iterator_types {
 	DNET_ITYPE_NETWORK,		/* iterator sends data chunks  to client */
 };
 
+/*
+ * Iterator control actions.
+ * DNET_ITERATOR_ACTION_START starts new iterator, its id is returned in every response,
+ * all other actions are applied to already running iterator with given id.
+ */
+enum dnet_iterator_action {
+	DNET_ITERATOR_ACTION_START = 0,
+	DNET_ITERATOR_ACTION_PAUSE,
+	DNET_ITERATOR_ACTION_CONTINUE,
+	DNET_ITERATOR_ACTION_CANCEL,
+	__DNET_ITERATOR_ACTION_MAX,
+};
+
 struct dnet_iterator_request
 {
 	struct dnet_raw_id		key;
@@ -708,7 +810,10 @@ struct dnet_iterator_request
 	uint64_t			id;
 	int				itype;
 	int				status;
-	uint64_t			reserved[5];
+	int				action;
+	int				__pad;
+	struct dnet_time		time_begin;
+	struct dnet_time		time_end;
 } __attribute__ ((packed));
 
 static inline void dnet_convert_iterator_request(struct dnet_iterator_request *r)
@@ -717,6 +822,199 @@ static inline void dnet_convert_iterator_request(struct dnet_iterator_request *r
 	r->id = dnet_bswap64(r->id);
 	r->itype = dnet_bswap32(r->itype);
 	r->status = dnet_bswap32(r->status);
+	r->action = dnet_bswap32(r->action);
+	dnet_convert_time(&r->time_begin);
+	dnet_convert_time(&r->time_end);
+}
+
+/*
+ * Iterator streams one response per found key,
+ * when DNET_IFLAGS_DATA is set, object data follows the structure
+ */
+struct dnet_iterator_response
+{
+	uint64_t			id;
+	struct dnet_raw_id		key;
+	int				status;
+	int				__pad;
+	uint64_t			size;
+	struct dnet_time		timestamp;
+	uint64_t			flags;
+	uint64_t			reserved[4];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_iterator_response(struct dnet_iterator_response *r)
+{
+	r->id = dnet_bswap64(r->id);
+	r->status = dnet_bswap32(r->status);
+	r->size = dnet_bswap64(r->size);
+	dnet_convert_time(&r->timestamp);
+	r->flags = dnet_bswap64(r->flags);
+}
+
+/*
+ * Initial credit of flow controlled transaction,
+ * client returns consumed credit in DNET_CMD_CREDIT requests
+ */
+#define DNET_FLOW_WINDOW_BYTES		(8 * 1024 * 1024)
+#define DNET_FLOW_WINDOW_RECORDS	1024
+
+struct dnet_flow_credit
+{
+	uint64_t			trans;
+	uint64_t			bytes;
+	uint64_t			records;
+	uint64_t			reserved[2];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_flow_credit(struct dnet_flow_credit *c)
+{
+	c->trans = dnet_bswap64(c->trans);
+	c->bytes = dnet_bswap64(c->bytes);
+	c->records = dnet_bswap64(c->records);
+}
+
+/*
+ * Anti-entropy hash tree.
+ *
+ * Every server keeps binary hash tree over the key space, leaf covers keys which share
+ * the first DNET_MERKLE_DEPTH bits. Leaf hash is XOR of digests of its keys' DNET_META_UPDATE,
+ * so trees of several nodes can be combined into tree of the whole group.
+ * Node with non-zero @dirty has at least one leaf with unknown hash below it.
+ */
+#define DNET_MERKLE_DEPTH		16
+#define DNET_MERKLE_LEAVES		(1 << DNET_MERKLE_DEPTH)
+
+struct dnet_merkle_node
+{
+	uint64_t			hash;
+	uint32_t			dirty;
+	uint32_t			__pad;
+} __attribute__ ((packed));
+
+static inline void dnet_convert_merkle_node(struct dnet_merkle_node *m)
+{
+	m->hash = dnet_bswap64(m->hash);
+	m->dirty = dnet_bswap32(m->dirty);
+}
+
+/*
+ * DNET_CMD_MERKLE request: @num node indexes at tree @level (root is level 0).
+ * Reply carries the same header followed by @num struct dnet_merkle_node.
+ */
+struct dnet_merkle_request
+{
+	uint32_t			level;
+	uint32_t			num;
+	uint64_t			reserved[2];
+	uint32_t			index[0];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_merkle_request(struct dnet_merkle_request *r)
+{
+	r->level = dnet_bswap32(r->level);
+	r->num = dnet_bswap32(r->num);
+}
+
+/*
+ * Secondary indexes.
+ *
+ * DNET_CMD_INDEXES is sent to the node which owns index id. Server keeps index entries
+ * sorted by object id in bounded pages stored next to index id, so every update
+ * reads and writes single page, concurrent updates of the same index are serialized
+ * by the server's operation lock instead of client-side compare-and-swap.
+ */
+enum dnet_indexes_ops {
+	DNET_INDEXES_ADD = 1,		/* insert entry or replace its data */
+	DNET_INDEXES_REMOVE,		/* remove entry */
+	DNET_INDEXES_READ,		/* read up to @limit entries (0 - all) starting from @id */
+	DNET_INDEXES_STAT,		/* return struct dnet_indexes_stat */
+	DNET_INDEXES_PROBE,		/* return entries for sorted array of struct dnet_raw_id in request data */
+	DNET_INDEXES_UPDATE,		/* apply sequence of struct dnet_indexes_update_entry in request data */
+};
+
+/* request is followed by @size bytes of entry data */
+struct dnet_indexes_request
+{
+	struct dnet_raw_id		id;
+	uint32_t			op;
+	uint32_t			limit;
+	uint64_t			size;
+	uint64_t			reserved[2];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_indexes_request(struct dnet_indexes_request *r)
+{
+	r->op = dnet_bswap32(r->op);
+	r->limit = dnet_bswap32(r->limit);
+	r->size = dnet_bswap64(r->size);
+}
+
+/* entry is followed by @size bytes of data */
+struct dnet_indexes_entry
+{
+	struct dnet_raw_id		id;
+	uint64_t			size;
+} __attribute__ ((packed));
+
+static inline void dnet_convert_indexes_entry(struct dnet_indexes_entry *e)
+{
+	e->size = dnet_bswap64(e->size);
+}
+
+/*
+ * DNET_INDEXES_UPDATE element, it is followed by @size bytes of entry data,
+ * @op is either DNET_INDEXES_ADD or DNET_INDEXES_REMOVE
+ */
+struct dnet_indexes_update_entry
+{
+	struct dnet_raw_id		id;
+	uint32_t			op;
+	uint32_t			reserved;
+	uint64_t			size;
+} __attribute__ ((packed));
+
+static inline void dnet_convert_indexes_update_entry(struct dnet_indexes_update_entry *e)
+{
+	e->op = dnet_bswap32(e->op);
+	e->size = dnet_bswap64(e->size);
+}
+
+/* there are more entries after the last one returned by DNET_INDEXES_READ */
+#define DNET_INDEXES_FLAGS_MORE		(1<<0)
+
+/*
+ * DNET_INDEXES_READ and DNET_INDEXES_PROBE send one reply per index page,
+ * every reply carries this header followed by @num entries.
+ */
+struct dnet_indexes_reply
+{
+	uint32_t			num;
+	uint32_t			flags;
+	uint64_t			reserved[2];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_indexes_reply(struct dnet_indexes_reply *r)
+{
+	r->num = dnet_bswap32(r->num);
+	r->flags = dnet_bswap32(r->flags);
+}
+
+/*
+ * DNET_INDEXES_STAT reply, number of entries is kept in the index root
+ * and updated by every change of the index.
+ */
+struct dnet_indexes_stat
+{
+	uint64_t			pages;
+	uint64_t			entries;
+	uint64_t			reserved[4];
+} __attribute__ ((packed));
+
+static inline void dnet_convert_indexes_stat(struct dnet_indexes_stat *s)
+{
+	s->pages = dnet_bswap64(s->pages);
+	s->entries = dnet_bswap64(s->entries);
 }
 
 /*
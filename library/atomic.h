@@ -63,6 +63,22 @@ static inline int atomic_dec(atomic_t *a)
 
 #define atomic_dec_and_test(a) (atomic_dec(a) == 0)
 
+/*
+ * Increment counter unless it is zero, returns non-zero if counter was incremented
+ */
+static inline int atomic_inc_not_zero(atomic_t *a)
+{
+	int val;
+
+	do {
+		val = a->val;
+		if (!val)
+			return 0;
+	} while (!__sync_bool_compare_and_swap(&a->val, val, val + 1));
+
+	return 1;
+}
+
 #else
 
 #include "lock.h"
@@ -132,6 +148,20 @@ static inline int atomic_dec(atomic_t *a)
 
 #define atomic_dec_and_test(a) (atomic_dec(a) == 0)
 
+static inline int atomic_inc_not_zero(atomic_t *a)
+{
+	int res = 0;
+
+	dnet_lock_lock(&a->lock);
+	if (a->val) {
+		a->val++;
+		res = 1;
+	}
+	dnet_lock_unlock(&a->lock);
+
+	return res;
+}
+
 #endif
 
 #ifdef __cplusplus
@@ -16,6 +16,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 
 #include <dirent.h>
 #include <errno.h>
@@ -189,6 +190,43 @@ err_out_exit:
 }
 */
 
+/*
+ * Fills reply for @id from in-memory metadata index when decision does not need stored metadata:
+ * key is absent locally or remote copy is newer. Returns -EAGAIN when metadata has to be read,
+ * local CHECK_STATUS is updated for keys which are up to date.
+ */
+static int dnet_bulk_check_index(struct dnet_node *n, struct dnet_bulk_id *id)
+{
+	struct dnet_meta_index_entry e;
+	struct dnet_meta_update mu;
+	int err;
+
+	err = dnet_meta_index_lookup(n, id->id.id, &e);
+	if (err == -EAGAIN)
+		return err;
+
+	mu = id->last_update;
+	dnet_convert_meta_update(&mu);
+
+	if (err) {
+		/* Meta is not present - set timestamp to very old one */
+		mu.tm.tsec = 1;
+		mu.flags = 0;
+	} else if (!(e.state & DNET_META_INDEX_UPDATE)) {
+		return 0;
+	} else if ((e.flags & DNET_IO_FLAGS_REMOVED) || (e.tm.tsec < mu.tm.tsec) ||
+			((e.tm.tnsec < mu.tm.tnsec) && (e.tm.tsec == mu.tm.tsec))) {
+		mu.tm = e.tm;
+		mu.flags = e.flags;
+	} else {
+		return -EAGAIN;
+	}
+
+	dnet_convert_meta_update(&mu);
+	id->last_update = mu;
+	return 0;
+}
+
 int dnet_cmd_bulk_check(struct dnet_net_state *orig, struct dnet_cmd *cmd, void *data)
 {
 	struct dnet_bulk_id *ids = (struct dnet_bulk_id *)data;
@@ -212,6 +250,10 @@ int dnet_cmd_bulk_check(struct dnet_net_state *orig, struct dnet_cmd *cmd, void
 			}
 
 			dnet_log(orig->n, DNET_LOG_DEBUG, "BULK: processing ID %s\n", dnet_dump_id_str(ids[i].id.id));
+
+			if (!dnet_bulk_check_index(orig->n, &ids[i]))
+				continue;
+
 			mc.data = NULL;
 			dnet_setup_id(&mc.id, 0, ids[i].id.id);
 			err = orig->n->cb->meta_read(orig->n->cb->command_private, &ids[i].id, &mc.data);
@@ -276,9 +318,9 @@ err_out_exit:
 }
 
 struct dnet_bulk_check_priv {
-	struct dnet_wait *w;
+	struct dnet_bulk_state *state;
 	struct dnet_check_temp_db *db;
-	atomic_t refcnt;
+	int status;
 	int group_num;
 	int *groups;
 };
@@ -557,13 +599,21 @@ static int dnet_bulk_check_complete(struct dnet_net_state *state, struct dnet_cm
 	int err = 0, i;
 
 	if (is_trans_destroyed(state, cmd)) {
-		dnet_wakeup(p->w, p->w->cond++);
-		dnet_wait_put(p->w);
+		struct dnet_bulk_state *bs = p->state;
+
+		if (cmd && cmd->status)
+			p->status = cmd->status;
+
+		pthread_mutex_lock(&bs->state_lock);
+		if (p->status)
+			bs->batch_errors++;
+		bs->in_flight--;
+		pthread_cond_broadcast(&bs->state_wait);
+		pthread_mutex_unlock(&bs->state_lock);
+
 		dnet_check_temp_db_put(p->db);
-		if (atomic_dec_and_test(&p->refcnt)) {
-			free(p->groups);
-			free(p);
-		}
+		free(p->groups);
+		free(p);
 		return 0;
 	}
 
@@ -602,41 +652,104 @@ static int dnet_bulk_check_complete(struct dnet_net_state *state, struct dnet_cm
 				(unsigned long long)cmd->size, sizeof(struct dnet_bulk_id));
 	}
 
-	p->w->status = cmd->status;
+	if (cmd->status)
+		p->status = cmd->status;
 	return err;
 }
 
+int dnet_bulk_state_init(struct dnet_bulk_state *state)
+{
+	int err;
+
+	state->in_flight = 0;
+	state->batches = 0;
+	state->batch_errors = 0;
+	state->ids_sent = 0;
+
+	err = pthread_mutex_init(&state->state_lock, NULL);
+	if (err)
+		return -err;
+
+	err = pthread_cond_init(&state->state_wait, NULL);
+	if (err) {
+		pthread_mutex_destroy(&state->state_lock);
+		return -err;
+	}
+
+	return 0;
+}
+
+/*
+ * Waits until all batches sent to the peer are completed.
+ * Transaction is always completed, either by reply or by timeout, so wait is not limited.
+ */
+void dnet_bulk_state_wait(struct dnet_bulk_state *state)
+{
+	pthread_mutex_lock(&state->state_lock);
+	while (state->in_flight > 0)
+		pthread_cond_wait(&state->state_wait, &state->state_lock);
+	pthread_mutex_unlock(&state->state_lock);
+}
+
+void dnet_bulk_state_destroy(struct dnet_bulk_state *state)
+{
+	pthread_cond_destroy(&state->state_wait);
+	pthread_mutex_destroy(&state->state_lock);
+}
+
+/*
+ * Sends accumulated ids to the peer without waiting for reply,
+ * blocks only if there are already @params->window batches in flight to this peer.
+ * Ids are copied into transaction, so state buffer can be reused right after return.
+ */
 int dnet_request_bulk_check(struct dnet_node *n, struct dnet_bulk_state *state, struct dnet_check_params *params)
 {
 	struct dnet_trans_control ctl;
 	struct dnet_net_state *st;
 	struct dnet_bulk_check_priv *p;
-	struct timespec	wait_ts;
-	int err;
+	struct timespec ts;
+	struct timeval tv;
+	int window = params->window > 0 ? params->window : DNET_BULK_CHECK_WINDOW;
+	int in_flight, err = 0;
+
+	gettimeofday(&tv, NULL);
+	ts.tv_sec = tv.tv_sec + n->wait_ts.tv_sec * DNET_BULK_IDS_SIZE;
+	ts.tv_nsec = tv.tv_usec * 1000;
+
+	pthread_mutex_lock(&state->state_lock);
+	while (state->in_flight >= window && !err)
+		err = -pthread_cond_timedwait(&state->state_wait, &state->state_lock, &ts);
+	if (!err)
+		state->in_flight++;
+	pthread_mutex_unlock(&state->state_lock);
 
-	p = (struct dnet_bulk_check_priv *)malloc(sizeof(struct dnet_bulk_check_priv));
-	if (!p) {
-		err = -ENOMEM;
+	if (err)
 		goto err_out_exit;
-	}
-	atomic_init(&p->refcnt, 2);
-	p->db = params->db;
-	dnet_check_temp_db_get(p->db);
 
-	p->w = dnet_wait_alloc(0);
-	if (!p->w) {
+	p = (struct dnet_bulk_check_priv *)malloc(sizeof(struct dnet_bulk_check_priv));
+	if (!p) {
 		err = -ENOMEM;
-		goto err_out_free;
+		goto err_out_release;
 	}
+	memset(p, 0, sizeof(struct dnet_bulk_check_priv));
 
+	p->state = state;
 	p->group_num = params->group_num;
 	p->groups = (int *)malloc(sizeof(int) * params->group_num);
-	if (!p->groups) {
+	if (!p->groups && params->group_num) {
 		err = -ENOMEM;
-		goto err_out_put;
+		goto err_out_free;
 	}
 	memcpy(p->groups, params->groups, sizeof(int) * params->group_num);
 
+	st = dnet_state_search_by_addr(n, &state->addr);
+	if (!st) {
+		err = -ENXIO;
+		goto err_out_free_groups;
+	}
+
+	p->db = dnet_check_temp_db_get(params->db);
+
 	memset(&ctl, 0, sizeof(struct dnet_trans_control));
 
 	ctl.cmd = DNET_CMD_LIST;
@@ -647,50 +760,37 @@ int dnet_request_bulk_check(struct dnet_node *n, struct dnet_bulk_state *state,
 	ctl.data = state->ids;
 	ctl.size = sizeof(struct dnet_bulk_id) * state->num;
 
-	st = dnet_state_search_by_addr(n, &state->addr);
-	if (!st) {
-		err = -ENXIO;
-		goto err_out_put;
-	}
 	dnet_setup_id(&ctl.id, st->idc->group->group_id, st->idc->ids[0].raw.id);
-	dnet_wait_get(p->w);
-
-	dnet_log(n, DNET_LOG_DEBUG, "BULK: sending %u bytes of data to %s (%s)\n",
-			ctl.size, dnet_dump_id(&ctl.id), dnet_server_convert_dnet_addr(&state->addr));
-	err = dnet_trans_alloc_send_state(st, &ctl);
-	dnet_state_put(st);
-
-	wait_ts = n->wait_ts;
-	wait_ts.tv_sec *= DNET_BULK_IDS_SIZE;
-	err = dnet_wait_event(p->w, p->w->cond != 0, &wait_ts);
-	if (err)
-		goto err_out_put;
 
-	if (p->w->status) {
-		err = p->w->status;
-		goto err_out_put;
-	}
+	pthread_mutex_lock(&state->state_lock);
+	state->batches++;
+	state->ids_sent += state->num;
+	in_flight = state->in_flight;
+	pthread_mutex_unlock(&state->state_lock);
 
-	dnet_wait_put(p->w);
+	dnet_log(n, DNET_LOG_DEBUG, "BULK: sending %u bytes of data to %s (%s), in flight: %d/%d\n",
+			ctl.size, dnet_dump_id(&ctl.id), dnet_server_convert_dnet_addr(&state->addr),
+			in_flight, window);
 
-	if (atomic_dec_and_test(&p->refcnt)) {
-		free(p->groups);
-		free(p);
-	}
-
-	return 0;
+	/* completion callback is invoked on error too, it releases window slot */
+	err = dnet_trans_alloc_send_state(st, &ctl);
+	dnet_state_put(st);
 
-err_out_put:
-	dnet_wait_put(p->w);
+	return err;
 
+err_out_free_groups:
+	free(p->groups);
 err_out_free:
-	if (atomic_dec_and_test(&p->refcnt)) {
-		free(p->groups);
-		free(p);
-	}
-
+	free(p);
+err_out_release:
+	pthread_mutex_lock(&state->state_lock);
+	state->in_flight--;
+	state->batch_errors++;
+	pthread_cond_broadcast(&state->state_wait);
+	pthread_mutex_unlock(&state->state_lock);
 err_out_exit:
-	dnet_log(n, DNET_LOG_ERROR, "Bulk check exited with status %d\n", err);
+	dnet_log(n, DNET_LOG_ERROR, "BULK: failed to send bulk check to %s: %d\n",
+			dnet_server_convert_dnet_addr(&state->addr), err);
 	return err;
 }
 
@@ -930,6 +1030,599 @@ err_out_exit:
 	return err;
 }
 
+/*
+ * Batched merge.
+ *
+ * Keys which do not belong to this node any more are queued by iterating thread instead of being
+ * moved one by one. Full queue is sorted by destination node, destination's META_UPDATE for all its
+ * keys is fetched with single bulk check request, and objects which have to be moved are streamed
+ * directly from backend files (sendfile) with up to DNET_MERGE_WINDOW transfers in flight.
+ * Metadata is written only after data is acknowledged, local copy is removed only after metadata.
+ * Transfers are paced by node-wide merge_bandwidth/merge_iops budget.
+ */
+
+enum dnet_merge_action {
+	DNET_MERGE_SKIP = 0,		/* destination has the same or newer version */
+	DNET_MERGE_SEND,		/* local version is newer, move it */
+	DNET_MERGE_REMOVE,		/* local version is newer and removed, remove destination's copy */
+	DNET_MERGE_SLOW,		/* can not decide using bulk reply, use per-key merge */
+};
+
+struct dnet_merge_entry {
+	struct dnet_addr		addr;
+	struct dnet_meta_container	mc;
+	struct dnet_merge_batch		*batch;
+	int				seq;
+	int				action;
+
+	/* protected by batch lock */
+	int				status;
+	int				trans;
+	int				acked;
+	uint64_t			size;
+};
+
+struct dnet_merge_batch {
+	struct dnet_node		*n;
+	struct dnet_session		*s;
+
+	pthread_mutex_t			lock;
+	pthread_cond_t			wait;
+	int				in_flight;
+
+	int				num;
+	struct dnet_merge_entry		*entries;
+
+	/* bulk check request and reply for destination being processed */
+	struct dnet_bulk_id		*ids;
+	int				ids_num;
+	int				ids_received;
+	int				fetch_status;
+};
+
+static int dnet_merge_compare_addr(const struct dnet_addr *a1, const struct dnet_addr *a2)
+{
+	if (a1->addr_len != a2->addr_len)
+		return (int)a1->addr_len - (int)a2->addr_len;
+
+	return memcmp(a1->addr, a2->addr, a1->addr_len);
+}
+
+static int dnet_merge_compare_entry(const void *k1, const void *k2)
+{
+	const struct dnet_merge_entry *e1 = k1;
+	const struct dnet_merge_entry *e2 = k2;
+	int cmp;
+
+	cmp = dnet_merge_compare_addr(&e1->addr, &e2->addr);
+	if (cmp)
+		return cmp;
+
+	/* keep iteration order within destination, so blob files are read sequentially */
+	return e1->seq - e2->seq;
+}
+
+/*
+ * Paces merge transfers: every object takes a time slot sized by its length and by IOPS limit,
+ * caller sleeps until its slot starts. Slots are shared by all merging threads.
+ */
+static void dnet_merge_throttle(struct dnet_node *n, uint64_t size)
+{
+	struct timespec ts;
+	struct timeval tv;
+	uint64_t now, cost = 0, delay = 0;
+
+	if (!n->merge_bandwidth && !n->merge_iops)
+		return;
+
+	if (n->merge_bandwidth > 0)
+		cost = size * 1000000 / ((uint64_t)n->merge_bandwidth * 1024 * 1024);
+	if (n->merge_iops > 0 && cost < 1000000ULL / n->merge_iops)
+		cost = 1000000ULL / n->merge_iops;
+
+	gettimeofday(&tv, NULL);
+	now = tv.tv_sec * 1000000ULL + tv.tv_usec;
+
+	pthread_mutex_lock(&n->merge_lock);
+	if (n->merge_next < now)
+		n->merge_next = now;
+	delay = n->merge_next - now;
+	n->merge_next += cost;
+	pthread_mutex_unlock(&n->merge_lock);
+
+	if (delay) {
+		ts.tv_sec = delay / 1000000;
+		ts.tv_nsec = (delay % 1000000) * 1000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static void dnet_merge_slot_get(struct dnet_merge_batch *b, int window)
+{
+	pthread_mutex_lock(&b->lock);
+	while (b->in_flight >= window)
+		pthread_cond_wait(&b->wait, &b->lock);
+	b->in_flight++;
+	pthread_mutex_unlock(&b->lock);
+}
+
+static void dnet_merge_slot_put(struct dnet_merge_batch *b)
+{
+	pthread_mutex_lock(&b->lock);
+	b->in_flight--;
+	pthread_cond_broadcast(&b->wait);
+	pthread_mutex_unlock(&b->lock);
+}
+
+/*
+ * Transaction is always completed, either by reply or by timeout, so wait is not limited.
+ */
+static void dnet_merge_wait(struct dnet_merge_batch *b)
+{
+	pthread_mutex_lock(&b->lock);
+	while (b->in_flight > 0)
+		pthread_cond_wait(&b->wait, &b->lock);
+	pthread_mutex_unlock(&b->lock);
+}
+
+static int dnet_merge_fetch_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct dnet_merge_batch *b = priv;
+	int err;
+
+	err = is_trans_destroyed(st, cmd);
+	if (err) {
+		pthread_mutex_lock(&b->lock);
+		if (err < 0 && !b->fetch_status)
+			b->fetch_status = err;
+		pthread_mutex_unlock(&b->lock);
+
+		dnet_merge_slot_put(b);
+		return 0;
+	}
+
+	pthread_mutex_lock(&b->lock);
+	if (cmd->status) {
+		b->fetch_status = cmd->status;
+	} else if (cmd->size == sizeof(struct dnet_bulk_id) * b->ids_num) {
+		/* the rest are empty keepalive replies */
+		memcpy(b->ids, cmd + 1, cmd->size);
+		b->ids_received = b->ids_num;
+	}
+	pthread_mutex_unlock(&b->lock);
+
+	return 0;
+}
+
+/*
+ * Sends local META_UPDATE of @num keys to their destination and gets back destination's ones
+ * in @b->ids, see dnet_cmd_bulk_check().
+ */
+static int dnet_merge_fetch_remote(struct dnet_merge_batch *b, struct dnet_merge_entry *e, int num)
+{
+	struct dnet_node *n = b->n;
+	struct dnet_trans_control ctl;
+	struct dnet_net_state *st;
+	struct dnet_meta_update mu;
+	int i, err;
+
+	st = dnet_state_search_by_addr(n, &e->addr);
+	if (!st)
+		return -ENXIO;
+
+	for (i = 0; i < num; ++i) {
+		memset(&b->ids[i], 0, sizeof(struct dnet_bulk_id));
+		memcpy(&b->ids[i].id, e[i].mc.id.id, DNET_ID_SIZE);
+
+		if (dnet_get_meta_update(n, &e[i].mc, &mu)) {
+			dnet_convert_meta_update(&mu);
+			memcpy(&b->ids[i].last_update, &mu, sizeof(struct dnet_meta_update));
+		}
+	}
+
+	b->ids_num = num;
+	b->ids_received = 0;
+	b->fetch_status = 0;
+
+	memset(&ctl, 0, sizeof(struct dnet_trans_control));
+
+	ctl.cmd = DNET_CMD_LIST;
+	ctl.complete = dnet_merge_fetch_complete;
+	ctl.priv = b;
+	ctl.cflags = DNET_FLAGS_NEED_ACK | DNET_FLAGS_NOLOCK | DNET_ATTR_BULK_CHECK;
+
+	ctl.data = b->ids;
+	ctl.size = sizeof(struct dnet_bulk_id) * num;
+
+	dnet_setup_id(&ctl.id, st->idc->group->group_id, st->idc->ids[0].raw.id);
+
+	dnet_merge_slot_get(b, DNET_MERGE_WINDOW);
+	dnet_trans_alloc_send_state(st, &ctl);
+	dnet_state_put(st);
+
+	dnet_merge_wait(b);
+
+	err = b->fetch_status;
+	if (!err && b->ids_received != num)
+		err = -EPROTO;
+
+	return err;
+}
+
+static int dnet_merge_decide(struct dnet_node *n, struct dnet_merge_entry *e, struct dnet_bulk_id *id)
+{
+	struct dnet_meta_update local, remote;
+
+	if (!dnet_get_meta_update(n, &e->mc, &local)) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: MERGE: META_UPDATE not found in local meta\n", dnet_dump_id(&e->mc.id));
+		return -ENOENT;
+	}
+
+	memcpy(&remote, &id->last_update, sizeof(struct dnet_meta_update));
+	dnet_convert_meta_update(&remote);
+
+	/*
+	 * Destination returns request entry untouched when its metadata has no META_UPDATE,
+	 * this is not distinguishable from equal versions with bulk reply
+	 */
+	if (!memcmp(&local, &remote, sizeof(struct dnet_meta_update)))
+		return DNET_MERGE_SLOW;
+
+	if ((local.tm.tsec > remote.tm.tsec) || (local.tm.tsec == remote.tm.tsec && local.tm.tnsec > remote.tm.tnsec)) {
+		if (local.flags & DNET_IO_FLAGS_REMOVED)
+			return DNET_MERGE_REMOVE;
+
+		return DNET_MERGE_SEND;
+	}
+
+	return DNET_MERGE_SKIP;
+}
+
+static void dnet_merge_set_status(struct dnet_merge_batch *b, struct dnet_merge_entry *e, int err)
+{
+	pthread_mutex_lock(&b->lock);
+	if (err && !e->status)
+		e->status = err;
+	pthread_mutex_unlock(&b->lock);
+}
+
+static int dnet_merge_write_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct dnet_merge_entry *e = priv;
+	struct dnet_merge_batch *b = e->batch;
+	int err;
+
+	err = is_trans_destroyed(st, cmd);
+	if (err) {
+		if (err < 0)
+			dnet_merge_set_status(b, e, err);
+
+		dnet_merge_slot_put(b);
+		return 0;
+	}
+
+	pthread_mutex_lock(&b->lock);
+	if (cmd->status) {
+		if (!e->status)
+			e->status = cmd->status;
+	} else if (!(cmd->flags & DNET_FLAGS_MORE)) {
+		e->acked++;
+	}
+	pthread_mutex_unlock(&b->lock);
+
+	return 0;
+}
+
+static void dnet_merge_write(struct dnet_merge_batch *b, struct dnet_merge_entry *e, struct dnet_io_control *ctl)
+{
+	int trans_num;
+
+	ctl->cmd = DNET_CMD_WRITE;
+	ctl->cflags = DNET_FLAGS_NEED_ACK | dnet_session_get_cflags(b->s);
+	ctl->complete = dnet_merge_write_complete;
+	ctl->priv = e;
+
+	memcpy(ctl->io.id, ctl->id.id, DNET_ID_SIZE);
+
+	/* session is bound to our own group, so there is exactly one transaction */
+	dnet_merge_slot_get(b, DNET_MERGE_WINDOW);
+	trans_num = dnet_write_object(b->s, ctl);
+
+	pthread_mutex_lock(&b->lock);
+	e->trans += trans_num;
+	pthread_mutex_unlock(&b->lock);
+}
+
+static int dnet_merge_send_record(void *priv, struct dnet_id *id, int fd, uint64_t offset, uint64_t size)
+{
+	struct dnet_merge_entry *e = priv;
+	struct dnet_merge_batch *b = e->batch;
+	struct dnet_io_control ctl;
+
+	dnet_merge_throttle(b->n, size);
+
+	memset(&ctl, 0, sizeof(struct dnet_io_control));
+
+	ctl.fd = fd;
+	ctl.local_offset = offset;
+
+	memcpy(&ctl.id, id, sizeof(struct dnet_id));
+
+	ctl.io.offset = 0;
+	ctl.io.size = size;
+	ctl.io.type = id->type;
+	ctl.io.flags = 0;
+
+	dnet_merge_write(b, e, &ctl);
+
+	e->size += size;
+	return 0;
+}
+
+static int dnet_merge_send(struct dnet_merge_batch *b, struct dnet_merge_entry *e)
+{
+	struct dnet_node *n = b->n;
+	struct dnet_net_state *base;
+	struct dnet_id id;
+	int err;
+
+	if (n->cb->locate) {
+		memcpy(&id, &e->mc.id, sizeof(struct dnet_id));
+		id.type = -1;
+
+		return n->cb->locate(n->cb->command_private, &id, dnet_merge_send_record, e);
+	}
+
+	/* backend can not expose its files, it sends object itself and waits for completion */
+	base = dnet_node_state(n);
+	if (!base)
+		return -ENXIO;
+
+	dnet_merge_throttle(n, 0);
+	err = n->cb->send(base, n->cb->command_private, &e->mc.id);
+	dnet_state_put(base);
+
+	return err < 0 ? err : 0;
+}
+
+static void dnet_merge_send_meta(struct dnet_merge_batch *b, struct dnet_merge_entry *e)
+{
+	struct dnet_io_control ctl;
+
+	if (b->n->flags & DNET_CFG_NO_META)
+		return;
+
+	memset(&ctl, 0, sizeof(struct dnet_io_control));
+
+	ctl.fd = -1;
+
+	ctl.data = e->mc.data;
+	ctl.io.size = e->mc.size;
+	ctl.io.flags = DNET_IO_FLAGS_META;
+
+	memcpy(&ctl.id, &e->mc.id, sizeof(struct dnet_id));
+	ctl.id.type = ctl.io.type = EBLOB_TYPE_META;
+
+	dnet_merge_write(b, e, &ctl);
+}
+
+/*
+ * Moves @num keys which belong to the same destination node.
+ */
+static void dnet_merge_peer(struct dnet_merge_batch *b, struct dnet_merge_entry *e, int num,
+		struct dnet_merge_stat *stat)
+{
+	struct dnet_node *n = b->n;
+	int moved = 0, removed = 0, skipped = 0, failed = 0;
+	uint64_t bytes = 0;
+	int i, err;
+
+	err = dnet_merge_fetch_remote(b, e, num);
+	if (err)
+		dnet_log(n, DNET_LOG_ERROR, "MERGE: %s: failed to get destination's metadata, merging %d keys one by one: %d\n",
+				dnet_server_convert_dnet_addr(&e->addr), num, err);
+
+	/* data goes first */
+	for (i = 0; i < num; ++i) {
+		int status = 0;
+
+		e[i].action = err ? DNET_MERGE_SLOW : dnet_merge_decide(n, &e[i], &b->ids[i]);
+
+		switch (e[i].action) {
+		case DNET_MERGE_SKIP:
+			break;
+		case DNET_MERGE_SEND:
+			status = dnet_merge_send(b, &e[i]);
+			break;
+		case DNET_MERGE_REMOVE:
+			dnet_merge_throttle(n, 0);
+			status = dnet_remove_object_now(b->s, &e[i].mc.id);
+			break;
+		case DNET_MERGE_SLOW:
+			dnet_merge_throttle(n, e[i].mc.size);
+			status = dnet_check_merge(b->s, &e[i].mc);
+			break;
+		default:
+			status = e[i].action;
+			break;
+		}
+
+		dnet_merge_set_status(b, &e[i], status);
+	}
+	dnet_merge_wait(b);
+
+	/* metadata only for objects which have reached destination */
+	for (i = 0; i < num; ++i) {
+		if (e[i].action == DNET_MERGE_SEND && !e[i].status && e[i].acked == e[i].trans)
+			dnet_merge_send_meta(b, &e[i]);
+	}
+	dnet_merge_wait(b);
+
+	for (i = 0; i < num; ++i) {
+		if (e[i].status || e[i].acked != e[i].trans) {
+			dnet_log(n, DNET_LOG_ERROR, "%s: MERGE: failed to move key to %s: action: %d, status: %d, "
+					"acked: %d/%d\n", dnet_dump_id(&e[i].mc.id), dnet_server_convert_dnet_addr(&e[i].addr),
+					e[i].action, e[i].status, e[i].acked, e[i].trans);
+			failed++;
+			continue;
+		}
+
+		dnet_merge_remove_local(n, &e[i].mc.id, 0);
+
+		if (e[i].action == DNET_MERGE_SKIP) {
+			skipped++;
+		} else if (e[i].action == DNET_MERGE_REMOVE) {
+			removed++;
+		} else {
+			moved++;
+			bytes += e[i].size;
+		}
+	}
+
+	__sync_fetch_and_add(&stat->moved, moved);
+	__sync_fetch_and_add(&stat->removed, removed);
+	__sync_fetch_and_add(&stat->skipped, skipped);
+	__sync_fetch_and_add(&stat->failed, failed);
+	__sync_fetch_and_add(&stat->bytes, bytes);
+
+	dnet_log(n, DNET_LOG_INFO, "MERGE: %s: keys: %d, moved: %d (%llu bytes), removed: %d, "
+			"up to date: %d, failed: %d\n",
+			dnet_server_convert_dnet_addr(&e->addr), num, moved, (unsigned long long)bytes,
+			removed, skipped, failed);
+}
+
+struct dnet_merge_batch *dnet_merge_batch_alloc(struct dnet_node *n)
+{
+	struct dnet_merge_batch *b;
+	int err;
+
+	b = malloc(sizeof(struct dnet_merge_batch));
+	if (!b)
+		goto err_out_exit;
+	memset(b, 0, sizeof(struct dnet_merge_batch));
+
+	b->n = n;
+
+	b->entries = malloc(sizeof(struct dnet_merge_entry) * DNET_MERGE_BATCH_SIZE);
+	if (!b->entries)
+		goto err_out_free;
+
+	b->ids = malloc(sizeof(struct dnet_bulk_id) * DNET_MERGE_BATCH_SIZE);
+	if (!b->ids)
+		goto err_out_free_entries;
+
+	b->s = dnet_session_create(n);
+	if (!b->s)
+		goto err_out_free_ids;
+	dnet_session_set_groups(b->s, (int *)&n->id.group_id, 1);
+
+	err = pthread_mutex_init(&b->lock, NULL);
+	if (err)
+		goto err_out_destroy_session;
+
+	err = pthread_cond_init(&b->wait, NULL);
+	if (err)
+		goto err_out_destroy_lock;
+
+	return b;
+
+err_out_destroy_lock:
+	pthread_mutex_destroy(&b->lock);
+err_out_destroy_session:
+	dnet_session_destroy(b->s);
+err_out_free_ids:
+	free(b->ids);
+err_out_free_entries:
+	free(b->entries);
+err_out_free:
+	free(b);
+err_out_exit:
+	dnet_log(n, DNET_LOG_ERROR, "MERGE: failed to allocate merge batch\n");
+	return NULL;
+}
+
+void dnet_merge_batch_flush(struct dnet_merge_batch *b, struct dnet_check_params *params)
+{
+	struct dnet_merge_stat *stat = &params->merge_stat;
+	struct timeval tv;
+	long elapsed;
+	int i, start;
+
+	if (!b->num)
+		return;
+
+	qsort(b->entries, b->num, sizeof(struct dnet_merge_entry), dnet_merge_compare_entry);
+
+	for (start = 0, i = 1; i <= b->num; ++i) {
+		if (i < b->num && !dnet_merge_compare_addr(&b->entries[start].addr, &b->entries[i].addr))
+			continue;
+
+		dnet_merge_peer(b, &b->entries[start], i - start, stat);
+		start = i;
+	}
+
+	for (i = 0; i < b->num; ++i)
+		free(b->entries[i].mc.data);
+	b->num = 0;
+
+	gettimeofday(&tv, NULL);
+	elapsed = tv.tv_sec - stat->start.tv_sec;
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	dnet_log(b->n, DNET_LOG_INFO, "MERGE: progress: moved: %llu (%llu MB, %llu MB/s), removed: %llu, "
+			"up to date: %llu, failed: %llu\n",
+			(unsigned long long)stat->moved, (unsigned long long)stat->bytes >> 20,
+			(unsigned long long)(stat->bytes >> 20) / elapsed,
+			(unsigned long long)stat->removed, (unsigned long long)stat->skipped,
+			(unsigned long long)stat->failed);
+}
+
+void dnet_merge_batch_free(struct dnet_merge_batch *b, struct dnet_check_params *params)
+{
+	dnet_merge_batch_flush(b, params);
+
+	pthread_cond_destroy(&b->wait);
+	pthread_mutex_destroy(&b->lock);
+	dnet_session_destroy(b->s);
+	free(b->ids);
+	free(b->entries);
+	free(b);
+}
+
+static int dnet_merge_batch_add(struct dnet_merge_batch *b, struct dnet_meta_container *mc,
+		struct dnet_check_params *params)
+{
+	struct dnet_merge_entry *e;
+	struct dnet_net_state *st;
+
+	st = dnet_state_get_first(b->n, &mc->id);
+	if (!st)
+		return 0;
+
+	e = &b->entries[b->num];
+	memset(e, 0, sizeof(struct dnet_merge_entry));
+
+	memcpy(&e->addr, &st->addr, sizeof(struct dnet_addr));
+	dnet_state_put(st);
+
+	e->mc.data = malloc(mc->size);
+	if (!e->mc.data)
+		return -ENOMEM;
+
+	memcpy(e->mc.data, mc->data, mc->size);
+	e->mc.size = mc->size;
+	memcpy(&e->mc.id, &mc->id, sizeof(struct dnet_id));
+
+	e->batch = b;
+	e->seq = b->num;
+
+	if (++b->num == DNET_MERGE_BATCH_SIZE)
+		dnet_merge_batch_flush(b, params);
+
+	return 0;
+}
+
 int dnet_check(struct dnet_node *n, struct dnet_meta_container *mc, struct dnet_bulk_array *bulk_array,
 		int need_merge, struct dnet_check_params *params)
 {
@@ -938,7 +1631,9 @@ int dnet_check(struct dnet_node *n, struct dnet_meta_container *mc, struct dnet_
 	dnet_session_set_groups(s, (int *)&n->id.group_id, 1);
 
 	dnet_log(n, DNET_LOG_DEBUG, "need_merge = %d, mc.size = %d\n", need_merge, mc->size);
-	if (need_merge) {
+	if (need_merge && bulk_array && bulk_array->merge) {
+		err = dnet_merge_batch_add(bulk_array->merge, mc, params);
+	} else if (need_merge) {
 		err = dnet_check_merge(s, mc);
 		dnet_log(n, DNET_LOG_DEBUG, "err=%d\n", err);
 		if (!err)
@@ -44,8 +44,8 @@ static int dnet_check_complete(struct dnet_net_state *state, struct dnet_cmd *cm
 
 		dnet_convert_check_reply(r);
 
-		dnet_log(state->n, DNET_LOG_INFO, "check: total: %d, completed: %d, errors: %d\n",
-				r->total, r->completed, r->errors);
+		dnet_log(state->n, DNET_LOG_INFO, "check: total: %d, completed: %d, errors: %d, merged: %d (%d MB)\n",
+				r->total, r->completed, r->errors, r->merged, r->merged_mb);
 	}
 
 	w->status = cmd->status;
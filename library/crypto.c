@@ -17,7 +17,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
+#include <string.h>
 
 #include "elliptics.h"
 #include "elliptics/interface.h"
@@ -55,6 +57,232 @@ static int dnet_local_digest_transform(void *priv __unused, const void *src, uin
 	return 0;
 }
 
+/*
+ * CRC32C (Castagnoli) content checksum.
+ * Software implementation processes data with slicing-by-8 tables,
+ * on x86_64 CPUs with SSE4.2 crc32 instruction is used instead, it is selected at runtime.
+ */
+#define DNET_CRC32C_POLY	0x82f63b78
+
+static uint32_t dnet_crc32c_table[8][256];
+static pthread_once_t dnet_crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t (* dnet_crc32c_update)(uint32_t crc, const unsigned char *p, uint64_t size);
+
+static uint32_t dnet_crc32c_sw(uint32_t crc, const unsigned char *p, uint64_t size)
+{
+	while (size && ((unsigned long)p & 7)) {
+		crc = dnet_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		size--;
+	}
+
+	while (size >= 8) {
+		uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+		uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+
+		crc = dnet_crc32c_table[7][lo & 0xff] ^
+			dnet_crc32c_table[6][(lo >> 8) & 0xff] ^
+			dnet_crc32c_table[5][(lo >> 16) & 0xff] ^
+			dnet_crc32c_table[4][lo >> 24] ^
+			dnet_crc32c_table[3][hi & 0xff] ^
+			dnet_crc32c_table[2][(hi >> 8) & 0xff] ^
+			dnet_crc32c_table[1][(hi >> 16) & 0xff] ^
+			dnet_crc32c_table[0][hi >> 24];
+
+		p += 8;
+		size -= 8;
+	}
+
+	while (size--)
+		crc = dnet_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define DNET_CRC32C_HW
+
+static uint32_t __attribute__ ((target("sse4.2"))) dnet_crc32c_hw(uint32_t crc, const unsigned char *p, uint64_t size)
+{
+	uint64_t crc64;
+
+	while (size && ((unsigned long)p & 7)) {
+		crc = __builtin_ia32_crc32qi(crc, *p++);
+		size--;
+	}
+
+	crc64 = crc;
+	while (size >= 8) {
+		crc64 = __builtin_ia32_crc32di(crc64, *(const uint64_t *)p);
+		p += 8;
+		size -= 8;
+	}
+	crc = crc64;
+
+	while (size--)
+		crc = __builtin_ia32_crc32qi(crc, *p++);
+
+	return crc;
+}
+#endif
+
+static void dnet_crc32c_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; ++i) {
+		crc = i;
+		for (j = 0; j < 8; ++j)
+			crc = (crc & 1) ? (crc >> 1) ^ DNET_CRC32C_POLY : crc >> 1;
+
+		dnet_crc32c_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; ++i) {
+		crc = dnet_crc32c_table[0][i];
+		for (j = 1; j < 8; ++j) {
+			crc = dnet_crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			dnet_crc32c_table[j][i] = crc;
+		}
+	}
+
+	dnet_crc32c_update = dnet_crc32c_sw;
+#ifdef DNET_CRC32C_HW
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+		dnet_crc32c_update = dnet_crc32c_hw;
+#endif
+}
+
+static void dnet_sha512_state_init(void *state)
+{
+	sha512_init_ctx(state);
+}
+
+static void dnet_sha512_state_update(void *state, const void *data, uint64_t size)
+{
+	sha512_process_bytes(data, size, state);
+}
+
+static void dnet_sha512_state_final(const void *state, unsigned char *hash)
+{
+	struct sha512_ctx ctx;
+
+	memcpy(&ctx, state, sizeof(struct sha512_ctx));
+	sha512_finish_ctx(&ctx, hash);
+}
+
+static void dnet_crc32c_state_init(void *state)
+{
+	pthread_once(&dnet_crc32c_once, dnet_crc32c_init);
+	*(uint32_t *)state = ~0U;
+}
+
+static void dnet_crc32c_state_update(void *state, const void *data, uint64_t size)
+{
+	*(uint32_t *)state = dnet_crc32c_update(*(uint32_t *)state, data, size);
+}
+
+static void dnet_crc32c_state_final(const void *state, unsigned char *hash)
+{
+	uint32_t crc = ~*(const uint32_t *)state;
+
+	memset(hash, 0, 64);
+	hash[0] = crc & 0xff;
+	hash[1] = (crc >> 8) & 0xff;
+	hash[2] = (crc >> 16) & 0xff;
+	hash[3] = crc >> 24;
+}
+
+/*
+ * Incremental checksum engines, state is opaque and stored in host byte order,
+ * final() does not change state, so it can be continued with more data later.
+ */
+struct dnet_checksum_engine {
+	const char		*name;
+	unsigned int		state_size;
+	void			(* init)(void *state);
+	void			(* update)(void *state, const void *data, uint64_t size);
+	void			(* final)(const void *state, unsigned char *hash);
+};
+
+static struct dnet_checksum_engine dnet_checksum_engines[] = {
+	[DNET_CHECKSUM_SHA512] = {
+		.name		= "sha512",
+		.state_size	= sizeof(struct sha512_ctx),
+		.init		= dnet_sha512_state_init,
+		.update		= dnet_sha512_state_update,
+		.final		= dnet_sha512_state_final,
+	},
+	[DNET_CHECKSUM_CRC32C] = {
+		.name		= "crc32c",
+		.state_size	= sizeof(uint32_t),
+		.init		= dnet_crc32c_state_init,
+		.update		= dnet_crc32c_state_update,
+		.final		= dnet_crc32c_state_final,
+	},
+};
+
+static int dnet_local_crc32c_transform(void *priv __unused, const void *src, uint64_t size,
+		void *dst, unsigned int *dsize, unsigned int flags __unused)
+{
+	unsigned int rs = *dsize;
+	unsigned char hash[64];
+	uint32_t crc;
+
+	dnet_crc32c_state_init(&crc);
+	dnet_crc32c_state_update(&crc, src, size);
+	dnet_crc32c_state_final(&crc, hash);
+
+	dnet_transform_final(dst, hash, dsize, rs);
+	return 0;
+}
+
+int dnet_checksum_type_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < __DNET_CHECKSUM_MAX; ++i) {
+		if (!strcmp(name, dnet_checksum_engines[i].name))
+			return i;
+	}
+
+	return -ENOENT;
+}
+
+const char *dnet_checksum_name(int type)
+{
+	if (type < 0 || type >= __DNET_CHECKSUM_MAX)
+		return "unknown";
+
+	return dnet_checksum_engines[type].name;
+}
+
+unsigned int dnet_checksum_state_size(struct dnet_node *n)
+{
+	return dnet_checksum_engines[n->checksum_type].state_size;
+}
+
+void dnet_checksum_state_init(struct dnet_node *n, void *state)
+{
+	dnet_checksum_engines[n->checksum_type].init(state);
+}
+
+void dnet_checksum_state_update(struct dnet_node *n, void *state, const void *data, uint64_t size)
+{
+	dnet_checksum_engines[n->checksum_type].update(state, data, size);
+}
+
+void dnet_checksum_state_final(struct dnet_node *n, const void *state, void *csum, int csize)
+{
+	unsigned char hash[64];
+	unsigned int rs = csize;
+
+	dnet_checksum_engines[n->checksum_type].final(state, hash);
+	dnet_transform_final(csum, hash, &rs, csize);
+}
+
 void dnet_crypto_cleanup(struct dnet_node *n __unused)
 {
 }
@@ -62,9 +290,28 @@ void dnet_crypto_cleanup(struct dnet_node *n __unused)
 int dnet_crypto_init(struct dnet_node *n)
 {
 	struct dnet_transform *t = &n->transform;
+	struct dnet_transform *c = &n->checksum;
 
 	t->transform = dnet_local_digest_transform;
 	t->priv = NULL;
 
+	c->priv = NULL;
+
+	switch (n->checksum_type) {
+		case DNET_CHECKSUM_SHA512:
+			c->transform = dnet_local_digest_transform;
+			break;
+		case DNET_CHECKSUM_CRC32C:
+			pthread_once(&dnet_crc32c_once, dnet_crc32c_init);
+			c->transform = dnet_local_crc32c_transform;
+
+			dnet_log(n, DNET_LOG_INFO, "Using %s crc32c data checksum.\n",
+					dnet_crc32c_update == dnet_crc32c_sw ? "software" : "hardware");
+			break;
+		default:
+			dnet_log(n, DNET_LOG_ERROR, "Unsupported data checksum type %d.\n", n->checksum_type);
+			return -EINVAL;
+	}
+
 	return 0;
 }
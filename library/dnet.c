@@ -117,6 +117,9 @@ int dnet_remove_local(struct dnet_node *n, struct dnet_id *id)
 	err = n->cb->command_handler(n->st, n->cb->command_private, cmd, io);
 	dnet_log(n, DNET_LOG_NOTICE, "%s: local remove: err: %d.\n", dnet_dump_id(&cmd->id), err);
 
+	if (n->flags & DNET_CFG_WRITE_CSUM)
+		dnet_meta_remove_checksum(n, id->id);
+
 	free(cmd);
 
 err_out_exit:
@@ -124,6 +127,110 @@ err_out_exit:
 
 }
 
+/* local read in progress in this thread, replies to its command are copied here instead of being sent */
+struct dnet_read_local_priv {
+	struct dnet_cmd		*cmd;
+	void			*data;
+	uint64_t		size;
+};
+
+static __thread struct dnet_read_local_priv *dnet_read_local_current;
+
+static int dnet_read_local_copy(struct dnet_read_local_priv *p, struct dnet_io_attr *io, void *data,
+		int fd, uint64_t offset, int on_exit)
+{
+	uint64_t end = io->offset + io->size, done = 0;
+	ssize_t err = 0;
+	void *tmp;
+
+	if (!p->data || end > p->size) {
+		tmp = realloc(p->data, end ? end : 1);
+		if (!tmp) {
+			err = -ENOMEM;
+			goto err_out_close;
+		}
+
+		if (end > p->size) {
+			memset(tmp + p->size, 0, end - p->size);
+			p->size = end;
+		}
+		p->data = tmp;
+	}
+
+	if (data) {
+		memcpy(p->data + io->offset, data, io->size);
+		goto err_out_close;
+	}
+
+	while (done < io->size) {
+		err = pread(fd, p->data + io->offset + done, io->size - done, offset + done);
+		if (err <= 0) {
+			err = err ? -errno : -EIO;
+			goto err_out_close;
+		}
+
+		done += err;
+	}
+	err = 0;
+
+err_out_close:
+	if (fd >= 0 && (on_exit & DNET_IO_REQ_FLAGS_CLOSE))
+		close(fd);
+	return err;
+}
+
+/*
+ * Reads whole local record through backend's command handler, it is used when backend
+ * can not expose its files via locate(). Returns -ENOENT if there is no such key.
+ */
+int dnet_read_local(struct dnet_node *n, struct dnet_id *id, void **datap, uint64_t *sizep)
+{
+	struct dnet_read_local_priv p;
+	struct dnet_net_state *base;
+	struct dnet_cmd cmd;
+	struct dnet_io_attr io;
+	int err;
+
+	memset(&p, 0, sizeof(p));
+	memset(&cmd, 0, sizeof(cmd));
+	memset(&io, 0, sizeof(io));
+
+	memcpy(&cmd.id, id, sizeof(struct dnet_id));
+	cmd.size = sizeof(struct dnet_io_attr);
+	cmd.flags = DNET_FLAGS_NOLOCK;
+	cmd.cmd = DNET_CMD_READ;
+
+	memcpy(io.id, id->id, DNET_ID_SIZE);
+	memcpy(io.parent, id->id, DNET_ID_SIZE);
+	io.type = id->type;
+
+	dnet_convert_io_attr(&io);
+
+	base = dnet_node_state(n);
+	if (!base)
+		return -ENXIO;
+
+	p.cmd = &cmd;
+	dnet_read_local_current = &p;
+	err = n->cb->command_handler(base, n->cb->command_private, &cmd, &io);
+	dnet_read_local_current = NULL;
+
+	dnet_state_put(base);
+
+	if (err >= 0 && !p.data)
+		err = -ENOENT;
+	if (err < 0)
+		goto err_out_free;
+
+	*datap = p.data;
+	*sizep = p.size;
+	return 0;
+
+err_out_free:
+	free(p.data);
+	return err;
+}
+
 static void dnet_send_idc_fill(struct dnet_net_state *st, struct dnet_addr_cmd *acmd, int total_size,
 		struct dnet_id *id, uint64_t trans, unsigned int command, int reply, int direct, int more)
 {
@@ -313,21 +420,67 @@ err_out_exit:
 	return err;
 }
 
-static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd)
+static int dnet_route_list_send_version(struct dnet_net_state *orig, struct dnet_cmd *cmd)
+{
+	struct dnet_node *n = orig->n;
+	struct {
+		struct dnet_cmd			cmd;
+		struct dnet_route_list_version	ver;
+	} __attribute__ ((packed)) reply;
+
+	memset(&reply, 0, sizeof(reply));
+
+	reply.cmd.id = cmd->id;
+	reply.cmd.cmd = DNET_CMD_ROUTE_LIST;
+	reply.cmd.trans = cmd->trans | DNET_TRANS_REPLY;
+	reply.cmd.flags = DNET_FLAGS_NOLOCK | DNET_FLAGS_MORE | DNET_ATTR_ROUTE_VERSION;
+	reply.cmd.size = sizeof(struct dnet_route_list_version);
+
+	reply.ver.generation = n->route_generation;
+	reply.ver.version = n->route_version;
+
+	dnet_convert_route_list_version(&reply.ver);
+	dnet_convert_cmd(&reply.cmd);
+
+	return dnet_send(orig, &reply, sizeof(reply));
+}
+
+/*
+ * Sends states of the local route table to @orig.
+ * When request carries DNET_ATTR_ROUTE_DELTA only states joined after requested version
+ * are sent (or all of them if version belongs to different node incarnation or nothing was
+ * sent over this connection yet), reply is finished with current version of the local route table.
+ */
+static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd, void *data)
 {
 	struct dnet_node *n = orig->n;
+	struct dnet_route_list_version *ver = NULL;
 	struct dnet_net_state *st;
 	struct dnet_group *g;
 	void *buf = NULL;
 	size_t size, orig_size = 0;
-	int err;
+	int err, delta = 0, sent = 0, total = 0;
+
+	if ((cmd->flags & DNET_ATTR_ROUTE_DELTA) && (cmd->size >= sizeof(struct dnet_route_list_version))) {
+		ver = data;
+		dnet_convert_route_list_version(ver);
+	}
 
 	pthread_mutex_lock(&n->state_lock);
+
+	if (ver && orig->route_list_sent && (ver->generation == n->route_generation) &&
+			(ver->version <= n->route_version))
+		delta = 1;
+
 	list_for_each_entry(g, &n->group_list, group_entry) {
 		list_for_each_entry(st, &g->state_list, state_entry) {
 			if (dnet_addr_equal(&st->addr, &orig->addr) || !st->addrs)
 				continue;
 
+			total++;
+			if (delta && (st->route_join_version <= ver->version))
+				continue;
+
 			size = st->idc->id_num * sizeof(struct dnet_raw_id) +
 				sizeof(struct dnet_addr_cmd) + n->addr_num * sizeof(struct dnet_addr);
 
@@ -353,10 +506,20 @@ static int dnet_cmd_route_list(struct dnet_net_state *orig, struct dnet_cmd *cmd
 			err = dnet_send(orig, buf, size);
 			if (err)
 				goto err_out_unlock;
+
+			sent++;
 		}
 	}
 
 	err = 0;
+	if (ver)
+		err = dnet_route_list_send_version(orig, cmd);
+	if (!err)
+		orig->route_list_sent = 1;
+
+	dnet_log(n, DNET_LOG_INFO, "%s: route list: %s, sent states: %d/%d, version: %llu, err: %d\n",
+			dnet_state_dump_addr(orig), delta ? "delta" : "full", sent, total,
+			(unsigned long long)n->route_version, err);
 
 err_out_unlock:
 	pthread_mutex_unlock(&n->state_lock);
@@ -449,6 +612,9 @@ static int dnet_cmd_stat_count_global(struct dnet_net_state *orig, struct dnet_c
 	}
 	as->count[DNET_CNTR_NODE_FILES].count = n->cb->meta_total_elements(n->cb->command_private);
 
+	if (n->cb->storage_counters)
+		n->cb->storage_counters(n->cb->command_private, as->count);
+
 	dnet_convert_addr_stat(as, as->num);
 
 	return dnet_send_reply(orig, cmd, as, sizeof(struct dnet_addr_stat) + __DNET_CNTR_MAX * sizeof(struct dnet_stat_count), 1);
@@ -584,29 +750,69 @@ int dnet_send_ack(struct dnet_net_state *st, struct dnet_cmd *cmd, int err)
 	return err;
 }
 
-static int dnet_cmd_iterator(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data __unused)
+/*
+ * Metadata sent inline with the write is copied out and IO attribute is moved
+ * right before the data, so that backends receive plain write request.
+ */
+static int dnet_io_inline_meta(struct dnet_net_state *st, struct dnet_cmd *cmd,
+		struct dnet_io_attr **iop, void **metap, unsigned int *meta_sizep)
 {
-	size_t buffer_size = sizeof(struct dnet_iterator_request) + 20;
-	char *buffer = alloca(buffer_size);
-	size_t i;
-	struct dnet_iterator_request *request = (struct dnet_iterator_request *)buffer;
-
-	memset(buffer, 0, sizeof(struct dnet_iterator_request));
-	memset(buffer + sizeof(struct dnet_iterator_request), ' ', 20);
-
-	for (i = 0; i < 3; ++i) {
-		if ((i % 2) == 0)
-			sleep(1);
-
-		request->id = i;
-		memcpy(request->key.id, cmd->id.id, sizeof(cmd->id.id));
-		memset(buffer + sizeof(struct dnet_iterator_request), 'a' + i, 20);
-		dnet_send_reply(st, cmd, buffer, buffer_size, 1);
+	struct dnet_io_attr *io = *iop;
+	uint64_t size = cmd->size - sizeof(struct dnet_io_attr);
+	void *meta;
+
+	if (size < io->size || size - io->size > UINT_MAX) {
+		dnet_log(st->n, DNET_LOG_ERROR, "%s: invalid inline metadata: cmd size: %llu, io size: %llu\n",
+				dnet_dump_id(&cmd->id), (unsigned long long)cmd->size, (unsigned long long)io->size);
+		return -EINVAL;
 	}
 
+	size -= io->size;
+
+	meta = malloc(size + 1);
+	if (!meta)
+		return -ENOMEM;
+
+	memcpy(meta, io + 1, size);
+
+	io = memmove((void *)io + size, io, sizeof(struct dnet_io_attr));
+	io->flags &= ~DNET_IO_FLAGS_INLINE_META;
+	cmd->size -= size;
+
+	*iop = io;
+	*metap = meta;
+	*meta_sizep = size;
 	return 0;
 }
 
+/*
+ * CAS parent is SHA-512 of the data calculated by client, so backend checksum is only
+ * usable when node checksums content with the same engine. Otherwise the record is read
+ * and hashed with the id transform. Returns -ENOENT if there is no data.
+ */
+static int dnet_cas_checksum(struct dnet_node *n, struct dnet_id *id, void *csum, int csize)
+{
+	void *data;
+	uint64_t size;
+	int err;
+
+	if (n->checksum_type == DNET_CHECKSUM_SHA512) {
+		if (!n->cb->checksum)
+			return -ENOTSUP;
+
+		return n->cb->checksum(n, n->cb->command_private, id, csum, &csize);
+	}
+
+	err = dnet_read_local(n, id, &data, &size);
+	if (err)
+		return err;
+
+	err = dnet_transform_node(n, data, size, csum, csize);
+	free(data);
+
+	return err;
+}
+
 int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
 {
 	int err = 0;
@@ -614,6 +820,10 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 	struct dnet_node *n = st->n;
 	unsigned long long tid = cmd->trans & ~DNET_TRANS_REPLY;
 	struct dnet_io_attr *io;
+	struct dnet_io_attr csum_io;
+	int update_csum = 0;
+	void *meta = NULL;
+	unsigned int meta_size = 0;
 	struct timeval start, end;
 	long diff;
 
@@ -621,6 +831,14 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 		dnet_oplock(n, &cmd->id);
 	}
 
+	err = dnet_flow_register(st, cmd);
+	if (err) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: %s: trans: %llu: failed to register flow control: %d, replies are not throttled\n",
+				dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), tid, err);
+		cmd->flags &= ~DNET_FLAGS_FLOW_CONTROL;
+		err = 0;
+	}
+
 	gettimeofday(&start, NULL);
 
 	switch (cmd->cmd) {
@@ -637,7 +855,7 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 			err = dnet_cmd_join_client(st, cmd, data);
 			break;
 		case DNET_CMD_ROUTE_LIST:
-			err = dnet_cmd_route_list(st, cmd);
+			err = dnet_cmd_route_list(st, cmd, data);
 			break;
 		case DNET_CMD_EXEC:
 			err = dnet_cmd_exec(st, cmd, data);
@@ -645,6 +863,12 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 		case DNET_CMD_ITERATOR:
 			err = dnet_cmd_iterator(st, cmd, data);
 			break;
+		case DNET_CMD_MERKLE:
+			err = dnet_cmd_merkle(st, cmd, data);
+			break;
+		case DNET_CMD_INDEXES:
+			err = dnet_cmd_indexes(st, cmd, data);
+			break;
 		case DNET_CMD_STAT_COUNT:
 			err = dnet_cmd_stat_count(st, cmd, data);
 			break;
@@ -709,6 +933,19 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 				break;
 			}
 
+			if ((cmd->cmd == DNET_CMD_WRITE) && (io->flags & DNET_IO_FLAGS_INLINE_META)) {
+				if (io->flags & (DNET_IO_FLAGS_CACHE_ONLY | DNET_IO_FLAGS_META)) {
+					err = -EINVAL;
+					break;
+				}
+
+				err = dnet_io_inline_meta(st, cmd, &io, &meta, &meta_size);
+				if (err)
+					break;
+
+				data = io;
+			}
+
 			/*
 			 * Only allow cache for column 0
 			 * In the next life (2012 I really expect) there will be no columns at all
@@ -740,14 +977,12 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 				char csum[DNET_ID_SIZE];
 				int csize = DNET_ID_SIZE;
 
-				if (!n->cb->checksum) {
-					err = -ENOTSUP;
+				err = dnet_cas_checksum(n, &cmd->id, csum, csize);
+				if (err == -ENOTSUP) {
 					dnet_log(n, DNET_LOG_ERROR, "%s: cas: checksum operation is not supported in backend\n",
 							dnet_dump_id(&cmd->id));
 					break;
 				}
-
-				err = n->cb->checksum(n, n->cb->command_private, &cmd->id, csum, &csize);
 				if (err < 0 && err != -ENOENT) {
 					dnet_log(n, DNET_LOG_ERROR, "%s: cas: checksum operation failed\n", dnet_dump_id(&cmd->id));
 					break;
@@ -774,6 +1009,14 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 				break;
 			}
 
+			if ((cmd->cmd == DNET_CMD_WRITE) && (n->flags & DNET_CFG_WRITE_CSUM) &&
+					!(n->flags & DNET_CFG_NO_META) && (io->type == 0)) {
+				update_csum = 1;
+			}
+
+			if (update_csum || meta)
+				memcpy(&csum_io, io, sizeof(struct dnet_io_attr));
+
 			dnet_convert_io_attr(io);
 		default:
 			/* Remove DNET_FLAGS_NEED_ACK flags for WRITE command 
@@ -791,6 +1034,18 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 				cmd->flags |= DNET_FLAGS_NEED_ACK;
 			}
 
+			if (!err && meta) {
+				/*
+				 * Data is already written and its reply was sent without ack,
+				 * so metadata failure is reported with error ack.
+				 */
+				err = dnet_meta_write_inline(n, &csum_io, data + sizeof(struct dnet_io_attr),
+						meta, meta_size, update_csum);
+				if (err)
+					cmd->flags |= DNET_FLAGS_NEED_ACK;
+			} else if (!err && update_csum)
+				dnet_meta_update_checksum(n, &csum_io, data + sizeof(struct dnet_io_attr), NULL, 0);
+
 			if (!err && (cmd->cmd == DNET_CMD_WRITE)) {
 				dnet_update_notify(st, cmd, data);
 			}
@@ -810,6 +1065,10 @@ int dnet_process_cmd_raw(struct dnet_net_state *st, struct dnet_cmd *cmd, void *
 			dnet_dump_id(&cmd->id), dnet_cmd_string(cmd->cmd), tid,
 			(unsigned long long)cmd->flags, diff, err);
 
+	dnet_flow_unregister(st, cmd);
+
+	free(meta);
+
 	err = dnet_send_ack(st, cmd, err);
 
 	if (!(cmd->flags & DNET_FLAGS_NOLOCK))
@@ -1019,6 +1278,13 @@ int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *
 	if (io->flags & DNET_IO_FLAGS_SKIP_SENDING)
 		return 0;
 
+	if (dnet_read_local_current && dnet_read_local_current->cmd == cmd)
+		return dnet_read_local_copy(dnet_read_local_current, io, data, fd, offset, on_exit);
+
+	err = dnet_flow_consume_io(st, cmd, io->size);
+	if (err)
+		goto err_out_exit;
+
 	c = malloc(hsize);
 	if (!c) {
 		err = -ENOMEM;
@@ -1055,9 +1321,14 @@ int dnet_send_read_data(void *state, struct dnet_cmd *cmd, struct dnet_io_attr *
 
 	if (io->flags & DNET_IO_FLAGS_CHECKSUM) {
 		if (data) {
-			err = dnet_checksum_data(n, data, io->size, io->parent, sizeof(io->parent));
+			err = dnet_checksum_data(n, data, io->size, rio->parent, sizeof(rio->parent));
 		} else {
-			err = dnet_checksum_fd(n, fd, offset, io->size, io->parent, sizeof(io->parent));
+			/* checksum of the object's head could be calculated while it was written */
+			err = -ENOENT;
+			if (!io->offset)
+				err = dnet_meta_read_checksum(n, io->id, io->size, rio->parent, sizeof(rio->parent));
+			if (err)
+				err = dnet_checksum_fd(n, fd, offset, io->size, rio->parent, sizeof(rio->parent));
 		}
 
 		if (err)
@@ -1088,9 +1359,18 @@ int dnet_read_file_info(struct dnet_node *n, struct dnet_id *id, struct dnet_fil
 	struct dnet_meta *m;
 	struct dnet_meta_update *mu;
 	struct dnet_meta_container mc;
+	struct dnet_meta_index_entry e;
 	struct dnet_raw_id raw;
 	int err;
 
+	err = dnet_meta_index_lookup(n, id->id, &e);
+	if (!err && (e.state & DNET_META_INDEX_UPDATE)) {
+		info->mtime = e.tm;
+		return 0;
+	}
+	if (err == -ENOENT)
+		return err;
+
 	memcpy(raw.id, id->id, DNET_ID_SIZE);
 
 	err = n->cb->meta_read(n->cb->command_private, &raw, &mc.data);
@@ -1260,7 +1540,9 @@ err_out_exit:
 
 int dnet_checksum_data(struct dnet_node *n, const void *data, uint64_t size, unsigned char *csum, int csize)
 {
-	return dnet_transform_node(n, data, size, csum, csize);
+	struct dnet_transform *t = &n->checksum;
+
+	return t->transform(t->priv, data, size, csum, (unsigned int *)&csize, 0);
 }
 
 int dnet_checksum_file(struct dnet_node *n, const char *file, uint64_t offset, uint64_t size, void *csum, int csize)
@@ -94,6 +94,9 @@ static char *dnet_cmd_strings[] = {
 	[DNET_CMD_BULK_READ] = "BULK_READ",
 	[DNET_CMD_DEFRAG] = "DEFRAG",
 	[DNET_CMD_ITERATOR] = "ITERATOR",
+	[DNET_CMD_CREDIT] = "CREDIT",
+	[DNET_CMD_MERKLE] = "MERKLE",
+	[DNET_CMD_INDEXES] = "INDEXES",
 	[DNET_CMD_UNKNOWN] = "UNKNOWN",
 };
 
@@ -124,6 +127,10 @@ static char *dnet_counter_strings[] = {
 	[DNET_CNTR_DBR_ERROR] = "DNET_CNTR_DBR_ERROR",
 	[DNET_CNTR_DBW_SYSTEM] = "DNET_CNTR_DBW_SYSTEM",
 	[DNET_CNTR_DBW_ERROR] = "DNET_CNTR_DBW_ERROR",
+	[DNET_CNTR_READ_SEQUENTIAL] = "DNET_CNTR_READ_SEQUENTIAL",
+	[DNET_CNTR_READ_RANDOM] = "DNET_CNTR_READ_RANDOM",
+	[DNET_CNTR_READ_AHEAD] = "DNET_CNTR_READ_AHEAD",
+	[DNET_CNTR_READ_CACHE_DROP] = "DNET_CNTR_READ_CACHE_DROP",
 	[DNET_CNTR_UNKNOWN] = "UNKNOWN",
 };
 
@@ -286,9 +293,24 @@ err_out_exit:
 	return err;
 }
 
+struct dnet_route_list_priv {
+	struct dnet_wait		*w;
+
+	/* remote route table version received in DNET_ATTR_ROUTE_VERSION reply */
+	int				have_version;
+	struct dnet_route_list_version	ver;
+
+	/* some received states were not added, they have to be requested again */
+	int				failed;
+
+	/* value of @route_resets when request was sent, version is not remembered if states were removed since */
+	uint64_t			resets;
+};
+
 static int dnet_recv_route_list_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
 {
-	struct dnet_wait *w = priv;
+	struct dnet_route_list_priv *p = priv;
+	struct dnet_wait *w = p->w;
 	struct dnet_addr_container *cnt;
 	long size;
 	int err, num;
@@ -298,9 +320,23 @@ static int dnet_recv_route_list_complete(struct dnet_net_state *st, struct dnet_
 		if (cmd)
 			err = cmd->status;
 
+		/*
+		 * Next route list request will only ask for changes since this version,
+		 * so it is only remembered when every received state was processed
+		 */
+		if (st && !err && p->have_version && !p->failed) {
+			pthread_mutex_lock(&st->n->state_lock);
+			if (p->resets == st->n->route_resets) {
+				st->route_generation = p->ver.generation;
+				st->route_version = p->ver.version;
+			}
+			pthread_mutex_unlock(&st->n->state_lock);
+		}
+
 		w->status = err;
 		dnet_wakeup(w, w->cond = 1);
 		dnet_wait_put(w);
+		free(p);
 		goto err_out_exit;
 	}
 
@@ -309,6 +345,18 @@ static int dnet_recv_route_list_complete(struct dnet_net_state *st, struct dnet_
 	if (!cmd->size || err)
 		goto err_out_exit;
 
+	if (cmd->flags & DNET_ATTR_ROUTE_VERSION) {
+		if (cmd->size < sizeof(struct dnet_route_list_version)) {
+			err = -EINVAL;
+			goto err_out_exit;
+		}
+
+		memcpy(&p->ver, cmd + 1, sizeof(struct dnet_route_list_version));
+		dnet_convert_route_list_version(&p->ver);
+		p->have_version = 1;
+		goto err_out_exit;
+	}
+
 	size = cmd->size + sizeof(struct dnet_cmd);
 	if (size < (signed)sizeof(struct dnet_addr_cmd)) {
 		err = -EINVAL;
@@ -330,39 +378,68 @@ static int dnet_recv_route_list_complete(struct dnet_net_state *st, struct dnet_
 	}
 
 	err = dnet_process_route_reply(st, cnt, cmd->id.group_id, num);
+	if (err && err != -EEXIST)
+		p->failed = 1;
 
 err_out_exit:
 	return err;
 }
 
+/*
+ * Requests route list from given state.
+ * Only states joined since the last successfully received version of its route table are requested,
+ * remote node sends full list if it does not recognize the version (or does not support versions at all).
+ */
 int dnet_recv_route_list(struct dnet_net_state *st)
 {
 	struct dnet_io_req req;
 	struct dnet_node *n = st->n;
+	struct dnet_route_list_priv *p;
+	struct dnet_route_list_version *ver;
 	struct dnet_trans *t;
 	struct dnet_cmd *cmd;
 	struct dnet_wait *w;
 	int err;
 
+	p = malloc(sizeof(struct dnet_route_list_priv));
+	if (!p) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(p, 0, sizeof(struct dnet_route_list_priv));
+
 	w = dnet_wait_alloc(0);
 	if (!w) {
 		err = -ENOMEM;
-		goto err_out_exit;
+		goto err_out_free;
 	}
+	p->w = w;
 
-	t = dnet_trans_alloc(n, sizeof(struct dnet_cmd));
+	t = dnet_trans_alloc(n, sizeof(struct dnet_cmd) + sizeof(struct dnet_route_list_version));
 	if (!t) {
 		err = -ENOMEM;
 		goto err_out_wait_put;
 	}
 
 	t->complete = dnet_recv_route_list_complete;
-	t->priv = w;
+	t->priv = p;
 
 	cmd = (struct dnet_cmd *)(t + 1);
+	ver = (struct dnet_route_list_version *)(cmd + 1);
 
-	cmd->flags = DNET_FLAGS_NEED_ACK | DNET_FLAGS_DIRECT | DNET_FLAGS_NOLOCK;
+	cmd->flags = DNET_FLAGS_NEED_ACK | DNET_FLAGS_DIRECT | DNET_FLAGS_NOLOCK | DNET_ATTR_ROUTE_DELTA;
 	cmd->status = 0;
+	cmd->size = sizeof(struct dnet_route_list_version);
+
+	memset(ver, 0, sizeof(struct dnet_route_list_version));
+
+	pthread_mutex_lock(&n->state_lock);
+	p->resets = n->route_resets;
+	ver->generation = st->route_generation;
+	ver->version = st->route_version;
+	pthread_mutex_unlock(&n->state_lock);
+
+	dnet_convert_route_list_version(ver);
 
 	memcpy(&t->cmd, cmd, sizeof(struct dnet_cmd));
 
@@ -379,7 +456,7 @@ int dnet_recv_route_list(struct dnet_net_state *st)
 	memset(&req, 0, sizeof(req));
 	req.st = st;
 	req.header = cmd;
-	req.hsize = sizeof(struct dnet_cmd);
+	req.hsize = sizeof(struct dnet_cmd) + sizeof(struct dnet_route_list_version);
 
 	dnet_wait_get(w);
 	err = dnet_trans_send(t, &req);
@@ -392,9 +469,15 @@ int dnet_recv_route_list(struct dnet_net_state *st)
 	return 0;
 
 err_out_destroy:
+	/* completion callback frees @p */
 	dnet_trans_put(t);
+	dnet_wait_put(w);
+	return err;
+
 err_out_wait_put:
 	dnet_wait_put(w);
+err_out_free:
+	free(p);
 err_out_exit:
 	return err;
 }
@@ -624,11 +707,18 @@ static struct dnet_trans *dnet_io_trans_create(struct dnet_session *s, struct dn
 	struct dnet_cmd *cmd;
 	uint64_t size = ctl->io.size;
 	uint64_t tsize = sizeof(struct dnet_io_attr) + sizeof(struct dnet_cmd);
+	unsigned int meta_size = 0;
 	int err;
 
 	if (ctl->cmd == DNET_CMD_READ)
 		size = 0;
 
+	/* inline metadata is placed between IO attribute and data */
+	if ((ctl->cmd == DNET_CMD_WRITE) && (ctl->io.flags & DNET_IO_FLAGS_INLINE_META)) {
+		meta_size = ctl->meta_size;
+		tsize += meta_size;
+	}
+
 	if (ctl->fd < 0 && size < DNET_COPY_IO_SIZE)
 		tsize += size;
 
@@ -644,15 +734,18 @@ static struct dnet_trans *dnet_io_trans_create(struct dnet_session *s, struct dn
 	cmd = (struct dnet_cmd *)(t + 1);
 	io = (struct dnet_io_attr *)(cmd + 1);
 
+	if (meta_size)
+		memcpy(io + 1, ctl->meta, meta_size);
+
 	if (ctl->fd < 0 && size < DNET_COPY_IO_SIZE) {
 		if (size) {
-			void *data = io + 1;
+			void *data = (void *)(io + 1) + meta_size;
 			memcpy(data, ctl->data, size);
 		}
 	}
 
 	memcpy(&cmd->id, &ctl->id, sizeof(struct dnet_id));
-	cmd->size = sizeof(struct dnet_io_attr) + size;
+	cmd->size = sizeof(struct dnet_io_attr) + meta_size + size;
 	cmd->flags = ctl->cflags;
 	cmd->status = 0;
 
@@ -741,7 +834,7 @@ int dnet_write_object(struct dnet_session *s, struct dnet_io_control *ctl)
 }
 
 static int dnet_write_file_id_raw(struct dnet_session *s, const char *file, struct dnet_id *id,
-		uint64_t local_offset, uint64_t remote_offset, uint64_t size)
+		uint64_t local_offset, uint64_t remote_offset, uint64_t size, struct dnet_meta_container *mc)
 {
 	struct dnet_node *n = s->node;
 	int fd, err, trans_num;
@@ -807,11 +900,17 @@ static int dnet_write_file_id_raw(struct dnet_session *s, const char *file, stru
 	memcpy(ctl.io.id, id->id, DNET_ID_SIZE);
 	memcpy(ctl.io.parent, id->id, DNET_ID_SIZE);
 
-	ctl.io.flags = dnet_session_get_ioflags(s);
+	ctl.io.flags = dnet_session_get_ioflags(s) & ~DNET_IO_FLAGS_INLINE_META;
 	ctl.io.size = size;
 	ctl.io.offset = remote_offset;
 	ctl.io.type = id->type;
 
+	if (mc) {
+		ctl.io.flags |= DNET_IO_FLAGS_INLINE_META;
+		ctl.meta = mc->data;
+		ctl.meta_size = mc->size;
+	}
+
 	memcpy(&ctl.id, id, sizeof(struct dnet_id));
 
 	trans_num = dnet_write_object(s, &ctl);
@@ -853,30 +952,54 @@ err_out_exit:
 	return err;
 }
 
-int dnet_write_file_id(struct dnet_session *s, const char *file, struct dnet_id *id, uint64_t local_offset,
-		uint64_t remote_offset, uint64_t size)
+/*
+ * Metadata is sent within the write request when session has DNET_IO_FLAGS_INLINE_META set,
+ * otherwise it is written by separate META request after data.
+ */
+static int dnet_write_file_meta(struct dnet_session *s, const char *file, const void *remote, int remote_len,
+		struct dnet_id *id, uint64_t local_offset, uint64_t remote_offset, uint64_t size)
 {
-	int err = dnet_write_file_id_raw(s, file, id, local_offset, remote_offset, size);
-	if (!err && !(dnet_session_get_ioflags(s) & DNET_IO_FLAGS_CACHE_ONLY))
-		err = dnet_create_write_metadata_strings(s, NULL, 0, id, NULL);
+	struct dnet_meta_container mc;
+	uint32_t ioflags = dnet_session_get_ioflags(s);
+	int err;
 
+	if ((ioflags & DNET_IO_FLAGS_CACHE_ONLY) || (s->node->flags & DNET_CFG_NO_META))
+		return dnet_write_file_id_raw(s, file, id, local_offset, remote_offset, size, NULL);
+
+	if (!(ioflags & DNET_IO_FLAGS_INLINE_META)) {
+		err = dnet_write_file_id_raw(s, file, id, local_offset, remote_offset, size, NULL);
+		if (!err)
+			err = dnet_create_write_metadata_strings(s, remote, remote_len, id, NULL);
+		return err;
+	}
+
+	err = dnet_create_metadata_strings(s, remote, remote_len, id, NULL, &mc);
+	if (err)
+		return err;
+
+	dnet_convert_metadata(s->node, mc.data, mc.size);
+
+	err = dnet_write_file_id_raw(s, file, id, local_offset, remote_offset, size, &mc);
+
+	free(mc.data);
 	return err;
 }
 
+int dnet_write_file_id(struct dnet_session *s, const char *file, struct dnet_id *id, uint64_t local_offset,
+		uint64_t remote_offset, uint64_t size)
+{
+	return dnet_write_file_meta(s, file, NULL, 0, id, local_offset, remote_offset, size);
+}
+
 int dnet_write_file(struct dnet_session *s, const char *file, const void *remote, int remote_len,
 		uint64_t local_offset, uint64_t remote_offset, uint64_t size, int type)
 {
-	int err;
 	struct dnet_id id;
 
 	dnet_transform(s, remote, remote_len, &id);
 	id.type = type;
 
-	err = dnet_write_file_id_raw(s, file, &id, local_offset, remote_offset, size);
-	if (!err && !(dnet_session_get_ioflags(s) & DNET_IO_FLAGS_CACHE_ONLY))
-		err = dnet_create_write_metadata_strings(s, remote, remote_len, &id, NULL);
-
-	return err;
+	return dnet_write_file_meta(s, file, remote, remote_len, &id, local_offset, remote_offset, size);
 }
 
 static int dnet_read_file_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
@@ -1963,6 +2086,8 @@ void *dnet_read_data_wait_raw(struct dnet_session *s, struct dnet_id *id, struct
 
 	ctl.cmd = cmd;
 	ctl.cflags = DNET_FLAGS_NEED_ACK | dnet_session_get_cflags(s);
+	if (cmd == DNET_CMD_READ_RANGE)
+		ctl.cflags |= DNET_FLAGS_FLOW_CONTROL;
 
 	memcpy(&ctl.io, io, sizeof(struct dnet_io_attr));
 	memcpy(&ctl.id, id, sizeof(struct dnet_id));
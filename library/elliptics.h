@@ -130,6 +130,13 @@ struct dnet_net_state
 	size_t			send_offset;
 	pthread_mutex_t		send_lock;
 	struct list_head	send_list;
+	/* number of bytes queued in @send_list, protected by @send_lock */
+	uint64_t		send_queue_size;
+
+	/* flow controlled transactions received over this state, see flow.c */
+	pthread_mutex_t		flow_lock;
+	pthread_cond_t		flow_wait;
+	struct list_head	flow_list;
 
 	pthread_mutex_t		trans_lock;
 	struct rb_root		trans_root;
@@ -143,6 +150,19 @@ struct dnet_net_state
 
 	struct dnet_idc		*idc;
 
+	/* local route table version at which ids of this state were added */
+	uint64_t		route_join_version;
+
+	/*
+	 * route table version of the remote node we have already received, see DNET_ATTR_ROUTE_DELTA,
+	 * it is reset when any state is removed from the local route table
+	 */
+	uint64_t		route_generation;
+	uint64_t		route_version;
+
+	/* route list was already sent over this connection, so delta requests can be served */
+	int			route_list_sent;
+
 	struct dnet_stat_count	stat[__DNET_CMD_MAX];
 };
 
@@ -167,6 +187,47 @@ struct dnet_idc {
 int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id *ids, int id_num);
 void dnet_idc_destroy_nolock(struct dnet_net_state *st);
 
+/*
+ * Immutable snapshot of the route table used by request routing.
+ *
+ * It is rebuilt from node's groups under n->state_lock every time ids are added or removed
+ * and published by pointer swap, readers search it without any lock and only announce
+ * themselves in per-slot epoch counters, so that writer knows when old snapshot can be freed.
+ */
+struct dnet_route_entry {
+	struct dnet_raw_id	id;
+	struct dnet_net_state	*st;
+};
+
+struct dnet_route_group {
+	unsigned int		group_id;
+	int			id_num;
+
+	/*
+	 * First 8 bytes of every id from @ids (in the same order) packed into
+	 * integers, so that lookup searches compact array and only touches
+	 * full ids on prefix ties.
+	 */
+	uint64_t		*prefix;
+	struct dnet_route_entry	*ids;
+};
+
+struct dnet_route_table {
+	uint64_t		version;
+	int			group_num;
+	struct dnet_route_group	groups[];
+};
+
+#define DNET_ROUTE_READER_SLOTS		64
+
+/* readers of the current and previous epochs, padded to the cache line */
+struct dnet_route_reader {
+	volatile int		count[2];
+	char			pad[64 - 2 * sizeof(int)];
+};
+
+void dnet_route_update_nolock(struct dnet_node *n);
+
 struct dnet_net_state *dnet_state_create(struct dnet_node *n,
 		int group_id, struct dnet_raw_id *ids, int id_num,
 		struct dnet_addr *addr, int s, int *errp, int join, int idx,
@@ -181,6 +242,8 @@ struct dnet_net_state *dnet_state_search_nolock(struct dnet_node *n, struct dnet
 struct dnet_net_state *dnet_node_state(struct dnet_node *n);
 
 void dnet_node_cleanup_common_resources(struct dnet_node *n);
+void dnet_node_stop_common_resources(struct dnet_node *n);
+void dnet_node_free_common_resources(struct dnet_node *n);
 
 int dnet_search_range(struct dnet_node *n, struct dnet_id *id,
 		struct dnet_raw_id *start, struct dnet_raw_id *next);
@@ -272,6 +335,19 @@ int dnet_notify_remove(struct dnet_net_state *st, struct dnet_cmd *cmd);
 int dnet_notify_init(struct dnet_node *n);
 void dnet_notify_exit(struct dnet_node *n);
 
+int dnet_flow_state_init(struct dnet_net_state *st);
+void dnet_flow_state_cleanup(struct dnet_net_state *st);
+int dnet_flow_register(struct dnet_net_state *st, struct dnet_cmd *cmd);
+void dnet_flow_unregister(struct dnet_net_state *st, struct dnet_cmd *cmd);
+int dnet_flow_consume(struct dnet_net_state *st, struct dnet_cmd *cmd, uint64_t size, long timeout);
+int dnet_flow_consume_io(struct dnet_net_state *st, struct dnet_cmd *cmd, uint64_t size);
+int dnet_flow_credit(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data);
+
+int dnet_cmd_iterator(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data);
+int dnet_iterator_init(struct dnet_node *n);
+void dnet_iterator_stop(struct dnet_node *n);
+void dnet_iterator_exit(struct dnet_node *n);
+
 struct dnet_group
 {
 	struct list_head	group_entry;
@@ -376,6 +452,10 @@ struct dnet_node
 
 	struct dnet_transform	transform;
 
+	/* content checksum engine, see DNET_CHECKSUM_* */
+	int			checksum_type;
+	struct dnet_transform	checksum;
+
 	int			need_exit;
 
 	int			autodiscovery_socket;
@@ -394,6 +474,16 @@ struct dnet_node
 	pthread_mutex_t		state_lock;
 	struct list_head	group_list;
 
+	/* lock-free route table snapshot, NULL means lookup has to use @group_list under @state_lock */
+	struct dnet_route_table	* volatile route;
+	uint64_t		route_generation;
+	uint64_t		route_version;
+
+	/* number of times remembered remote route versions were reset, protected by @state_lock */
+	uint64_t		route_resets;
+	volatile unsigned int	route_epoch;
+	struct dnet_route_reader	route_readers[DNET_ROUTE_READER_SLOTS];
+
 	/* hosts client states, i.e. those who didn't join network */
 	struct list_head	empty_state_list;
 
@@ -407,6 +497,10 @@ struct dnet_node
 	int			error;
 
 	struct dnet_log		*log;
+	/* asynchronous log writer, NULL if messages are passed to logger synchronously, see log.c */
+	struct dnet_log_async	*log_async;
+	/* threads which are currently putting message into log_async */
+	volatile int		log_async_users;
 
 	struct dnet_wait	*wait;
 	struct timespec		wait_ts;
@@ -449,6 +543,26 @@ struct dnet_node
 
 	size_t			cache_size;
 	void			*cache;
+
+	/* running server-side iterators, see iterator.c */
+	pthread_mutex_t		iterator_lock;
+	pthread_cond_t		iterator_wait;
+	struct list_head	iterator_list;
+	uint64_t		iterator_id;
+	int			iterator_num;
+	int			iterator_stopped;
+
+	/* anti-entropy hash tree, see merkle.c */
+	struct dnet_merkle_tree	*merkle;
+
+	/* in-memory index of local metadata, see metaindex.c */
+	struct dnet_meta_index	*meta_index;
+
+	/* merge transfer budget, see check.c */
+	int			merge_bandwidth;
+	int			merge_iops;
+	pthread_mutex_t		merge_lock;
+	uint64_t		merge_next;
 };
 
 
@@ -468,8 +582,6 @@ struct dnet_session {
 	int			nsize;
 };
 
-struct timespec *dnet_session_get_timeout(struct dnet_session *s);
-
 static inline int dnet_counter_init(struct dnet_node *n)
 {
 	memset(&n->counters, 0, __DNET_CNTR_MAX * sizeof(struct dnet_stat_count));
@@ -555,6 +667,10 @@ struct dnet_trans
 
 	int				command; /* main command this transaction carries */
 
+	/* replies consumed since the last credit was returned, protected by st->flow_lock */
+	uint64_t			flow_bytes;
+	uint64_t			flow_records;
+
 	void				*priv;
 	int				(* complete)(struct dnet_net_state *st,
 						     struct dnet_cmd *cmd,
@@ -578,6 +694,8 @@ static inline void dnet_trans_put(struct dnet_trans *t)
 		dnet_trans_destroy(t);
 }
 
+int dnet_flow_consumed(struct dnet_net_state *st, struct dnet_trans *t, struct dnet_cmd *cmd);
+
 int dnet_trans_insert_nolock(struct rb_root *root, struct dnet_trans *a);
 void dnet_trans_remove(struct dnet_trans *t);
 void dnet_trans_remove_nolock(struct rb_root *root, struct dnet_trans *t);
@@ -636,6 +754,8 @@ int dnet_try_reconnect(struct dnet_node *n);
 #define DNET_BULK_CHECK_PING			100
 #define DNET_BULK_STATES_ALLOC_STEP		10
 #define DNET_BULK_META_UPD_SIZE			1000
+/* default number of bulk check batches in flight to single peer */
+#define DNET_BULK_CHECK_WINDOW			4
 
 struct dnet_bulk_id
 {
@@ -647,8 +767,17 @@ struct dnet_bulk_state
 {
 	struct dnet_addr addr;
 	pthread_mutex_t	state_lock;
+	pthread_cond_t	state_wait;
 	int num;
 	struct dnet_bulk_id *ids;
+
+	/* batches sent to the peer and not yet completed, protected by state_lock */
+	int in_flight;
+
+	/* per-peer progress */
+	uint64_t batches;
+	uint64_t batch_errors;
+	uint64_t ids_sent;
 };
 
 struct dnet_bulk_array
@@ -656,6 +785,9 @@ struct dnet_bulk_array
 	int num;
 	struct dnet_bulk_state *states;
 	atomic_t refcnt;
+
+	/* keys to be moved to other nodes, queued by this iterating thread */
+	struct dnet_merge_batch *merge;
 };
 
 static inline int dnet_compare_bulk_state(const void *k1, const void *k2)
@@ -676,10 +808,28 @@ struct dnet_check_temp_db {
 	atomic_t refcnt;
 };
 
+/* number of keys queued by iterating thread before they are moved */
+#define DNET_MERGE_BATCH_SIZE			DNET_BULK_IDS_SIZE
+/* number of object transfers in flight from single iterating thread */
+#define DNET_MERGE_WINDOW			16
+
+struct dnet_merge_stat {
+	uint64_t	moved;
+	uint64_t	removed;
+	uint64_t	skipped;
+	uint64_t	failed;
+	uint64_t	bytes;
+	struct timeval	start;
+};
+
 struct dnet_check_params {
 	struct dnet_check_temp_db *db;
 	int group_num;
 	int *groups;
+	/* maximum number of bulk check batches in flight to single peer */
+	int window;
+	/* merge progress of all iterating threads */
+	struct dnet_merge_stat merge_stat;
 };
 
 
@@ -700,8 +850,15 @@ int dnet_check(struct dnet_node *n, struct dnet_meta_container *mc, struct dnet_
 		int check_copies, struct dnet_check_params *params);
 int dnet_db_list(struct dnet_net_state *st, struct dnet_cmd *cmd);
 int dnet_cmd_bulk_check(struct dnet_net_state *orig, struct dnet_cmd *cmd, void *data);
+int dnet_bulk_state_init(struct dnet_bulk_state *state);
+void dnet_bulk_state_wait(struct dnet_bulk_state *state);
+void dnet_bulk_state_destroy(struct dnet_bulk_state *state);
 int dnet_request_bulk_check(struct dnet_node *n, struct dnet_bulk_state *state, struct dnet_check_params *params);
 
+struct dnet_merge_batch *dnet_merge_batch_alloc(struct dnet_node *n);
+void dnet_merge_batch_flush(struct dnet_merge_batch *b, struct dnet_check_params *params);
+void dnet_merge_batch_free(struct dnet_merge_batch *b, struct dnet_check_params *params);
+
 struct dnet_meta_update * dnet_get_meta_update(struct dnet_node *n, struct dnet_meta_container *mc,
 		struct dnet_meta_update *meta_update);
 
@@ -709,11 +866,80 @@ int dnet_update_ts_metadata(struct eblob_backend *b, struct dnet_raw_id *id, uin
 int dnet_update_ts_metadata_raw(struct dnet_meta_container *mc, uint64_t flags_set, uint64_t flags_clear);
 
 int dnet_process_meta(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_io_attr *io);
-void dnet_convert_metadata(struct dnet_node *n __unused, void *data, int size);
+int dnet_meta_write_inline(struct dnet_node *n, struct dnet_io_attr *io, const void *data,
+		void *meta, unsigned int meta_size, int update_csum);
+
+enum dnet_merkle_key_state {
+	DNET_MERKLE_KEY_UNKNOWN = -1,
+	DNET_MERKLE_KEY_ABSENT = 0,
+	DNET_MERKLE_KEY_PRESENT,
+};
+
+/* DNET_META_UPDATE of the key saved before metadata change */
+struct dnet_merkle_key {
+	int			state;
+	struct dnet_meta_update	mu;
+};
+
+struct dnet_merkle_tree;
+
+int dnet_merkle_init(struct dnet_node *n);
+void dnet_merkle_exit(struct dnet_node *n);
+void dnet_merkle_key_read(struct dnet_node *n, struct dnet_raw_id *id, struct dnet_merkle_key *k);
+void dnet_merkle_key_update(struct dnet_node *n, struct dnet_raw_id *id, struct dnet_merkle_key *old);
+int dnet_merkle_rebuild_start(struct dnet_node *n);
+void dnet_merkle_rebuild_add(struct dnet_node *n, struct dnet_meta_container *mc);
+void dnet_merkle_rebuild_add_update(struct dnet_node *n, const unsigned char *id, struct dnet_meta_update *mu);
+void dnet_merkle_rebuild_finish(struct dnet_node *n, int success);
+int dnet_merkle_leaf_differs(uint8_t *differ, const unsigned char *id);
+int dnet_merkle_diff(struct dnet_node *n, int *groups, int group_num, uint8_t **differp);
+int dnet_cmd_merkle(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data);
+
+int dnet_cmd_indexes(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data);
+
+#define DNET_META_INDEX_SHARDS		256
+
+/* entry has DNET_META_UPDATE data */
+#define DNET_META_INDEX_UPDATE		(1<<2)
+/* entry has DNET_META_CHECKSUM_STATE data */
+#define DNET_META_INDEX_CSUM		(1<<3)
+
+struct dnet_meta_index_entry {
+	struct dnet_raw_id	id;
+	struct dnet_time	tm;
+	uint64_t		flags;
+	uint64_t		check_ts;
+	uint64_t		size;
+	uint8_t			csum[8];
+	uint32_t		state;
+};
+
+struct dnet_meta_index;
+
+int dnet_meta_index_init(struct dnet_node *n);
+void dnet_meta_index_exit(struct dnet_node *n);
+int dnet_meta_index_ready(struct dnet_node *n);
+int dnet_meta_index_lookup(struct dnet_node *n, const unsigned char *id, struct dnet_meta_index_entry *e);
+int dnet_meta_index_shard_copy(struct dnet_node *n, int shard, struct dnet_meta_index_entry **entriesp, int *nump);
+int dnet_meta_write_local(struct dnet_node *n, struct dnet_raw_id *id, void *data, size_t size);
+int dnet_meta_remove_local(struct dnet_node *n, struct dnet_raw_id *id, int real_remove);
+void dnet_meta_index_sync(struct dnet_node *n, struct dnet_raw_id *id);
+
+int dnet_meta_update_checksum(struct dnet_node *n, struct dnet_io_attr *io, const void *data,
+		const void *meta, unsigned int meta_size);
+int dnet_meta_remove_checksum(struct dnet_node *n, const unsigned char *id);
+int dnet_meta_checksum_state_current(struct dnet_node *n, struct dnet_meta_container *mc,
+		struct dnet_meta_checksum_state *cs);
+int dnet_meta_write_preserve_checksum(struct dnet_node *n, struct dnet_raw_id *id, void *data, unsigned int size);
 
 void dnet_monitor_exit(struct dnet_node *n);
 int dnet_monitor_init(struct dnet_node *n, struct dnet_config *cfg);
 
+struct dnet_log_async;
+
+int dnet_log_async_init(struct dnet_node *n);
+void dnet_log_async_exit(struct dnet_node *n);
+
 int dnet_set_name(char *name);
 int dnet_ioprio_set(long pid, int class_id, int prio);
 int dnet_ioprio_get(long pid);
@@ -742,6 +968,7 @@ void dnet_cache_cleanup(struct dnet_node *n);
 int dnet_cmd_cache_io(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_io_attr *io, char *data);
 
 int __attribute__((weak)) dnet_remove_local(struct dnet_node *n, struct dnet_id *id);
+int dnet_read_local(struct dnet_node *n, struct dnet_id *id, void **datap, uint64_t *sizep);
 
 int dnet_discovery(struct dnet_node *n);
 
@@ -0,0 +1,298 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "elliptics.h"
+
+#include "elliptics/packet.h"
+#include "elliptics/interface.h"
+
+/*
+ * Credit-based flow control for long streaming replies.
+ *
+ * Request marked with DNET_FLAGS_FLOW_CONTROL starts with DNET_FLOW_WINDOW_BYTES/DNET_FLOW_WINDOW_RECORDS
+ * credit on the server. Every reply sent for it consumes credit, when credit is exhausted producer
+ * blocks until client returns some with DNET_CMD_CREDIT. Client returns credit after completion
+ * callback has processed replies, so server never has more than a window of data in flight
+ * and scan proceeds at client's consumption rate.
+ *
+ * Credits are matched by transaction number within the connection, thus forwarded requests
+ * are not flow controlled.
+ */
+
+/* producer checks connection state at least this often while waiting for credit */
+#define DNET_FLOW_WAIT_SLICE		100
+
+struct dnet_flow
+{
+	struct list_head		flow_entry;
+	uint64_t			trans;
+	int				refcnt;
+
+	int64_t				bytes;
+	int64_t				records;
+};
+
+int dnet_flow_state_init(struct dnet_net_state *st)
+{
+	int err;
+
+	INIT_LIST_HEAD(&st->flow_list);
+
+	err = pthread_mutex_init(&st->flow_lock, NULL);
+	if (err)
+		return -err;
+
+	err = pthread_cond_init(&st->flow_wait, NULL);
+	if (err) {
+		pthread_mutex_destroy(&st->flow_lock);
+		return -err;
+	}
+
+	return 0;
+}
+
+void dnet_flow_state_cleanup(struct dnet_net_state *st)
+{
+	struct dnet_flow *f, *tmp;
+
+	list_for_each_entry_safe(f, tmp, &st->flow_list, flow_entry) {
+		list_del(&f->flow_entry);
+		free(f);
+	}
+
+	pthread_cond_destroy(&st->flow_wait);
+	pthread_mutex_destroy(&st->flow_lock);
+}
+
+static struct dnet_flow *dnet_flow_search_nolock(struct dnet_net_state *st, uint64_t trans)
+{
+	struct dnet_flow *f;
+
+	list_for_each_entry(f, &st->flow_list, flow_entry) {
+		if (f->trans == trans)
+			return f;
+	}
+
+	return NULL;
+}
+
+/*
+ * Registers flow controlled transaction, every user which sends replies
+ * asynchronously must hold its own registration.
+ * Does nothing if request did not ask for flow control.
+ */
+int dnet_flow_register(struct dnet_net_state *st, struct dnet_cmd *cmd)
+{
+	uint64_t trans = cmd->trans & ~DNET_TRANS_REPLY;
+	struct dnet_flow *f;
+	int err = 0;
+
+	if (!(cmd->flags & DNET_FLAGS_FLOW_CONTROL))
+		return 0;
+
+	pthread_mutex_lock(&st->flow_lock);
+	f = dnet_flow_search_nolock(st, trans);
+	if (f) {
+		f->refcnt++;
+		goto err_out_unlock;
+	}
+
+	f = malloc(sizeof(struct dnet_flow));
+	if (!f) {
+		err = -ENOMEM;
+		goto err_out_unlock;
+	}
+
+	f->trans = trans;
+	f->refcnt = 1;
+	f->bytes = DNET_FLOW_WINDOW_BYTES;
+	f->records = DNET_FLOW_WINDOW_RECORDS;
+
+	list_add_tail(&f->flow_entry, &st->flow_list);
+
+err_out_unlock:
+	pthread_mutex_unlock(&st->flow_lock);
+	return err;
+}
+
+void dnet_flow_unregister(struct dnet_net_state *st, struct dnet_cmd *cmd)
+{
+	uint64_t trans = cmd->trans & ~DNET_TRANS_REPLY;
+	struct dnet_flow *f;
+
+	if (!(cmd->flags & DNET_FLAGS_FLOW_CONTROL))
+		return;
+
+	pthread_mutex_lock(&st->flow_lock);
+	f = dnet_flow_search_nolock(st, trans);
+	if (f && --f->refcnt == 0) {
+		list_del(&f->flow_entry);
+		free(f);
+	}
+	pthread_mutex_unlock(&st->flow_lock);
+}
+
+/*
+ * Takes credit for one reply of @size bytes, waits at most @timeout milliseconds for client to grant it.
+ * Reply is allowed to be sent as long as there is any credit left, so objects larger than window
+ * are still transferred. Returns -ETIMEDOUT if client did not grant credit in time.
+ */
+int dnet_flow_consume(struct dnet_net_state *st, struct dnet_cmd *cmd, uint64_t size, long timeout)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_flow *f;
+	struct timespec ts;
+	struct timeval tv;
+	long slice;
+	int err = 0;
+
+	if (!(cmd->flags & DNET_FLAGS_FLOW_CONTROL))
+		return 0;
+
+	pthread_mutex_lock(&st->flow_lock);
+	f = dnet_flow_search_nolock(st, cmd->trans & ~DNET_TRANS_REPLY);
+	if (!f)
+		goto err_out_unlock;
+
+	while (f->bytes <= 0 || f->records <= 0) {
+		if (st->need_exit || n->need_exit) {
+			err = -ECONNRESET;
+			goto err_out_unlock;
+		}
+
+		if (timeout <= 0) {
+			err = -ETIMEDOUT;
+			goto err_out_unlock;
+		}
+
+		slice = timeout < DNET_FLOW_WAIT_SLICE ? timeout : DNET_FLOW_WAIT_SLICE;
+		timeout -= slice;
+
+		gettimeofday(&tv, NULL);
+		ts.tv_sec = tv.tv_sec;
+		ts.tv_nsec = tv.tv_usec * 1000 + slice * 1000000;
+		ts.tv_sec += ts.tv_nsec / 1000000000;
+		ts.tv_nsec %= 1000000000;
+
+		pthread_cond_timedwait(&st->flow_wait, &st->flow_lock, &ts);
+	}
+
+	f->bytes -= size;
+	f->records--;
+
+err_out_unlock:
+	pthread_mutex_unlock(&st->flow_lock);
+	return err;
+}
+
+/*
+ * Credit wait for replies sent from IO pool thread which processes @cmd.
+ * Operation lock of the request's key is kept, since caller continues with fds, offsets
+ * and pages it has read under the lock. Wait is limited by node's wait timeout, which
+ * starts again whenever client grants credit, so slow but alive consumer never fails
+ * the request. Client which did not grant any credit for the whole timeout has already
+ * timed out the transaction on its side.
+ */
+int dnet_flow_consume_io(struct dnet_net_state *st, struct dnet_cmd *cmd, uint64_t size)
+{
+	struct dnet_node *n = st->n;
+
+	return dnet_flow_consume(st, cmd, size, n->wait_ts.tv_sec * 1000);
+}
+
+/*
+ * DNET_CMD_CREDIT processing, it is called directly from network thread,
+ * since producers waiting for credit may occupy all IO threads.
+ */
+int dnet_flow_credit(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
+{
+	struct dnet_flow_credit *c = data;
+	struct dnet_flow *f;
+
+	if (cmd->size < sizeof(struct dnet_flow_credit))
+		return -EINVAL;
+
+	dnet_convert_flow_credit(c);
+
+	pthread_mutex_lock(&st->flow_lock);
+	f = dnet_flow_search_nolock(st, c->trans);
+	if (f) {
+		f->bytes += c->bytes;
+		f->records += c->records;
+		pthread_cond_broadcast(&st->flow_wait);
+	}
+	pthread_mutex_unlock(&st->flow_lock);
+
+	dnet_log(st->n, DNET_LOG_DEBUG, "%s: credit: trans: %llu, bytes: %llu, records: %llu, found: %d\n",
+			dnet_state_dump_addr(st), (unsigned long long)c->trans,
+			(unsigned long long)c->bytes, (unsigned long long)c->records, !!f);
+
+	return 0;
+}
+
+/*
+ * Client side: accounts reply processed by completion callback of flow controlled transaction
+ * and returns credit to server once half of the window was consumed.
+ */
+int dnet_flow_consumed(struct dnet_net_state *st, struct dnet_trans *t, struct dnet_cmd *cmd)
+{
+	struct {
+		struct dnet_cmd		cmd;
+		struct dnet_flow_credit	credit;
+	} __attribute__ ((packed)) req;
+
+	if (!(t->cmd.flags & DNET_FLAGS_FLOW_CONTROL) || !(cmd->flags & DNET_FLAGS_MORE))
+		return 0;
+
+	memset(&req, 0, sizeof(req));
+
+	pthread_mutex_lock(&st->flow_lock);
+	t->flow_bytes += cmd->size;
+	t->flow_records++;
+
+	if (t->flow_bytes >= DNET_FLOW_WINDOW_BYTES / 2 || t->flow_records >= DNET_FLOW_WINDOW_RECORDS / 2) {
+		req.credit.bytes = t->flow_bytes;
+		req.credit.records = t->flow_records;
+
+		t->flow_bytes = 0;
+		t->flow_records = 0;
+	}
+	pthread_mutex_unlock(&st->flow_lock);
+
+	if (!req.credit.records)
+		return 0;
+
+	req.credit.trans = t->trans;
+
+	req.cmd.id = t->cmd.id;
+	req.cmd.cmd = DNET_CMD_CREDIT;
+	req.cmd.flags = DNET_FLAGS_NOLOCK | DNET_FLAGS_DIRECT;
+	req.cmd.size = sizeof(struct dnet_flow_credit);
+
+	dnet_convert_flow_credit(&req.credit);
+	dnet_convert_cmd(&req.cmd);
+
+	return dnet_send(st, &req, sizeof(req));
+}
@@ -0,0 +1,1720 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "elliptics/packet.h"
+#include "elliptics/interface.h"
+
+/*
+ * Server-side secondary indexes.
+ *
+ * Index is a set of entries sorted by object id. It is split into pages of at most
+ * DNET_INDEXES_PAGE_ENTRIES entries or DNET_INDEXES_PAGE_SIZE bytes, page is split in halves
+ * when it overflows. Root record stored at index id keeps sorted list of page start ids,
+ * page @i holds entries in [start(i), start(i + 1)) range, first page always starts at zero id.
+ *
+ * Page is stored at index id with its last 8 bytes XORed with page number + 1,
+ * so pages share index id prefix and are routed to the same node as index itself,
+ * and check/merge moves them together with the root. All pages are read and written
+ * locally by the node which received command, commands are serialized by operation lock
+ * taken on index id, thus update touches root and single page without any compare-and-swap.
+ *
+ * Split writes new page first, then root, then truncated old page, entries which do not
+ * belong to page range are dropped at load, so interrupted split never exposes duplicates.
+ *
+ * Root keeps number of entries in the index, it is updated by every change and returned
+ * by DNET_INDEXES_STAT. Roots written before it was introduced are counted on first update,
+ * until then stat loads their pages to count entries.
+ *
+ * Page is stored in columns: header, (num + 1) data offsets, id prefix common to all entries,
+ * fixed-width sorted id suffixes and data blob. Read and probe search suffix column in place
+ * and copy data straight from the loaded buffer, entries are materialized only when page
+ * is modified. Pages of the older row format are still read and rewritten as columns.
+ */
+
+#define DNET_INDEXES_PAGE_ENTRIES	1024
+#define DNET_INDEXES_PAGE_SIZE		(1024 * 1024)
+
+#define DNET_INDEXES_ROOT_MAGIC		0x746f6f7278646e69ULL	/* "indxroot" */
+#define DNET_INDEXES_PAGE_MAGIC		0x6567617078646e69ULL	/* "indxpage", row format */
+#define DNET_INDEXES_COLUMNS_MAGIC	0x736c6f6378646e69ULL	/* "indxcols" */
+
+/* root @entries_num is valid */
+#define DNET_INDEXES_ROOT_FLAGS_COUNTED	(1<<0)
+
+/* legacy index blob is msgpack array of 3 elements starting with version 1 */
+#define DNET_INDEXES_LEGACY_HEADER	0x93
+#define DNET_INDEXES_LEGACY_VERSION	1
+
+struct dnet_indexes_root_entry
+{
+	struct dnet_raw_id		start;
+	uint64_t			page;
+} __attribute__ ((packed));
+
+struct dnet_indexes_root
+{
+	uint64_t			magic;
+	uint64_t			next_page;
+	uint32_t			num;
+	uint32_t			flags;
+	uint64_t			entries_num;
+	uint64_t			reserved;
+	struct dnet_indexes_root_entry	entries[0];
+} __attribute__ ((packed));
+
+/*
+ * Columnar page header is followed by @num + 1 uint32_t data offsets, @prefix_len bytes of id prefix,
+ * @num id suffixes of DNET_ID_SIZE - @prefix_len bytes and @data_size bytes of data.
+ * Row format page header is followed by @num struct dnet_indexes_entry with data.
+ */
+struct dnet_indexes_page_header
+{
+	uint64_t			magic;
+	uint32_t			num;
+	uint32_t			prefix_len;
+	uint64_t			data_size;
+	uint64_t			reserved;
+} __attribute__ ((packed));
+
+static inline void dnet_convert_indexes_root(struct dnet_indexes_root *r, uint32_t num)
+{
+	uint32_t i;
+
+	r->magic = dnet_bswap64(r->magic);
+	r->next_page = dnet_bswap64(r->next_page);
+	r->num = dnet_bswap32(r->num);
+	r->flags = dnet_bswap32(r->flags);
+	r->entries_num = dnet_bswap64(r->entries_num);
+
+	for (i = 0; i < num; ++i)
+		r->entries[i].page = dnet_bswap64(r->entries[i].page);
+}
+
+static inline void dnet_convert_indexes_page_header(struct dnet_indexes_page_header *h)
+{
+	h->magic = dnet_bswap64(h->magic);
+	h->num = dnet_bswap32(h->num);
+	h->prefix_len = dnet_bswap32(h->prefix_len);
+	h->data_size = dnet_bswap64(h->data_size);
+}
+
+/* in-memory page entry, @data points either into loaded page or into request */
+struct dnet_indexes_item
+{
+	struct dnet_raw_id		id;
+	uint64_t			size;
+	void				*data;
+};
+
+struct dnet_indexes_page
+{
+	void				*buf;
+
+	/* columns of loaded page, entries [@first, @first + @num) belong to the page range */
+	const uint32_t			*offsets;
+	const unsigned char		*prefix;
+	const unsigned char		*suffixes;
+	const unsigned char		*blob;
+	uint32_t			prefix_len;
+	int				first;
+
+	/* materialized entries, they are used instead of columns when not NULL */
+	struct dnet_indexes_item	*items;
+	int				num, alloc;
+	uint64_t			bytes;
+};
+
+static inline int dnet_indexes_page_cmp(struct dnet_indexes_page *p, int i, const unsigned char *id)
+{
+	unsigned int suffix_size = DNET_ID_SIZE - p->prefix_len;
+	int cmp;
+
+	if (p->items)
+		return dnet_id_cmp_str(p->items[i].id.id, id);
+
+	cmp = memcmp(p->prefix, id, p->prefix_len);
+	if (cmp)
+		return cmp;
+
+	return memcmp(p->suffixes + (size_t)(p->first + i) * suffix_size, id + p->prefix_len, suffix_size);
+}
+
+static void dnet_indexes_page_get(struct dnet_indexes_page *p, int i, struct dnet_indexes_item *it)
+{
+	unsigned int suffix_size = DNET_ID_SIZE - p->prefix_len;
+	uint32_t start, end;
+	int pos = p->first + i;
+
+	if (p->items) {
+		*it = p->items[i];
+		return;
+	}
+
+	memcpy(it->id.id, p->prefix, p->prefix_len);
+	memcpy(it->id.id + p->prefix_len, p->suffixes + (size_t)pos * suffix_size, suffix_size);
+
+	start = dnet_bswap32(p->offsets[pos]);
+	end = dnet_bswap32(p->offsets[pos + 1]);
+
+	it->size = end - start;
+	it->data = (void *)(p->blob + start);
+}
+
+static void dnet_indexes_page_id(struct dnet_raw_id *dst, const unsigned char *index, uint64_t page)
+{
+	uint64_t tail;
+
+	memcpy(dst->id, index, DNET_ID_SIZE);
+	memcpy(&tail, dst->id + DNET_ID_SIZE - sizeof(tail), sizeof(tail));
+	tail ^= dnet_bswap64(page + 1);
+	memcpy(dst->id + DNET_ID_SIZE - sizeof(tail), &tail, sizeof(tail));
+}
+
+struct dnet_indexes_read_priv
+{
+	void				*data;
+	uint64_t			size;
+};
+
+static int dnet_indexes_read_callback(void *priv, struct dnet_id *id __unused, int fd, uint64_t offset, uint64_t size)
+{
+	struct dnet_indexes_read_priv *p = priv;
+	ssize_t err;
+	uint64_t done = 0;
+
+	p->data = malloc(size ? size : 1);
+	if (!p->data)
+		return -ENOMEM;
+
+	while (done < size) {
+		err = pread(fd, p->data + done, size - done, offset + done);
+		if (err <= 0) {
+			err = err ? -errno : -EIO;
+			free(p->data);
+			p->data = NULL;
+			return err;
+		}
+
+		done += err;
+	}
+
+	p->size = size;
+	return 1;
+}
+
+/*
+ * Reads whole local record, returns -ENOENT if there is no such key.
+ * Backends which can not expose their files are read through command handler.
+ */
+static int dnet_indexes_read_local(struct dnet_node *n, struct dnet_raw_id *id, void **datap, uint64_t *sizep)
+{
+	struct dnet_indexes_read_priv p;
+	struct dnet_id raw;
+	int err;
+
+	dnet_setup_id(&raw, n->id.group_id, id->id);
+	raw.type = 0;
+
+	if (!n->cb->locate)
+		return dnet_read_local(n, &raw, datap, sizep);
+
+	memset(&p, 0, sizeof(p));
+
+	err = n->cb->locate(n->cb->command_private, &raw, dnet_indexes_read_callback, &p);
+	if (err < 0)
+		return err;
+	if (!p.data)
+		return -ENOENT;
+
+	*datap = p.data;
+	*sizep = p.size;
+	return 0;
+}
+
+static int dnet_indexes_write_meta(struct dnet_net_state *base, struct dnet_raw_id *id)
+{
+	struct dnet_node *n = base->n;
+	struct dnet_cmd *cmd;
+	struct dnet_io_attr *io;
+	struct dnet_meta *m;
+	int size, err;
+
+	size = sizeof(struct dnet_meta) + sizeof(struct dnet_meta_check_status) +
+		sizeof(struct dnet_meta) + sizeof(struct dnet_meta_update) +
+		sizeof(struct dnet_meta) + sizeof(int);
+
+	cmd = malloc(sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr) + size);
+	if (!cmd)
+		return -ENOMEM;
+
+	memset(cmd, 0, sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr) + size);
+
+	io = (struct dnet_io_attr *)(cmd + 1);
+	m = (struct dnet_meta *)(io + 1);
+
+	m->size = sizeof(struct dnet_meta_check_status);
+	m->type = DNET_META_CHECK_STATUS;
+
+	m = (struct dnet_meta *)(m->data + m->size);
+	dnet_create_meta_update(m, NULL, 0, 0);
+
+	m = (struct dnet_meta *)(m->data + m->size);
+	m->size = sizeof(int);
+	m->type = DNET_META_GROUPS;
+	memcpy(m->data, &n->id.group_id, sizeof(int));
+
+	dnet_convert_metadata(n, io + 1, size);
+
+	dnet_setup_id(&cmd->id, n->id.group_id, id->id);
+	cmd->id.type = EBLOB_TYPE_META;
+	cmd->cmd = DNET_CMD_WRITE;
+	cmd->flags = DNET_FLAGS_NOLOCK;
+	cmd->size = sizeof(struct dnet_io_attr) + size;
+
+	memcpy(io->id, id->id, DNET_ID_SIZE);
+	memcpy(io->parent, id->id, DNET_ID_SIZE);
+	io->size = size;
+	io->type = EBLOB_TYPE_META;
+	io->flags = DNET_IO_FLAGS_META;
+
+	err = dnet_process_meta(base, cmd, io);
+
+	free(cmd);
+	return err;
+}
+
+/*
+ * Writes local record, @buf must have room for command and IO attribute before @size bytes of data.
+ * Replies of the backend are swallowed since they are sent to node's own state.
+ */
+static int dnet_indexes_write_local(struct dnet_node *n, struct dnet_raw_id *id, void *buf, uint64_t size)
+{
+	struct dnet_net_state *base;
+	struct dnet_cmd *cmd = buf;
+	struct dnet_io_attr *io = (struct dnet_io_attr *)(cmd + 1);
+	int err;
+
+	memset(cmd, 0, sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr));
+
+	dnet_setup_id(&cmd->id, n->id.group_id, id->id);
+	cmd->cmd = DNET_CMD_WRITE;
+	cmd->flags = DNET_FLAGS_NOLOCK;
+	cmd->size = sizeof(struct dnet_io_attr) + size;
+
+	memcpy(io->id, id->id, DNET_ID_SIZE);
+	memcpy(io->parent, id->id, DNET_ID_SIZE);
+	io->size = size;
+	io->flags = DNET_IO_FLAGS_NOCSUM;
+
+	dnet_convert_io_attr(io);
+
+	base = dnet_node_state(n);
+	if (!base)
+		return -ENXIO;
+
+	err = n->cb->command_handler(base, n->cb->command_private, cmd, io);
+	if (!err && !(n->flags & DNET_CFG_NO_META))
+		err = dnet_indexes_write_meta(base, id);
+
+	dnet_state_put(base);
+	return err;
+}
+
+static int dnet_indexes_remove_local(struct dnet_node *n, struct dnet_raw_id *id)
+{
+	struct dnet_net_state *base;
+	struct dnet_cmd cmd;
+	int err;
+
+	memset(&cmd, 0, sizeof(cmd));
+
+	dnet_setup_id(&cmd.id, n->id.group_id, id->id);
+	cmd.cmd = DNET_CMD_DEL;
+	cmd.flags = DNET_FLAGS_NOLOCK;
+
+	base = dnet_node_state(n);
+	if (!base)
+		return -ENXIO;
+
+	err = dnet_process_meta(base, &cmd, NULL);
+	dnet_state_put(base);
+
+	return err;
+}
+
+static int dnet_indexes_legacy_convert(struct dnet_node *n, struct dnet_raw_id *index,
+		const void *data, uint64_t size, struct dnet_indexes_root **rootp);
+
+/* returns -ENOENT if index does not exist, legacy client-side index is converted */
+static int dnet_indexes_root_load(struct dnet_node *n, struct dnet_raw_id *index, struct dnet_indexes_root **rootp)
+{
+	struct dnet_indexes_root *root;
+	const unsigned char *raw;
+	uint64_t size;
+	void *data;
+	uint32_t num;
+	int err;
+
+	err = dnet_indexes_read_local(n, index, &data, &size);
+	if (err)
+		return err;
+
+	raw = data;
+	if (size >= 2 && raw[0] == DNET_INDEXES_LEGACY_HEADER && raw[1] == DNET_INDEXES_LEGACY_VERSION) {
+		err = dnet_indexes_legacy_convert(n, index, data, size, rootp);
+		free(data);
+		return err;
+	}
+
+	root = data;
+	if (size < sizeof(struct dnet_indexes_root))
+		goto err_out_corrupted;
+
+	num = dnet_bswap32(root->num);
+	if (size < sizeof(struct dnet_indexes_root) + (uint64_t)num * sizeof(struct dnet_indexes_root_entry))
+		goto err_out_corrupted;
+
+	dnet_convert_indexes_root(root, num);
+	if (root->magic != DNET_INDEXES_ROOT_MAGIC || !root->num)
+		goto err_out_corrupted;
+
+	*rootp = root;
+	return 0;
+
+err_out_corrupted:
+	dnet_log(n, DNET_LOG_ERROR, "%s: indexes: corrupted root, size: %llu\n",
+			dnet_dump_id_str(index->id), (unsigned long long)size);
+	free(data);
+	return -EILSEQ;
+}
+
+static int dnet_indexes_root_store(struct dnet_node *n, struct dnet_raw_id *index, struct dnet_indexes_root *root)
+{
+	uint64_t size = sizeof(struct dnet_indexes_root) + root->num * sizeof(struct dnet_indexes_root_entry);
+	struct dnet_indexes_root *r;
+	void *buf;
+	int err;
+
+	buf = malloc(sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr) + size);
+	if (!buf)
+		return -ENOMEM;
+
+	r = buf + sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr);
+	memcpy(r, root, size);
+	dnet_convert_indexes_root(r, root->num);
+
+	err = dnet_indexes_write_local(n, index, buf, size);
+	free(buf);
+
+	return err;
+}
+
+/* returns page number containing @id */
+static uint32_t dnet_indexes_root_search(struct dnet_indexes_root *root, const unsigned char *id)
+{
+	uint32_t low = 0, high = root->num;
+
+	/* entries[0].start is zero id, so result is always valid */
+	while (high - low > 1) {
+		uint32_t mid = low + (high - low) / 2;
+
+		if (dnet_id_cmp_str(root->entries[mid].start.id, id) <= 0)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static void dnet_indexes_page_cleanup(struct dnet_indexes_page *p)
+{
+	free(p->items);
+	free(p->buf);
+}
+
+static int dnet_indexes_page_reserve(struct dnet_indexes_page *p, int num)
+{
+	struct dnet_indexes_item *items;
+	int alloc;
+
+	if (num <= p->alloc)
+		return 0;
+
+	alloc = p->alloc ? p->alloc * 2 : 64;
+	if (alloc < num)
+		alloc = num;
+
+	items = realloc(p->items, alloc * sizeof(struct dnet_indexes_item));
+	if (!items)
+		return -ENOMEM;
+
+	p->items = items;
+	p->alloc = alloc;
+	return 0;
+}
+
+/* returns position of the first entry not less than @id, searching exponentially from @from */
+static int dnet_indexes_page_gallop(struct dnet_indexes_page *p, int from, const unsigned char *id)
+{
+	int low = from, high, step = 1;
+
+	if (low >= p->num || dnet_indexes_page_cmp(p, low, id) >= 0)
+		return low;
+
+	/* entry at @low is less than id */
+	while (low + step < p->num && dnet_indexes_page_cmp(p, low + step, id) < 0) {
+		low += step;
+		step *= 2;
+	}
+
+	high = low + step;
+	if (high > p->num)
+		high = p->num;
+
+	/* entry at @low is less than id, entry at @high is not */
+	while (high - low > 1) {
+		int mid = low + (high - low) / 2;
+
+		if (dnet_indexes_page_cmp(p, mid, id) < 0)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	return high;
+}
+
+/* returns position of @id in page or position where it should be inserted negated minus one */
+static int dnet_indexes_page_search(struct dnet_indexes_page *p, const unsigned char *id)
+{
+	int low = 0, high = p->num - 1;
+
+	while (low <= high) {
+		int mid = low + (high - low) / 2;
+		int cmp = dnet_indexes_page_cmp(p, mid, id);
+
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+
+	return -low - 1;
+}
+
+static int dnet_indexes_page_load_columns(struct dnet_indexes_page *p, uint64_t size,
+		const unsigned char *start, const unsigned char *end)
+{
+	struct dnet_indexes_page_header *h = p->buf;
+	uint64_t need;
+	uint32_t i, prev, off;
+	int from, to;
+
+	if (h->prefix_len > DNET_ID_SIZE)
+		return -EILSEQ;
+
+	need = sizeof(struct dnet_indexes_page_header) + ((uint64_t)h->num + 1) * sizeof(uint32_t) +
+		h->prefix_len + (uint64_t)h->num * (DNET_ID_SIZE - h->prefix_len) + h->data_size;
+	if (need > size)
+		return -EILSEQ;
+
+	p->offsets = (const uint32_t *)(h + 1);
+	p->prefix = (const unsigned char *)(p->offsets + h->num + 1);
+	p->suffixes = p->prefix + h->prefix_len;
+	p->blob = p->suffixes + (size_t)h->num * (DNET_ID_SIZE - h->prefix_len);
+	p->prefix_len = h->prefix_len;
+
+	for (i = 0, prev = 0; i <= h->num; ++i) {
+		off = dnet_bswap32(p->offsets[i]);
+		if (off < prev || off > h->data_size)
+			return -EILSEQ;
+		prev = off;
+	}
+
+	if (dnet_bswap32(p->offsets[0]) != 0 || prev != h->data_size)
+		return -EILSEQ;
+
+	p->first = 0;
+	p->num = h->num;
+
+	from = dnet_indexes_page_gallop(p, 0, start);
+	to = end ? dnet_indexes_page_gallop(p, from, end) : p->num;
+
+	p->first = from;
+	p->num = to - from;
+	return 0;
+}
+
+static int dnet_indexes_page_load_rows(struct dnet_indexes_page *p, uint64_t size,
+		const unsigned char *start, const unsigned char *end)
+{
+	struct dnet_indexes_page_header *h = p->buf;
+	struct dnet_indexes_entry *e;
+	uint64_t offset;
+	uint32_t i;
+	int err;
+
+	err = dnet_indexes_page_reserve(p, h->num ? h->num : 1);
+	if (err)
+		return err;
+
+	offset = sizeof(struct dnet_indexes_page_header);
+	for (i = 0; i < h->num; ++i) {
+		if (offset + sizeof(struct dnet_indexes_entry) > size)
+			return -EILSEQ;
+
+		e = p->buf + offset;
+		dnet_convert_indexes_entry(e);
+		offset += sizeof(struct dnet_indexes_entry);
+
+		if (offset + e->size > size)
+			return -EILSEQ;
+
+		if (dnet_id_cmp_str(e->id.id, start) >= 0 && (!end || dnet_id_cmp_str(e->id.id, end) < 0)) {
+			struct dnet_indexes_item *it = &p->items[p->num++];
+
+			it->id = e->id;
+			it->size = e->size;
+			it->data = e + 1;
+
+			p->bytes += sizeof(struct dnet_indexes_entry) + e->size;
+		}
+
+		offset += e->size;
+	}
+
+	return 0;
+}
+
+/*
+ * Loads page @idx of the root, only entries within page range are kept.
+ * Missing page is empty.
+ */
+static int dnet_indexes_page_load(struct dnet_node *n, struct dnet_raw_id *index,
+		struct dnet_indexes_root *root, uint32_t idx, struct dnet_indexes_page *p)
+{
+	struct dnet_indexes_page_header *h;
+	struct dnet_raw_id id;
+	const unsigned char *start, *end;
+	uint64_t size = 0;
+	int err;
+
+	memset(p, 0, sizeof(struct dnet_indexes_page));
+
+	start = root->entries[idx].start.id;
+	end = (idx + 1 < root->num) ? root->entries[idx + 1].start.id : NULL;
+
+	dnet_indexes_page_id(&id, index->id, root->entries[idx].page);
+
+	err = dnet_indexes_read_local(n, &id, &p->buf, &size);
+	if (err == -ENOENT)
+		return 0;
+	if (err)
+		return err;
+
+	h = p->buf;
+	err = -EILSEQ;
+	if (size >= sizeof(struct dnet_indexes_page_header)) {
+		dnet_convert_indexes_page_header(h);
+
+		if (h->magic == DNET_INDEXES_COLUMNS_MAGIC)
+			err = dnet_indexes_page_load_columns(p, size, start, end);
+		else if (h->magic == DNET_INDEXES_PAGE_MAGIC)
+			err = dnet_indexes_page_load_rows(p, size, start, end);
+	}
+
+	if (err) {
+		if (err == -EILSEQ)
+			dnet_log(n, DNET_LOG_ERROR, "%s: indexes: corrupted page %llu, size: %llu\n",
+					dnet_dump_id_str(index->id), (unsigned long long)root->entries[idx].page,
+					(unsigned long long)size);
+		dnet_indexes_page_cleanup(p);
+	}
+
+	return err;
+}
+
+/* converts columns into entries which can be modified */
+static int dnet_indexes_page_materialize(struct dnet_indexes_page *p)
+{
+	struct dnet_indexes_item *items;
+	int i;
+
+	if (p->items || !p->num)
+		return 0;
+
+	items = malloc(p->num * sizeof(struct dnet_indexes_item));
+	if (!items)
+		return -ENOMEM;
+
+	p->bytes = 0;
+	for (i = 0; i < p->num; ++i) {
+		dnet_indexes_page_get(p, i, &items[i]);
+		p->bytes += sizeof(struct dnet_indexes_entry) + items[i].size;
+	}
+
+	p->items = items;
+	p->alloc = p->num;
+	return 0;
+}
+
+/* writes entries [@from, @to) of @p as columnar page number @page */
+static int dnet_indexes_page_store(struct dnet_node *n, struct dnet_raw_id *index, uint64_t page,
+		struct dnet_indexes_page *p, int from, int to)
+{
+	struct dnet_indexes_page_header *h;
+	struct dnet_indexes_item it, last;
+	struct dnet_raw_id id;
+	uint32_t *offsets;
+	unsigned char *prefix, *suffixes, *blob;
+	unsigned int prefix_len = 0, suffix_size;
+	uint64_t size, data_size = 0;
+	int i, num = to - from, err;
+	void *buf;
+
+	if (num) {
+		dnet_indexes_page_get(p, from, &it);
+		dnet_indexes_page_get(p, to - 1, &last);
+
+		/* entries are sorted, so prefix of the first and the last one is common to all */
+		while (prefix_len < DNET_ID_SIZE && it.id.id[prefix_len] == last.id.id[prefix_len])
+			prefix_len++;
+	}
+	suffix_size = DNET_ID_SIZE - prefix_len;
+
+	for (i = from; i < to; ++i) {
+		dnet_indexes_page_get(p, i, &it);
+		data_size += it.size;
+	}
+
+	if (data_size > 0xffffffffULL)
+		return -E2BIG;
+
+	size = sizeof(struct dnet_indexes_page_header) + (num + 1) * sizeof(uint32_t) +
+		prefix_len + (uint64_t)num * suffix_size + data_size;
+
+	buf = malloc(sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr) + size);
+	if (!buf)
+		return -ENOMEM;
+
+	h = buf + sizeof(struct dnet_cmd) + sizeof(struct dnet_io_attr);
+	offsets = (uint32_t *)(h + 1);
+	prefix = (unsigned char *)(offsets + num + 1);
+	suffixes = prefix + prefix_len;
+	blob = suffixes + (size_t)num * suffix_size;
+
+	memset(h, 0, sizeof(struct dnet_indexes_page_header));
+	h->magic = DNET_INDEXES_COLUMNS_MAGIC;
+	h->num = num;
+	h->prefix_len = prefix_len;
+	h->data_size = data_size;
+	dnet_convert_indexes_page_header(h);
+
+	data_size = 0;
+	for (i = 0; i < num; ++i) {
+		dnet_indexes_page_get(p, from + i, &it);
+
+		if (i == 0)
+			memcpy(prefix, it.id.id, prefix_len);
+		memcpy(suffixes + (size_t)i * suffix_size, it.id.id + prefix_len, suffix_size);
+
+		offsets[i] = dnet_bswap32(data_size);
+		memcpy(blob + data_size, it.data, it.size);
+		data_size += it.size;
+	}
+	offsets[num] = dnet_bswap32(data_size);
+
+	dnet_indexes_page_id(&id, index->id, page);
+	err = dnet_indexes_write_local(n, &id, buf, size);
+
+	free(buf);
+	return err;
+}
+
+static int dnet_indexes_root_create(struct dnet_indexes_root **rootp)
+{
+	struct dnet_indexes_root *root;
+
+	root = malloc(sizeof(struct dnet_indexes_root) + sizeof(struct dnet_indexes_root_entry));
+	if (!root)
+		return -ENOMEM;
+
+	memset(root, 0, sizeof(struct dnet_indexes_root) + sizeof(struct dnet_indexes_root_entry));
+	root->magic = DNET_INDEXES_ROOT_MAGIC;
+	root->flags = DNET_INDEXES_ROOT_FLAGS_COUNTED;
+	root->next_page = 1;
+	root->num = 1;
+
+	*rootp = root;
+	return 0;
+}
+
+/* index change decoded from request */
+struct dnet_indexes_change
+{
+	struct dnet_raw_id		id;
+	uint32_t			op;
+	uint64_t			size;
+	void				*data;
+	int				seq;
+};
+
+static int dnet_indexes_change_compare(const void *a1, const void *a2)
+{
+	const struct dnet_indexes_change *c1 = a1;
+	const struct dnet_indexes_change *c2 = a2;
+	int cmp;
+
+	cmp = dnet_id_cmp_str(c1->id.id, c2->id.id);
+	if (cmp)
+		return cmp;
+
+	/* changes of the same entry are applied in request order */
+	return c1->seq - c2->seq;
+}
+
+static int dnet_indexes_page_apply(struct dnet_indexes_page *p, struct dnet_indexes_change *c)
+{
+	struct dnet_indexes_item *it;
+	int pos, err;
+
+	pos = dnet_indexes_page_search(p, c->id.id);
+
+	if (c->op == DNET_INDEXES_REMOVE) {
+		if (pos < 0)
+			return 0;
+
+		p->bytes -= sizeof(struct dnet_indexes_entry) + p->items[pos].size;
+		memmove(&p->items[pos], &p->items[pos + 1], (p->num - pos - 1) * sizeof(struct dnet_indexes_item));
+		p->num--;
+		return 0;
+	}
+
+	if (pos < 0) {
+		err = dnet_indexes_page_reserve(p, p->num + 1);
+		if (err)
+			return err;
+
+		pos = -pos - 1;
+		memmove(&p->items[pos + 1], &p->items[pos], (p->num - pos) * sizeof(struct dnet_indexes_item));
+		p->num++;
+
+		p->bytes += sizeof(struct dnet_indexes_entry);
+	} else {
+		p->bytes -= p->items[pos].size;
+	}
+
+	it = &p->items[pos];
+	it->id = c->id;
+	it->size = c->size;
+	it->data = c->data;
+
+	p->bytes += c->size;
+	return 0;
+}
+
+/*
+ * Returns number of pages @p has to be split into, entries are divided evenly,
+ * @cut receives position of the first entry of every part.
+ */
+static int dnet_indexes_page_parts(struct dnet_indexes_page *p, int *cut)
+{
+	uint64_t bytes;
+	int parts, i, j;
+
+	parts = (p->num + DNET_INDEXES_PAGE_ENTRIES - 1) / DNET_INDEXES_PAGE_ENTRIES;
+	if ((uint64_t)parts < (p->bytes + DNET_INDEXES_PAGE_SIZE - 1) / DNET_INDEXES_PAGE_SIZE)
+		parts = (p->bytes + DNET_INDEXES_PAGE_SIZE - 1) / DNET_INDEXES_PAGE_SIZE;
+	if (parts < 1)
+		parts = 1;
+
+	/* entries have different sizes, so part may still overflow, then more parts are needed */
+	for (; parts < p->num; ++parts) {
+		for (i = 0; i < parts; ++i)
+			cut[i] = (int)((uint64_t)p->num * i / parts);
+		cut[parts] = p->num;
+
+		for (i = 0; i < parts; ++i) {
+			bytes = 0;
+			for (j = cut[i]; j < cut[i + 1]; ++j)
+				bytes += sizeof(struct dnet_indexes_entry) + p->items[j].size;
+
+			if (bytes > DNET_INDEXES_PAGE_SIZE && cut[i + 1] - cut[i] > 1)
+				break;
+		}
+
+		if (i == parts)
+			return parts;
+	}
+
+	for (i = 0; i <= p->num; ++i)
+		cut[i] = i;
+	return p->num;
+}
+
+/*
+ * Before indexes were kept by the server, clients stored every index as single msgpack blob
+ * at index id: [1, [[id, data], ...], [id, ...]], ids and data are raw strings, the last array
+ * is not used. Only the subset of msgpack written by the client is parsed here.
+ */
+struct dnet_indexes_mp
+{
+	const unsigned char		*ptr;
+	const unsigned char		*end;
+};
+
+/* reads @size bytes of big-endian number which follows type byte */
+static int dnet_indexes_mp_number(struct dnet_indexes_mp *mp, int size, uint64_t *v)
+{
+	int i;
+
+	if (mp->end - mp->ptr < 1 + size)
+		return -EILSEQ;
+
+	*v = 0;
+	for (i = 1; i <= size; ++i)
+		*v = (*v << 8) | mp->ptr[i];
+
+	mp->ptr += 1 + size;
+	return 0;
+}
+
+static int dnet_indexes_mp_uint(struct dnet_indexes_mp *mp, uint64_t *v)
+{
+	if (mp->ptr >= mp->end)
+		return -EILSEQ;
+
+	if (*mp->ptr < 0x80) {
+		*v = *mp->ptr++;
+		return 0;
+	}
+
+	switch (*mp->ptr) {
+	case 0xcc:
+		return dnet_indexes_mp_number(mp, 1, v);
+	case 0xcd:
+		return dnet_indexes_mp_number(mp, 2, v);
+	case 0xce:
+		return dnet_indexes_mp_number(mp, 4, v);
+	case 0xcf:
+		return dnet_indexes_mp_number(mp, 8, v);
+	}
+
+	return -EILSEQ;
+}
+
+static int dnet_indexes_mp_array(struct dnet_indexes_mp *mp, uint64_t *num)
+{
+	if (mp->ptr >= mp->end)
+		return -EILSEQ;
+
+	if ((*mp->ptr & 0xf0) == 0x90) {
+		*num = *mp->ptr++ & 0x0f;
+		return 0;
+	}
+
+	switch (*mp->ptr) {
+	case 0xdc:
+		return dnet_indexes_mp_number(mp, 2, num);
+	case 0xdd:
+		return dnet_indexes_mp_number(mp, 4, num);
+	}
+
+	return -EILSEQ;
+}
+
+/* raw type of the old specification, str and bin types of the new one are accepted */
+static int dnet_indexes_mp_raw(struct dnet_indexes_mp *mp, const void **data, uint64_t *size)
+{
+	int err;
+
+	if (mp->ptr >= mp->end)
+		return -EILSEQ;
+
+	if ((*mp->ptr & 0xe0) == 0xa0) {
+		*size = *mp->ptr++ & 0x1f;
+		err = 0;
+	} else {
+		switch (*mp->ptr) {
+		case 0xc4:
+		case 0xd9:
+			err = dnet_indexes_mp_number(mp, 1, size);
+			break;
+		case 0xc5:
+		case 0xda:
+			err = dnet_indexes_mp_number(mp, 2, size);
+			break;
+		case 0xc6:
+		case 0xdb:
+			err = dnet_indexes_mp_number(mp, 4, size);
+			break;
+		default:
+			err = -EILSEQ;
+			break;
+		}
+	}
+	if (err)
+		return err;
+
+	if ((uint64_t)(mp->end - mp->ptr) < *size)
+		return -EILSEQ;
+
+	*data = mp->ptr;
+	mp->ptr += *size;
+	return 0;
+}
+
+static int dnet_indexes_item_compare(const void *a1, const void *a2)
+{
+	const struct dnet_indexes_item *i1 = a1;
+	const struct dnet_indexes_item *i2 = a2;
+
+	return dnet_id_cmp_str(i1->id.id, i2->id.id);
+}
+
+/* fills @p with entries of legacy blob, entries point into @data */
+static int dnet_indexes_legacy_parse(const void *data, uint64_t size, struct dnet_indexes_page *p)
+{
+	struct dnet_indexes_mp mp;
+	struct dnet_indexes_item *it;
+	const void *id, *entry;
+	uint64_t num, version, fields, id_size, entry_size, i;
+	int err;
+
+	mp.ptr = data;
+	mp.end = mp.ptr + size;
+
+	if (dnet_indexes_mp_array(&mp, &fields) || fields != 3)
+		return -EILSEQ;
+
+	if (dnet_indexes_mp_uint(&mp, &version) || version != DNET_INDEXES_LEGACY_VERSION)
+		return -EILSEQ;
+
+	/* every entry takes at least 3 bytes */
+	if (dnet_indexes_mp_array(&mp, &num) || num > size / 3)
+		return -EILSEQ;
+
+	err = dnet_indexes_page_reserve(p, num ? num : 1);
+	if (err)
+		return err;
+
+	for (i = 0; i < num; ++i) {
+		if (dnet_indexes_mp_array(&mp, &fields) || fields != 2)
+			return -EILSEQ;
+
+		err = dnet_indexes_mp_raw(&mp, &id, &id_size);
+		if (err || id_size != DNET_ID_SIZE)
+			return -EILSEQ;
+
+		err = dnet_indexes_mp_raw(&mp, &entry, &entry_size);
+		if (err)
+			return err;
+
+		/* page data offsets are 32-bit */
+		if (entry_size > DNET_INDEXES_PAGE_SIZE)
+			return -E2BIG;
+
+		it = &p->items[i];
+		memcpy(it->id.id, id, DNET_ID_SIZE);
+		it->size = entry_size;
+		it->data = (void *)entry;
+
+		p->bytes += sizeof(struct dnet_indexes_entry) + entry_size;
+	}
+	p->num = num;
+
+	/* client kept entries sorted, but its order is not trusted */
+	qsort(p->items, p->num, sizeof(struct dnet_indexes_item), dnet_indexes_item_compare);
+	return 0;
+}
+
+/*
+ * Converts legacy blob stored at index id into root and pages. Pages are written before root
+ * overwrites the blob, so interrupted conversion is restarted from scratch on the next access.
+ * Called under operation lock of the index id like any other update.
+ */
+static int dnet_indexes_legacy_convert(struct dnet_node *n, struct dnet_raw_id *index,
+		const void *data, uint64_t size, struct dnet_indexes_root **rootp)
+{
+	struct dnet_indexes_root *root = NULL;
+	struct dnet_indexes_page p;
+	int *cut = NULL, parts = 1, i, err;
+
+	memset(&p, 0, sizeof(struct dnet_indexes_page));
+
+	err = dnet_indexes_legacy_parse(data, size, &p);
+	if (err) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: indexes: corrupted legacy index, size: %llu, err: %d\n",
+				dnet_dump_id_str(index->id), (unsigned long long)size, err);
+		goto err_out_cleanup;
+	}
+
+	if (p.num) {
+		cut = malloc((p.num + 1) * sizeof(int));
+		if (!cut) {
+			err = -ENOMEM;
+			goto err_out_cleanup;
+		}
+
+		parts = dnet_indexes_page_parts(&p, cut);
+	}
+
+	root = malloc(sizeof(struct dnet_indexes_root) + parts * sizeof(struct dnet_indexes_root_entry));
+	if (!root) {
+		err = -ENOMEM;
+		goto err_out_free_cut;
+	}
+
+	memset(root, 0, sizeof(struct dnet_indexes_root) + parts * sizeof(struct dnet_indexes_root_entry));
+	root->magic = DNET_INDEXES_ROOT_MAGIC;
+	root->flags = DNET_INDEXES_ROOT_FLAGS_COUNTED;
+	root->entries_num = p.num;
+	root->next_page = parts;
+	root->num = parts;
+
+	for (i = 0; i < parts && p.num; ++i) {
+		/* first page always starts at zero id */
+		if (i)
+			root->entries[i].start = p.items[cut[i]].id;
+		root->entries[i].page = i;
+
+		err = dnet_indexes_page_store(n, index, i, &p, cut[i], cut[i + 1]);
+		if (err)
+			goto err_out_free_root;
+	}
+
+	err = dnet_indexes_root_store(n, index, root);
+	if (err)
+		goto err_out_free_root;
+
+	dnet_log(n, DNET_LOG_INFO, "%s: indexes: converted legacy index, entries: %d, pages: %d\n",
+			dnet_dump_id_str(index->id), p.num, parts);
+
+	*rootp = root;
+	root = NULL;
+
+err_out_free_root:
+	free(root);
+err_out_free_cut:
+	free(cut);
+err_out_cleanup:
+	dnet_indexes_page_cleanup(&p);
+	return err;
+}
+
+/* counts entries of root written before it kept the number of entries */
+static int dnet_indexes_root_count(struct dnet_node *n, struct dnet_raw_id *index,
+		struct dnet_indexes_root *root, uint64_t *nump)
+{
+	struct dnet_indexes_page page;
+	uint64_t num = 0;
+	uint32_t idx;
+	int err;
+
+	for (idx = 0; idx < root->num; ++idx) {
+		err = dnet_indexes_page_load(n, index, root, idx, &page);
+		if (err)
+			return err;
+
+		num += page.num;
+		dnet_indexes_page_cleanup(&page);
+	}
+
+	*nump = num;
+	return 0;
+}
+
+/*
+ * Writes modified page @idx of the root. Overflowed page is split into several parts,
+ * new pages are written before root references them, empty page is unlinked from the root
+ * before it is removed, the whole index is removed with its last page.
+ */
+static int dnet_indexes_page_flush(struct dnet_node *n, struct dnet_raw_id *index,
+		struct dnet_indexes_root **rootp, uint32_t idx, struct dnet_indexes_page *p)
+{
+	struct dnet_indexes_root *root = *rootp;
+	struct dnet_indexes_root_entry *re;
+	struct dnet_raw_id page_id;
+	int *cut, parts, i, err;
+
+	if (!p->num && !(idx == 0 && root->num > 1)) {
+		dnet_indexes_page_id(&page_id, index->id, root->entries[idx].page);
+
+		if (root->num == 1) {
+			err = dnet_indexes_remove_local(n, index);
+			root->num = 0;
+		} else {
+			memmove(&root->entries[idx], &root->entries[idx + 1],
+					(root->num - idx - 1) * sizeof(struct dnet_indexes_root_entry));
+			root->num--;
+
+			err = dnet_indexes_root_store(n, index, root);
+		}
+
+		if (!err)
+			err = dnet_indexes_remove_local(n, &page_id);
+		return err;
+	}
+
+	if (p->num <= DNET_INDEXES_PAGE_ENTRIES && (p->num <= 1 || p->bytes <= DNET_INDEXES_PAGE_SIZE))
+		return dnet_indexes_page_store(n, index, root->entries[idx].page, p, 0, p->num);
+
+	cut = malloc((p->num + 1) * sizeof(int));
+	if (!cut)
+		return -ENOMEM;
+
+	parts = dnet_indexes_page_parts(p, cut);
+
+	root = realloc(root, sizeof(struct dnet_indexes_root) +
+			(root->num + parts - 1) * sizeof(struct dnet_indexes_root_entry));
+	if (!root) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+	*rootp = root;
+
+	re = &root->entries[idx + 1];
+	memmove(re + parts - 1, re, (root->num - idx - 1) * sizeof(struct dnet_indexes_root_entry));
+
+	for (i = 1; i < parts; ++i, ++re) {
+		re->start = p->items[cut[i]].id;
+		re->page = root->next_page++;
+
+		err = dnet_indexes_page_store(n, index, re->page, p, cut[i], cut[i + 1]);
+		if (err)
+			goto err_out_free;
+	}
+	root->num += parts - 1;
+
+	err = dnet_indexes_root_store(n, index, root);
+	if (err)
+		goto err_out_free;
+
+	dnet_log(n, DNET_LOG_INFO, "%s: indexes: split page %llu at %d entries into %d parts, pages: %u\n",
+			dnet_dump_id_str(index->id), (unsigned long long)root->entries[idx].page,
+			p->num, parts, root->num);
+
+	err = dnet_indexes_page_store(n, index, root->entries[idx].page, p, 0, cut[1]);
+
+err_out_free:
+	free(cut);
+	return err;
+}
+
+/*
+ * Applies @num changes sorted by id to the index, every affected page
+ * is read and written once no matter how many of its entries are changed.
+ */
+static int dnet_indexes_apply(struct dnet_net_state *st, struct dnet_cmd *cmd,
+		struct dnet_indexes_change *changes, int num)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_raw_id index;
+	struct dnet_indexes_root *root = NULL;
+	struct dnet_indexes_page page;
+	const unsigned char *end;
+	uint32_t idx;
+	int i, j, num_before, root_changed = 0, pages = 0, err = 0;
+
+	memcpy(index.id, cmd->id.id, DNET_ID_SIZE);
+
+	err = dnet_indexes_root_load(n, &index, &root);
+	if (err == -ENOENT) {
+		for (i = 0; i < num; ++i) {
+			if (changes[i].op == DNET_INDEXES_ADD)
+				break;
+		}
+
+		/* nothing to remove */
+		if (i == num) {
+			err = 0;
+			goto err_out_exit;
+		}
+
+		err = dnet_indexes_root_create(&root);
+		if (!err)
+			err = dnet_indexes_root_store(n, &index, root);
+	}
+	if (err)
+		goto err_out_free_root;
+
+	if (!(root->flags & DNET_INDEXES_ROOT_FLAGS_COUNTED)) {
+		err = dnet_indexes_root_count(n, &index, root, &root->entries_num);
+		if (err)
+			goto err_out_free_root;
+
+		root->flags |= DNET_INDEXES_ROOT_FLAGS_COUNTED;
+		root_changed = 1;
+	}
+
+	for (i = 0; i < num; i = j) {
+		idx = dnet_indexes_root_search(root, changes[i].id.id);
+		end = (idx + 1 < root->num) ? root->entries[idx + 1].start.id : NULL;
+
+		for (j = i + 1; j < num; ++j) {
+			if (end && dnet_id_cmp_str(changes[j].id.id, end) >= 0)
+				break;
+		}
+
+		err = dnet_indexes_page_load(n, &index, root, idx, &page);
+		if (err)
+			break;
+
+		err = dnet_indexes_page_materialize(&page);
+
+		num_before = page.num;
+		for (; i < j && !err; ++i)
+			err = dnet_indexes_page_apply(&page, &changes[i]);
+
+		if (!err) {
+			if (page.num != num_before) {
+				root->entries_num += page.num - num_before;
+				root_changed = 1;
+			}
+
+			err = dnet_indexes_page_flush(n, &index, &root, idx, &page);
+		}
+
+		dnet_indexes_page_cleanup(&page);
+		pages++;
+
+		if (err)
+			break;
+	}
+
+	/* the whole index is removed with its last page */
+	if (!err && root_changed && root->num)
+		err = dnet_indexes_root_store(n, &index, root);
+
+	dnet_log(n, DNET_LOG_NOTICE, "%s: indexes: update: changes: %d, pages: %d, entries: %llu, err: %d\n",
+			dnet_dump_id(&cmd->id), num, pages, (unsigned long long)root->entries_num, err);
+
+err_out_free_root:
+	free(root);
+err_out_exit:
+	return err;
+}
+
+static int dnet_indexes_update(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_indexes_request *req)
+{
+	struct dnet_indexes_change change;
+
+	/* page data offsets are 32-bit */
+	if (req->op == DNET_INDEXES_ADD && req->size > DNET_INDEXES_PAGE_SIZE)
+		return -E2BIG;
+
+	memset(&change, 0, sizeof(change));
+	change.id = req->id;
+	change.op = req->op;
+	change.size = req->size;
+	change.data = req + 1;
+
+	return dnet_indexes_apply(st, cmd, &change, 1);
+}
+
+/* request data is a sequence of struct dnet_indexes_update_entry with data */
+static int dnet_indexes_update_batch(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_indexes_request *req)
+{
+	struct dnet_indexes_update_entry *e;
+	struct dnet_indexes_change *changes;
+	uint64_t offset = 0;
+	int num = 0, alloc = 0, err;
+	void *data = req + 1;
+
+	changes = NULL;
+	while (offset < req->size) {
+		if (offset + sizeof(struct dnet_indexes_update_entry) > req->size) {
+			err = -EINVAL;
+			goto err_out_free;
+		}
+
+		e = data + offset;
+		dnet_convert_indexes_update_entry(e);
+		offset += sizeof(struct dnet_indexes_update_entry);
+
+		if (offset + e->size > req->size ||
+				(e->op != DNET_INDEXES_ADD && e->op != DNET_INDEXES_REMOVE)) {
+			err = -EINVAL;
+			goto err_out_free;
+		}
+
+		if (e->op == DNET_INDEXES_ADD && e->size > DNET_INDEXES_PAGE_SIZE) {
+			err = -E2BIG;
+			goto err_out_free;
+		}
+
+		if (num == alloc) {
+			struct dnet_indexes_change *tmp;
+
+			alloc = alloc ? alloc * 2 : 64;
+			tmp = realloc(changes, alloc * sizeof(struct dnet_indexes_change));
+			if (!tmp) {
+				err = -ENOMEM;
+				goto err_out_free;
+			}
+			changes = tmp;
+		}
+
+		changes[num].id = e->id;
+		changes[num].op = e->op;
+		changes[num].size = e->size;
+		changes[num].data = e + 1;
+		changes[num].seq = num;
+		num++;
+
+		offset += e->size;
+	}
+
+	qsort(changes, num, sizeof(struct dnet_indexes_change), dnet_indexes_change_compare);
+
+	err = 0;
+	if (num)
+		err = dnet_indexes_apply(st, cmd, changes, num);
+
+err_out_free:
+	free(changes);
+	return err;
+}
+
+/*
+ * Sends @num page entries as single reply, entries are taken
+ * from @pos array if it is not NULL and starting from @from otherwise.
+ */
+static int dnet_indexes_send_entries(struct dnet_net_state *st, struct dnet_cmd *cmd,
+		struct dnet_indexes_page *p, int from, const int *pos, int num, int more)
+{
+	struct dnet_indexes_reply *reply;
+	struct dnet_indexes_entry *e;
+	struct dnet_indexes_item it;
+	uint64_t size;
+	void *buf, *ptr;
+	int i, err;
+
+	size = sizeof(struct dnet_indexes_reply);
+	for (i = 0; i < num; ++i) {
+		dnet_indexes_page_get(p, pos ? pos[i] : from + i, &it);
+		size += sizeof(struct dnet_indexes_entry) + it.size;
+	}
+
+	err = dnet_flow_consume_io(st, cmd, size);
+	if (err)
+		return err;
+
+	buf = malloc(size);
+	if (!buf)
+		return -ENOMEM;
+
+	reply = buf;
+	memset(reply, 0, sizeof(struct dnet_indexes_reply));
+	reply->num = num;
+	if (more)
+		reply->flags |= DNET_INDEXES_FLAGS_MORE;
+	dnet_convert_indexes_reply(reply);
+
+	ptr = reply + 1;
+	for (i = 0; i < num; ++i) {
+		dnet_indexes_page_get(p, pos ? pos[i] : from + i, &it);
+
+		e = ptr;
+		e->id = it.id;
+		e->size = it.size;
+		dnet_convert_indexes_entry(e);
+
+		memcpy(e + 1, it.data, it.size);
+		ptr += sizeof(struct dnet_indexes_entry) + it.size;
+	}
+
+	err = dnet_send_reply(st, cmd, buf, size, 1);
+	free(buf);
+
+	return err;
+}
+
+/*
+ * Read position is kept as the id to continue from rather than page number, so that
+ * request processed without operation lock (DNET_FLAGS_NOLOCK) reloads root after every
+ * page and does not lose entries moved by concurrent page split or merge.
+ */
+static int dnet_indexes_read(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_indexes_request *req)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_raw_id index, start;
+	struct dnet_indexes_root *root;
+	struct dnet_indexes_page page;
+	struct dnet_indexes_item it;
+	char id_str[2 * DNET_ID_SIZE + 1];
+	uint64_t sent = 0;
+	uint32_t idx, pages = 0;
+	int from, to, more, next, err;
+
+	memcpy(index.id, cmd->id.id, DNET_ID_SIZE);
+	memcpy(start.id, req->id.id, DNET_ID_SIZE);
+
+	err = dnet_indexes_root_load(n, &index, &root);
+	if (err)
+		goto err_out_exit;
+
+	do {
+		idx = dnet_indexes_root_search(root, start.id);
+
+		err = dnet_indexes_page_load(n, &index, root, idx, &page);
+		if (err)
+			goto err_out_free;
+
+		from = dnet_indexes_page_search(&page, start.id);
+		if (from < 0)
+			from = -from - 1;
+
+		to = page.num;
+		more = 0;
+		if (req->limit && sent + (to - from) >= req->limit) {
+			to = from + (req->limit - sent);
+			more = (to < page.num) || (idx + 1 < root->num);
+		}
+
+		err = 0;
+		if (to > from)
+			err = dnet_indexes_send_entries(st, cmd, &page, from, NULL, to - from, more);
+
+		sent += to - from;
+		pages++;
+
+		if (to < page.num) {
+			dnet_indexes_page_get(&page, to, &it);
+			start = it.id;
+			next = 1;
+		} else if (idx + 1 < root->num) {
+			start = root->entries[idx + 1].start;
+			next = 1;
+		} else {
+			next = 0;
+		}
+		dnet_indexes_page_cleanup(&page);
+
+		if (err || !next || (req->limit && sent >= req->limit))
+			break;
+
+		if (cmd->flags & DNET_FLAGS_NOLOCK) {
+			free(root);
+
+			err = dnet_indexes_root_load(n, &index, &root);
+			if (err)
+				goto err_out_exit;
+		}
+	} while (1);
+
+	dnet_log(n, DNET_LOG_NOTICE, "%s: indexes: read: start: %s, limit: %u, sent: %llu, pages: %u, err: %d\n",
+			dnet_dump_id(&cmd->id), dnet_dump_id_len_raw(req->id.id, DNET_ID_SIZE, id_str), req->limit,
+			(unsigned long long)sent, pages, err);
+
+err_out_free:
+	free(root);
+err_out_exit:
+	return err;
+}
+
+static int dnet_indexes_stat(struct dnet_net_state *st, struct dnet_cmd *cmd)
+{
+	struct dnet_raw_id index;
+	struct dnet_indexes_root *root;
+	struct dnet_indexes_stat stat;
+	int err;
+
+	memcpy(index.id, cmd->id.id, DNET_ID_SIZE);
+
+	err = dnet_indexes_root_load(st->n, &index, &root);
+	if (err)
+		return err;
+
+	memset(&stat, 0, sizeof(stat));
+	stat.pages = root->num;
+	stat.entries = root->entries_num;
+
+	if (!(root->flags & DNET_INDEXES_ROOT_FLAGS_COUNTED)) {
+		err = dnet_indexes_root_count(st->n, &index, root, &stat.entries);
+		if (err) {
+			free(root);
+			return err;
+		}
+	}
+	dnet_convert_indexes_stat(&stat);
+
+	free(root);
+
+	return dnet_send_reply(st, cmd, &stat, sizeof(stat), 1);
+}
+
+/*
+ * Looks up sorted ids from request in the index and sends entries which are present.
+ * Pages without requested ids are skipped via root search, ids within page are searched
+ * exponentially from the previous match, so probing is linear in the number of requested ids
+ * when they are dense and logarithmic in index size when they are sparse.
+ */
+static int dnet_indexes_probe(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_indexes_request *req)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_raw_id index;
+	struct dnet_indexes_root *root;
+	struct dnet_indexes_page page;
+	int *found = NULL;
+	struct dnet_raw_id *ids = (struct dnet_raw_id *)(req + 1);
+	uint64_t i, num = req->size / sizeof(struct dnet_raw_id);
+	uint32_t idx = 0;
+	int loaded = 0, found_num = 0, matched = 0, pages = 0;
+	int pos = 0, err;
+
+	if (req->size % sizeof(struct dnet_raw_id))
+		return -EINVAL;
+
+	for (i = 1; i < num; ++i) {
+		if (dnet_id_cmp_str(ids[i - 1].id, ids[i].id) > 0)
+			return -EINVAL;
+	}
+
+	memcpy(index.id, cmd->id.id, DNET_ID_SIZE);
+
+	err = dnet_indexes_root_load(n, &index, &root);
+	if (err)
+		goto err_out_exit;
+
+	for (i = 0; i < num; ++i) {
+		if (!loaded || (idx + 1 < root->num && dnet_id_cmp_str(ids[i].id, root->entries[idx + 1].start.id) >= 0)) {
+			if (loaded) {
+				if (found_num)
+					err = dnet_indexes_send_entries(st, cmd, &page, 0, found, found_num, 0);
+
+				dnet_indexes_page_cleanup(&page);
+				loaded = 0;
+				if (err)
+					goto err_out_free;
+			}
+
+			idx = dnet_indexes_root_search(root, ids[i].id);
+			err = dnet_indexes_page_load(n, &index, root, idx, &page);
+			if (err)
+				goto err_out_free;
+
+			free(found);
+			found = malloc((page.num ? page.num : 1) * sizeof(int));
+			if (!found) {
+				err = -ENOMEM;
+				dnet_indexes_page_cleanup(&page);
+				goto err_out_free;
+			}
+
+			loaded = 1;
+			found_num = 0;
+			pos = 0;
+			pages++;
+		}
+
+		pos = dnet_indexes_page_gallop(&page, pos, ids[i].id);
+		if (pos < page.num && !dnet_indexes_page_cmp(&page, pos, ids[i].id)) {
+			/* duplicate ids in request are returned once */
+			if (!found_num || found[found_num - 1] != pos)
+				found[found_num++] = pos;
+			matched++;
+		}
+	}
+
+	if (loaded) {
+		if (found_num)
+			err = dnet_indexes_send_entries(st, cmd, &page, 0, found, found_num, 0);
+		dnet_indexes_page_cleanup(&page);
+	}
+
+	dnet_log(n, DNET_LOG_NOTICE, "%s: indexes: probe: ids: %llu, matched: %d, pages: %d/%u, err: %d\n",
+			dnet_dump_id(&cmd->id), (unsigned long long)num, matched, pages, root->num, err);
+
+err_out_free:
+	free(found);
+	free(root);
+err_out_exit:
+	return err;
+}
+
+int dnet_cmd_indexes(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_indexes_request *req = data;
+	char id_str[2 * DNET_ID_SIZE + 1];
+	int err;
+
+	if (cmd->size < sizeof(struct dnet_indexes_request)) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: indexes: invalid size: %llu\n",
+				dnet_dump_id(&cmd->id), (unsigned long long)cmd->size);
+		return -EINVAL;
+	}
+
+	dnet_convert_indexes_request(req);
+
+	if (cmd->size != sizeof(struct dnet_indexes_request) + req->size) {
+		err = -EINVAL;
+		goto err_out_exit;
+	}
+
+	switch (req->op) {
+	case DNET_INDEXES_ADD:
+	case DNET_INDEXES_REMOVE:
+		if (n->ro) {
+			err = -EROFS;
+			break;
+		}
+
+		err = dnet_indexes_update(st, cmd, req);
+		break;
+	case DNET_INDEXES_UPDATE:
+		if (n->ro) {
+			err = -EROFS;
+			break;
+		}
+
+		err = dnet_indexes_update_batch(st, cmd, req);
+		break;
+	case DNET_INDEXES_READ:
+		err = dnet_indexes_read(st, cmd, req);
+		break;
+	case DNET_INDEXES_STAT:
+		err = dnet_indexes_stat(st, cmd);
+		break;
+	case DNET_INDEXES_PROBE:
+		err = dnet_indexes_probe(st, cmd, req);
+		break;
+	default:
+		err = -ENOTSUP;
+		break;
+	}
+
+err_out_exit:
+	dnet_log(n, ((err && err != -ENOENT) ? DNET_LOG_ERROR : DNET_LOG_NOTICE),
+			"%s: indexes: op: %u, entry: %s, size: %llu, err: %d\n",
+			dnet_dump_id(&cmd->id), req->op, dnet_dump_id_len_raw(req->id.id, DNET_ID_SIZE, id_str),
+			(unsigned long long)req->size, err);
+	return err;
+}
@@ -0,0 +1,492 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "elliptics.h"
+
+#include "elliptics/packet.h"
+#include "elliptics/interface.h"
+
+/*
+ * Server-side iterator.
+ *
+ * DNET_ITERATOR_ACTION_START spawns a thread which walks backend keys through
+ * @dnet_backend_callbacks.iterator and streams dnet_iterator_response (optionally followed
+ * by object data) for every key matching request filters. Every response is sent as a reply
+ * to the original transaction, which is completed with the final acknowledge carrying
+ * iteration status once backend walk is over.
+ *
+ * Other actions are applied to running iterator by its id: pause blocks the thread
+ * before the next key, continue wakes it up, cancel stops iteration.
+ * Replies of requests sent with DNET_FLAGS_FLOW_CONTROL consume credit granted by the client (see flow.c),
+ * otherwise thread sleeps while the reply queue of the client's state exceeds DNET_ITERATOR_QUEUE_LIMIT bytes,
+ * so slow client does not force node to buffer the whole storage.
+ * At most DNET_ITERATOR_MAX iterators run concurrently, further start requests fail with -EBUSY.
+ */
+
+#define DNET_ITERATOR_QUEUE_LIMIT	(32 * 1024 * 1024)
+
+#define DNET_ITERATOR_MAX		16
+
+/* iterator rechecks its state at least this often (milliseconds) while throttled */
+#define DNET_ITERATOR_WAIT_SLICE	10
+
+struct dnet_iterator
+{
+	struct list_head		iterator_entry;
+
+	uint64_t			id;
+	int				action;
+
+	struct dnet_net_state		*st;
+	struct dnet_cmd			cmd;
+	struct dnet_iterator_request	req;
+
+	uint64_t			total;
+	uint64_t			sent;
+};
+
+static struct dnet_iterator *dnet_iterator_search_nolock(struct dnet_node *n, uint64_t id)
+{
+	struct dnet_iterator *it;
+
+	list_for_each_entry(it, &n->iterator_list, iterator_entry) {
+		if (it->id == id)
+			return it;
+	}
+
+	return NULL;
+}
+
+static void dnet_iterator_wait_timeout(struct dnet_node *n, long msec)
+{
+	struct timespec ts;
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	ts.tv_sec = tv.tv_sec + msec / 1000;
+	ts.tv_nsec = tv.tv_usec * 1000 + (msec % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_cond_timedwait(&n->iterator_wait, &n->iterator_lock, &ts);
+}
+
+/*
+ * Blocks while iterator is paused or client did not yet consume previously sent replies.
+ * Returns negative error when iteration has to be stopped.
+ */
+static int dnet_iterator_throttle(struct dnet_iterator *it, uint64_t size)
+{
+	struct dnet_net_state *st = it->st;
+	struct dnet_node *n = st->n;
+	uint64_t queued;
+	int err = 0;
+
+	while (1) {
+		pthread_mutex_lock(&n->iterator_lock);
+		while (it->action == DNET_ITERATOR_ACTION_PAUSE && !n->need_exit && !st->need_exit)
+			pthread_cond_wait(&n->iterator_wait, &n->iterator_lock);
+
+		if (n->need_exit || st->need_exit)
+			err = -EINTR;
+		else if (it->action == DNET_ITERATOR_ACTION_CANCEL)
+			err = -ECANCELED;
+		pthread_mutex_unlock(&n->iterator_lock);
+
+		if (err)
+			break;
+
+		if (it->cmd.flags & DNET_FLAGS_FLOW_CONTROL) {
+			err = dnet_flow_consume(st, &it->cmd, size, DNET_ITERATOR_WAIT_SLICE);
+			if (err == -ETIMEDOUT) {
+				err = 0;
+				continue;
+			}
+			break;
+		}
+
+		pthread_mutex_lock(&st->send_lock);
+		queued = st->send_queue_size;
+		pthread_mutex_unlock(&st->send_lock);
+
+		if (queued < DNET_ITERATOR_QUEUE_LIMIT)
+			break;
+
+		pthread_mutex_lock(&n->iterator_lock);
+		dnet_iterator_wait_timeout(n, DNET_ITERATOR_WAIT_SLICE);
+		pthread_mutex_unlock(&n->iterator_lock);
+	}
+
+	return err;
+}
+
+static int dnet_iterator_check_ts(struct dnet_iterator *it, struct dnet_raw_id *key, struct dnet_iterator_response *re)
+{
+	struct dnet_node *n = it->st->n;
+	struct dnet_iterator_request *req = &it->req;
+	struct dnet_meta_container mc;
+	struct dnet_meta_update mu;
+	struct dnet_meta_index_entry e;
+	int err;
+
+	if (!n->cb->meta_read)
+		return !(req->flags & DNET_IFLAGS_TS_RANGE);
+
+	err = dnet_meta_index_lookup(n, key->id, &e);
+	if (err != -EAGAIN) {
+		if (err || !(e.state & DNET_META_INDEX_UPDATE))
+			return !(req->flags & DNET_IFLAGS_TS_RANGE);
+
+		re->timestamp = e.tm;
+		re->flags = e.flags;
+
+		if (req->flags & DNET_IFLAGS_TS_RANGE) {
+			if (dnet_time_cmp(&e.tm, &req->time_begin) < 0 || dnet_time_cmp(&e.tm, &req->time_end) > 0)
+				return 0;
+		}
+		return 1;
+	}
+
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+	dnet_setup_id(&mc.id, n->id.group_id, key->id);
+
+	err = n->cb->meta_read(n->cb->command_private, key, &mc.data);
+	if (err <= 0 || !mc.data)
+		return !(req->flags & DNET_IFLAGS_TS_RANGE);
+
+	mc.size = err;
+	err = 1;
+
+	if (dnet_get_meta_update(n, &mc, &mu)) {
+		dnet_convert_meta_update(&mu);
+
+		re->timestamp = mu.tm;
+		re->flags = mu.flags;
+
+		if (req->flags & DNET_IFLAGS_TS_RANGE) {
+			if (dnet_time_cmp(&mu.tm, &req->time_begin) < 0 || dnet_time_cmp(&mu.tm, &req->time_end) > 0)
+				err = 0;
+		}
+	} else if (req->flags & DNET_IFLAGS_TS_RANGE) {
+		err = 0;
+	}
+
+	free(mc.data);
+	return err;
+}
+
+static int dnet_iterator_callback(void *priv, struct dnet_raw_id *key, void *data, int fd, uint64_t offset, uint64_t size)
+{
+	struct dnet_iterator *it = priv;
+	struct dnet_net_state *st = it->st;
+	struct dnet_node *n = st->n;
+	struct dnet_iterator_request *req = &it->req;
+	struct {
+		struct dnet_cmd			cmd;
+		struct dnet_iterator_response	re;
+	} __attribute__ ((packed)) h;
+	uint64_t obj_size = size;
+	int err;
+
+	it->total++;
+
+	if (req->flags & DNET_IFLAGS_KEY_RANGE) {
+		if (memcmp(key->id, req->key.id, DNET_ID_SIZE) < 0 || memcmp(key->id, req->end.id, DNET_ID_SIZE) > 0)
+			return 0;
+	}
+
+	memset(&h, 0, sizeof(h));
+
+	if (!dnet_iterator_check_ts(it, key, &h.re))
+		return 0;
+
+	if (!(req->flags & DNET_IFLAGS_DATA))
+		size = 0;
+
+	err = dnet_iterator_throttle(it, size);
+	if (err)
+		return err;
+
+	h.re.id = it->id;
+	h.re.key = *key;
+	h.re.size = obj_size;
+
+	h.cmd.id = it->cmd.id;
+	h.cmd.cmd = it->cmd.cmd;
+	h.cmd.trans = it->cmd.trans | DNET_TRANS_REPLY;
+	h.cmd.flags = (it->cmd.flags & ~DNET_FLAGS_NEED_ACK) | DNET_FLAGS_MORE;
+	h.cmd.size = sizeof(struct dnet_iterator_response) + size;
+
+	dnet_convert_iterator_response(&h.re);
+	dnet_convert_cmd(&h.cmd);
+
+	if (size && !data) {
+		int dfd = dup(fd);
+
+		if (dfd < 0) {
+			err = -errno;
+			dnet_log_err(n, "%s: iterator %llu: failed to duplicate data fd",
+					dnet_dump_id_str(key->id), (unsigned long long)it->id);
+			return err;
+		}
+
+		err = dnet_send_fd(st, &h, sizeof(h), dfd, offset, size, DNET_IO_REQ_FLAGS_CLOSE);
+	} else {
+		err = dnet_send_data(st, &h, sizeof(h), data, size);
+	}
+
+	if (err < 0)
+		return err;
+
+	it->sent++;
+	return 0;
+}
+
+static void *dnet_iterator_process(void *priv)
+{
+	struct dnet_iterator *it = priv;
+	struct dnet_net_state *st = it->st;
+	struct dnet_node *n = st->n;
+	struct dnet_iterator_ctl ctl;
+	int err;
+
+	dnet_set_name("iterator");
+
+	memset(&ctl, 0, sizeof(struct dnet_iterator_ctl));
+	ctl.iterator_private = n->cb->command_private;
+	ctl.flags = it->req.flags;
+	ctl.start = it->req.key;
+	ctl.end = it->req.end;
+	ctl.callback_private = it;
+	ctl.callback = dnet_iterator_callback;
+
+	err = n->cb->iterator(&ctl);
+
+	dnet_log(n, DNET_LOG_INFO, "%s: iterator %llu: completed: total: %llu, sent: %llu, err: %d\n",
+			dnet_state_dump_addr(st), (unsigned long long)it->id,
+			(unsigned long long)it->total, (unsigned long long)it->sent, err);
+
+	dnet_flow_unregister(st, &it->cmd);
+	dnet_send_ack(st, &it->cmd, err);
+	dnet_state_put(st);
+
+	/* node may be destroyed as soon as iterator is unlinked, nothing but @it is touched after that */
+	pthread_mutex_lock(&n->iterator_lock);
+	list_del(&it->iterator_entry);
+	n->iterator_num--;
+	pthread_cond_broadcast(&n->iterator_wait);
+	pthread_mutex_unlock(&n->iterator_lock);
+
+	free(it);
+
+	return NULL;
+}
+
+static int dnet_iterator_start(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_iterator_request *req)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_iterator *it;
+	pthread_t tid;
+	int err;
+
+	if (!n->cb || !n->cb->iterator) {
+		err = -ENOTSUP;
+		goto err_out_exit;
+	}
+
+	if (req->itype != DNET_ITYPE_NETWORK) {
+		err = -ENOTSUP;
+		goto err_out_exit;
+	}
+
+	it = malloc(sizeof(struct dnet_iterator));
+	if (!it) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memset(it, 0, sizeof(struct dnet_iterator));
+
+	it->action = DNET_ITERATOR_ACTION_START;
+	it->st = dnet_state_get(st);
+	it->cmd = *cmd;
+	it->cmd.size = 0;
+	it->req = *req;
+
+	pthread_mutex_lock(&n->iterator_lock);
+	if (n->need_exit || n->iterator_stopped) {
+		pthread_mutex_unlock(&n->iterator_lock);
+		err = -EINTR;
+		goto err_out_free;
+	}
+
+	if (n->iterator_num >= DNET_ITERATOR_MAX) {
+		pthread_mutex_unlock(&n->iterator_lock);
+		dnet_log(n, DNET_LOG_ERROR, "%s: too many running iterators: %d\n",
+				dnet_state_dump_addr(st), n->iterator_num);
+		err = -EBUSY;
+		goto err_out_free;
+	}
+
+	err = dnet_flow_register(st, &it->cmd);
+	if (err) {
+		pthread_mutex_unlock(&n->iterator_lock);
+		goto err_out_free;
+	}
+
+	it->id = ++n->iterator_id;
+	list_add_tail(&it->iterator_entry, &n->iterator_list);
+	n->iterator_num++;
+
+	err = pthread_create(&tid, &n->attr, dnet_iterator_process, it);
+	if (err) {
+		err = -err;
+		list_del(&it->iterator_entry);
+		n->iterator_num--;
+		pthread_mutex_unlock(&n->iterator_lock);
+		dnet_flow_unregister(st, &it->cmd);
+		dnet_log(n, DNET_LOG_ERROR, "%s: failed to start iterator thread: %d\n", dnet_state_dump_addr(st), err);
+		goto err_out_free;
+	}
+	pthread_mutex_unlock(&n->iterator_lock);
+
+	dnet_log(n, DNET_LOG_INFO, "%s: iterator %llu: started: flags: %llx\n",
+			dnet_state_dump_addr(st), (unsigned long long)it->id, (unsigned long long)req->flags);
+
+	/* transaction is completed by iterator thread */
+	cmd->flags &= ~DNET_FLAGS_NEED_ACK;
+	return 0;
+
+err_out_free:
+	dnet_state_put(st);
+	free(it);
+err_out_exit:
+	return err;
+}
+
+int dnet_cmd_iterator(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_iterator_request *req = data;
+	struct dnet_iterator *it;
+	int err = 0;
+
+	if (cmd->size < sizeof(struct dnet_iterator_request))
+		return -EINVAL;
+
+	dnet_convert_iterator_request(req);
+
+	switch (req->action) {
+		case DNET_ITERATOR_ACTION_START:
+			return dnet_iterator_start(st, cmd, req);
+		case DNET_ITERATOR_ACTION_PAUSE:
+		case DNET_ITERATOR_ACTION_CONTINUE:
+		case DNET_ITERATOR_ACTION_CANCEL:
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	pthread_mutex_lock(&n->iterator_lock);
+	it = dnet_iterator_search_nolock(n, req->id);
+	if (!it) {
+		err = -ENOENT;
+	} else if (it->action != DNET_ITERATOR_ACTION_CANCEL) {
+		it->action = req->action;
+		pthread_cond_broadcast(&n->iterator_wait);
+	}
+	pthread_mutex_unlock(&n->iterator_lock);
+
+	dnet_log(n, DNET_LOG_INFO, "%s: iterator %llu: action: %d, err: %d\n",
+			dnet_state_dump_addr(st), (unsigned long long)req->id, req->action, err);
+
+	return err;
+}
+
+int dnet_iterator_init(struct dnet_node *n)
+{
+	int err;
+
+	INIT_LIST_HEAD(&n->iterator_list);
+	n->iterator_id = 0;
+	n->iterator_num = 0;
+	n->iterator_stopped = 0;
+
+	err = pthread_mutex_init(&n->iterator_lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_exit;
+	}
+
+	err = pthread_cond_init(&n->iterator_wait, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_destroy_lock;
+	}
+
+	return 0;
+
+err_out_destroy_lock:
+	pthread_mutex_destroy(&n->iterator_lock);
+err_out_exit:
+	return err;
+}
+
+/*
+ * Cancels all running iterators, forbids new ones and waits for their threads to complete.
+ * Must be called while states and IO pool are still alive, since iterator threads use them.
+ */
+void dnet_iterator_stop(struct dnet_node *n)
+{
+	struct dnet_iterator *it;
+
+	pthread_mutex_lock(&n->iterator_lock);
+	n->iterator_stopped = 1;
+
+	list_for_each_entry(it, &n->iterator_list, iterator_entry)
+		it->action = DNET_ITERATOR_ACTION_CANCEL;
+
+	while (!list_empty(&n->iterator_list)) {
+		pthread_cond_broadcast(&n->iterator_wait);
+		pthread_cond_wait(&n->iterator_wait, &n->iterator_lock);
+	}
+	pthread_mutex_unlock(&n->iterator_lock);
+}
+
+/*
+ * Releases iterator resources, must be called after IO threads are stopped,
+ * so that no new start requests can be processed.
+ */
+void dnet_iterator_exit(struct dnet_node *n)
+{
+	dnet_iterator_stop(n);
+
+	pthread_cond_destroy(&n->iterator_wait);
+	pthread_mutex_destroy(&n->iterator_lock);
+}
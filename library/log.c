@@ -23,6 +23,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +34,306 @@
 
 #include "elliptics.h"
 
+/*
+ * Asynchronous logging.
+ *
+ * Every thread formats its messages into its own ring buffer, which only this thread
+ * writes and only writer thread reads, so logging does not take locks and does not
+ * wait for logger callback. Writer thread passes messages to the logger in per-thread order.
+ * When ring is full message is dropped and accounted, writer reports number of dropped messages.
+ */
+
+#define DNET_LOG_RING_SIZE		(64 * 1024)
+#define DNET_LOG_ALIGN(size)		(((size) + 7) & ~7)
+
+#define DNET_LOG_WRITER_SLEEP_MIN	1000
+#define DNET_LOG_WRITER_SLEEP_MAX	16000
+
+/* record with negative level pads the end of the ring, next record starts at its beginning */
+struct dnet_log_record {
+	int			level;
+	int			size;
+};
+
+struct dnet_log_ring {
+	struct list_head	ring_entry;
+
+	/* moved only by owner thread */
+	volatile uint64_t	head;
+	/* moved only by writer thread */
+	volatile uint64_t	tail;
+
+	/* owner thread has exited, ring is freed by writer when drained */
+	volatile int		orphan;
+
+	char			data[DNET_LOG_RING_SIZE];
+};
+
+struct dnet_log_async {
+	struct dnet_node	*n;
+
+	pthread_key_t		key;
+
+	pthread_mutex_t		lock;
+	struct list_head	rings;
+
+	uint64_t		dropped;
+
+	volatile int		need_exit;
+	pthread_t		tid;
+};
+
+static void dnet_log_ring_orphan(void *priv)
+{
+	struct dnet_log_ring *r = priv;
+
+	r->orphan = 1;
+}
+
+static struct dnet_log_ring *dnet_log_ring_get(struct dnet_log_async *a)
+{
+	struct dnet_log_ring *r;
+
+	r = pthread_getspecific(a->key);
+	if (r)
+		return r;
+
+	r = malloc(sizeof(struct dnet_log_ring));
+	if (!r)
+		return NULL;
+
+	r->head = r->tail = 0;
+	r->orphan = 0;
+
+	if (pthread_setspecific(a->key, r)) {
+		free(r);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&a->lock);
+	list_add_tail(&r->ring_entry, &a->rings);
+	pthread_mutex_unlock(&a->lock);
+
+	return r;
+}
+
+/* returns negative error if message has to be logged synchronously */
+static int dnet_log_async_put(struct dnet_log_async *a, int level, const char *msg)
+{
+	struct dnet_log_ring *r;
+	struct dnet_log_record *rec;
+	unsigned int len = strlen(msg) + 1;
+	unsigned int need = DNET_LOG_ALIGN(sizeof(struct dnet_log_record) + len);
+	unsigned int off, pad = 0;
+	uint64_t head, tail;
+
+	r = dnet_log_ring_get(a);
+	if (!r)
+		return -ENOMEM;
+
+	head = r->head;
+	tail = r->tail;
+	__sync_synchronize();
+
+	off = head % DNET_LOG_RING_SIZE;
+	if (off + need > DNET_LOG_RING_SIZE)
+		pad = DNET_LOG_RING_SIZE - off;
+
+	if (head + pad + need - tail > DNET_LOG_RING_SIZE) {
+		__sync_fetch_and_add(&a->dropped, 1);
+		return 0;
+	}
+
+	if (pad) {
+		rec = (struct dnet_log_record *)(r->data + off);
+		rec->level = -1;
+		rec->size = 0;
+		off = 0;
+	}
+
+	rec = (struct dnet_log_record *)(r->data + off);
+	rec->level = level;
+	rec->size = len;
+	memcpy(rec + 1, msg, len);
+
+	__sync_synchronize();
+	r->head = head + pad + need;
+
+	return 0;
+}
+
+static int dnet_log_ring_drain(struct dnet_log_async *a, struct dnet_log_ring *r)
+{
+	struct dnet_log *l = a->n->log;
+	struct dnet_log_record *rec;
+	uint64_t head, tail;
+	unsigned int off;
+	int num = 0;
+
+	head = r->head;
+	tail = r->tail;
+	__sync_synchronize();
+
+	while (tail != head) {
+		off = tail % DNET_LOG_RING_SIZE;
+		rec = (struct dnet_log_record *)(r->data + off);
+
+		if (rec->level < 0) {
+			tail += DNET_LOG_RING_SIZE - off;
+		} else {
+			if (l->log)
+				l->log(l->log_private, rec->level, (char *)(rec + 1));
+
+			tail += DNET_LOG_ALIGN(sizeof(struct dnet_log_record) + rec->size);
+			num++;
+		}
+
+		__sync_synchronize();
+		r->tail = tail;
+	}
+
+	return num;
+}
+
+static int dnet_log_async_drain(struct dnet_log_async *a)
+{
+	struct dnet_log *l = a->n->log;
+	struct dnet_log_ring *r, *tmp;
+	char buf[128];
+	uint64_t dropped;
+	int num = 0;
+
+	pthread_mutex_lock(&a->lock);
+	list_for_each_entry_safe(r, tmp, &a->rings, ring_entry) {
+		num += dnet_log_ring_drain(a, r);
+
+		if (r->orphan && (r->tail == r->head)) {
+			list_del(&r->ring_entry);
+			free(r);
+		}
+	}
+	pthread_mutex_unlock(&a->lock);
+
+	dropped = __sync_fetch_and_and(&a->dropped, 0);
+	if (dropped && l->log) {
+		snprintf(buf, sizeof(buf), "log: %llu messages were dropped, log buffer is full\n",
+				(unsigned long long)dropped);
+		l->log(l->log_private, DNET_LOG_ERROR, buf);
+	}
+
+	return num;
+}
+
+static void *dnet_log_async_process(void *priv)
+{
+	struct dnet_log_async *a = priv;
+	long timeout = DNET_LOG_WRITER_SLEEP_MIN;
+
+	dnet_set_name("log");
+
+	while (!a->need_exit) {
+		if (dnet_log_async_drain(a)) {
+			timeout = DNET_LOG_WRITER_SLEEP_MIN;
+			continue;
+		}
+
+		usleep(timeout);
+
+		timeout *= 2;
+		if (timeout > DNET_LOG_WRITER_SLEEP_MAX)
+			timeout = DNET_LOG_WRITER_SLEEP_MAX;
+	}
+
+	dnet_log_async_drain(a);
+	return NULL;
+}
+
+int dnet_log_async_init(struct dnet_node *n)
+{
+	struct dnet_log_async *a;
+	int err;
+
+	if (!(n->flags & DNET_CFG_ASYNC_LOG) || !n->log)
+		return 0;
+
+	a = malloc(sizeof(struct dnet_log_async));
+	if (!a) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+
+	memset(a, 0, sizeof(struct dnet_log_async));
+
+	a->n = n;
+	INIT_LIST_HEAD(&a->rings);
+
+	err = pthread_mutex_init(&a->lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_free;
+	}
+
+	err = pthread_key_create(&a->key, dnet_log_ring_orphan);
+	if (err) {
+		err = -err;
+		goto err_out_destroy_lock;
+	}
+
+	err = pthread_create(&a->tid, NULL, dnet_log_async_process, a);
+	if (err) {
+		err = -err;
+		goto err_out_delete_key;
+	}
+
+	n->log_async = a;
+	return 0;
+
+err_out_delete_key:
+	pthread_key_delete(a->key);
+err_out_destroy_lock:
+	pthread_mutex_destroy(&a->lock);
+err_out_free:
+	free(a);
+err_out_exit:
+	dnet_log(n, DNET_LOG_ERROR, "Failed to start asynchronous logger: %d\n", err);
+	return err;
+}
+
+/*
+ * Flushes queued messages, messages logged after this call are passed to logger synchronously.
+ *
+ * Node threads are already stopped when this is called, but application threads may still log
+ * through the node, so writer is detached first and then we wait for threads which have already
+ * picked it up in dnet_log_raw() before rings are freed.
+ */
+void dnet_log_async_exit(struct dnet_node *n)
+{
+	struct dnet_log_async *a = n->log_async;
+	struct dnet_log_ring *r, *tmp;
+
+	if (!a)
+		return;
+
+	n->log_async = NULL;
+	__sync_synchronize();
+
+	while (n->log_async_users)
+		sched_yield();
+
+	a->need_exit = 1;
+	pthread_join(a->tid, NULL);
+
+	pthread_key_delete(a->key);
+
+	list_for_each_entry_safe(r, tmp, &a->rings, ring_entry) {
+		list_del(&r->ring_entry);
+		free(r);
+	}
+
+	pthread_mutex_destroy(&a->lock);
+	free(a);
+}
+
 int dnet_log_init(struct dnet_node *n, struct dnet_log *l)
 {
 	if (!n)
@@ -55,6 +357,22 @@ void dnet_log_raw(struct dnet_node *n, int level, const char *format, ...)
 	va_start(args, format);
 	vsnprintf(buf, buflen, format, args);
 	buf[buflen-1] = '\0';
-	l->log(l->log_private, level, buf);
 	va_end(args);
+
+	if (n->log_async) {
+		struct dnet_log_async *a;
+		int err = -ENOENT;
+
+		/* pairs with barrier in dnet_log_async_exit(), writer is not freed while we are counted */
+		__sync_fetch_and_add(&n->log_async_users, 1);
+		a = n->log_async;
+		if (a)
+			err = dnet_log_async_put(a, level, buf);
+		__sync_fetch_and_sub(&n->log_async_users, 1);
+
+		if (!err)
+			return;
+	}
+
+	l->log(l->log_private, level, buf);
 }
@@ -0,0 +1,801 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elliptics.h"
+
+#include "elliptics/packet.h"
+#include "elliptics/interface.h"
+
+/*
+ * Anti-entropy hash tree.
+ *
+ * Tree is stored as implicit binary heap, level @l occupies nodes [2^l - 1, 2^(l+1) - 1).
+ * Leaf hash is XOR of 64-bit digests of (id, DNET_META_UPDATE) of all keys in the leaf,
+ * so it is updated incrementally on every metadata change: old digest is XORed out,
+ * new one is XORed in. Leaf which hash can not be trusted is marked dirty and is always
+ * reported as different, dirty flag is cleared by the next full check pass, which
+ * recomputes hashes of all leaves from scratch.
+ *
+ * Check process compares trees of all nodes group by group descending only into
+ * subtrees which differ, and then checks only keys from differing leaves.
+ */
+
+/* levels descended per exchange round, DNET_MERKLE_DEPTH must be its multiple */
+#define DNET_MERKLE_STEP		4
+
+#define DNET_MERKLE_NODE(level, index)	(((1U << (level)) - 1) + (index))
+
+struct dnet_merkle_tree
+{
+	pthread_mutex_t			lock;
+
+	/* full check pass is recomputing leaves */
+	int				rebuilding;
+
+	struct dnet_merkle_node		nodes[2 * DNET_MERKLE_LEAVES - 1];
+
+	/* leaf hashes accumulated by running check pass */
+	uint64_t			fresh[DNET_MERKLE_LEAVES];
+	/* leaves changed while check pass runs, they keep incrementally updated hash */
+	uint8_t				touched[DNET_MERKLE_LEAVES];
+};
+
+static unsigned int dnet_merkle_leaf(const unsigned char *id)
+{
+	return (((unsigned int)id[0] << 8) | id[1]) >> (16 - DNET_MERKLE_DEPTH);
+}
+
+static inline uint64_t dnet_merkle_fnv(uint64_t hash, uint64_t val, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; ++i) {
+		hash ^= (val >> (i * 8)) & 0xff;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * Digest does not depend on host byte order, since hashes of different nodes are compared.
+ */
+static uint64_t dnet_merkle_digest(const unsigned char *id, struct dnet_meta_update *mu)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i < DNET_ID_SIZE; ++i)
+		hash = dnet_merkle_fnv(hash, id[i], 1);
+
+	hash = dnet_merkle_fnv(hash, mu->tm.tsec, 8);
+	hash = dnet_merkle_fnv(hash, mu->tm.tnsec, 8);
+	hash = dnet_merkle_fnv(hash, mu->flags, 8);
+
+	return hash;
+}
+
+static void dnet_merkle_update_parents_nolock(struct dnet_merkle_tree *t, unsigned int leaf)
+{
+	struct dnet_merkle_node *p, *l, *r;
+	unsigned int index = leaf;
+	int level;
+
+	for (level = DNET_MERKLE_DEPTH; level > 0; --level) {
+		index >>= 1;
+
+		p = &t->nodes[DNET_MERKLE_NODE(level - 1, index)];
+		l = &t->nodes[DNET_MERKLE_NODE(level, index * 2)];
+		r = l + 1;
+
+		p->hash = l->hash ^ r->hash;
+		p->dirty = l->dirty + r->dirty;
+	}
+}
+
+static void dnet_merkle_update_all_nolock(struct dnet_merkle_tree *t)
+{
+	struct dnet_merkle_node *p, *l;
+	unsigned int index;
+	int level;
+
+	for (level = DNET_MERKLE_DEPTH - 1; level >= 0; --level) {
+		for (index = 0; index < (1U << level); ++index) {
+			p = &t->nodes[DNET_MERKLE_NODE(level, index)];
+			l = &t->nodes[DNET_MERKLE_NODE(level + 1, index * 2)];
+
+			p->hash = l[0].hash ^ l[1].hash;
+			p->dirty = l[0].dirty + l[1].dirty;
+		}
+	}
+}
+
+int dnet_merkle_init(struct dnet_node *n)
+{
+	struct dnet_merkle_tree *t;
+	unsigned int i;
+	int err;
+
+	/* there is no metadata to build tree from */
+	if (n->flags & DNET_CFG_NO_META)
+		return 0;
+
+	t = malloc(sizeof(struct dnet_merkle_tree));
+	if (!t) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+
+	memset(t, 0, sizeof(struct dnet_merkle_tree));
+
+	err = pthread_mutex_init(&t->lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_free;
+	}
+
+	/* nothing is known until the first full check pass */
+	for (i = 0; i < DNET_MERKLE_LEAVES; ++i)
+		t->nodes[DNET_MERKLE_NODE(DNET_MERKLE_DEPTH, i)].dirty = 1;
+	dnet_merkle_update_all_nolock(t);
+
+	n->merkle = t;
+	return 0;
+
+err_out_free:
+	free(t);
+err_out_exit:
+	dnet_log(n, DNET_LOG_ERROR, "merkle: failed to initialize hash tree: %d\n", err);
+	return err;
+}
+
+void dnet_merkle_exit(struct dnet_node *n)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+
+	if (!t)
+		return;
+
+	n->merkle = NULL;
+
+	pthread_mutex_destroy(&t->lock);
+	free(t);
+}
+
+/*
+ * Reads current DNET_META_UPDATE of the key before it is changed.
+ * Metadata is not read at all if leaf is dirty, since its hash is not maintained.
+ */
+void dnet_merkle_key_read(struct dnet_node *n, struct dnet_raw_id *id, struct dnet_merkle_key *k)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+	struct dnet_meta_container mc;
+	struct dnet_meta_index_entry e;
+	int dirty, err;
+
+	k->state = DNET_MERKLE_KEY_UNKNOWN;
+
+	if (!t)
+		return;
+
+	pthread_mutex_lock(&t->lock);
+	dirty = t->nodes[DNET_MERKLE_NODE(DNET_MERKLE_DEPTH, dnet_merkle_leaf(id->id))].dirty;
+	pthread_mutex_unlock(&t->lock);
+
+	if (dirty)
+		return;
+
+	err = dnet_meta_index_lookup(n, id->id, &e);
+	if (err != -EAGAIN) {
+		k->state = DNET_MERKLE_KEY_ABSENT;
+
+		if (!err && (e.state & DNET_META_INDEX_UPDATE)) {
+			memset(&k->mu, 0, sizeof(struct dnet_meta_update));
+			k->mu.tm = e.tm;
+			k->mu.flags = e.flags;
+			k->state = DNET_MERKLE_KEY_PRESENT;
+		}
+		return;
+	}
+
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+
+	err = n->cb->meta_read(n->cb->command_private, id, &mc.data);
+	if (err == -ENOENT || err == 0) {
+		k->state = DNET_MERKLE_KEY_ABSENT;
+		return;
+	}
+
+	if (err < 0)
+		return;
+
+	mc.size = err;
+
+	if (dnet_get_meta_update(n, &mc, &k->mu))
+		k->state = DNET_MERKLE_KEY_PRESENT;
+	else
+		k->state = DNET_MERKLE_KEY_ABSENT;
+
+	free(mc.data);
+}
+
+/*
+ * Accounts metadata change of the key, @old was read by dnet_merkle_key_read() before change.
+ * Leaf is marked dirty if either old or new state is not known.
+ *
+ * Concurrent updates of the same key may race between read and update,
+ * resulting hash is fixed by the next full check pass.
+ */
+void dnet_merkle_key_update(struct dnet_node *n, struct dnet_raw_id *id, struct dnet_merkle_key *old)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+	struct dnet_merkle_node *leaf;
+	struct dnet_merkle_key new;
+	unsigned int index;
+
+	if (!t)
+		return;
+
+	dnet_merkle_key_read(n, id, &new);
+
+	index = dnet_merkle_leaf(id->id);
+
+	pthread_mutex_lock(&t->lock);
+	if (t->rebuilding)
+		t->touched[index] = 1;
+
+	leaf = &t->nodes[DNET_MERKLE_NODE(DNET_MERKLE_DEPTH, index)];
+	if (!leaf->dirty) {
+		if (old->state == DNET_MERKLE_KEY_UNKNOWN || new.state == DNET_MERKLE_KEY_UNKNOWN) {
+			leaf->dirty = 1;
+		} else {
+			if (old->state == DNET_MERKLE_KEY_PRESENT)
+				leaf->hash ^= dnet_merkle_digest(id->id, &old->mu);
+			if (new.state == DNET_MERKLE_KEY_PRESENT)
+				leaf->hash ^= dnet_merkle_digest(id->id, &new.mu);
+		}
+
+		dnet_merkle_update_parents_nolock(t, index);
+	}
+	pthread_mutex_unlock(&t->lock);
+}
+
+/*
+ * Full check pass recomputes all leaves, it has to visit every key on the node
+ * between dnet_merkle_rebuild_start() and dnet_merkle_rebuild_finish().
+ */
+int dnet_merkle_rebuild_start(struct dnet_node *n)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+	int err = 0;
+
+	if (!t)
+		return -ENOTSUP;
+
+	pthread_mutex_lock(&t->lock);
+	if (t->rebuilding) {
+		err = -EBUSY;
+	} else {
+		t->rebuilding = 1;
+		memset(t->fresh, 0, sizeof(t->fresh));
+		memset(t->touched, 0, sizeof(t->touched));
+	}
+	pthread_mutex_unlock(&t->lock);
+
+	return err;
+}
+
+/* called from many iterating threads, so leaf is updated atomically without tree lock */
+void dnet_merkle_rebuild_add_update(struct dnet_node *n, const unsigned char *id, struct dnet_meta_update *mu)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+
+	if (!t)
+		return;
+
+	__sync_fetch_and_xor(&t->fresh[dnet_merkle_leaf(id)], dnet_merkle_digest(id, mu));
+}
+
+void dnet_merkle_rebuild_add(struct dnet_node *n, struct dnet_meta_container *mc)
+{
+	struct dnet_meta_update mu;
+
+	if (!n->merkle || !dnet_get_meta_update(n, mc, &mu))
+		return;
+
+	dnet_merkle_rebuild_add_update(n, mc->id.id, &mu);
+}
+
+void dnet_merkle_rebuild_finish(struct dnet_node *n, int success)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+	struct dnet_merkle_node *leaf;
+	unsigned int i, updated = 0;
+
+	if (!t)
+		return;
+
+	pthread_mutex_lock(&t->lock);
+	if (success) {
+		for (i = 0; i < DNET_MERKLE_LEAVES; ++i) {
+			if (t->touched[i])
+				continue;
+
+			leaf = &t->nodes[DNET_MERKLE_NODE(DNET_MERKLE_DEPTH, i)];
+			leaf->hash = t->fresh[i];
+			leaf->dirty = 0;
+			updated++;
+		}
+
+		dnet_merkle_update_all_nolock(t);
+	}
+	t->rebuilding = 0;
+	pthread_mutex_unlock(&t->lock);
+
+	dnet_log(n, DNET_LOG_INFO, "merkle: rebuild completed: success: %d, leaves updated: %u/%u, dirty: %u\n",
+			success, updated, DNET_MERKLE_LEAVES, t->nodes[0].dirty);
+}
+
+int dnet_merkle_leaf_differs(uint8_t *differ, const unsigned char *id)
+{
+	return differ[dnet_merkle_leaf(id)];
+}
+
+static int dnet_merkle_read(struct dnet_node *n, uint32_t level, uint32_t *index, uint32_t num,
+		struct dnet_merkle_node *nodes)
+{
+	struct dnet_merkle_tree *t = n->merkle;
+	uint32_t i;
+
+	if (!t)
+		return -ENOTSUP;
+
+	if (level > DNET_MERKLE_DEPTH || num > (1U << level))
+		return -EINVAL;
+
+	for (i = 0; i < num; ++i) {
+		if (index[i] >= (1U << level))
+			return -EINVAL;
+	}
+
+	pthread_mutex_lock(&t->lock);
+	for (i = 0; i < num; ++i)
+		nodes[i] = t->nodes[DNET_MERKLE_NODE(level, index[i])];
+	pthread_mutex_unlock(&t->lock);
+
+	return 0;
+}
+
+int dnet_cmd_merkle(struct dnet_net_state *st, struct dnet_cmd *cmd, void *data)
+{
+	struct dnet_node *n = st->n;
+	struct dnet_merkle_request *req = data, *reply;
+	struct dnet_merkle_node *nodes;
+	uint32_t i;
+	size_t size;
+	int err;
+
+	if (cmd->size < sizeof(struct dnet_merkle_request)) {
+		dnet_log(n, DNET_LOG_ERROR, "%s: merkle: invalid request size %llu\n",
+				dnet_dump_id(&cmd->id), (unsigned long long)cmd->size);
+		return -EINVAL;
+	}
+
+	dnet_convert_merkle_request(req);
+
+	if (req->num > DNET_MERKLE_LEAVES ||
+			cmd->size != sizeof(struct dnet_merkle_request) + req->num * sizeof(uint32_t)) {
+		err = -EINVAL;
+		goto err_out_exit;
+	}
+
+	for (i = 0; i < req->num; ++i)
+		req->index[i] = dnet_bswap32(req->index[i]);
+
+	size = sizeof(struct dnet_merkle_request) + req->num * sizeof(struct dnet_merkle_node);
+	reply = malloc(size);
+	if (!reply) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+
+	memset(reply, 0, sizeof(struct dnet_merkle_request));
+	reply->level = req->level;
+	reply->num = req->num;
+	nodes = (struct dnet_merkle_node *)(reply + 1);
+
+	err = dnet_merkle_read(n, req->level, req->index, req->num, nodes);
+	if (err)
+		goto err_out_free;
+
+	for (i = 0; i < req->num; ++i)
+		dnet_convert_merkle_node(&nodes[i]);
+	dnet_convert_merkle_request(reply);
+
+	err = dnet_send_reply(st, cmd, reply, size, 1);
+
+err_out_free:
+	free(reply);
+err_out_exit:
+	dnet_log(n, (err ? DNET_LOG_ERROR : DNET_LOG_NOTICE), "%s: merkle: level: %u, num: %u, err: %d\n",
+			dnet_dump_id(&cmd->id), req->level, req->num, err);
+	return err;
+}
+
+/*
+ * Client side of the exchange: one round requests the same node indexes from all nodes
+ * and combines replies into per-group trees.
+ */
+struct dnet_merkle_round
+{
+	struct dnet_wait		*w;
+	atomic_t			refcnt;
+
+	uint32_t			level;
+	uint32_t			num;
+
+	int				group_num;
+	int				*groups;
+	struct dnet_merkle_node		*acc;
+
+	int				replies;
+	int				err;
+};
+
+static void dnet_merkle_round_put(struct dnet_merkle_round *r)
+{
+	if (atomic_dec_and_test(&r->refcnt)) {
+		dnet_wait_put(r->w);
+		free(r->groups);
+		free(r->acc);
+		free(r);
+	}
+}
+
+static int dnet_merkle_group_index(struct dnet_merkle_round *r, int group_id)
+{
+	int i;
+
+	for (i = 0; i < r->group_num; ++i) {
+		if (r->groups[i] == group_id)
+			return i;
+	}
+
+	return -1;
+}
+
+static void dnet_merkle_round_add(struct dnet_merkle_round *r, int g, struct dnet_merkle_node *nodes)
+{
+	struct dnet_merkle_node *acc = &r->acc[g * r->num];
+	uint32_t i;
+
+	for (i = 0; i < r->num; ++i) {
+		acc[i].hash ^= nodes[i].hash;
+		acc[i].dirty += nodes[i].dirty;
+	}
+}
+
+static int dnet_merkle_complete(struct dnet_net_state *st, struct dnet_cmd *cmd, void *priv)
+{
+	struct dnet_merkle_round *r = priv;
+	struct dnet_merkle_request *reply;
+	struct dnet_merkle_node *nodes;
+	uint32_t i;
+	int g;
+
+	if (is_trans_destroyed(st, cmd)) {
+		pthread_mutex_lock(&r->w->wait_lock);
+		if (!cmd)
+			r->err = -ENOMEM;
+		else if (cmd->status)
+			r->err = cmd->status;
+		pthread_mutex_unlock(&r->w->wait_lock);
+
+		dnet_wakeup(r->w, r->w->cond++);
+		dnet_merkle_round_put(r);
+		return 0;
+	}
+
+	pthread_mutex_lock(&r->w->wait_lock);
+	if (cmd->status) {
+		r->err = cmd->status;
+	} else if (cmd->size) {
+		reply = (struct dnet_merkle_request *)(cmd + 1);
+		nodes = (struct dnet_merkle_node *)(reply + 1);
+		g = dnet_merkle_group_index(r, cmd->id.group_id);
+
+		if (cmd->size != sizeof(struct dnet_merkle_request) + r->num * sizeof(struct dnet_merkle_node) || g < 0) {
+			r->err = -EINVAL;
+		} else {
+			dnet_convert_merkle_request(reply);
+
+			if (reply->level != r->level || reply->num != r->num) {
+				r->err = -EINVAL;
+			} else {
+				for (i = 0; i < r->num; ++i)
+					dnet_convert_merkle_node(&nodes[i]);
+
+				dnet_merkle_round_add(r, g, nodes);
+				r->replies++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&r->w->wait_lock);
+
+	return 0;
+}
+
+struct dnet_merkle_peer
+{
+	struct dnet_net_state		*st;
+	int				group_id;
+};
+
+/*
+ * Requests nodes @index at @level from all peers and local tree, results are combined
+ * per group into @r->acc. Returns negative error if any tree is not available.
+ */
+static int dnet_merkle_round(struct dnet_node *n, struct dnet_merkle_round *r, uint32_t *index,
+		struct dnet_merkle_peer *peers, int peer_num)
+{
+	struct dnet_merkle_request *req;
+	struct dnet_merkle_node *local;
+	struct dnet_trans_control ctl;
+	struct timespec wait_ts;
+	size_t size;
+	uint32_t i;
+	int j, err;
+
+	local = malloc(r->num * sizeof(struct dnet_merkle_node));
+	if (!local) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+
+	err = dnet_merkle_read(n, r->level, index, r->num, local);
+	if (err)
+		goto err_out_free_local;
+
+	dnet_merkle_round_add(r, 0, local);
+
+	size = sizeof(struct dnet_merkle_request) + r->num * sizeof(uint32_t);
+	req = malloc(size);
+	if (!req) {
+		err = -ENOMEM;
+		goto err_out_free_local;
+	}
+
+	memset(req, 0, sizeof(struct dnet_merkle_request));
+	req->level = r->level;
+	req->num = r->num;
+	for (i = 0; i < r->num; ++i)
+		req->index[i] = dnet_bswap32(index[i]);
+	dnet_convert_merkle_request(req);
+
+	for (j = 0; j < peer_num; ++j) {
+		memset(&ctl, 0, sizeof(struct dnet_trans_control));
+
+		dnet_setup_id(&ctl.id, peers[j].group_id, peers[j].st->idc->ids[0].raw.id);
+		ctl.cmd = DNET_CMD_MERKLE;
+		ctl.cflags = DNET_FLAGS_NEED_ACK | DNET_FLAGS_NOLOCK | DNET_FLAGS_DIRECT;
+		ctl.complete = dnet_merkle_complete;
+		ctl.priv = r;
+		ctl.data = req;
+		ctl.size = size;
+
+		atomic_inc(&r->refcnt);
+
+		/* completion is invoked on every error path, so it is not checked here */
+		dnet_trans_alloc_send_state(peers[j].st, &ctl);
+	}
+
+	free(req);
+
+	wait_ts = n->wait_ts;
+	err = dnet_wait_event(r->w, r->w->cond == peer_num, &wait_ts);
+	if (err)
+		goto err_out_free_local;
+
+	err = r->err;
+	if (!err && r->replies != peer_num)
+		err = -ENOENT;
+
+err_out_free_local:
+	free(local);
+err_out_exit:
+	return err;
+}
+
+/*
+ * Compares hash tree of the group this node belongs to with trees of all other groups
+ * (or only @groups if provided) and returns array of DNET_MERKLE_LEAVES flags,
+ * non-zero flag means keys of the leaf differ in some group or are not known.
+ */
+int dnet_merkle_diff(struct dnet_node *n, int *groups, int group_num, uint8_t **differp)
+{
+	struct dnet_merkle_peer *peers = NULL, *tmp;
+	struct dnet_merkle_round *r;
+	struct dnet_merkle_node *acc, *own;
+	struct dnet_net_state *st;
+	struct dnet_group *g;
+	uint32_t *index, *next;
+	uint32_t num, next_num, i, c;
+	uint8_t *differ;
+	int peer_num = 0, peer_alloc = 0, gnum, level, differs, j, k, err;
+
+	if (!n->merkle || !n->st)
+		return -ENOTSUP;
+
+	differ = calloc(DNET_MERKLE_LEAVES, 1);
+	index = malloc(DNET_MERKLE_LEAVES * sizeof(uint32_t));
+	if (!differ || !index) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+
+	pthread_mutex_lock(&n->state_lock);
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (group_num && g->group_id != n->id.group_id) {
+			for (k = 0; k < group_num; ++k) {
+				if (groups[k] == (int)g->group_id)
+					break;
+			}
+
+			if (k == group_num)
+				continue;
+		}
+
+		list_for_each_entry(st, &g->state_list, state_entry) {
+			if (st == n->st)
+				continue;
+
+			if (peer_num == peer_alloc) {
+				peer_alloc += 16;
+				tmp = realloc(peers, peer_alloc * sizeof(struct dnet_merkle_peer));
+				if (!tmp) {
+					pthread_mutex_unlock(&n->state_lock);
+					err = -ENOMEM;
+					goto err_out_put_peers;
+				}
+				peers = tmp;
+			}
+
+			peers[peer_num].st = dnet_state_get(st);
+			peers[peer_num].group_id = g->group_id;
+			peer_num++;
+		}
+	}
+	pthread_mutex_unlock(&n->state_lock);
+
+	num = 1;
+	index[0] = 0;
+
+	for (level = 0; level <= DNET_MERKLE_DEPTH; level += DNET_MERKLE_STEP) {
+		r = malloc(sizeof(struct dnet_merkle_round));
+		if (!r) {
+			err = -ENOMEM;
+			goto err_out_put_peers;
+		}
+
+		memset(r, 0, sizeof(struct dnet_merkle_round));
+		atomic_init(&r->refcnt, 1);
+		r->level = level;
+		r->num = num;
+
+		r->w = dnet_wait_alloc(0);
+		r->groups = malloc((peer_num + 1) * sizeof(int));
+		if (!r->w || !r->groups) {
+			err = -ENOMEM;
+			goto err_out_put_round;
+		}
+
+		/* local group always goes first */
+		r->groups[r->group_num++] = n->id.group_id;
+		for (j = 0; j < peer_num; ++j) {
+			if (dnet_merkle_group_index(r, peers[j].group_id) < 0)
+				r->groups[r->group_num++] = peers[j].group_id;
+		}
+		gnum = r->group_num;
+
+		r->acc = calloc(gnum * num, sizeof(struct dnet_merkle_node));
+		if (!r->acc) {
+			err = -ENOMEM;
+			goto err_out_put_round;
+		}
+
+		err = dnet_merkle_round(n, r, index, peers, peer_num);
+		if (err)
+			goto err_out_put_round;
+
+		next = NULL;
+		next_num = 0;
+		if (level < DNET_MERKLE_DEPTH) {
+			next = malloc(num * (1 << DNET_MERKLE_STEP) * sizeof(uint32_t));
+			if (!next) {
+				err = -ENOMEM;
+				goto err_out_put_round;
+			}
+		}
+
+		for (i = 0; i < num; ++i) {
+			own = &r->acc[i];
+			differs = own->dirty != 0;
+
+			for (k = 1; k < gnum && !differs; ++k) {
+				acc = &r->acc[k * num + i];
+				differs = acc->dirty || acc->hash != own->hash;
+			}
+
+			if (!differs)
+				continue;
+
+			if (level == DNET_MERKLE_DEPTH) {
+				differ[index[i]] = 1;
+			} else {
+				for (c = 0; c < (1 << DNET_MERKLE_STEP); ++c)
+					next[next_num++] = (index[i] << DNET_MERKLE_STEP) + c;
+			}
+		}
+
+		dnet_log(n, DNET_LOG_INFO, "merkle: level: %d, groups: %d, peers: %d, requested: %u, descending: %u\n",
+				level, gnum, peer_num, num, next_num);
+
+		dnet_merkle_round_put(r);
+
+		if (next) {
+			memcpy(index, next, next_num * sizeof(uint32_t));
+			free(next);
+		}
+
+		num = next_num;
+		if (!num)
+			break;
+	}
+
+	for (j = 0; j < peer_num; ++j)
+		dnet_state_put(peers[j].st);
+	free(peers);
+	free(index);
+
+	*differp = differ;
+	return 0;
+
+err_out_put_round:
+	/* late replies only touch round itself, it is freed by the last reference */
+	if (r->w) {
+		dnet_merkle_round_put(r);
+	} else {
+		free(r->groups);
+		free(r);
+	}
+err_out_put_peers:
+	for (j = 0; j < peer_num; ++j)
+		dnet_state_put(peers[j].st);
+	free(peers);
+err_out_free:
+	free(index);
+	free(differ);
+	dnet_log(n, DNET_LOG_ERROR, "merkle: failed to compare hash trees: %d\n", err);
+	return err;
+}
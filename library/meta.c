@@ -222,38 +222,45 @@ int dnet_write_metadata(struct dnet_session *s, struct dnet_meta_container *mc,
 	return 0;
 }
 
-int dnet_create_write_metadata_strings(struct dnet_session *s, const void *remote, unsigned int remote_len,
-		struct dnet_id *id, struct timespec *ts)
+int dnet_create_metadata_strings(struct dnet_session *s, const void *remote, unsigned int remote_len,
+		struct dnet_id *id, struct timespec *ts, struct dnet_meta_container *mc)
 {
-	struct dnet_node *n = s->node;
-	struct dnet_metadata_control mc;
-	int *groups = NULL;
-	int group_num = 0;
-	int err;
-
-	group_num = s->group_num;
-	groups = alloca(group_num * sizeof(int));
-
-	memcpy(groups, s->groups, group_num * sizeof(int));
+	struct dnet_metadata_control ctl;
 
-	memset(&mc, 0, sizeof(mc));
-	mc.obj = remote;
-	mc.len = remote_len;
-	mc.groups = groups;
-	mc.group_num = group_num;
-	mc.id = *id;
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.obj = remote;
+	ctl.len = remote_len;
+	ctl.groups = s->groups;
+	ctl.group_num = s->group_num;
+	ctl.id = *id;
 
 	if (ts) {
-		mc.ts = *ts;
+		ctl.ts = *ts;
 	} else {
 		struct timeval tv;
 
 		gettimeofday(&tv, NULL);
-		mc.ts.tv_sec = tv.tv_sec;
-		mc.ts.tv_nsec = tv.tv_usec * 1000;
+		ctl.ts.tv_sec = tv.tv_sec;
+		ctl.ts.tv_nsec = tv.tv_usec * 1000;
+	}
+
+	memset(mc, 0, sizeof(struct dnet_meta_container));
+	return dnet_create_metadata(s, &ctl, mc);
+}
+
+int dnet_create_write_metadata_strings(struct dnet_session *s, const void *remote, unsigned int remote_len,
+		struct dnet_id *id, struct timespec *ts)
+{
+	struct dnet_node *n = s->node;
+	struct dnet_meta_container mc;
+	int err;
+
+	err = dnet_create_metadata_strings(s, remote, remote_len, id, ts, &mc);
+	if (!err) {
+		err = dnet_write_metadata(s, &mc, 1);
+		free(mc.data);
 	}
 
-	err = dnet_create_write_metadata(s, &mc);
 	if (err < 0) {
 		dnet_log(n, DNET_LOG_ERROR, "%s: failed to write metadata: %d\n", dnet_dump_id(id), err);
 	}
@@ -366,6 +373,7 @@ static char *dnet_meta_types[__DNET_META_MAX] = {
 	[DNET_META_NAMESPACE] = "DNET_META_NAMESPACE",
 	[DNET_META_UPDATE] = "DNET_META_UPDATE",
 	[DNET_META_CHECKSUM] = "DNET_META_CHECKSUM",
+	[DNET_META_CHECKSUM_STATE] = "DNET_META_CHECKSUM_STATE",
 };
 
 void dnet_meta_print(struct dnet_session *s, struct dnet_meta_container *mc)
@@ -466,6 +474,16 @@ void dnet_meta_print(struct dnet_session *s, struct dnet_meta_container *mc)
 			dnet_log(n, DNET_LOG_DATA, "%s: type: %u, size: %u, csum: %s, ts: %s %lld.%lld\n",
 					dnet_meta_types[m->type], m->type, m->size, str, tstr,
 					(unsigned long long)cs->tm.tsec, (unsigned long long)cs->tm.tnsec);
+		} else if (m->type == DNET_META_CHECKSUM_STATE) {
+			struct dnet_meta_checksum_state *cs = (struct dnet_meta_checksum_state *)m->data;
+			char str[2*DNET_CSUM_SIZE+1];
+
+			dnet_convert_meta_checksum_state(cs);
+
+			dnet_dump_id_len_raw(cs->checksum, DNET_CSUM_SIZE, str);
+			dnet_log(n, DNET_LOG_DATA, "%s: type: %u, size: %u, csum: %s, engine: %s, data-size: %llu\n",
+					dnet_meta_types[m->type], m->type, m->size, str,
+					dnet_checksum_name(cs->type), (unsigned long long)cs->size);
 		} else {
 			dnet_log(n, DNET_LOG_DATA, "%s: type: %u, size: %u\n",
 					dnet_meta_types[m->type], m->type, m->size);
@@ -585,7 +603,7 @@ int dnet_meta_update_check_status(struct dnet_node *n, struct dnet_meta_containe
 		return err;
 	} else {
 		memcpy(&id.id, &mc->id.id, DNET_ID_SIZE);
-		err = n->cb->meta_write(n->cb->command_private, &id, mc->data, mc->size);
+		err = dnet_meta_write_local(n, &id, mc->data, mc->size);
 		if (err) {
 			dnet_log(n, DNET_LOG_ERROR, "%s: failed to write meta, err=%d\n",
 					dnet_dump_id(&mc->id), err);
@@ -595,3 +613,395 @@ int dnet_meta_update_check_status(struct dnet_node *n, struct dnet_meta_containe
 	return err;
 }
 
+
+/*
+ * Server-side data checksum maintained in DNET_META_CHECKSUM_STATE entry.
+ *
+ * Checksum state is updated after every successful data write: full object write
+ * starts new state, append continues stored one, any other partial update drops it.
+ * Stored checksum covers the first @size bytes of the object, so it can be used
+ * instead of rereading data when checksum of exactly that range is requested.
+ *
+ * Size alone does not catch same-size rewrites which bypass the update, so state is also
+ * bound to DNET_META_UPDATE timestamp of the metadata it is stored with. Data write leaves
+ * state unbound (zero timestamp) until metadata of that write is stored, metadata update
+ * over already bound state drops it, since data could be changed behind our back.
+ * Only bound state matching current metadata timestamp is used to answer checksum requests.
+ */
+static void dnet_meta_remove_entry(struct dnet_meta_container *mc, struct dnet_meta *m)
+{
+	struct dnet_meta tmp = *m;
+	unsigned int entry_size, offset;
+
+	dnet_convert_meta(&tmp);
+
+	entry_size = sizeof(struct dnet_meta) + tmp.size;
+	offset = (void *)m - mc->data;
+
+	memmove(m, (void *)m + entry_size, mc->size - offset - entry_size);
+	mc->size -= entry_size;
+}
+
+static int dnet_meta_checksum_state_valid(struct dnet_node *n, struct dnet_meta *m, struct dnet_meta_checksum_state *cs)
+{
+	struct dnet_meta tmp = *m;
+
+	dnet_convert_meta(&tmp);
+	if (tmp.size < sizeof(struct dnet_meta_checksum_state))
+		return 0;
+
+	memcpy(cs, m->data, sizeof(struct dnet_meta_checksum_state));
+	dnet_convert_meta_checksum_state(cs);
+
+	if (cs->type != (uint32_t)n->checksum_type)
+		return 0;
+	if (cs->state_size != dnet_checksum_state_size(n))
+		return 0;
+	if (tmp.size != sizeof(struct dnet_meta_checksum_state) + cs->state_size)
+		return 0;
+
+	return 1;
+}
+
+static inline int dnet_meta_checksum_state_unbound(struct dnet_meta_checksum_state *cs)
+{
+	return !cs->tm.tsec && !cs->tm.tnsec;
+}
+
+/* returns 1 if checksum state @cs is bound to the update timestamp of @mc */
+static int dnet_meta_checksum_state_bound(struct dnet_node *n, struct dnet_meta_container *mc,
+		struct dnet_meta_checksum_state *cs)
+{
+	struct dnet_meta_update mu;
+
+	if (dnet_meta_checksum_state_unbound(cs))
+		return 0;
+	if (!dnet_get_meta_update(n, mc, &mu))
+		return 0;
+
+	return cs->tm.tsec == mu.tm.tsec && cs->tm.tnsec == mu.tm.tnsec;
+}
+
+/*
+ * Returns 1 and fills @cs if @mc has checksum state which still describes stored data.
+ */
+int dnet_meta_checksum_state_current(struct dnet_node *n, struct dnet_meta_container *mc,
+		struct dnet_meta_checksum_state *cs)
+{
+	struct dnet_meta *m;
+
+	m = dnet_meta_search(n, mc, DNET_META_CHECKSUM_STATE);
+	if (!m || !dnet_meta_checksum_state_valid(n, m, cs))
+		return 0;
+
+	return dnet_meta_checksum_state_bound(n, mc, cs);
+}
+
+/* binds checksum state entry @m to update timestamp of @mc, entry is dropped if it can not be trusted */
+static void dnet_meta_checksum_state_bind(struct dnet_node *n, struct dnet_meta_container *mc, struct dnet_meta *m)
+{
+	struct dnet_meta_checksum_state cs, *ncs = (struct dnet_meta_checksum_state *)m->data;
+	struct dnet_meta_update mu;
+
+	if (!dnet_meta_checksum_state_valid(n, m, &cs))
+		goto err_out_remove;
+
+	if (!dnet_meta_checksum_state_unbound(&cs))
+		goto err_out_remove;
+
+	if (!dnet_get_meta_update(n, mc, &mu))
+		return;
+
+	cs.tm = mu.tm;
+	dnet_convert_time(&cs.tm);
+	ncs->tm = cs.tm;
+	return;
+
+err_out_remove:
+	dnet_meta_remove_entry(mc, m);
+}
+
+/*
+ * Builds container from metadata @meta received inline with the write,
+ * checksum state entry of the stored metadata is carried over.
+ */
+static int dnet_meta_inline_container(struct dnet_node *n, struct dnet_raw_id *id,
+		const void *meta, unsigned int meta_size, struct dnet_meta_container *mc)
+{
+	struct dnet_meta_container old;
+	struct dnet_meta *m, tmp;
+	unsigned int entry_size = 0;
+	ssize_t size;
+
+	memset(&old, 0, sizeof(struct dnet_meta_container));
+
+	size = n->cb->meta_read(n->cb->command_private, id, &old.data);
+	if (size > 0)
+		old.size = size;
+	else
+		old.data = NULL;
+
+	m = NULL;
+	if (old.data) {
+		struct dnet_meta_checksum_state cs;
+
+		m = dnet_meta_search(n, &old, DNET_META_CHECKSUM_STATE);
+		if (m && dnet_meta_checksum_state_valid(n, m, &cs) &&
+				(dnet_meta_checksum_state_unbound(&cs) || dnet_meta_checksum_state_bound(n, &old, &cs))) {
+			tmp = *m;
+			dnet_convert_meta(&tmp);
+			entry_size = sizeof(struct dnet_meta) + tmp.size;
+		} else {
+			m = NULL;
+		}
+	}
+
+	mc->data = malloc(meta_size + entry_size + 1);
+	if (!mc->data) {
+		free(old.data);
+		return -ENOMEM;
+	}
+
+	memcpy(mc->data, meta, meta_size);
+	if (m) {
+		struct dnet_meta_checksum_state *cs;
+
+		memcpy(mc->data + meta_size, m, entry_size);
+
+		/* carried state is bound to the new metadata by the caller */
+		cs = (struct dnet_meta_checksum_state *)((struct dnet_meta *)(mc->data + meta_size))->data;
+		memset(&cs->tm, 0, sizeof(struct dnet_time));
+	}
+	mc->size = meta_size + entry_size;
+
+	free(old.data);
+	return 0;
+}
+
+int dnet_meta_update_checksum(struct dnet_node *n, struct dnet_io_attr *io, const void *data,
+		const void *meta, unsigned int meta_size)
+{
+	struct dnet_meta_container mc;
+	struct dnet_meta_checksum_state cs, *ncs;
+	struct dnet_meta *m, *nm;
+	struct dnet_raw_id id;
+	unsigned int state_size = dnet_checksum_state_size(n);
+	unsigned int entry_size = sizeof(struct dnet_meta) + sizeof(struct dnet_meta_checksum_state) + state_size;
+	int append = !!(io->flags & DNET_IO_FLAGS_APPEND);
+	int valid = 0;
+	ssize_t size;
+	int err;
+
+	memcpy(id.id, io->id, DNET_ID_SIZE);
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+
+	if (meta) {
+		err = dnet_meta_inline_container(n, &id, meta, meta_size, &mc);
+		if (err)
+			goto err_out_free;
+	} else {
+		size = n->cb->meta_read(n->cb->command_private, &id, &mc.data);
+		if (size > 0)
+			mc.size = size;
+		else
+			mc.data = NULL;
+	}
+
+	m = NULL;
+	if (mc.data) {
+		m = dnet_meta_search(n, &mc, DNET_META_CHECKSUM_STATE);
+		if (m) {
+			valid = dnet_meta_checksum_state_valid(n, m, &cs);
+
+			/* state bound to stale metadata can not be continued */
+			if (valid && !dnet_meta_checksum_state_unbound(&cs) && !dnet_meta_checksum_state_bound(n, &mc, &cs))
+				valid = 0;
+		}
+	}
+
+	if ((io->flags & (DNET_IO_FLAGS_PREPARE | DNET_IO_FLAGS_PLAIN_WRITE | DNET_IO_FLAGS_COMMIT | DNET_IO_FLAGS_COMPRESS)) ||
+			(io->offset && !append) || (append && !valid)) {
+		/* checksum can not be continued, drop it */
+		err = 0;
+		if (m)
+			dnet_meta_remove_entry(&mc, m);
+		if (m || meta)
+			err = dnet_meta_write_local(n, &id, mc.data, mc.size);
+		goto err_out_free;
+	}
+
+	if (!m) {
+		void *tmp = realloc(mc.data, mc.size + entry_size);
+		if (!tmp) {
+			err = -ENOMEM;
+			goto err_out_free;
+		}
+
+		mc.data = tmp;
+		m = mc.data + mc.size;
+		mc.size += entry_size;
+	} else if (!valid) {
+		/* entry was created with different engine, recreate it at the end of container */
+		void *tmp;
+
+		dnet_meta_remove_entry(&mc, m);
+
+		tmp = realloc(mc.data, mc.size + entry_size);
+		if (!tmp) {
+			err = -ENOMEM;
+			goto err_out_free;
+		}
+
+		mc.data = tmp;
+		m = mc.data + mc.size;
+		mc.size += entry_size;
+	}
+
+	nm = m;
+	ncs = (struct dnet_meta_checksum_state *)nm->data;
+
+	if (!append) {
+		memset(ncs, 0, sizeof(struct dnet_meta_checksum_state));
+		dnet_checksum_state_init(n, ncs->state);
+		cs.size = 0;
+	}
+
+	dnet_checksum_state_update(n, ncs->state, data, io->size);
+
+	nm->type = DNET_META_CHECKSUM_STATE;
+	nm->size = sizeof(struct dnet_meta_checksum_state) + state_size;
+	dnet_convert_meta(nm);
+
+	ncs->size = cs.size + io->size;
+	ncs->type = n->checksum_type;
+	ncs->state_size = state_size;
+	memset(&ncs->tm, 0, sizeof(struct dnet_time));
+	dnet_checksum_state_final(n, ncs->state, ncs->checksum, DNET_CSUM_SIZE);
+
+	/* metadata written inline with data binds the state right away */
+	if (meta) {
+		struct dnet_meta_update mu;
+
+		if (dnet_get_meta_update(n, &mc, &mu))
+			ncs->tm = mu.tm;
+	}
+	dnet_convert_meta_checksum_state(ncs);
+
+	err = dnet_meta_write_local(n, &id, mc.data, mc.size);
+
+err_out_free:
+	free(mc.data);
+	if (err)
+		dnet_log(n, DNET_LOG_ERROR, "%s: failed to update data checksum: %d\n", dnet_dump_id_str(io->id), err);
+	return err;
+}
+
+int dnet_meta_read_checksum(struct dnet_node *n, const unsigned char *raw_id, uint64_t size, void *csum, int csize)
+{
+	struct dnet_meta_container mc;
+	struct dnet_meta_checksum_state cs;
+	struct dnet_raw_id id;
+	ssize_t err;
+
+	if (!(n->flags & DNET_CFG_WRITE_CSUM) || !n->cb || !n->cb->meta_read)
+		return -ENOENT;
+
+	memcpy(id.id, raw_id, DNET_ID_SIZE);
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+
+	err = n->cb->meta_read(n->cb->command_private, &id, &mc.data);
+	if (err <= 0)
+		return -ENOENT;
+	mc.size = err;
+
+	err = -ENOENT;
+	if (dnet_meta_checksum_state_current(n, &mc, &cs) && cs.size == size) {
+		memcpy(csum, cs.checksum, csize < DNET_CSUM_SIZE ? csize : DNET_CSUM_SIZE);
+		if (csize > DNET_CSUM_SIZE)
+			memset((char *)csum + DNET_CSUM_SIZE, 0, csize - DNET_CSUM_SIZE);
+		err = 0;
+	}
+
+	free(mc.data);
+	return err;
+}
+
+int dnet_meta_remove_checksum(struct dnet_node *n, const unsigned char *raw_id)
+{
+	struct dnet_meta_container mc;
+	struct dnet_meta *m;
+	struct dnet_raw_id id;
+	ssize_t err;
+
+	memcpy(id.id, raw_id, DNET_ID_SIZE);
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+
+	err = n->cb->meta_read(n->cb->command_private, &id, &mc.data);
+	if (err <= 0)
+		return 0;
+	mc.size = err;
+
+	err = 0;
+	m = dnet_meta_search(n, &mc, DNET_META_CHECKSUM_STATE);
+	if (m) {
+		dnet_meta_remove_entry(&mc, m);
+		err = dnet_meta_write_local(n, &id, mc.data, mc.size);
+	}
+
+	free(mc.data);
+	return err;
+}
+
+/*
+ * Client writes whole metadata container, which does not have server-side checksum,
+ * so it is copied from currently stored metadata and bound to the new update timestamp.
+ */
+int dnet_meta_write_preserve_checksum(struct dnet_node *n, struct dnet_raw_id *id, void *data, unsigned int size)
+{
+	struct dnet_meta_container mc, old;
+	struct dnet_meta *m, tmp;
+	unsigned int entry_size;
+	ssize_t err;
+
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+	mc.data = data;
+	mc.size = size;
+
+	if (dnet_meta_search(n, &mc, DNET_META_CHECKSUM_STATE))
+		return dnet_meta_write_local(n, id, data, size);
+
+	memset(&old, 0, sizeof(struct dnet_meta_container));
+	err = n->cb->meta_read(n->cb->command_private, id, &old.data);
+	if (err <= 0)
+		return dnet_meta_write_local(n, id, data, size);
+	old.size = err;
+
+	m = dnet_meta_search(n, &old, DNET_META_CHECKSUM_STATE);
+	if (!m) {
+		err = dnet_meta_write_local(n, id, data, size);
+		goto err_out_free;
+	}
+
+	tmp = *m;
+	dnet_convert_meta(&tmp);
+	entry_size = sizeof(struct dnet_meta) + tmp.size;
+
+	mc.data = malloc(size + entry_size);
+	if (!mc.data) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+
+	memcpy(mc.data, data, size);
+	memcpy(mc.data + size, m, entry_size);
+	mc.size = size + entry_size;
+
+	dnet_meta_checksum_state_bind(n, &mc, mc.data + size);
+
+	err = dnet_meta_write_local(n, id, mc.data, mc.size);
+	free(mc.data);
+
+err_out_free:
+	free(old.data);
+	return err;
+}
@@ -157,9 +157,43 @@ err_out_exit:
        return err;
 }
 
+/*
+ * Stores metadata which came inline with WRITE command @io, when @update_csum is set
+ * data checksum state is updated within the same metadata write.
+ */
+int dnet_meta_write_inline(struct dnet_node *n, struct dnet_io_attr *io, const void *data,
+		void *meta, unsigned int meta_size, int update_csum)
+{
+	struct dnet_merkle_key old;
+	struct dnet_raw_id id;
+	int err;
+
+	if (n->flags & DNET_CFG_NO_META)
+		return 0;
+
+	memcpy(id.id, io->id, DNET_ID_SIZE);
+
+	dnet_merkle_key_read(n, &id, &old);
+
+	if (update_csum)
+		err = dnet_meta_update_checksum(n, io, data, meta, meta_size);
+	else if (n->flags & DNET_CFG_WRITE_CSUM)
+		err = dnet_meta_write_preserve_checksum(n, &id, meta, meta_size);
+	else
+		err = dnet_meta_write_local(n, &id, meta, meta_size);
+
+	dnet_merkle_key_update(n, &id, &old);
+
+	if (err)
+		dnet_log(n, DNET_LOG_ERROR, "%s: failed to write inline metadata: size: %u, err: %d\n",
+				dnet_dump_id_str(io->id), meta_size, err);
+	return err;
+}
+
 int dnet_process_meta(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dnet_io_attr *io)
 {
 	struct dnet_node *n = st->n;
+	struct dnet_merkle_key old;
 	struct dnet_raw_id id;
 	void *data;
 	int err;
@@ -195,12 +229,26 @@ int dnet_process_meta(struct dnet_net_state *st, struct dnet_cmd *cmd, struct dn
 
 		data = io + 1;
 
-		err = n->cb->meta_write(n->cb->command_private, &id, data, io->size);
+		dnet_merkle_key_read(n, &id, &old);
+
+		if (n->flags & DNET_CFG_WRITE_CSUM)
+			err = dnet_meta_write_preserve_checksum(n, &id, data, io->size);
+		else
+			err = dnet_meta_write_local(n, &id, data, io->size);
+
+		dnet_merkle_key_update(n, &id, &old);
 		break;
 	case DNET_CMD_DEL:
 		memcpy(id.id, cmd->id.id, DNET_ID_SIZE);
-		n->cb->meta_remove(n->cb->command_private, &id, !!(cmd->flags & DNET_ATTR_DELETE_HISTORY));
+
+		dnet_merkle_key_read(n, &id, &old);
+		dnet_meta_remove_local(n, &id, !!(cmd->flags & DNET_ATTR_DELETE_HISTORY));
+		dnet_merkle_key_update(n, &id, &old);
+
 		err = n->cb->command_handler(st, n->cb->command_private, cmd, io);
+
+		/* removal of all columns drops metadata too */
+		dnet_meta_index_sync(n, &id);
 		break;
 	default:
 		err = -EINVAL;
@@ -218,6 +266,11 @@ struct dnet_db_list_control {
 	struct dnet_check_request	*req;
 	struct dnet_check_params	params;
 
+	/* leaves of anti-entropy hash tree which differ from other groups, NULL if all keys are checked */
+	uint8_t				*merkle_differ;
+	/* pass visits every key, so it recomputes hash tree */
+	int				merkle_rebuild;
+
 	atomic_t			completed;
 	atomic_t			errors;
 	atomic_t			total;
@@ -248,6 +301,12 @@ static int dnet_db_send_check_reply(struct dnet_db_list_control *ctl)
 	reply.errors = atomic_read(&ctl->errors);
 	reply.completed = atomic_read(&ctl->completed);
 
+	/* queued merge keys were counted as completed, move failed ones to errors */
+	reply.completed -= ctl->params.merge_stat.failed;
+	reply.errors += ctl->params.merge_stat.failed;
+	reply.merged = ctl->params.merge_stat.moved;
+	reply.merged_mb = ctl->params.merge_stat.bytes >> 20;
+
 	dnet_convert_check_reply(&reply);
 	return dnet_send_reply(ctl->st, ctl->cmd, &reply, sizeof(reply), 1);
 }
@@ -311,31 +370,38 @@ static int dnet_db_list_iter_init(struct eblob_iterate_control *iter_ctl, void *
 	struct dnet_db_list_control *ctl = iter_ctl->priv;
 	struct dnet_node *n = ctl->n;
 	struct dnet_bulk_array *bulk_array = NULL;
+	struct dnet_bulk_state *states;
 	struct dnet_net_state *st;
 	struct dnet_group *g;
 	int only_merge = !!(ctl->req->flags & DNET_CHECK_MERGE);
 	int bulk_array_tmp_num;
 	int err = 0;
+	int i;
 
 	dnet_log(n, DNET_LOG_DEBUG, "BULK: only_merge=%d\n", only_merge);
-	if (!only_merge) {
-		bulk_array = malloc(sizeof(struct dnet_bulk_array));
-		if (!bulk_array) {
-			err = -ENOMEM;
-			goto err_out_exit;
-		}
-		atomic_init(&bulk_array->refcnt, 0);
 
+	bulk_array = malloc(sizeof(struct dnet_bulk_array));
+	if (!bulk_array) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	atomic_init(&bulk_array->refcnt, 0);
+
+	bulk_array->num = 0;
+	bulk_array->states = NULL;
+
+	/* keys are moved one by one if batch can not be allocated */
+	bulk_array->merge = dnet_merge_batch_alloc(n);
+
+	if (!only_merge) {
 		bulk_array_tmp_num = DNET_BULK_STATES_ALLOC_STEP;
-		bulk_array->num = 0;
-		bulk_array->states = NULL;
 		dnet_log(n, DNET_LOG_DEBUG, "BULK: allocating space for arrays, num=%d\n", bulk_array_tmp_num);
 
 		bulk_array->states = (struct dnet_bulk_state *)malloc(sizeof(struct dnet_bulk_state) * bulk_array_tmp_num);
 		if (!bulk_array->states) {
 			err = -ENOMEM;
 			dnet_log(n, DNET_LOG_ERROR, "BULK: Failed to allocate buffer for bulk states array.\n");
-			goto err_out_exit;
+			goto err_out_free;
 		}
 
 		pthread_mutex_lock(&n->state_lock);
@@ -350,16 +416,17 @@ static int dnet_db_list_iter_init(struct eblob_iterate_control *iter_ctl, void *
 				if (bulk_array->num == bulk_array_tmp_num) {
 					dnet_log(n, DNET_LOG_DEBUG, "BULK: reallocating space for arrays, num=%d\n", bulk_array_tmp_num);
 					bulk_array_tmp_num += DNET_BULK_STATES_ALLOC_STEP;
-					bulk_array->states = realloc(bulk_array->states, sizeof(struct dnet_bulk_state) * bulk_array_tmp_num);
-					if (!bulk_array->states) {
+					states = realloc(bulk_array->states, sizeof(struct dnet_bulk_state) * bulk_array_tmp_num);
+					if (!states) {
 						err = -ENOMEM;
 						dnet_log(n, DNET_LOG_ERROR, "BULK: Failed to reallocate buffer for bulk states array.\n");
-						goto err_out_exit;
+						pthread_mutex_unlock(&n->state_lock);
+						goto err_out_free;
 					}
+					bulk_array->states = states;
 				}
 
 				memcpy(&bulk_array->states[bulk_array->num].addr, &st->addr, sizeof(struct dnet_addr));
-				pthread_mutex_init(&bulk_array->states[bulk_array->num].state_lock, NULL);
 				bulk_array->states[bulk_array->num].num = 0;
 				bulk_array->states[bulk_array->num].ids = NULL;
 
@@ -368,7 +435,7 @@ static int dnet_db_list_iter_init(struct eblob_iterate_control *iter_ctl, void *
 					err = -ENOMEM;
 					dnet_log(n, DNET_LOG_ERROR, "BULK: Failed to reallocate buffer for bulk states array.\n");
 					pthread_mutex_unlock(&n->state_lock);
-					goto err_out_exit;
+					goto err_out_free;
 				}
 
 				dnet_log(n, DNET_LOG_DEBUG, "BULK: added state %s (%s)\n",
@@ -380,11 +447,30 @@ static int dnet_db_list_iter_init(struct eblob_iterate_control *iter_ctl, void *
 		pthread_mutex_unlock(&n->state_lock);
 
 		qsort(bulk_array->states, bulk_array->num, sizeof(struct dnet_bulk_state), dnet_compare_bulk_state);
+
+		/* states are moved by qsort, so locks are initialized only after it */
+		for (i = 0; i < bulk_array->num; ++i) {
+			err = dnet_bulk_state_init(&bulk_array->states[i]);
+			if (err) {
+				dnet_log(n, DNET_LOG_ERROR, "BULK: Failed to initialize bulk state: %d.\n", err);
+				goto err_out_destroy;
+			}
+		}
 	}
 
 	*thread_priv = bulk_array;
 	return 0;
 
+err_out_destroy:
+	while (--i >= 0)
+		dnet_bulk_state_destroy(&bulk_array->states[i]);
+err_out_free:
+	for (i = 0; i < bulk_array->num; ++i)
+		free(bulk_array->states[i].ids);
+	free(bulk_array->states);
+	if (bulk_array->merge)
+		dnet_merge_batch_free(bulk_array->merge, &ctl->params);
+	free(bulk_array);
 err_out_exit:
 	return err;
 }
@@ -401,6 +487,10 @@ static int dnet_db_list_iter_free(struct eblob_iterate_control *iter_ctl, void *
 		while(atomic_read(&bulk_array->refcnt) > 0)
 			sleep(1);
 
+		if (bulk_array->merge)
+			dnet_merge_batch_free(bulk_array->merge, &ctl->params);
+
+		/* send the rest of ids to all peers first, so they are processed in parallel */
 		for (i = 0; i < bulk_array->num; ++i) {
 			dnet_log(n, DNET_LOG_DEBUG, "CHECK: free: processing state %d %s: %d ids in this state\n",
 					i, dnet_server_convert_dnet_addr(&bulk_array->states[i].addr), bulk_array->states[i].num);
@@ -411,8 +501,22 @@ static int dnet_db_list_iter_free(struct eblob_iterate_control *iter_ctl, void *
 					dnet_log(n, DNET_LOG_ERROR, "CHECK: dnet_request_bulk_check failed, state %s, err %d\n",
 							dnet_server_convert_dnet_addr(&bulk_array->states[i].addr), err);
 				}
+				bulk_array->states[i].num = 0;
 			}
-			free(bulk_array->states[i].ids);
+		}
+
+		for (i = 0; i < bulk_array->num; ++i) {
+			struct dnet_bulk_state *state = &bulk_array->states[i];
+
+			dnet_bulk_state_wait(state);
+
+			dnet_log(n, DNET_LOG_INFO, "CHECK: peer %s: batches: %llu, errors: %llu, ids: %llu\n",
+					dnet_server_convert_dnet_addr(&state->addr),
+					(unsigned long long)state->batches, (unsigned long long)state->batch_errors,
+					(unsigned long long)state->ids_sent);
+
+			dnet_bulk_state_destroy(state);
+			free(state->ids);
 		}
 
 		free(bulk_array->states);
@@ -424,30 +528,25 @@ static int dnet_db_list_iter_free(struct eblob_iterate_control *iter_ctl, void *
 	return 0;
 }
 
-static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_control *rc,
-				void *data, void *p, void *thread_priv)
+/*
+ * Checks single key, @mc->data may be NULL when key comes from in-memory metadata index,
+ * then metadata is read only if key has to be checked. @mu is NULL if there is no DNET_META_UPDATE.
+ */
+static int dnet_db_list_key(struct dnet_db_list_control *ctl, struct dnet_bulk_array *bulk_array,
+		struct dnet_meta_container *mc, long long check_ts, struct dnet_meta_update *mu)
 {
-	struct dnet_db_list_control *ctl = p;
 	struct dnet_node *n = ctl->n;
-	struct dnet_meta_container mc;
 	struct dnet_net_state *tmp;
-	struct dnet_bulk_array *bulk_array;
-	long long check_ts, check_edge_ts = ctl->req->timestamp, update_ts;
+	struct dnet_raw_id id;
+	long long check_edge_ts = ctl->req->timestamp, update_ts;
 	char check_time[64], check_edge_time[64], update_start[64], update_stop[64], update_time[64];
 	struct tm tm;
 	int will_check, should_be_merged;
 	int send_check_reply = 1;
+	int loaded = 0;
+	ssize_t size;
 	int err = 0;
 
-	bulk_array = thread_priv;
-	if (!bulk_array && !(ctl->req->flags & DNET_CHECK_MERGE)) {
-		dnet_log(n, DNET_LOG_ERROR, "CHECK: bulk_array is not initialized and check type is not MERGE_ONLY\n");
-		return -ENOMEM;
-	}
-
-	mc.data = data;
-	mc.size = rc->size;
-
 	if (check_edge_ts) {
 		localtime_r((time_t *)&check_edge_ts, &tm);
 		strftime(check_edge_time, sizeof(check_edge_time), "%F %R:%S %Z", &tm);
@@ -467,8 +566,6 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 	strftime(update_stop, sizeof(update_stop), "%F %R:%S %Z", &tm);
 
 
-	dnet_setup_id(&mc.id, n->id.group_id, dc->key.id);
-
 	/*
 	* Use group ID field to specify whether we should check number of copies
 	* or merge transaction with other history log in the storage
@@ -478,7 +575,7 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 	* key must be moved to another machine and potentially merged with data
 	* present there
 	*/
-	tmp = dnet_state_get_first(n, &mc.id);
+	tmp = dnet_state_get_first(n, &mc->id);
 	should_be_merged = (tmp != NULL);
 	dnet_state_put(tmp);
 
@@ -486,7 +583,6 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 	* If timestamp is specified check should be performed only to files
 	* that was not checked since that timestamp
 	*/
-	check_ts = dnet_meta_get_ts(n, &mc);
 	will_check = !(check_edge_ts && (check_ts > check_edge_ts));
 
 	/*
@@ -495,14 +591,12 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 	 */
 	update_ts = 0;
 	if (will_check) {
-		struct dnet_meta_update mu;
-
 		/* only try to check creation/update timestamp if it is really present in database */
-		if (dnet_get_meta_update(n, &mc, &mu)) {
-			update_ts = mu.tm.tsec;
+		if (mu) {
+			update_ts = mu->tm.tsec;
 
 			will_check = 0;
-			if ((mu.tm.tsec >= ctl->req->updatestamp_start) && (mu.tm.tsec <= ctl->req->updatestamp_stop))
+			if ((mu->tm.tsec >= ctl->req->updatestamp_start) && (mu->tm.tsec <= ctl->req->updatestamp_stop))
 				will_check = 1;
 		}
 	}
@@ -511,6 +605,12 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 		will_check = 0;
 	}
 
+	/* hash tree says copies in other groups are the same */
+	if (will_check && !should_be_merged && ctl->merkle_differ &&
+			!dnet_merkle_leaf_differs(ctl->merkle_differ, mc->id.id)) {
+		will_check = 0;
+	}
+
 	if (n->log->log_level > DNET_LOG_NOTICE) {
 		localtime_r((time_t *)&check_ts, &tm);
 		strftime(check_time, sizeof(check_time), "%F %R:%S %Z", &tm);
@@ -524,23 +624,44 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 				"created/updated: %lld [%s], "
 				"updated between: %lld [%s] - %lld [%s], "
 				"will check: %d, should_be_merged: %d, dry: %d, flags: %x, size: %u.\n",
-				dnet_dump_id(&mc.id),
+				dnet_dump_id(&mc->id),
 				check_ts, check_time,
 				check_edge_ts, check_edge_time,
 				update_ts, update_time,
 				(unsigned long long)ctl->req->updatestamp_start, update_start,
 				(unsigned long long)ctl->req->updatestamp_stop, update_stop,
 				will_check, should_be_merged,
-				!!(ctl->req->flags & DNET_CHECK_DRY_RUN), ctl->req->flags, mc.size);
+				!!(ctl->req->flags & DNET_CHECK_DRY_RUN), ctl->req->flags, mc->size);
 	}
 
 	if (will_check) {
 		err = 0;
 		if (!(ctl->req->flags & DNET_CHECK_DRY_RUN)) {
-			err = dnet_check(n, &mc, bulk_array, should_be_merged, &ctl->params);
+			/* key comes from metadata index, read metadata only now when it has to be checked */
+			if (!mc->data) {
+				memcpy(id.id, mc->id.id, DNET_ID_SIZE);
+
+				size = n->cb->meta_read(n->cb->command_private, &id, &mc->data);
+				if (size > 0 && mc->data) {
+					mc->size = size;
+					loaded = 1;
+				} else {
+					free(mc->data);
+					mc->data = NULL;
+					err = size ? size : -ENOENT;
+				}
+			}
+
+			if (!err)
+				err = dnet_check(n, mc, bulk_array, should_be_merged, &ctl->params);
+
+			if (loaded) {
+				free(mc->data);
+				mc->data = NULL;
+			}
 
 			dnet_log_raw(n, DNET_LOG_NOTICE, "CHECK: complete key: %s, merge: %d, err: %d\n",
-					dnet_dump_id(&mc.id), should_be_merged, err);
+					dnet_dump_id(&mc->id), should_be_merged, err);
 		}
 
 		if (!err) {
@@ -568,6 +689,135 @@ static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_con
 	return 0;
 }
 
+static int dnet_db_list_iter(struct eblob_disk_control *dc, struct eblob_ram_control *rc,
+				void *data, void *p, void *thread_priv)
+{
+	struct dnet_db_list_control *ctl = p;
+	struct dnet_node *n = ctl->n;
+	struct dnet_meta_container mc;
+	struct dnet_meta_update mu;
+	struct dnet_bulk_array *bulk_array;
+	int have_mu;
+
+	bulk_array = thread_priv;
+	if (!bulk_array) {
+		dnet_log(n, DNET_LOG_ERROR, "CHECK: bulk_array is not initialized\n");
+		return -ENOMEM;
+	}
+
+	mc.data = data;
+	mc.size = rc->size;
+
+	dnet_setup_id(&mc.id, n->id.group_id, dc->key.id);
+
+	if (ctl->merkle_rebuild)
+		dnet_merkle_rebuild_add(n, &mc);
+
+	have_mu = !!dnet_get_meta_update(n, &mc, &mu);
+
+	return dnet_db_list_key(ctl, bulk_array, &mc, dnet_meta_get_ts(n, &mc), have_mu ? &mu : NULL);
+}
+
+struct dnet_db_list_walk {
+	struct dnet_db_list_control	*ctl;
+	atomic_t			shard;
+	int				err;
+};
+
+static void *dnet_db_list_walk_process(void *priv)
+{
+	struct dnet_db_list_walk *w = priv;
+	struct dnet_db_list_control *ctl = w->ctl;
+	struct dnet_node *n = ctl->n;
+	struct eblob_iterate_control iter_ctl;
+	struct dnet_meta_index_entry *entries, *e;
+	struct dnet_meta_container mc;
+	struct dnet_meta_update mu, *have_mu;
+	void *bulk_array = NULL;
+	int shard, num, i, err;
+
+	memset(&iter_ctl, 0, sizeof(struct eblob_iterate_control));
+	iter_ctl.priv = ctl;
+
+	err = dnet_db_list_iter_init(&iter_ctl, &bulk_array);
+	if (err)
+		goto err_out_exit;
+
+	while ((shard = atomic_inc(&w->shard) - 1) < DNET_META_INDEX_SHARDS) {
+		err = dnet_meta_index_shard_copy(n, shard, &entries, &num);
+		if (err)
+			break;
+
+		for (i = 0; i < num; ++i) {
+			e = &entries[i];
+
+			memset(&mc, 0, sizeof(struct dnet_meta_container));
+			dnet_setup_id(&mc.id, n->id.group_id, e->id.id);
+
+			have_mu = NULL;
+			if (e->state & DNET_META_INDEX_UPDATE) {
+				memset(&mu, 0, sizeof(struct dnet_meta_update));
+				mu.tm = e->tm;
+				mu.flags = e->flags;
+				have_mu = &mu;
+
+				if (ctl->merkle_rebuild)
+					dnet_merkle_rebuild_add_update(n, e->id.id, &mu);
+			}
+
+			dnet_db_list_key(ctl, bulk_array, &mc, e->check_ts, have_mu);
+		}
+
+		free(entries);
+	}
+
+	dnet_db_list_iter_free(&iter_ctl, &bulk_array);
+
+err_out_exit:
+	if (err)
+		w->err = err;
+	return NULL;
+}
+
+/*
+ * Checks keys known to in-memory metadata index without iterating metadata on disk,
+ * index shards are distributed among @thread_num threads.
+ */
+static int dnet_db_list_walk(struct dnet_db_list_control *ctl, int thread_num)
+{
+	struct dnet_node *n = ctl->n;
+	struct dnet_db_list_walk w;
+	pthread_t *tids;
+	int i, err;
+
+	if (thread_num > DNET_META_INDEX_SHARDS)
+		thread_num = DNET_META_INDEX_SHARDS;
+
+	tids = malloc(thread_num * sizeof(pthread_t));
+	if (!tids)
+		return -ENOMEM;
+
+	w.ctl = ctl;
+	w.err = 0;
+	atomic_init(&w.shard, 0);
+
+	for (i = 0; i < thread_num; ++i) {
+		err = pthread_create(&tids[i], NULL, dnet_db_list_walk_process, &w);
+		if (err) {
+			w.err = -err;
+			break;
+		}
+	}
+
+	dnet_log(n, DNET_LOG_INFO, "CHECK: walking metadata index in %d threads\n", i);
+
+	while (--i >= 0)
+		pthread_join(tids[i], NULL);
+
+	free(tids);
+	return w.err;
+}
+
 int dnet_db_list(struct dnet_net_state *st, struct dnet_cmd *cmd)
 {
 	struct dnet_node *n = st->n;
@@ -606,6 +856,8 @@ int dnet_db_list(struct dnet_net_state *st, struct dnet_cmd *cmd)
 	ctl.st = st;
 	ctl.cmd = cmd;
 	ctl.req = &req;
+	ctl.params.window = req.bulk_window;
+	gettimeofday(&ctl.params.merge_stat.start, NULL);
 	ctl.params.db = dnet_check_temp_db_alloc(n, n->temp_meta_env);
 	if (!ctl.params.db) {
 		err = -ENOMEM;
@@ -689,25 +941,46 @@ int dnet_db_list(struct dnet_net_state *st, struct dnet_cmd *cmd)
 	} else {
 		struct dnet_iterate_ctl dctl;
 
-		memset(&dctl, 0, sizeof(struct dnet_iterate_ctl));
+		if ((req.flags & DNET_CHECK_MERKLE) && !(req.flags & DNET_CHECK_MERGE)) {
+			err = dnet_merkle_diff(n, ctl.params.groups, ctl.params.group_num, &ctl.merkle_differ);
+			if (err) {
+				dnet_log(n, DNET_LOG_ERROR, "CHECK: failed to compare hash trees, checking all keys: %d\n", err);
+				ctl.merkle_differ = NULL;
+			}
+		}
 
-		dctl.iterate_private = n->cb->command_private;
-		dctl.flags = 0;
-		dctl.blob_start = req.blob_start;
-		dctl.blob_num = req.blob_num;
-		dctl.callback_private = &ctl;
+		if (!req.blob_start && !req.blob_num)
+			ctl.merkle_rebuild = !dnet_merkle_rebuild_start(n);
 
-		dctl.iterate_cb.iterator = dnet_db_list_iter;
-		dctl.iterate_cb.iterator_init = dnet_db_list_iter_init;
-		dctl.iterate_cb.iterator_free = dnet_db_list_iter_free;
-		dctl.iterate_cb.thread_num = req.thread_num;
+		if (!req.blob_start && !req.blob_num && dnet_meta_index_ready(n)) {
+			err = dnet_db_list_walk(&ctl, req.thread_num);
+		} else {
+			memset(&dctl, 0, sizeof(struct dnet_iterate_ctl));
+
+			dctl.iterate_private = n->cb->command_private;
+			dctl.flags = 0;
+			dctl.blob_start = req.blob_start;
+			dctl.blob_num = req.blob_num;
+			dctl.callback_private = &ctl;
+
+			dctl.iterate_cb.iterator = dnet_db_list_iter;
+			dctl.iterate_cb.iterator_init = dnet_db_list_iter_init;
+			dctl.iterate_cb.iterator_free = dnet_db_list_iter_free;
+			dctl.iterate_cb.thread_num = req.thread_num;
+
+			err = n->cb->meta_iterate(&dctl);
+		}
 
-		err = n->cb->meta_iterate(&dctl);
+		if (ctl.merkle_rebuild)
+			dnet_merkle_rebuild_finish(n, !err);
+		free(ctl.merkle_differ);
 	}
 
 	if(r->flags & DNET_CHECK_MERGE) {
-		dnet_counter_set(n, DNET_CNTR_NODE_LAST_MERGE, 0, atomic_read(&ctl.completed));
-		dnet_counter_set(n, DNET_CNTR_NODE_LAST_MERGE, 1, atomic_read(&ctl.errors));
+		dnet_counter_set(n, DNET_CNTR_NODE_LAST_MERGE, 0,
+				atomic_read(&ctl.completed) - ctl.params.merge_stat.failed);
+		dnet_counter_set(n, DNET_CNTR_NODE_LAST_MERGE, 1,
+				atomic_read(&ctl.errors) + ctl.params.merge_stat.failed);
 	}
 
 	dnet_db_send_check_reply(&ctl);
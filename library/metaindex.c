@@ -0,0 +1,549 @@
+/*
+ * 2013+ Copyright (c) Evgeniy Polyakov <zbr@ioremap.net>
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elliptics.h"
+
+#include "elliptics/packet.h"
+#include "elliptics/interface.h"
+
+/*
+ * In-memory metadata index.
+ *
+ * Keeps the part of every key's metadata which check, bulk check and iterator
+ * look at: update timestamp and flags, last check time, data size and checksum prefix.
+ * Table is filled by background pass over metadata started with the node and is kept
+ * current by dnet_meta_write_local() and dnet_meta_remove_local(), through which
+ * all metadata changes go. Until the pass completes lookups return -EAGAIN
+ * and callers read metadata from disk.
+ *
+ * Table is split into shards by the first id byte, every shard is open addressing
+ * hash table with linear probing, ids are already uniformly distributed hashes.
+ */
+
+#define DNET_META_INDEX_LOAD_THREADS	4
+
+/* slot is occupied */
+#define DNET_META_INDEX_USED		(1<<0)
+/* key was removed while loading pass runs, entry prevents pass from resurrecting it */
+#define DNET_META_INDEX_ABSENT		(1<<1)
+
+struct dnet_meta_index_shard
+{
+	pthread_mutex_t			lock;
+	struct dnet_meta_index_entry	*entries;
+	uint32_t			size;
+	uint32_t			num;
+};
+
+struct dnet_meta_index
+{
+	/* loading pass has completed, table may be trusted */
+	atomic_t			ready;
+	/* node is being destroyed, loading pass has to stop */
+	atomic_t			need_exit;
+	atomic_t			loaded;
+
+	pthread_t			loader;
+
+	struct dnet_meta_index_shard	shards[DNET_META_INDEX_SHARDS];
+};
+
+static inline struct dnet_meta_index_shard *dnet_meta_index_shard(struct dnet_meta_index *idx,
+		const unsigned char *id)
+{
+	return &idx->shards[id[0]];
+}
+
+static inline uint32_t dnet_meta_index_hash(const unsigned char *id)
+{
+	return ((uint32_t)id[1] << 24) | ((uint32_t)id[2] << 16) | ((uint32_t)id[3] << 8) | id[4];
+}
+
+/* returns entry of @id or empty slot where it has to be placed */
+static struct dnet_meta_index_entry *dnet_meta_index_find_nolock(struct dnet_meta_index_shard *s,
+		const unsigned char *id)
+{
+	uint32_t mask = s->size - 1;
+	uint32_t i = dnet_meta_index_hash(id) & mask;
+	struct dnet_meta_index_entry *e;
+
+	for (;; i = (i + 1) & mask) {
+		e = &s->entries[i];
+
+		if (!(e->state & DNET_META_INDEX_USED))
+			return e;
+		if (!memcmp(e->id.id, id, DNET_ID_SIZE))
+			return e;
+	}
+}
+
+static int dnet_meta_index_grow_nolock(struct dnet_meta_index_shard *s)
+{
+	struct dnet_meta_index_entry *entries = s->entries, *e;
+	uint32_t size = s->size, i;
+
+	s->size = size ? size * 2 : 64;
+	s->entries = calloc(s->size, sizeof(struct dnet_meta_index_entry));
+	if (!s->entries) {
+		s->entries = entries;
+		s->size = size;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < size; ++i) {
+		if (!(entries[i].state & DNET_META_INDEX_USED))
+			continue;
+
+		e = dnet_meta_index_find_nolock(s, entries[i].id.id);
+		*e = entries[i];
+	}
+
+	free(entries);
+	return 0;
+}
+
+/* backward shift deletion keeps probe sequences intact without tombstones */
+static void dnet_meta_index_erase_nolock(struct dnet_meta_index_shard *s, struct dnet_meta_index_entry *e)
+{
+	uint32_t mask = s->size - 1;
+	uint32_t i = e - s->entries, j = i, k;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!(s->entries[j].state & DNET_META_INDEX_USED))
+			break;
+
+		k = dnet_meta_index_hash(s->entries[j].id.id) & mask;
+
+		/* entry stays if its home slot is cyclically within (i, j] */
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+			continue;
+
+		s->entries[i] = s->entries[j];
+		i = j;
+	}
+
+	memset(&s->entries[i], 0, sizeof(struct dnet_meta_index_entry));
+	s->num--;
+}
+
+/* @e->id has to be set, slot is allocated if there is no such key yet */
+static int dnet_meta_index_store(struct dnet_meta_index *idx, struct dnet_meta_index_entry *e, int replace)
+{
+	struct dnet_meta_index_shard *s = dnet_meta_index_shard(idx, e->id.id);
+	struct dnet_meta_index_entry *slot;
+	int err = 0;
+
+	pthread_mutex_lock(&s->lock);
+
+	if ((s->num + 1) * 4 > s->size * 3) {
+		err = dnet_meta_index_grow_nolock(s);
+		if (err)
+			goto err_out_unlock;
+	}
+
+	slot = dnet_meta_index_find_nolock(s, e->id.id);
+	if (!(slot->state & DNET_META_INDEX_USED)) {
+		*slot = *e;
+		s->num++;
+	} else if (replace) {
+		*slot = *e;
+	}
+
+err_out_unlock:
+	pthread_mutex_unlock(&s->lock);
+	return err;
+}
+
+static void dnet_meta_index_parse(struct dnet_node *n, struct dnet_raw_id *id, void *data, size_t size,
+		struct dnet_meta_index_entry *e)
+{
+	struct dnet_meta_container mc;
+	struct dnet_meta_update mu;
+	struct dnet_meta_check_status c;
+	struct dnet_meta_checksum_state cs;
+	struct dnet_meta *m, tmp;
+
+	memset(e, 0, sizeof(struct dnet_meta_index_entry));
+	e->id = *id;
+	e->state = DNET_META_INDEX_USED;
+
+	memset(&mc, 0, sizeof(struct dnet_meta_container));
+	mc.data = data;
+	mc.size = size;
+
+	if (dnet_get_meta_update(n, &mc, &mu)) {
+		e->tm = mu.tm;
+		e->flags = mu.flags;
+		e->state |= DNET_META_INDEX_UPDATE;
+	}
+
+	m = dnet_meta_search(n, &mc, DNET_META_CHECK_STATUS);
+	if (m) {
+		tmp = *m;
+		dnet_convert_meta(&tmp);
+
+		if (tmp.size >= sizeof(struct dnet_meta_check_status)) {
+			memcpy(&c, m->data, sizeof(struct dnet_meta_check_status));
+			dnet_convert_meta_check_status(&c);
+			e->check_ts = c.tm.tsec;
+		}
+	}
+
+	if (dnet_meta_checksum_state_current(n, &mc, &cs)) {
+		e->size = cs.size;
+		memcpy(e->csum, cs.checksum, sizeof(e->csum));
+		e->state |= DNET_META_INDEX_CSUM;
+	}
+}
+
+static int dnet_meta_index_load_iter(struct eblob_disk_control *dc, struct eblob_ram_control *rc,
+		void *data, void *priv, void *thread_priv __unused)
+{
+	struct dnet_node *n = priv;
+	struct dnet_meta_index *idx = n->meta_index;
+	struct dnet_meta_index_entry e;
+	struct dnet_raw_id id;
+
+	if (atomic_read(&idx->need_exit))
+		return -EINTR;
+
+	memcpy(id.id, dc->key.id, DNET_ID_SIZE);
+	dnet_meta_index_parse(n, &id, data, rc->size, &e);
+
+	/* key changed since pass has started is already known better */
+	atomic_inc(&idx->loaded);
+	return dnet_meta_index_store(idx, &e, 0);
+}
+
+static int dnet_meta_index_load_init(struct eblob_iterate_control *ctl __unused, void **thread_priv)
+{
+	*thread_priv = NULL;
+	return 0;
+}
+
+static int dnet_meta_index_load_free(struct eblob_iterate_control *ctl __unused, void **thread_priv __unused)
+{
+	return 0;
+}
+
+/* drops keys removed while loading pass ran */
+static void dnet_meta_index_sweep(struct dnet_meta_index *idx)
+{
+	struct dnet_meta_index_shard *s;
+	uint32_t i;
+	int k;
+
+	for (k = 0; k < DNET_META_INDEX_SHARDS; ++k) {
+		s = &idx->shards[k];
+
+		pthread_mutex_lock(&s->lock);
+		for (i = 0; i < s->size; ) {
+			if (s->entries[i].state & DNET_META_INDEX_ABSENT) {
+				/* erase shifts next entry into this slot */
+				dnet_meta_index_erase_nolock(s, &s->entries[i]);
+				continue;
+			}
+			++i;
+		}
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+static void *dnet_meta_index_load(void *priv)
+{
+	struct dnet_node *n = priv;
+	struct dnet_meta_index *idx = n->meta_index;
+	struct dnet_iterate_ctl dctl;
+	struct timeval start, end;
+	long diff;
+	int err;
+
+	dnet_set_name("meta_index");
+	dnet_ioprio_set(dnet_get_id(), n->bg_ionice_class, n->bg_ionice_prio);
+
+	gettimeofday(&start, NULL);
+
+	memset(&dctl, 0, sizeof(struct dnet_iterate_ctl));
+
+	dctl.iterate_private = n->cb->command_private;
+	dctl.callback_private = n;
+
+	dctl.iterate_cb.iterator = dnet_meta_index_load_iter;
+	dctl.iterate_cb.iterator_init = dnet_meta_index_load_init;
+	dctl.iterate_cb.iterator_free = dnet_meta_index_load_free;
+	dctl.iterate_cb.thread_num = DNET_META_INDEX_LOAD_THREADS;
+
+	err = n->cb->meta_iterate(&dctl);
+
+	gettimeofday(&end, NULL);
+	diff = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+
+	if (!err) {
+		dnet_meta_index_sweep(idx);
+		atomic_set(&idx->ready, 1);
+	}
+
+	dnet_log(n, (err ? DNET_LOG_ERROR : DNET_LOG_INFO), "meta-index: loading completed: keys: %d, time: %ld msecs, err: %d\n",
+			atomic_read(&idx->loaded), diff, err);
+	return NULL;
+}
+
+int dnet_meta_index_init(struct dnet_node *n)
+{
+	struct dnet_meta_index *idx;
+	int err, i;
+
+	if (!(n->flags & DNET_CFG_META_INDEX) || (n->flags & DNET_CFG_NO_META))
+		return 0;
+
+	if (!n->cb || !n->cb->meta_iterate) {
+		dnet_log(n, DNET_LOG_ERROR, "meta-index: backend does not support metadata iteration, index is disabled\n");
+		return 0;
+	}
+
+	idx = malloc(sizeof(struct dnet_meta_index));
+	if (!idx) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+
+	memset(idx, 0, sizeof(struct dnet_meta_index));
+
+	atomic_init(&idx->ready, 0);
+	atomic_init(&idx->need_exit, 0);
+	atomic_init(&idx->loaded, 0);
+
+	for (i = 0; i < DNET_META_INDEX_SHARDS; ++i) {
+		err = pthread_mutex_init(&idx->shards[i].lock, NULL);
+		if (err) {
+			err = -err;
+			goto err_out_destroy;
+		}
+	}
+
+	n->meta_index = idx;
+
+	err = pthread_create(&idx->loader, NULL, dnet_meta_index_load, n);
+	if (err) {
+		err = -err;
+		n->meta_index = NULL;
+		goto err_out_destroy;
+	}
+
+	return 0;
+
+err_out_destroy:
+	while (--i >= 0)
+		pthread_mutex_destroy(&idx->shards[i].lock);
+	free(idx);
+err_out_exit:
+	dnet_log(n, DNET_LOG_ERROR, "meta-index: failed to initialize: %d\n", err);
+	return err;
+}
+
+void dnet_meta_index_exit(struct dnet_node *n)
+{
+	struct dnet_meta_index *idx = n->meta_index;
+	int i;
+
+	if (!idx)
+		return;
+
+	atomic_set(&idx->need_exit, 1);
+	pthread_join(idx->loader, NULL);
+
+	n->meta_index = NULL;
+
+	for (i = 0; i < DNET_META_INDEX_SHARDS; ++i) {
+		pthread_mutex_destroy(&idx->shards[i].lock);
+		free(idx->shards[i].entries);
+	}
+
+	free(idx);
+}
+
+int dnet_meta_index_ready(struct dnet_node *n)
+{
+	return n->meta_index && atomic_read(&n->meta_index->ready);
+}
+
+/*
+ * Returns 0 and fills @e if key is present, -ENOENT if there is no metadata for it,
+ * -EAGAIN if index is not available and metadata has to be read from disk.
+ */
+int dnet_meta_index_lookup(struct dnet_node *n, const unsigned char *id, struct dnet_meta_index_entry *e)
+{
+	struct dnet_meta_index *idx = n->meta_index;
+	struct dnet_meta_index_shard *s;
+	struct dnet_meta_index_entry *slot;
+	int err = -ENOENT;
+
+	if (!idx || !atomic_read(&idx->ready))
+		return -EAGAIN;
+
+	s = dnet_meta_index_shard(idx, id);
+
+	pthread_mutex_lock(&s->lock);
+	if (s->size) {
+		slot = dnet_meta_index_find_nolock(s, id);
+		if (slot->state & DNET_META_INDEX_USED) {
+			*e = *slot;
+			err = 0;
+		}
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return err;
+}
+
+/* copies all entries of shard @shard, they are valid only if index is ready */
+int dnet_meta_index_shard_copy(struct dnet_node *n, int shard, struct dnet_meta_index_entry **entriesp, int *nump)
+{
+	struct dnet_meta_index *idx = n->meta_index;
+	struct dnet_meta_index_shard *s;
+	struct dnet_meta_index_entry *entries;
+	uint32_t i;
+	int num = 0;
+
+	if (!idx || !atomic_read(&idx->ready))
+		return -EAGAIN;
+
+	s = &idx->shards[shard];
+
+	pthread_mutex_lock(&s->lock);
+	entries = malloc((s->num + 1) * sizeof(struct dnet_meta_index_entry));
+	if (!entries) {
+		pthread_mutex_unlock(&s->lock);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < s->size; ++i) {
+		if (s->entries[i].state & DNET_META_INDEX_USED)
+			entries[num++] = s->entries[i];
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	*entriesp = entries;
+	*nump = num;
+	return 0;
+}
+
+static void dnet_meta_index_update(struct dnet_node *n, struct dnet_raw_id *id, void *data, size_t size)
+{
+	struct dnet_meta_index *idx = n->meta_index;
+	struct dnet_meta_index_entry e;
+	int err;
+
+	if (!idx)
+		return;
+
+	dnet_meta_index_parse(n, id, data, size, &e);
+
+	err = dnet_meta_index_store(idx, &e, 1);
+	if (err) {
+		/* index can not be trusted anymore */
+		atomic_set(&idx->ready, 0);
+		dnet_log(n, DNET_LOG_ERROR, "%s: meta-index: failed to update key, index is disabled: %d\n",
+				dnet_dump_id_str(id->id), err);
+	}
+}
+
+static void dnet_meta_index_remove(struct dnet_node *n, struct dnet_raw_id *id)
+{
+	struct dnet_meta_index *idx = n->meta_index;
+	struct dnet_meta_index_shard *s;
+	struct dnet_meta_index_entry *slot, e;
+
+	if (!idx)
+		return;
+
+	if (!atomic_read(&idx->ready)) {
+		memset(&e, 0, sizeof(struct dnet_meta_index_entry));
+		e.id = *id;
+		e.state = DNET_META_INDEX_USED | DNET_META_INDEX_ABSENT;
+
+		if (dnet_meta_index_store(idx, &e, 1))
+			atomic_set(&idx->ready, 0);
+		return;
+	}
+
+	s = dnet_meta_index_shard(idx, id->id);
+
+	pthread_mutex_lock(&s->lock);
+	if (s->size) {
+		slot = dnet_meta_index_find_nolock(s, id->id);
+		if (slot->state & DNET_META_INDEX_USED)
+			dnet_meta_index_erase_nolock(s, slot);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* writes metadata of @id to the backend and accounts it in the index */
+int dnet_meta_write_local(struct dnet_node *n, struct dnet_raw_id *id, void *data, size_t size)
+{
+	int err;
+
+	err = n->cb->meta_write(n->cb->command_private, id, data, size);
+	if (!err)
+		dnet_meta_index_update(n, id, data, size);
+
+	return err;
+}
+
+/* rereads metadata of @id from the backend into the index */
+void dnet_meta_index_sync(struct dnet_node *n, struct dnet_raw_id *id)
+{
+	void *data = NULL;
+	ssize_t size;
+
+	if (!n->meta_index)
+		return;
+
+	size = n->cb->meta_read(n->cb->command_private, id, &data);
+	if (size > 0 && data)
+		dnet_meta_index_update(n, id, data, size);
+	else
+		dnet_meta_index_remove(n, id);
+
+	free(data);
+}
+
+/*
+ * Removes metadata of @id, when @real_remove is not set backend only marks it removed,
+ * so changed metadata is read back into the index.
+ */
+int dnet_meta_remove_local(struct dnet_node *n, struct dnet_raw_id *id, int real_remove)
+{
+	int err;
+
+	err = n->cb->meta_remove(n->cb->command_private, id, real_remove);
+
+	if (real_remove)
+		dnet_meta_index_remove(n, id);
+	else
+		dnet_meta_index_sync(n, id);
+
+	return err;
+}
@@ -304,6 +304,7 @@ static int dnet_io_req_queue(struct dnet_net_state *st, struct dnet_io_req *orig
 
 	pthread_mutex_lock(&st->send_lock);
 	list_add_tail(&r->req_entry, &st->send_list);
+	st->send_queue_size += r->hsize + r->dsize + r->fsize;
 
 	if (!st->need_exit)
 		dnet_schedule_send(st);
@@ -636,6 +637,9 @@ static int dnet_trans_forward(struct dnet_trans *t, struct dnet_io_req *r,
 	t->rcv_trans = cmd->trans;
 	cmd->trans = t->cmd.trans = t->trans = atomic_inc(&orig->n->trans);
 
+	/* credits are granted per connection, forwarded replies are not flow controlled */
+	cmd->flags &= ~DNET_FLAGS_FLOW_CONTROL;
+
 	dnet_convert_cmd(cmd);
 
 	t->command = cmd->cmd;
@@ -693,6 +697,8 @@ int dnet_process_recv(struct dnet_net_state *st, struct dnet_io_req *r)
 		if (t->complete)
 			t->complete(t->st, cmd, t->priv);
 
+		dnet_flow_consumed(st, t, cmd);
+
 		dnet_trans_put(t);
 		if (!(cmd->flags & DNET_FLAGS_MORE)) {
 			memcpy(&t->cmd, cmd, sizeof(struct dnet_cmd));
@@ -739,11 +745,35 @@ err_out_exit:
 	return err;
 }
 
+/*
+ * Removed state could be received in route list of any other node,
+ * so delta requests would not return it back, next route list requests have to fetch full tables.
+ */
+static void dnet_route_versions_reset_nolock(struct dnet_node *n)
+{
+	struct dnet_net_state *st;
+
+	list_for_each_entry(st, &n->storage_state_list, storage_state_entry) {
+		st->route_generation = 0;
+		st->route_version = 0;
+	}
+
+	n->route_resets++;
+}
+
 void dnet_state_remove_nolock(struct dnet_net_state *st)
 {
+	int joined = !!st->idc;
+
 	list_del_init(&st->state_entry);
 	list_del_init(&st->storage_state_entry);
 	dnet_idc_destroy_nolock(st);
+
+	st->route_generation = 0;
+	st->route_version = 0;
+
+	if (joined)
+		dnet_route_versions_reset_nolock(st->n);
 }
 
 static void dnet_state_remove(struct dnet_net_state *st)
@@ -944,6 +974,12 @@ struct dnet_net_state *dnet_state_create(struct dnet_node *n,
 		goto err_out_trans_destroy;
 	}
 
+	err = dnet_flow_state_init(st);
+	if (err) {
+		dnet_log(n, DNET_LOG_ERROR, "Failed to initialize flow control: %d\n", err);
+		goto err_out_send_lock_destroy;
+	}
+
 	atomic_init(&st->refcnt, 1);
 
 	memcpy(&st->addr, addr, sizeof(struct dnet_addr));
@@ -1019,6 +1055,8 @@ err_out_unlock:
 	pthread_mutex_unlock(&n->state_lock);
 err_out_send_destroy:
 	dnet_state_put(st);
+	dnet_flow_state_cleanup(st);
+err_out_send_lock_destroy:
 	pthread_mutex_destroy(&st->send_lock);
 err_out_trans_destroy:
 	pthread_mutex_destroy(&st->trans_lock);
@@ -1076,6 +1114,7 @@ void dnet_state_destroy(struct dnet_net_state *st)
 
 	dnet_state_send_clean(st);
 
+	dnet_flow_state_cleanup(st);
 	pthread_mutex_destroy(&st->send_lock);
 	pthread_mutex_destroy(&st->trans_lock);
 
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <signal.h>
 
 #include "elliptics.h"
@@ -66,11 +67,18 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 		goto err_out_destroy_counter;
 	}
 
+	err = pthread_mutex_init(&n->merge_lock, NULL);
+	if (err) {
+		err = -err;
+		dnet_log_err(n, "Failed to initialize merge lock: err: %d", err);
+		goto err_out_destroy_reconnect_lock;
+	}
+
 	err = pthread_attr_init(&n->attr);
 	if (err) {
 		err = -err;
 		dnet_log_err(n, "Failed to initialize pthread attributes: err: %d", err);
-		goto err_out_destroy_reconnect_lock;
+		goto err_out_destroy_merge_lock;
 	}
 	pthread_attr_setdetachstate(&n->attr, PTHREAD_CREATE_DETACHED);
 
@@ -85,8 +93,13 @@ static struct dnet_node *dnet_node_alloc(struct dnet_config *cfg)
 
 	memcpy(n->cookie, cfg->cookie, DNET_AUTH_COOKIE_SIZE);
 
+	/* route table versions are only comparable within single node's lifetime */
+	n->route_generation = ((uint64_t)rand() << 32) ^ ((uint64_t)getpid() << 16) ^ rand() ^ time(NULL);
+
 	return n;
 
+err_out_destroy_merge_lock:
+	pthread_mutex_destroy(&n->merge_lock);
 err_out_destroy_reconnect_lock:
 	pthread_mutex_destroy(&n->reconnect_lock);
 err_out_destroy_counter:
@@ -154,6 +167,267 @@ static int dnet_idc_compare(const void *k1, const void *k2)
 	return dnet_id_cmp_str(id1->raw.id, id2->raw.id);
 }
 
+static inline uint64_t dnet_id_prefix(const unsigned char *id)
+{
+	uint64_t p = 0;
+	int i;
+
+	for (i = 0; i < (int)sizeof(uint64_t); ++i)
+		p = (p << 8) | id[i];
+
+	return p;
+}
+
+#ifdef HAVE_SYNC_ATOMIC_SUPPORT
+static int dnet_route_group_compare(const void *k1, const void *k2)
+{
+	const struct dnet_route_group *g1 = k1;
+	const struct dnet_route_group *g2 = k2;
+
+	if (g1->group_id < g2->group_id)
+		return -1;
+	if (g1->group_id > g2->group_id)
+		return 1;
+	return 0;
+}
+
+/*
+ * Snapshot is a single allocation: header, groups sorted by group id,
+ * then prefix arrays and route entries of all groups.
+ * Big-endian prefix packing keeps integer order equal to dnet_id_cmp_str() order of the ids.
+ */
+static struct dnet_route_table *dnet_route_table_build(struct dnet_node *n)
+{
+	struct dnet_route_table *t;
+	struct dnet_route_group *rg;
+	struct dnet_route_entry *ids;
+	struct dnet_group *g;
+	uint64_t *prefix;
+	int group_num = 0, id_num = 0, i;
+
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (g->id_num) {
+			group_num++;
+			id_num += g->id_num;
+		}
+	}
+
+	t = malloc(sizeof(struct dnet_route_table) + group_num * sizeof(struct dnet_route_group) +
+			id_num * (sizeof(uint64_t) + sizeof(struct dnet_route_entry)));
+	if (!t)
+		return NULL;
+
+	t->group_num = group_num;
+
+	prefix = (uint64_t *)&t->groups[group_num];
+	ids = (struct dnet_route_entry *)&prefix[id_num];
+	rg = t->groups;
+
+	list_for_each_entry(g, &n->group_list, group_entry) {
+		if (!g->id_num)
+			continue;
+
+		rg->group_id = g->group_id;
+		rg->id_num = g->id_num;
+		rg->prefix = prefix;
+		rg->ids = ids;
+
+		for (i = 0; i < g->id_num; ++i) {
+			memcpy(&ids[i].id, &g->ids[i].raw, sizeof(struct dnet_raw_id));
+			ids[i].st = g->ids[i].idc->st;
+			prefix[i] = dnet_id_prefix(g->ids[i].raw.id);
+		}
+
+		prefix += g->id_num;
+		ids += g->id_num;
+		rg++;
+	}
+
+	qsort(t->groups, t->group_num, sizeof(struct dnet_route_group), dnet_route_group_compare);
+	return t;
+}
+
+static inline int dnet_route_reader_slot(void)
+{
+	unsigned long self = (unsigned long)pthread_self();
+
+	return (self ^ (self >> 12) ^ (self >> 24)) % DNET_ROUTE_READER_SLOTS;
+}
+
+/*
+ * Readers announce themselves in the counter of the current epoch.
+ * __sync operations are full barriers, so snapshot pointer is loaded
+ * only after counter increment is visible to the writer.
+ */
+static inline int dnet_route_read_lock(struct dnet_node *n)
+{
+	int slot = dnet_route_reader_slot();
+	int idx = n->route_epoch & 1;
+
+	__sync_add_and_fetch(&n->route_readers[slot].count[idx], 1);
+	return (slot << 1) | idx;
+}
+
+static inline void dnet_route_read_unlock(struct dnet_node *n, int token)
+{
+	__sync_sub_and_fetch(&n->route_readers[token >> 1].count[token & 1], 1);
+}
+
+static void dnet_route_wait_readers(struct dnet_node *n, int idx)
+{
+	int i, num;
+
+	while (1) {
+		for (i = 0, num = 0; i < DNET_ROUTE_READER_SLOTS; ++i)
+			num += n->route_readers[i].count[idx];
+
+		if (!num)
+			break;
+
+		sched_yield();
+	}
+}
+
+/*
+ * Wait until every reader, which could see previous snapshot, has finished.
+ * Readers which entered with stale epoch index are drained first, then epoch is flipped
+ * and readers of the old one are drained. Readers never block inside critical section,
+ * so this only waits for in-flight lookups. Must be called with n->state_lock held.
+ */
+static void dnet_route_synchronize(struct dnet_node *n)
+{
+	int idx = n->route_epoch & 1;
+
+	dnet_route_wait_readers(n, idx ^ 1);
+	__sync_add_and_fetch(&n->route_epoch, 1);
+	dnet_route_wait_readers(n, idx);
+}
+#endif
+
+/*
+ * Publish new route snapshot after group ids were changed, must be called with n->state_lock held.
+ * If snapshot can not be allocated NULL is published and lookups fall back to locked search.
+ */
+void dnet_route_update_nolock(struct dnet_node *n)
+{
+	n->route_version++;
+
+#ifdef HAVE_SYNC_ATOMIC_SUPPORT
+	struct dnet_route_table *t, *old = n->route;
+
+	t = dnet_route_table_build(n);
+	if (t)
+		t->version = n->route_version;
+	else
+		dnet_log(n, DNET_LOG_ERROR, "Failed to allocate route table snapshot, falling back to locked lookup.\n");
+
+	__sync_synchronize();
+	n->route = t;
+
+	/*
+	 * Store of the new snapshot must be visible before reader counters are loaded,
+	 * otherwise store-load reordering lets us miss reader which still uses @old
+	 */
+	__sync_synchronize();
+
+	if (old) {
+		dnet_route_synchronize(n);
+		free(old);
+	}
+#endif
+}
+
+/*
+ * Returns position of the largest id which is less or equal to @id,
+ * or the last one if @id is less than all ids in the group (ring wraps).
+ */
+static int dnet_route_group_search(const struct dnet_route_group *g, const unsigned char *id)
+{
+	const uint64_t *base = g->prefix;
+	uint64_t key = dnet_id_prefix(id);
+	int len = g->id_num, half, i;
+
+	/*
+	 * Branchless upper bound over prefixes: loop has fixed number of iterations
+	 * for given id_num and compiles into conditional moves, so there are
+	 * no mispredicted branches and every probe reads single 8-byte word
+	 */
+	while (len > 1) {
+		half = len / 2;
+		base = (base[half] <= key) ? base + half : base;
+		len -= half;
+	}
+
+	i = (base - g->prefix) + (*base <= key) - 1;
+
+	/* ids sharing the same prefix are resolved by full comparison */
+	while (i >= 0 && g->prefix[i] == key && dnet_id_cmp_str(g->ids[i].id.id, id) > 0)
+		i--;
+
+	if (i == -1)
+		i = g->id_num - 1;
+
+	return i;
+}
+
+/*
+ * Lock-free lookup in the current route snapshot.
+ * Grabs reference of the found state into @stp and/or fills @start and @next ids of the range.
+ * Returns -EAGAIN if there is no snapshot and caller has to search under n->state_lock.
+ */
+static int dnet_route_search(struct dnet_node *n, struct dnet_id *id, struct dnet_net_state **stp,
+		struct dnet_raw_id *start, struct dnet_raw_id *next)
+{
+#ifdef HAVE_SYNC_ATOMIC_SUPPORT
+	struct dnet_route_table *t;
+	struct dnet_route_group *g, key;
+	struct dnet_net_state *st;
+	int token, pos, err = 0;
+
+	token = dnet_route_read_lock(n);
+
+	t = n->route;
+	if (!t) {
+		err = -EAGAIN;
+		goto err_out_unlock;
+	}
+
+	key.group_id = id->group_id;
+	g = bsearch(&key, t->groups, t->group_num, sizeof(struct dnet_route_group), dnet_route_group_compare);
+	if (!g) {
+		err = -ENXIO;
+		goto err_out_unlock;
+	}
+
+	pos = dnet_route_group_search(g, id->id);
+
+	if (start) {
+		memcpy(start, &g->ids[pos].id, sizeof(struct dnet_raw_id));
+		memcpy(next, &g->ids[(pos + 1) % g->id_num].id, sizeof(struct dnet_raw_id));
+	}
+
+	if (stp) {
+		/* state can be in the middle of destruction, its memory is alive until we leave */
+		st = g->ids[pos].st;
+		if (!atomic_inc_not_zero(&st->refcnt))
+			st = NULL;
+
+		*stp = st;
+	}
+
+err_out_unlock:
+	dnet_route_read_unlock(n, token);
+	return err;
+#else
+	(void) n;
+	(void) id;
+	(void) stp;
+	(void) start;
+	(void) next;
+	return -EAGAIN;
+#endif
+}
+
 static void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
 {
 	int i, pos;
@@ -169,6 +443,8 @@ static void dnet_idc_remove_ids(struct dnet_net_state *st, struct dnet_group *g)
 
 	qsort(g->ids,  g->id_num, sizeof(struct dnet_state_id), dnet_idc_compare);
 	st->idc = NULL;
+
+	dnet_route_update_nolock(st->n);
 }
 
 int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id *ids, int id_num)
@@ -236,6 +512,9 @@ int dnet_idc_create(struct dnet_net_state *st, int group_id, struct dnet_raw_id
 
 	st->idc = idc;
 
+	dnet_route_update_nolock(n);
+	st->route_join_version = n->route_version;
+
 	if (n->log->log_level >= DNET_LOG_DEBUG) {
 		for (i=0; i<g->id_num; ++i) {
 			struct dnet_state_id *id = &g->ids[i];
@@ -366,6 +645,10 @@ int dnet_search_range(struct dnet_node *n, struct dnet_id *id, struct dnet_raw_i
 {
 	int err;
 
+	err = dnet_route_search(n, id, NULL, start, next);
+	if (err != -EAGAIN)
+		return err;
+
 	pthread_mutex_lock(&n->state_lock);
 	err = dnet_search_range_nolock(n, id, start, next);
 	pthread_mutex_unlock(&n->state_lock);
@@ -422,7 +705,7 @@ struct dnet_net_state *dnet_state_search_by_addr(struct dnet_node *n, struct dne
 	return found;
 }
 
-struct dnet_net_state *dnet_state_search_nolock(struct dnet_node *n, struct dnet_id *id)
+static struct dnet_net_state *dnet_state_search_locked(struct dnet_node *n, struct dnet_id *id)
 {
 	struct dnet_net_state *found;
 
@@ -442,19 +725,43 @@ err_out_exit:
 	return found;
 }
 
+/*
+ * Searches route snapshot, n->state_lock must be held by the caller
+ * only for the case when there is no snapshot.
+ */
+struct dnet_net_state *dnet_state_search_nolock(struct dnet_node *n, struct dnet_id *id)
+{
+	struct dnet_net_state *found = NULL;
+
+	if (dnet_route_search(n, id, &found, NULL, NULL) == -EAGAIN)
+		found = dnet_state_search_locked(n, id);
+
+	return found;
+}
+
+static struct dnet_net_state *dnet_state_search(struct dnet_node *n, struct dnet_id *id)
+{
+	struct dnet_net_state *found = NULL;
+
+	if (dnet_route_search(n, id, &found, NULL, NULL) == -EAGAIN) {
+		pthread_mutex_lock(&n->state_lock);
+		found = dnet_state_search_locked(n, id);
+		pthread_mutex_unlock(&n->state_lock);
+	}
+
+	return found;
+}
+
 struct dnet_net_state *dnet_state_get_first(struct dnet_node *n, struct dnet_id *id)
 {
 	struct dnet_net_state *found;
 
-	pthread_mutex_lock(&n->state_lock);
-	found = dnet_state_search_nolock(n, id);
+	found = dnet_state_search(n, id);
 	if (found == n->st) {
 		dnet_state_put(found);
 		found = NULL;
 	}
 
-	pthread_mutex_unlock(&n->state_lock);
-
 	return found;
 }
 void dnet_state_put(struct dnet_net_state *st)
@@ -472,13 +779,7 @@ void dnet_state_put(struct dnet_net_state *st)
  */
 struct dnet_net_state *dnet_node_state(struct dnet_node *n)
 {
-	struct dnet_net_state *found;
-
-	pthread_mutex_lock(&n->state_lock);
-	found = dnet_state_search_nolock(n, &n->id);
-	pthread_mutex_unlock(&n->state_lock);
-
-	return found;
+	return dnet_state_search(n, &n->id);
 }
 
 struct dnet_node *dnet_node_create(struct dnet_config *cfg)
@@ -555,6 +856,9 @@ struct dnet_node *dnet_node_create(struct dnet_config *cfg)
 	n->removal_delay = cfg->removal_delay;
 	n->flags = cfg->flags;
 	n->cache_size = cfg->cache_size;
+	n->checksum_type = cfg->checksum_type;
+	n->merge_bandwidth = cfg->merge_bandwidth;
+	n->merge_iops = cfg->merge_iops;
 
 	if (strlen(cfg->temp_meta_env))
 		n->temp_meta_env = cfg->temp_meta_env;
@@ -587,10 +891,14 @@ struct dnet_node *dnet_node_create(struct dnet_config *cfg)
 	n->client_prio = cfg->client_prio;
 	n->server_prio = cfg->server_prio;
 
-	err = dnet_crypto_init(n);
+	err = dnet_log_async_init(n);
 	if (err)
 		goto err_out_free;
 
+	err = dnet_crypto_init(n);
+	if (err)
+		goto err_out_log_exit;
+
 	err = dnet_io_init(n, cfg);
 	if (err)
 		goto err_out_crypto_cleanup;
@@ -607,6 +915,8 @@ err_out_io_exit:
 	dnet_io_exit(n);
 err_out_crypto_cleanup:
 	dnet_crypto_cleanup(n);
+err_out_log_exit:
+	dnet_log_async_exit(n);
 err_out_free:
 	free(n);
 err_out_exit:
@@ -630,18 +940,26 @@ void dnet_set_need_exit(struct dnet_node *n)
 	n->need_exit = 1;
 }
 
-void dnet_node_cleanup_common_resources(struct dnet_node *n)
+/*
+ * Stops check and IO threads, after this no requests are processed
+ * and subsystems used by them can be released.
+ */
+void dnet_node_stop_common_resources(struct dnet_node *n)
 {
-	struct dnet_addr_storage *it, *atmp;
-
 	n->need_exit = 1;
 	dnet_check_thread_stop(n);
 
 	dnet_io_exit(n);
+}
+
+void dnet_node_free_common_resources(struct dnet_node *n)
+{
+	struct dnet_addr_storage *it, *atmp;
 
 	pthread_attr_destroy(&n->attr);
 
 	pthread_mutex_destroy(&n->state_lock);
+	free(n->route);
 	dnet_crypto_cleanup(n);
 
 	list_for_each_entry_safe(it, atmp, &n->reconnect_list, reconnect_entry) {
@@ -650,17 +968,25 @@ void dnet_node_cleanup_common_resources(struct dnet_node *n)
 	}
 	dnet_counter_destroy(n);
 	pthread_mutex_destroy(&n->reconnect_lock);
+	pthread_mutex_destroy(&n->merge_lock);
 
 	dnet_wait_put(n->wait);
 
 	close(n->autodiscovery_socket);
 }
 
+void dnet_node_cleanup_common_resources(struct dnet_node *n)
+{
+	dnet_node_stop_common_resources(n);
+	dnet_node_free_common_resources(n);
+}
+
 void dnet_node_destroy(struct dnet_node *n)
 {
 	dnet_log(n, DNET_LOG_DEBUG, "Destroying node.\n");
 
 	dnet_node_cleanup_common_resources(n);
+	dnet_log_async_exit(n);
 
 	free(n);
 }
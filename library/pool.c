@@ -351,6 +351,13 @@ again:
 
 	dnet_schedule_command(st);
 
+	if (r->header && ((struct dnet_cmd *)r->header)->cmd == DNET_CMD_CREDIT &&
+			!(((struct dnet_cmd *)r->header)->trans & DNET_TRANS_REPLY)) {
+		dnet_flow_credit(st, r->header, r->data);
+		dnet_io_req_free(r);
+		return 0;
+	}
+
 	r->st = dnet_state_get(st);
 
 	dnet_schedule_io(n, r);
@@ -487,6 +494,7 @@ static int dnet_process_send_single(struct dnet_net_state *st)
 		if (st->send_offset == (r->dsize + r->hsize + r->fsize)) {
 			pthread_mutex_lock(&st->send_lock);
 			list_del(&r->req_entry);
+			st->send_queue_size -= r->hsize + r->dsize + r->fsize;
 			pthread_mutex_unlock(&st->send_lock);
 
 			dnet_io_req_free(r);
@@ -229,10 +229,22 @@ struct dnet_node *dnet_server_node_create(struct dnet_config *cfg, struct dnet_a
 	if (err)
 		goto err_out_notify_exit;
 
-	err = dnet_local_addr_add(n, addrs, addr_num);
+	err = dnet_iterator_init(n);
 	if (err)
 		goto err_out_cache_cleanup;
 
+	err = dnet_merkle_init(n);
+	if (err)
+		goto err_out_iterator_exit;
+
+	err = dnet_meta_index_init(n);
+	if (err)
+		goto err_out_merkle_exit;
+
+	err = dnet_local_addr_add(n, addrs, addr_num);
+	if (err)
+		goto err_out_meta_index_exit;
+
 	if (cfg->flags & DNET_CFG_JOIN_NETWORK) {
 		struct dnet_addr la;
 		int s;
@@ -291,6 +303,12 @@ err_out_locks_destroy:
 	dnet_locks_destroy(n);
 err_out_addr_cleanup:
 	dnet_local_addr_cleanup(n);
+err_out_meta_index_exit:
+	dnet_meta_index_exit(n);
+err_out_merkle_exit:
+	dnet_merkle_exit(n);
+err_out_iterator_exit:
+	dnet_iterator_exit(n);
 err_out_cache_cleanup:
 	dnet_cache_cleanup(n);
 err_out_notify_exit:
@@ -308,7 +326,19 @@ void dnet_server_node_destroy(struct dnet_node *n)
 
 	dnet_srw_cleanup(n);
 
-	dnet_node_cleanup_common_resources(n);
+	/*
+	 * Detached iterator threads use states and IO pool, they are cancelled and waited for
+	 * while everything is still alive. Merkle tree and metadata index are used by IO threads,
+	 * so they are released once those are stopped, but before node resources are freed.
+	 */
+	dnet_iterator_stop(n);
+	dnet_node_stop_common_resources(n);
+
+	dnet_iterator_exit(n);
+	dnet_meta_index_exit(n);
+	dnet_merkle_exit(n);
+
+	dnet_node_free_common_resources(n);
 
 	if (n->cb && n->cb->backend_cleanup)
 		n->cb->backend_cleanup(n->cb->command_private);
@@ -316,6 +346,7 @@ void dnet_server_node_destroy(struct dnet_node *n)
 	dnet_locks_destroy(n);
 	dnet_notify_exit(n);
 	dnet_local_addr_cleanup(n);
+	dnet_log_async_exit(n);
 
 	free(n);
 }
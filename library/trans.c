@@ -173,7 +173,7 @@ void dnet_trans_destroy(struct dnet_trans *t)
 		st->median_read_time = (st->median_read_time + diff) / 2;
 	}
 
-	if (st && st->n && t->command != 0) {
+	if (st && st->n && t->command != 0 && st->n->log && (st->n->log->log_level >= DNET_LOG_INFO)) {
 		char str[64];
 		struct tm tm;
 
@@ -131,7 +131,12 @@ class srw_log {
 
 			memcpy(msg_data, msg.data(), msg.size());
 
-			m_s->node->cb->command_handler(m_s->node->st, m_s->node->cb->command_private, cmd, (void *)(cmd + 1));
+			struct dnet_io_attr csum_io = *io;
+			int err = m_s->node->cb->command_handler(m_s->node->st, m_s->node->cb->command_private, cmd, (void *)(cmd + 1));
+
+			/* direct backend write bypasses dnet_process_cmd_raw(), so keep stored checksum in sync here */
+			if (!err && (m_s->node->flags & DNET_CFG_WRITE_CSUM))
+				dnet_meta_update_checksum(m_s->node, &csum_io, msg_data);
 		}
 };
 